@@ -1,18 +1,25 @@
 #ifndef LOAD_BALANCER_BACKEND_SERVER_H
 #define LOAD_BALANCER_BACKEND_SERVER_H
 
+#include "core/feature_store.h"
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
 #include <string>
-#include <mutex>
 
 namespace load_balancer {
 namespace core {
 
 // Represents a single backend server that can handle requests.
 // Manages the state and properties of a backend server, including its health,
-// active connections, and last check time.
+// active connections, and last check time. The mutable state lives in the
+// server's slots of the FeatureStore, not in this object, so updates never
+// share a cache line with the server's address.
 class BackendServer {
  public:
   BackendServer(std::string ip, int port, int weight = 1);
+  ~BackendServer();
 
   // This class is not copyable or movable.
   BackendServer(const BackendServer& other) = delete;
@@ -23,33 +30,81 @@ class BackendServer {
   // Accessor methods for server properties.
   std::string Ip() const { return ip_; }
   int Port() const { return port_; }
-  int Weight() const { return weight_; }
-  bool IsHealthy() const { return healthy_; }
-  int ActiveConnections() const { return active_connections_; }
+  int Weight() const {
+    return features_->weight.load(std::memory_order_relaxed);
+  }
+  // Identifies the server as "ip:port".
+  std::string Address() const { return ip_ + ":" + std::to_string(port_); }
+  bool IsHealthy() const {
+    return features_->healthy.load(std::memory_order_relaxed);
+  }
+  int ActiveConnections() const {
+    return features_->in_flight.load(std::memory_order_relaxed);
+  }
+  // Moving averages of the latency, failure rate and successes per second of
+  // recent outcomes.
+  double LatencyMs() const {
+    return features_->latency_ms.load(std::memory_order_relaxed);
+  }
+  double ErrorRate() const {
+    return features_->error_rate.load(std::memory_order_relaxed);
+  }
+  double Throughput() const {
+    return features_->throughput.load(std::memory_order_relaxed);
+  }
   std::chrono::steady_clock::time_point LastChecked() const;
 
+  // The server's dense ID in the FeatureStore and its slots there.
+  uint32_t Id() const { return id_; }
+  const BackendFeatures& Features() const { return *features_; }
+  BackendHealth& Health() { return *health_; }
+
   // Mutator methods for server state.
-  void SetHealthy(bool healthy) { healthy_ = healthy; }
-  void IncrementConnections() { active_connections_++; }
+  void SetHealthy(bool healthy) {
+    features_->healthy.store(healthy, std::memory_order_relaxed);
+  }
+  // Changes the weight; use Router::SetBackendWeight for managed servers so
+  // routing state derived from it is rebuilt.
+  void SetWeight(int weight) {
+    features_->weight.store(weight, std::memory_order_relaxed);
+  }
+  void IncrementConnections() {
+    features_->in_flight.fetch_add(1, std::memory_order_relaxed);
+  }
   void DecrementConnections();
+  // Folds the outcome of one attempt into the moving averages; failures do
+  // not contribute their latency.
+  void RecordOutcome(std::chrono::microseconds latency, bool success);
   void UpdateLastChecked();
 
  private:
+  // The server's ID in the FeatureStore and its slots there.
+  uint32_t id_;
+  BackendFeatures* features_;
+  BackendHealth* health_;
   // The IP address of the backend server.
   std::string ip_;
   // The port number of the backend server.
   int port_;
-  // The weight for load balancing.
-  int weight_;
-
-  // True if the server is considered healthy.
-  std::atomic<bool> healthy_;
-  // Number of active connections to this server.
-  std::atomic<int> active_connections_;
-  // Timestamp of the last health check.
-  std::chrono::steady_clock::time_point last_checked_;
-  // Mutex to protect access to 'last_checked_' field.
-  mutable std::mutex time_mutex_;
+};
+
+// Counts one connection forwarded to a backend server as active for as long
+// as it lives.
+class ActiveConnection {
+ public:
+  ActiveConnection() = default;
+  explicit ActiveConnection(std::shared_ptr<BackendServer> backend);
+  ~ActiveConnection();
+
+  // This class is movable but not copyable.
+  ActiveConnection(const ActiveConnection& other) = delete;
+  ActiveConnection& operator=(const ActiveConnection& other) = delete;
+  ActiveConnection(ActiveConnection&& other) noexcept = default;
+  ActiveConnection& operator=(ActiveConnection&& other) noexcept;
+
+ private:
+  // The backend counted, or nullptr.
+  std::shared_ptr<BackendServer> backend_;
 };
 
 }  // namespace core
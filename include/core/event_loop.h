@@ -0,0 +1,109 @@
+#ifndef LOAD_BALANCER_EVENT_LOOP_H
+#define LOAD_BALANCER_EVENT_LOOP_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace load_balancer {
+namespace core {
+
+// Receives readiness notifications for descriptors registered with an
+// EventLoop.
+class EventHandler {
+ public:
+  virtual ~EventHandler() = default;
+
+  // Invoked on the loop thread with the epoll events that are ready on 'fd'.
+  virtual void HandleEvent(int fd, uint32_t events) = 0;
+};
+
+// A single-threaded, edge-triggered epoll reactor.
+// Each loop owns one epoll instance and one thread. Every descriptor that is
+// registered with a loop is only ever touched from that loop's thread, so the
+// handlers it drives need no locking of their own.
+class EventLoop {
+ public:
+  EventLoop();
+  ~EventLoop();
+
+  // This class is not copyable or movable.
+  EventLoop(const EventLoop& other) = delete;
+  EventLoop& operator=(const EventLoop& other) = delete;
+  EventLoop(EventLoop&& other) = delete;
+  EventLoop& operator=(EventLoop&& other) = delete;
+
+  // Creates the epoll instance and starts the loop thread. The thread is
+  // pinned to 'cpus' when it is not empty.
+  bool Start(const std::vector<int>& cpus = {});
+  // Stops the loop thread and waits for it to exit. Descriptors that are still
+  // registered are reported with EPOLLHUP | EPOLLERR so their owners release
+  // them.
+  void Stop();
+
+  // Registers 'fd' for edge-triggered notifications delivered to 'handler'.
+  // Must be called on the loop thread. Every registration gets a new
+  // generation, so events collected for an earlier descriptor with the same
+  // number are never delivered to it.
+  bool Add(int fd, uint32_t events, EventHandler* handler);
+  // Changes the event mask of a registered descriptor.
+  bool Modify(int fd, uint32_t events);
+  // Deregisters 'fd'. Events already collected for it are dropped.
+  void Remove(int fd);
+
+  // Queues 'task' to run on the loop thread. Safe to call from any thread.
+  // Once the loop thread has run its last tasks, 'task' runs right away on
+  // the calling thread instead, so late posts from handler teardown are not
+  // lost.
+  void Post(std::function<void()> task);
+
+  // Returns true when called from this loop's thread.
+  bool InLoopThread() const;
+
+ private:
+  // The main loop waiting for and dispatching readiness events.
+  void Run();
+  // Runs all tasks queued by Post.
+  void RunPendingTasks();
+  // Wakes the loop thread out of 'epoll_wait'.
+  void Wakeup();
+
+  // A descriptor's current registration.
+  struct Registration {
+    // Handler notified of events, or null when 'fd' is not registered.
+    EventHandler* handler = nullptr;
+    // Generation of the registration, carried in the epoll event data.
+    uint32_t generation = 0;
+  };
+
+  // Packs 'fd' and its registration generation into epoll event data.
+  static uint64_t MakeToken(int fd, uint32_t generation);
+
+  // File descriptor for the epoll instance.
+  int epoll_fd_;
+  // Eventfd used to wake the loop when tasks are posted.
+  int wake_fd_;
+  // Flag indicating if the loop is running.
+  std::atomic<bool> running_;
+  // The thread that runs the loop.
+  std::thread thread_;
+  // Registrations indexed by file descriptor. Loop thread only.
+  std::vector<Registration> handlers_;
+  // Generation handed to the next registration. Zero is reserved for the
+  // wakeup descriptor. Loop thread only.
+  uint32_t next_generation_;
+  // Tasks queued for execution on the loop thread.
+  std::vector<std::function<void()>> pending_tasks_;
+  // False once the loop thread ran its last tasks, until the next Start.
+  bool accepting_tasks_;
+  // Mutex to protect access to 'pending_tasks_' and 'accepting_tasks_'.
+  std::mutex tasks_mutex_;
+};
+
+}  // namespace core
+}  // namespace load_balancer
+
+#endif  // LOAD_BALANCER_EVENT_LOOP_H
@@ -0,0 +1,98 @@
+#ifndef LOAD_BALANCER_FEATURE_STORE_H
+#define LOAD_BALANCER_FEATURE_STORE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace load_balancer {
+namespace core {
+
+// The observations routing decisions read for one backend, in one cache
+// line of its own. Written with relaxed atomics by whichever thread
+// observes an outcome; readers accept values that are a few updates old.
+struct alignas(64) BackendFeatures {
+  // Moving averages of the connect latency and failure rate.
+  std::atomic<double> latency_ms{0.0};
+  std::atomic<double> error_rate{0.0};
+  // Moving average of successful outcomes per second, and the time of the
+  // last one in nanoseconds of the steady clock.
+  std::atomic<double> throughput{0.0};
+  std::atomic<int64_t> last_success_ns{0};
+  // Connections currently forwarded to the backend.
+  std::atomic<int32_t> in_flight{0};
+  // The weight for load balancing.
+  std::atomic<int32_t> weight{1};
+  std::atomic<bool> healthy{true};
+};
+
+// Health bookkeeping of one backend, kept apart from its features so
+// monitoring writes do not invalidate the lines decisions read.
+struct alignas(64) BackendHealth {
+  // Consecutive failed and successful attempts seen by the passive monitor.
+  std::atomic<int32_t> consecutive_failures{0};
+  std::atomic<int32_t> consecutive_successes{0};
+  // Times in nanoseconds of the steady clock.
+  std::atomic<int64_t> last_failure_ns{0};
+  std::atomic<int64_t> last_checked_ns{0};
+};
+
+// The process-wide store of backend state, indexed by a dense ID each
+// BackendServer holds for its lifetime. Features and health live in two
+// arrays of cache-line-sized slots that never move, so a reader indexes them
+// without locking and every backend's features are contiguous with the
+// next's. The arrays reserve address space for kMaxBackends up front and
+// the kernel backs pages only as IDs reach them. Released IDs are reused,
+// most recently released first.
+class FeatureStore {
+ public:
+  // Most backends that can exist at once.
+  static constexpr size_t kMaxBackends = 65536;
+
+  static FeatureStore& Instance();
+
+  // This class is not copyable or movable.
+  FeatureStore(const FeatureStore& other) = delete;
+  FeatureStore& operator=(const FeatureStore& other) = delete;
+  FeatureStore(FeatureStore&& other) = delete;
+  FeatureStore& operator=(FeatureStore&& other) = delete;
+
+  // Returns an unused ID whose slots hold their initial values.
+  uint32_t Acquire();
+  // Makes 'id' available to Acquire again.
+  void Release(uint32_t id);
+
+  BackendFeatures& Features(uint32_t id) { return features_[id]; }
+  BackendHealth& Health(uint32_t id) { return health_[id]; }
+  // The features of every ID, contiguous and indexed by ID.
+  const BackendFeatures* FeatureArray() const { return features_; }
+
+ private:
+  FeatureStore();
+
+  BackendFeatures* features_;
+  BackendHealth* health_;
+
+  // Serializes Acquire and Release.
+  std::mutex ids_mutex_;
+  // Lowest ID never handed out.
+  uint32_t next_id_ = 0;
+  // Released IDs.
+  std::vector<uint32_t> free_ids_;
+};
+
+// Returns the current time of the steady clock in nanoseconds, as stored in
+// the slots.
+inline int64_t SteadyNowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+}  // namespace core
+}  // namespace load_balancer
+
+#endif  // LOAD_BALANCER_FEATURE_STORE_H
@@ -0,0 +1,85 @@
+#ifndef LOAD_BALANCER_IO_URING_H
+#define LOAD_BALANCER_IO_URING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <linux/io_uring.h>
+#include <sys/uio.h>
+
+namespace load_balancer {
+namespace core {
+
+// A minimal io_uring instance driven through the raw system calls.
+// Submission entries are prepared directly in the ring shared with the kernel
+// and handed over in batches by Submit, so any number of operations costs a
+// single system call. Completions are consumed straight from the shared
+// completion ring. One thread owns the ring; the class is not thread-safe.
+class IoUring {
+ public:
+  IoUring() = default;
+  ~IoUring();
+
+  // This class is not copyable or movable.
+  IoUring(const IoUring& other) = delete;
+  IoUring& operator=(const IoUring& other) = delete;
+  IoUring(IoUring&& other) = delete;
+  IoUring& operator=(IoUring&& other) = delete;
+
+  // Returns true if io_uring is enabled and the kernel implements every
+  // opcode in 'ops'.
+  static bool Supports(std::initializer_list<uint8_t> ops);
+
+  // Creates the ring with room for 'entries' submissions and twice as many
+  // completions. Returns false on failure.
+  bool Init(unsigned entries);
+
+  // Returns a zeroed submission entry, or nullptr while the ring is full.
+  io_uring_sqe* GetSqe();
+
+  // Hands every prepared entry to the kernel and waits until at least
+  // 'wait_for' completions are available. Returns the number of entries
+  // consumed, or -errno.
+  int Submit(unsigned wait_for = 0);
+
+  // Returns the oldest unconsumed completion, or nullptr.
+  io_uring_cqe* PeekCqe();
+  // Consumes the completion returned by PeekCqe.
+  void SeenCqe();
+
+  // Registers buffers for IORING_OP_READ_FIXED and IORING_OP_WRITE_FIXED.
+  bool RegisterBuffers(const iovec* buffers, unsigned count);
+  // Registers an empty fixed file table with 'count' slots.
+  bool RegisterSparseFiles(unsigned count);
+
+ private:
+  // Unmaps the rings and closes the instance.
+  void Close();
+
+  // File descriptor of the io_uring instance.
+  int fd_ = -1;
+  // Mapped submission ring, completion ring and submission entries.
+  void* sq_ring_ = nullptr;
+  size_t sq_ring_size_ = 0;
+  void* cq_ring_ = nullptr;
+  size_t cq_ring_size_ = 0;
+  io_uring_sqe* sqes_ = nullptr;
+  size_t sqes_size_ = 0;
+  // Submission ring fields shared with the kernel.
+  unsigned* sq_head_ = nullptr;
+  unsigned* sq_tail_ = nullptr;
+  unsigned sq_mask_ = 0;
+  unsigned sq_entries_ = 0;
+  // Tail including entries prepared but not yet published to the kernel.
+  unsigned sqe_tail_ = 0;
+  // Completion ring fields shared with the kernel.
+  unsigned* cq_head_ = nullptr;
+  unsigned* cq_tail_ = nullptr;
+  unsigned cq_mask_ = 0;
+  io_uring_cqe* cqes_ = nullptr;
+};
+
+}  // namespace core
+}  // namespace load_balancer
+
+#endif  // LOAD_BALANCER_IO_URING_H
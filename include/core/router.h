@@ -3,29 +3,145 @@
 
 #include "backend_server.h"
 #include "rl/agent.h"
+#include "rl/features.h"
+#include "rl/trainer.h"
+#include "utils/alias_table.h"
 
+#include <atomic>
+#include <cstdint>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 
 namespace load_balancer {
 namespace core {
 
+// An immutable view of the backend servers managed by a Router.
+// Every change publishes a new set; a published set is never modified.
+struct BackendSet {
+  // Backends that receive new connections.
+  std::vector<std::shared_ptr<BackendServer>> routable;
+  // Backends that finish their current connections but receive no new ones.
+  std::vector<std::shared_ptr<BackendServer>> draining;
+  // Samples 'routable' in proportion to the backends' weights.
+  utils::AliasTable weights;
+  // Samples 'routable' by the agent's action probabilities; empty if the
+  // agent decides per request.
+  utils::AliasTable policy;
+  // Incremented by every change of the members or their weights, but not
+  // by policy refreshes, so state derived from the members stays valid.
+  uint64_t version = 0;
+  // Incremented by every change, policy refreshes included.
+  uint64_t policy_version = 0;
+};
+
 // Manages the selection of backend servers for incoming requests.
 // This class uses a reinforcement learning agent to intelligently pick the most
 // suitable backend server from a pool of available servers.
+// The backend servers can be changed while traffic flows. Picks read the
+// current BackendSet without locking; changes are serialized, publish a new
+// set atomically and retire the old one through epoch-based reclamation, so
+// sessions already holding a backend are unaffected.
+// Rewards are not learned from on the request path: they are queued for a
+// trainer thread owned by the router, which updates the agent in batches and
+// hands every batch to the observer of its TrainerConfig, such as a
+// MetricsCollector's RecordExperiences.
+// Every published set carries an alias table over the routable backends'
+// weights, rebuilt by the change that published it, so weighted random
+// picks take constant time regardless of the number of backends. A router
+// without an agent routes by weight alone. An agent that exposes action
+// probabilities gets an alias table over them in every set, republished
+// after each training batch, which picks sample in place of a decision.
 class Router {
  public:
-  explicit Router(std::shared_ptr<rl::Agent> agent);
+  // 'agent' may be null to route by weighted random choice.
+  explicit Router(std::shared_ptr<rl::Agent> agent,
+                  rl::TrainerConfig trainer_config = {});
+  ~Router();
+
+  // This class is not copyable or movable.
+  Router(const Router& other) = delete;
+  Router& operator=(const Router& other) = delete;
+  Router(Router&& other) = delete;
+  Router& operator=(Router&& other) = delete;
+
+  // Adds a backend server to route to. Returns false if a server with the
+  // same address is already managed.
+  bool AddBackendServer(std::shared_ptr<BackendServer> backend_server);
+  // Stops routing to the server with 'address' and forgets it. Connections
+  // already forwarded to it continue. Returns false if it is not managed.
+  bool RemoveBackendServer(const std::string& address);
+  // Stops routing new connections to the server with 'address' while
+  // keeping it listed until it is removed. Returns false if it is not
+  // routable.
+  bool DrainBackendServer(const std::string& address);
+  // Changes the weight of the server with 'address'. Returns false if it is
+  // not managed.
+  bool SetBackendWeight(const std::string& address, int weight);
 
-  void AddBackendServer(std::shared_ptr<BackendServer> backend_server);
+  // Returns the managed backend servers, draining ones included.
+  std::vector<std::shared_ptr<BackendServer>> BackendServers() const;
+  // Returns the version of the current backend set.
+  uint64_t Version() const;
 
-  // Selects an available backend server using the configured RL agent.
+  // Selects an available backend server using the configured RL agent, or
+  // by weight if the agent finds no healthy one. Returns nullptr if there
+  // is none.
   std::shared_ptr<BackendServer> PickBackendServer();
+  // Selects a backend server at random in proportion to its weight,
+  // preferring healthy ones. Returns nullptr if no backend has a positive
+  // weight.
+  std::shared_ptr<BackendServer> PickWeightedBackendServer();
+  // Selects a backend server like PickBackendServer, but only among those
+  // not listed in 'excluded'. Returns nullptr if none is left.
+  std::shared_ptr<BackendServer> PickBackendServer(
+      const std::vector<std::shared_ptr<BackendServer>>& excluded);
+
+  // Returns the agent's replica deciding on the calling thread, to be
+  // recorded in the experience of a pick made on it, or -1.
+  int DecisionReplica() const;
+
+  // Queues the outcome of routing to 'experience.backend' for the agent and
+  // the trainer's batch observer. Never blocks; the experience is dropped if
+  // the trainer has fallen behind.
+  void ReportReward(rl::Experience experience);
+  // Returns the counters of the trainer thread.
+  rl::TrainerStats TrainingStats() const;
+  // Republishes the current set with the agent's current action
+  // probabilities, if it has any. Called on the trainer thread after every
+  // batch, and by callers that train the agent themselves after theirs.
+  void RefreshPolicy();
 
  private:
-  // Collection of managed backend servers.
-  std::vector<std::shared_ptr<BackendServer>> backend_servers_;
+  // Rebuilds the alias tables of 'next', whose members or weights changed,
+  // under a new version and installs it. Must be called with
+  // 'update_mutex_' held.
+  void Publish(std::unique_ptr<BackendSet> next);
+  // Publishes 'next' as the current set and retires the previous one. Must
+  // be called with 'update_mutex_' held.
+  void Install(std::unique_ptr<BackendSet> next);
+  // Samples 'table' over the routable backends of 'backends' a few times
+  // for one that is healthy and not in 'excluded'. Returns nullptr if no
+  // draw qualified.
+  static std::shared_ptr<BackendServer> SampleHealthy(
+      const BackendSet& backends, const utils::AliasTable& table,
+      const std::vector<std::shared_ptr<BackendServer>>& excluded);
+  // Samples the weights of 'backends', skipping those in 'excluded' and
+  // unhealthy ones while a healthy one is left. Returns nullptr if no
+  // backend with weight qualifies.
+  static std::shared_ptr<BackendServer> SampleWeighted(
+      const BackendSet& backends,
+      const std::vector<std::shared_ptr<BackendServer>>& excluded);
+
+  // The current backend set, read without locking.
+  std::atomic<const BackendSet*> backends_;
+  // Serializes changes of the backend set.
+  std::mutex update_mutex_;
   // The reinforcement learning agent for server selection.
   std::shared_ptr<rl::Agent> agent_;
+  // Applies reported rewards to 'agent_'.
+  rl::Trainer trainer_;
 };
 
 }  // namespace core
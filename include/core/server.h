@@ -1,26 +1,114 @@
 #ifndef LOAD_BALANCER_SERVER_H
 #define LOAD_BALANCER_SERVER_H
 
+#include "event_loop.h"
 #include "router.h"
+#include "uring_loop.h"
+#include "protocols/connection_pool.h"
+#include "protocols/handler_context.h"
+#include "utils/tls_utils.h"
 
 #include <string>
 #include <thread>
 #include <vector>
 #include <atomic>
+#include <condition_variable>
+#include <list>
 #include <memory>
+#include <mutex>
 #include <netinet/in.h>
 
 namespace load_balancer {
+namespace protocols {
+class ProtocolHandler;
+}  // namespace protocols
+
 namespace core {
 
+// Selects how accepted client connections are served.
+enum class IoMode {
+  // One blocking handler thread per accepted connection.
+  kThreadPerConnection,
+  // A fixed pool of edge-triggered epoll event loops driving non-blocking
+  // handler state machines.
+  kEventLoop,
+  // One io_uring completion loop per listener, accepting with a multishot
+  // accept and relaying through fixed files and registered buffers. Serves
+  // 'Protocol::kPassthrough' only; other protocols, and kernels without the
+  // required operations, fall back to 'kEventLoop'. Set 'listeners' to scale
+  // it over several cores.
+  kIoUring,
+};
+
+// Selects the protocol handler serving client connections.
+enum class Protocol {
+  // Opaque TLS-terminated stream relaying (TcpHandler).
+  kTcp,
+  // HTTPS with pooled backend connections (HttpHandler).
+  kHttp,
+  // Plain layer 4 forwarding without TLS termination, relayed with splice()
+  // (PassthroughHandler). No credentials are loaded.
+  kPassthrough,
+};
+
+// Configuration options for a Server instance.
+struct ServerConfig {
+  // TCP port number to listen on.
+  int port = 8080;
+  // Protocol handler serving accepted connections. Every listening port is
+  // served by its own Server, so the protocol is chosen per listener; servers
+  // for different ports can share one Router.
+  Protocol protocol = Protocol::kTcp;
+  // How accepted connections are served.
+  IoMode io_mode = IoMode::kThreadPerConnection;
+  // Number of event-loop threads in 'IoMode::kEventLoop'. Zero uses one per
+  // available core.
+  int event_loop_threads = 0;
+  // Maximum number of pending connections in each listening socket's queue.
+  int listen_backlog = 100;
+  // Number of listening sockets bound to 'port' with SO_REUSEPORT, each with
+  // its own accept loop. Zero uses one per available core.
+  int listeners = 1;
+  // Attaches a classic BPF program to the SO_REUSEPORT group that steers each
+  // connection to listener 'cpu % listeners' for the CPU that received it,
+  // and pins every listener's threads to the CPUs mapped to it. Only used
+  // with more than one listener.
+  bool steer_by_cpu = false;
+  // Credentials and session resumption settings for client connections.
+  utils::TlsConfig tls{};
+  // Deadline and retry budget of backend connects. Its timeout also applies
+  // to the connects of the pools.
+  protocols::ConnectConfig connect{};
+  // How the timings of routed connections and requests are turned into the
+  // rewards the router's agent learns from.
+  rl::RewardConfig reward{};
+  // Limits of the warm backend connection pools used by 'Protocol::kHttp'.
+  protocols::ConnectionPoolConfig connection_pool{};
+  // Size classes and cache limit of the relay buffer pool.
+  utils::BufferPoolConfig buffers{};
+  // Limits applied when parsing HTTP messages in 'Protocol::kHttp'.
+  protocols::HttpParserLimits http_limits{};
+  // Whether 'Protocol::kHttp' routes every request or every connection. Event
+  // loop mode only routes per connection: Start refuses to serve
+  // 'HttpRouting::kPerRequest' with it.
+  protocols::HttpRouting http_routing = protocols::HttpRouting::kPerRequest;
+  // HTTP/2 frontend of 'Protocol::kHttp', negotiated with ALPN.
+  protocols::Http2Config http2{};
+  // Ring and buffer sizes of every listener in 'IoMode::kIoUring'.
+  UringConfig uring{};
+};
+
 // The Server class manages the core functionality of the load balancer.
 // This class is responsible for initializing a TCP server, listening for
 // incoming client connections, and dispatching these connections to
-// individual handler threads. It integrates with a Router to determine
-// which backend server should handle the client's requests.
+// individual handler threads or event loops. Connections can be spread over
+// several SO_REUSEPORT listeners, each owning its own share of the handler
+// state. It integrates with a Router to determine which backend server should
+// handle the client's requests.
 class Server {
  public:
   Server(int port, std::shared_ptr<Router> router);
+  Server(ServerConfig config, std::shared_ptr<Router> router);
   ~Server();
 
   // This class is not copyable or movable.
@@ -29,27 +117,85 @@ class Server {
   Server(Server&& other) = delete;
   Server& operator=(Server&& other) = delete;
 
-  // Start listening for incoming connections and handling clients.
+  // Start listening for incoming connections and handling clients. Blocks
+  // until Stop is called. Returns right away, after logging why, if the
+  // configuration cannot be served or no listener could be opened.
   void Start();
   // Stop the server gracefully.
   void Stop();
 
  private:
-  // Internal loop accepting incoming client connections.
-  void AcceptConnections();
-  // Handle an individual client connection.
-  void HandleClient(int client_socket);
+  // A thread serving one client connection in 'IoMode::kThreadPerConnection'.
+  struct Worker {
+    // Client connection the thread serves. Closed under the shard's
+    // 'workers_mutex', so Stop never shuts down a reused descriptor.
+    int client_socket = -1;
+    // Set once the thread has closed 'client_socket' and is about to exit.
+    std::atomic<bool> done{false};
+    // Thread handling the connection.
+    std::thread thread;
+  };
 
-  // TCP port number to listen on.
-  int port_;
-  // File descriptor for server socket.
-  int server_socket_;
+  // A listening socket together with the state serving the connections the
+  // kernel hands to it. Shards share nothing but the router.
+  struct ListenerShard {
+    // File descriptor for the listening socket.
+    int socket = -1;
+    // CPUs this shard's threads are pinned to: those the steering program
+    // maps to this shard. Empty when not pinned.
+    std::vector<int> cpus;
+    // Thread running this shard's accept loop.
+    std::thread accept_thread;
+    // Threads handling client connections. Finished ones are joined and
+    // removed on the next accept.
+    std::list<Worker> workers;
+    // Mutex to protect access to 'workers' and their client sockets.
+    std::mutex workers_mutex;
+    // Event loops serving this shard in 'IoMode::kEventLoop'.
+    std::vector<std::unique_ptr<EventLoop>> event_loops;
+    // Index of the event loop receiving the next connection.
+    size_t next_event_loop = 0;
+    // Completion loop accepting and serving this shard in 'IoMode::kIoUring'.
+    std::unique_ptr<UringLoop> uring_loop;
+  };
+
+  // Creates, binds and starts listening on a socket for the configured port.
+  int OpenListeningSocket(bool reuse_port);
+  // Attaches the CPU-steering BPF program to the SO_REUSEPORT group.
+  bool AttachCpuSteeringProgram();
+  // Internal loop accepting incoming client connections for 'shard'.
+  void AcceptConnections(ListenerShard& shard);
+  // Creates the protocol handler for a client connection.
+  std::shared_ptr<protocols::ProtocolHandler> CreateHandler(int client_socket);
+  // Handle an individual client connection on 'worker's thread.
+  void HandleClient(ListenerShard& shard, Worker& worker);
+  // Joins and removes the shard's finished workers.
+  void ReapWorkers(ListenerShard& shard);
+  // Hand a client connection to one of the shard's event loops.
+  void DispatchToEventLoop(ListenerShard& shard, int client_socket);
+  // Starts the shard's io_uring loop, which accepts on its own.
+  bool StartUringLoop(ListenerShard& shard);
+  // Joins the threads of 'shards', closes their listening sockets and
+  // releases them.
+  void CloseShards(std::vector<std::unique_ptr<ListenerShard>> shards);
+
+  // Configuration this server was created with.
+  ServerConfig config_;
   // Flag indicating if server is running.
   std::atomic<bool> running_;
-  // Threads handling client connections.
-  std::vector<std::thread> worker_threads_;
-  // Shared router instance for backend selection.
-  std::shared_ptr<Router> router_{};
+  // Listening sockets and the state serving each of them.
+  std::vector<std::unique_ptr<ListenerShard>> shards_;
+  // Set by a Stop that ran before Start published the shards; Start honours
+  // it instead of serving.
+  bool stop_requested_ = false;
+  // Set while Stop joins the shards it took out of 'shards_'.
+  bool closing_shards_ = false;
+  // Signalled once Stop has released every shard.
+  std::condition_variable stopped_;
+  // Mutex to protect access to 'shards_' and the stop flags during shutdown.
+  std::mutex stop_mutex_;
+  // State shared by every handler: router, TLS contexts and session caches.
+  std::shared_ptr<protocols::HandlerContext> context_;
 };
 
 }  // namespace core
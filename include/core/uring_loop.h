@@ -0,0 +1,164 @@
+#ifndef LOAD_BALANCER_URING_LOOP_H
+#define LOAD_BALANCER_URING_LOOP_H
+
+#include "core/io_uring.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace load_balancer {
+namespace core {
+
+// Configuration for the io_uring engine of one listener shard.
+struct UringConfig {
+  // Number of submission queue entries.
+  unsigned entries = 4096;
+  // Maximum number of concurrent sessions. Each one occupies two slots of the
+  // fixed file table; the table is clamped to the descriptor limit.
+  unsigned max_connections = 4096;
+  // Number of relay buffers registered with the kernel.
+  unsigned registered_buffers = 1024;
+  // Size of a relay buffer in bytes.
+  size_t buffer_size = 16384;
+};
+
+// Receives the completions of operations submitted through a UringLoop.
+class CompletionHandler {
+ public:
+  virtual ~CompletionHandler() = default;
+
+  // Invoked on the loop thread with the result of an operation prepared with
+  // tag 'op'. 'result' is the operation's return value or -errno.
+  virtual void HandleCompletion(uint8_t op, int32_t result,
+                                uint32_t flags) = 0;
+};
+
+// A single-threaded completion-based reactor built on io_uring.
+// The loop accepts connections from one listening socket with a multishot
+// accept that installs every client directly into the ring's fixed file
+// table, so sessions never own ordinary descriptors. Sessions submit their
+// socket operations through Prepare and all of them are handed to the kernel
+// with one system call per loop iteration. Relay buffers are preallocated and
+// registered with the kernel once. Everything but Stop must be called on the
+// loop thread.
+class UringLoop {
+ public:
+  // Invoked with the fixed file index of every accepted client.
+  using AcceptCallback = std::function<void(int fixed_file)>;
+
+  explicit UringLoop(UringConfig config);
+  ~UringLoop();
+
+  // This class is not copyable or movable.
+  UringLoop(const UringLoop& other) = delete;
+  UringLoop& operator=(const UringLoop& other) = delete;
+  UringLoop(UringLoop&& other) = delete;
+  UringLoop& operator=(UringLoop&& other) = delete;
+
+  // Returns true if the running kernel provides every operation the loop and
+  // its sessions rely on.
+  static bool Supported();
+
+  // Creates the ring and starts accepting on 'listen_socket' from the loop
+  // thread, which is pinned to 'cpus' when it is not empty.
+  bool Start(int listen_socket, AcceptCallback on_accept,
+             const std::vector<int>& cpus = {});
+  // Stops accepting, cancels every outstanding operation, waits until the
+  // sessions have released their resources and joins the loop thread.
+  void Stop();
+
+  // Returns a submission entry whose completion is delivered to 'handler'
+  // with tag 'op' (0-7). The entry is submitted on the next loop iteration.
+  io_uring_sqe* Prepare(CompletionHandler* handler, uint8_t op);
+  // Returns the user data identifying operation 'op' of 'handler', as used by
+  // IORING_OP_ASYNC_CANCEL.
+  static uint64_t UserData(CompletionHandler* handler, uint8_t op);
+
+  // Takes a free relay buffer. Returns its index and stores its address in
+  // 'data', or returns -1 if every buffer is in use.
+  int AcquireBuffer(char** data);
+  // Returns a buffer taken with AcquireBuffer.
+  void ReleaseBuffer(int index);
+  // Returns the size of each relay buffer.
+  size_t BufferSize() const { return config_.buffer_size; }
+  // Returns true if buffer indices can be used with the fixed read and write
+  // operations.
+  bool BuffersRegistered() const { return buffers_registered_; }
+
+  // Closes the socket installed at 'index' of the fixed file table.
+  void CloseFixedFile(int index);
+
+  // Keeps 'handler' alive until it calls Retire.
+  CompletionHandler* Adopt(std::unique_ptr<CompletionHandler> handler);
+  // Destroys an adopted handler once the current completion batch has been
+  // dispatched. The handler must have no operations in flight.
+  void Retire(CompletionHandler* handler);
+
+ private:
+  // Tags of the loop's own operations, submitted without a handler.
+  enum InternalOp : uint8_t {
+    kAcceptOp = 1,
+    kWakeupOp = 2,
+    kCloseOp = 3,
+    kCancelOp = 4,
+  };
+
+  // The main loop submitting operations and dispatching completions.
+  void Run();
+  // Dispatches every available completion. Returns false once the loop has
+  // been asked to stop.
+  bool DispatchCompletions();
+  // Submits the multishot accept on the listening socket.
+  void ArmAccept();
+  // Submits a read of the wakeup eventfd used by Stop.
+  void ArmWakeup();
+  // Handles a completion of the loop's own operations.
+  void HandleInternal(uint8_t op, int32_t result, uint32_t flags);
+
+  // Configuration of the loop.
+  UringConfig config_;
+  // The ring owned by the loop thread.
+  IoUring ring_;
+  // Listening socket multishot accepts are armed on.
+  int listen_socket_ = -1;
+  // Callback receiving accepted clients.
+  AcceptCallback on_accept_;
+  // Eventfd signalled by Stop to wake the loop thread.
+  int wake_fd_ = -1;
+  // Counter read from 'wake_fd_'.
+  uint64_t wake_counter_ = 0;
+  // Flag indicating if the loop is running.
+  std::atomic<bool> running_;
+  // The thread that runs the loop.
+  std::thread thread_;
+  // Number of submitted operations that have not completed for good.
+  size_t in_flight_ = 0;
+  // True while the multishot accept is armed.
+  bool accept_armed_ = false;
+  // True while accepting is paused because the fixed file table is full.
+  bool accept_paused_ = false;
+  // True while a cancellation of every operation is in flight.
+  bool cancel_pending_ = false;
+  // Contiguous storage for every relay buffer.
+  std::unique_ptr<char[]> buffer_storage_;
+  // Indices of free relay buffers.
+  std::vector<int> free_buffers_;
+  // True if the relay buffers are registered with the kernel.
+  bool buffers_registered_ = false;
+  // Handlers kept alive by the loop.
+  std::unordered_map<CompletionHandler*, std::unique_ptr<CompletionHandler>>
+      handlers_;
+  // Handlers to destroy after the current completion batch.
+  std::vector<CompletionHandler*> retired_;
+};
+
+}  // namespace core
+}  // namespace load_balancer
+
+#endif  // LOAD_BALANCER_URING_LOOP_H
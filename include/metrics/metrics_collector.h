@@ -2,8 +2,10 @@
 #define LOAD_BALANCER_MONITOR_METRICS_COLLECTOR_H_
 
 #include "core/backend_server.h"
+#include "rl/agent.h"
 
 #include <mutex>
+#include <span>
 #include <unordered_map>
 #include <string>
 #include <chrono>
@@ -49,6 +51,12 @@ class MetricsCollector {
   void RecordLatency(const std::shared_ptr<core::BackendServer>& backend,
                      std::chrono::milliseconds latency);
 
+  // Record the outcome of every routed request of 'batch' under one lock:
+  // a request, a success or failure and, for successes, the latency from
+  // the pick to the last phase reached. Meant as the observer of the
+  // router's trainer, so the request path never takes the lock.
+  void RecordExperiences(std::span<const rl::Experience> batch);
+
   // Get total requests for a backend.
   int GetRequestCount(const std::shared_ptr<core::BackendServer>& backend);
 
@@ -71,7 +79,7 @@ class MetricsCollector {
   const std::unordered_map<std::string, Metrics> MetricsMap();
 
  private:
-  // Maps backend IP to its collected metrics.
+  // Maps backend address (ip:port) to its collected metrics.
   std::unordered_map<std::string, Metrics> metrics_map_;
   // Mutex to ensure thread-safe access to 'metrics_map_' field.
   std::mutex metrics_mutex_;
@@ -4,8 +4,6 @@
 #include "core/backend_server.h"
 
 #include <memory>
-#include <unordered_map>
-#include <mutex>
 #include <chrono>
 
 namespace load_balancer {
@@ -14,7 +12,10 @@ namespace monitor {
 // Implements passive health monitoring for backend servers.
 // This class tracks success and failure rates of backend servers based on
 // observed traffic. It can mark servers as suspect after a certain number of
-// failures and introduce a quarantine period.
+// failures and introduce a quarantine period. Handlers report the outcome of
+// every backend connection attempt, so the counts are kept in the backend's
+// BackendHealth slot and updated with relaxed atomics; concurrent reports
+// may interleave, which at worst delays a reset by one outcome.
 class PassiveMonitor {
  public:
   PassiveMonitor() = default;
@@ -34,21 +35,6 @@ class PassiveMonitor {
   bool IsBackendSuspect(const std::shared_ptr<core::BackendServer>& backend);
 
  private:
-  // Internal structure to store statistics for each backend server.
-  struct BackendStats {
-    // Number of consecutive failures.
-    int failure_count = 0;
-    // Number of consecutive successes.
-    int success_count = 0;
-    // Timestamp of the last recorded failure.
-    std::chrono::steady_clock::time_point last_failure_time;
-  };
-
-  // Maps backend IP to its statistics.
-  std::unordered_map<std::string, BackendStats> backend_stats_;
-  // Mutex to protect 'backend_stats_' from concurrent access.
-  std::mutex stats_mutex_;
-
   // Number of failures after which a backend becomes suspect.
   static constexpr int kFailureThreshold = 3;
   // Number of consecutive successes to reset failure count.
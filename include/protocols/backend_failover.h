@@ -0,0 +1,144 @@
+#ifndef LOAD_BALANCER_BACKEND_FAILOVER_H
+#define LOAD_BALANCER_BACKEND_FAILOVER_H
+
+#include "core/backend_server.h"
+#include "protocols/handler_context.h"
+#include "rl/features.h"
+#include "rl/reward.h"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace load_balancer {
+namespace protocols {
+
+// The outcome of routing one connection or request to the backend that
+// accepted it, reported once as a reward to the router's agent.
+// Handlers timestamp the phases they reach with the steady clock; the reward
+// is computed from them with the server's RewardConfig when the work ends,
+// at the latest when the instance is destroyed, and handed to the router's
+// trainer queue without blocking. A failure after the connect also counts
+// against the backend with the passive monitor and in its moving averages.
+// An instance is owned by one handler at a time and is not thread-safe.
+class RoutingDecision {
+ public:
+  // Tracks nothing and reports nothing.
+  RoutingDecision() = default;
+  // 'context' must outlive the instance.
+  // 'replica' is the agent's replica that picked 'backend'.
+  RoutingDecision(const HandlerContext& context,
+                  std::shared_ptr<core::BackendServer> backend,
+                  const rl::FeatureVector& features,
+                  const rl::RequestTiming& timing, int replica);
+  // Reports a pending outcome as a success over the phases reached, so
+  // handlers must call Finish(false) on every path that ends in an error.
+  ~RoutingDecision();
+
+  // This class is movable but not copyable.
+  RoutingDecision(const RoutingDecision& other) = delete;
+  RoutingDecision& operator=(const RoutingDecision& other) = delete;
+  RoutingDecision(RoutingDecision&& other) noexcept;
+  RoutingDecision& operator=(RoutingDecision&& other) noexcept;
+
+  // Records that the TLS handshake with the backend finished.
+  void HandshakeDone();
+  // Records that the first response byte reached the client, now or at
+  // 'at_ns' on the steady clock, where 0 means not yet. Only the first time
+  // counts.
+  void FirstByte();
+  void FirstByteAt(int64_t at_ns);
+  // Records that the request was answered in full and reports the outcome.
+  void Complete();
+  // Reports the outcome of work without a completion phase, like a tunnel
+  // whose length is up to the client.
+  void Finish(bool success);
+
+  // True until the outcome was reported.
+  bool Pending() const { return context_ != nullptr; }
+
+ private:
+  // State shared by every handler of the server, or nullptr once reported.
+  const HandlerContext* context_ = nullptr;
+  // The backend that accepted and its features when it was picked.
+  std::shared_ptr<core::BackendServer> backend_;
+  rl::FeatureVector features_{};
+  // When each phase was reached.
+  rl::RequestTiming timing_;
+  // The agent's replica that made the decision, or -1.
+  int replica_ = -1;
+};
+
+// Picks the backends a single client connection is tried on.
+// The first pick is the router's regular decision. When connecting to it
+// fails, the next pick excludes every backend tried so far and, while others
+// are left, those the passive monitor holds as suspect, until the connect
+// budget is spent. Every connect outcome is reported to the passive monitor
+// and to the backend's moving averages. A refused connect is reported to the
+// router's agent right away; the reward of the backend that accepted waits
+// in a RoutingDecision for the later phases of the work. The backend that
+// accepted counts the connection as active for as long as the instance
+// lives. One instance serves one connection attempt sequence and is not
+// thread-safe.
+class BackendFailover {
+ public:
+  // 'context' must outlive the instance.
+  explicit BackendFailover(const HandlerContext& context);
+
+  // Returns the next backend to connect to, or nullptr once the budget is
+  // spent or every backend was tried.
+  std::shared_ptr<core::BackendServer> Next();
+  // Reports that connecting to the backend returned by Next failed.
+  void Failed();
+  // Reports that the backend returned by Next accepted the connection.
+  void Succeeded();
+
+  // Calls 'connect' with the backends returned by Next until it returns true.
+  // Returns the backend that accepted, or nullptr.
+  std::shared_ptr<core::BackendServer> Connect(
+      const std::function<bool(const std::shared_ptr<core::BackendServer>&)>&
+          connect);
+
+  // Borrows a pooled connection, opening one if none is idle, from the
+  // backends returned by Next until one is obtained. Stores its backend in
+  // 'backend'. Returns nullptr if no backend could be reached.
+  std::unique_ptr<BackendConnection> AcquirePooled(
+      std::shared_ptr<core::BackendServer>* backend);
+
+  // Number of backends returned by Next so far.
+  int Attempts() const { return attempts_; }
+
+  // The pending outcome of the backend that accepted.
+  RoutingDecision& Decision() { return decision_; }
+
+  // Hand over the active connection count and the pending outcome of the
+  // accepted backend, for callers that do not keep the instance for the
+  // whole connection.
+  core::ActiveConnection TakeActiveConnection() { return std::move(active_); }
+  RoutingDecision TakeDecision() { return std::move(decision_); }
+
+ private:
+  // State shared by every handler of the server.
+  const HandlerContext& context_;
+  // Backend returned by the last call to Next.
+  std::shared_ptr<core::BackendServer> current_;
+  // Features of 'current_' when it was picked, the time of the pick and
+  // the agent's replica that made it.
+  rl::FeatureVector features_{};
+  int64_t picked_ns_ = 0;
+  int replica_ = -1;
+  // Backends that failed to connect.
+  std::vector<std::shared_ptr<core::BackendServer>> tried_;
+  // Counts the connection to the backend that accepted.
+  core::ActiveConnection active_;
+  // Outcome of the work done on the backend that accepted.
+  RoutingDecision decision_;
+  // Number of backends returned by Next so far.
+  int attempts_ = 0;
+};
+
+}  // namespace protocols
+}  // namespace load_balancer
+
+#endif  // LOAD_BALANCER_BACKEND_FAILOVER_H
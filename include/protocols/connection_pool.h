@@ -0,0 +1,245 @@
+#ifndef LOAD_BALANCER_CONNECTION_POOL_H
+#define LOAD_BALANCER_CONNECTION_POOL_H
+
+#include "core/backend_server.h"
+#include "core/router.h"
+#include "utils/tls_utils.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <openssl/ssl.h>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace load_balancer {
+namespace protocols {
+
+// Limits and timings of the per-backend connection pools.
+struct ConnectionPoolConfig {
+  // Number of idle connections kept open (and re-opened) for every backend.
+  size_t min_idle = 0;
+  // Maximum number of idle connections kept for every backend; connections
+  // released beyond it are closed.
+  size_t max_idle = 8;
+  // Idle connections older than this are closed instead of handed out.
+  std::chrono::seconds idle_timeout{60};
+  // Interval between maintenance passes that expire and replenish pools.
+  std::chrono::seconds maintenance_interval{5};
+  // Time allowed for the TCP connect and TLS handshake of a new connection.
+  std::chrono::milliseconds connect_timeout{3000};
+};
+
+// An established, TLS-handshaked connection to a backend server.
+// The socket is non-blocking. The connection is shut down and closed when
+// the object is destroyed.
+class BackendConnection {
+ public:
+  BackendConnection(int socket, SSL* ssl);
+  ~BackendConnection();
+
+  // This class is not copyable or movable.
+  BackendConnection(const BackendConnection& other) = delete;
+  BackendConnection& operator=(const BackendConnection& other) = delete;
+  BackendConnection(BackendConnection&& other) = delete;
+  BackendConnection& operator=(BackendConnection&& other) = delete;
+
+  // Accessor methods for connection properties.
+  int Socket() const { return socket_; }
+  SSL* Ssl() const { return ssl_; }
+  std::chrono::steady_clock::time_point IdleSince() const {
+    return idle_since_;
+  }
+
+  // Records that the connection just became idle.
+  void MarkIdle() { idle_since_ = std::chrono::steady_clock::now(); }
+
+  // Checks without blocking that the backend has neither closed the
+  // connection nor sent unsolicited application data. TLS records that carry
+  // no application data, like session tickets, are consumed.
+  bool IsAlive();
+
+ private:
+  // File descriptor for the backend's socket.
+  int socket_;
+  // TLS connection on top of 'socket_'.
+  SSL* ssl_;
+  // Time the connection was last returned to its pool.
+  std::chrono::steady_clock::time_point idle_since_;
+};
+
+// A connection to a backend server being opened without blocking. The TCP
+// connect and the TLS handshake advance whenever the owner calls Advance,
+// typically once Socket() is ready for Events(), and fail once the deadline
+// passed. The socket is closed when the object is destroyed, unless the
+// established connection was taken.
+class PendingConnection {
+ public:
+  enum class Status { kPending, kEstablished, kFailed };
+
+  // 'socket' must be non-blocking with a connect in progress.
+  PendingConnection(std::shared_ptr<core::BackendServer> backend,
+                    std::shared_ptr<utils::TlsContextManager> tls, int socket,
+                    std::chrono::steady_clock::time_point deadline);
+  ~PendingConnection();
+
+  // This class is not copyable or movable.
+  PendingConnection(const PendingConnection& other) = delete;
+  PendingConnection& operator=(const PendingConnection& other) = delete;
+  PendingConnection(PendingConnection&& other) = delete;
+  PendingConnection& operator=(PendingConnection&& other) = delete;
+
+  // Makes as much progress as possible without blocking. Must not be called
+  // again once it returned kEstablished or kFailed.
+  Status Advance();
+
+  // The socket and the poll events the next step waits for.
+  int Socket() const { return socket_; }
+  short Events() const { return events_; }
+  // Time by which the connection must be established.
+  std::chrono::steady_clock::time_point Deadline() const { return deadline_; }
+
+  // Hands over the connection once Advance returned kEstablished.
+  std::unique_ptr<BackendConnection> Take();
+
+ private:
+  // The backend server being connected to.
+  std::shared_ptr<core::BackendServer> backend_;
+  // TLS contexts and backend session cache.
+  std::shared_ptr<utils::TlsContextManager> tls_;
+  // The socket, and its TLS connection once the TCP connect finished.
+  int socket_;
+  SSL* ssl_ = nullptr;
+  std::chrono::steady_clock::time_point deadline_;
+  // Poll events the connect or handshake waits for.
+  short events_;
+};
+
+// Keeps idle connections to a single backend server ready for reuse.
+// Connections are handed out most recently used first, after a liveness
+// check, so requests skip the TCP connect and the TLS handshake. This class
+// is thread-safe.
+class ConnectionPool {
+ public:
+  ConnectionPool(std::shared_ptr<core::BackendServer> backend,
+                 std::shared_ptr<utils::TlsContextManager> tls,
+                 const ConnectionPoolConfig& config);
+
+  // This class is not copyable or movable.
+  ConnectionPool(const ConnectionPool& other) = delete;
+  ConnectionPool& operator=(const ConnectionPool& other) = delete;
+  ConnectionPool(ConnectionPool&& other) = delete;
+  ConnectionPool& operator=(ConnectionPool&& other) = delete;
+
+  // Returns a live idle connection, or establishes a new one with blocking
+  // connect and handshake. Returns nullptr if the backend is unreachable.
+  std::unique_ptr<BackendConnection> Acquire();
+
+  // Returns a live idle connection without ever blocking, or nullptr.
+  std::unique_ptr<BackendConnection> TryAcquireIdle();
+
+  // Starts opening a new connection, bounded by the connect timeout, for a
+  // caller that advances it alongside other work. Returns nullptr if the
+  // connect could not be started.
+  std::unique_ptr<PendingConnection> StartConnect();
+
+  // Hands a connection back after use. Connections that are 'reusable' (the
+  // last response was fully delimited and nothing else is pending) go back
+  // to the idle list while there is room; all others are closed.
+  void Release(std::unique_ptr<BackendConnection> connection, bool reusable);
+
+  // Closes expired idle connections and opens new ones until 'min_idle'
+  // connections are idle.
+  void Maintain();
+
+  // Number of idle connections.
+  size_t IdleCount() const;
+  // The backend server this pool connects to.
+  const std::shared_ptr<core::BackendServer>& Backend() const {
+    return backend_;
+  }
+
+ private:
+  // Opens and handshakes a new connection to the backend, blocking until it
+  // is established or the connect timeout passed.
+  std::unique_ptr<BackendConnection> Connect();
+
+  // The backend server this pool connects to.
+  std::shared_ptr<core::BackendServer> backend_;
+  // TLS contexts and backend session cache.
+  std::shared_ptr<utils::TlsContextManager> tls_;
+  // Limits and timings of this pool.
+  ConnectionPoolConfig config_;
+  // Idle connections, most recently released last.
+  std::vector<std::unique_ptr<BackendConnection>> idle_;
+  // Mutex to protect access to 'idle_' field.
+  mutable std::mutex mutex_;
+};
+
+// Owns one ConnectionPool per backend server and keeps them maintained.
+// A background thread periodically drops the pools of backends the router no
+// longer lists, expires idle connections and replenishes every pool to its
+// minimum. This class is thread-safe.
+class ConnectionPoolManager {
+ public:
+  ConnectionPoolManager(std::shared_ptr<core::Router> router,
+                        std::shared_ptr<utils::TlsContextManager> tls,
+                        ConnectionPoolConfig config);
+  ~ConnectionPoolManager();
+
+  // This class is not copyable or movable.
+  ConnectionPoolManager(const ConnectionPoolManager& other) = delete;
+  ConnectionPoolManager& operator=(const ConnectionPoolManager& other) = delete;
+  ConnectionPoolManager(ConnectionPoolManager&& other) = delete;
+  ConnectionPoolManager& operator=(ConnectionPoolManager&& other) = delete;
+
+  // Returns the pool of 'backend', creating it on first use. A pool that was
+  // dropped stays usable by those still holding it; connections released
+  // into it are closed along with it.
+  std::shared_ptr<ConnectionPool> PoolFor(
+      const std::shared_ptr<core::BackendServer>& backend);
+
+  // Fills the pools of 'backends' to their minimum before traffic arrives.
+  void Warm(const std::vector<std::shared_ptr<core::BackendServer>>& backends);
+
+  // Drops the pools of backends that are not in 'backends', closing their
+  // idle connections.
+  void Prune(const std::vector<std::shared_ptr<core::BackendServer>>& backends);
+
+  // Starts the maintenance thread.
+  void Start();
+  // Stops the maintenance thread gracefully.
+  void Stop();
+
+ private:
+  // The main loop of the maintenance thread.
+  void MaintenanceLoop();
+
+  // Router whose backend set decides which pools are kept.
+  std::shared_ptr<core::Router> router_;
+  // TLS contexts and backend session cache shared by all pools.
+  std::shared_ptr<utils::TlsContextManager> tls_;
+  // Limits and timings applied to every pool.
+  ConnectionPoolConfig config_;
+  // Pools keyed by backend address.
+  std::unordered_map<std::string, std::shared_ptr<ConnectionPool>> pools_;
+  // Mutex to protect access to 'pools_' field.
+  std::mutex pools_mutex_;
+  // Atomic flag to control the running state of the maintenance thread.
+  std::atomic<bool> running_;
+  // The thread that runs the maintenance loop.
+  std::thread maintenance_thread_;
+  // Wakes the maintenance thread early when stopping.
+  std::condition_variable stop_cv_;
+  // Mutex used with 'stop_cv_'.
+  std::mutex stop_mutex_;
+};
+
+}  // namespace protocols
+}  // namespace load_balancer
+
+#endif  // LOAD_BALANCER_CONNECTION_POOL_H
@@ -0,0 +1,80 @@
+#ifndef LOAD_BALANCER_HANDLER_CONTEXT_H
+#define LOAD_BALANCER_HANDLER_CONTEXT_H
+
+#include "core/router.h"
+#include "monitor/passive_monitor.h"
+#include "protocols/connection_pool.h"
+#include "protocols/http_parser.h"
+#include "rl/reward.h"
+#include "utils/buffer_pool.h"
+#include "utils/tls_utils.h"
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+namespace load_balancer {
+namespace protocols {
+
+// How HTTP handlers assign requests to backend servers.
+enum class HttpRouting {
+  // One backend per client connection, chosen for its first request; the
+  // rest of the connection is relayed opaquely.
+  kPerConnection,
+  // Every request on a keep-alive connection is framed and routed on its own
+  // over pooled backend connections. Thread-per-connection mode only.
+  kPerRequest,
+};
+
+// Settings of the HTTP/2 frontend of 'Protocol::kHttp'.
+struct Http2Config {
+  // Offers "h2" with ALPN. Only used in thread-per-connection mode.
+  bool enabled = false;
+  // Streams a client may have open at once.
+  uint32_t max_concurrent_streams = 100;
+  // Receive window of every stream; bounds the request bytes buffered per
+  // stream before they reach the backend.
+  uint32_t initial_window_size = 65535;
+  // Largest decoded header list accepted for a request.
+  uint32_t max_header_list_size = 65536;
+};
+
+// How handlers establish backend connections.
+struct ConnectConfig {
+  // Time a single connect may take before the backend is given up on.
+  std::chrono::milliseconds timeout{3000};
+  // Backends tried per connection, the first pick included. Every backend is
+  // tried at most once.
+  int max_attempts = 3;
+};
+
+// Long-lived state shared by every protocol handler of a server.
+// Built once when the server is created, so per-connection work is limited to
+// the connection itself.
+struct HandlerContext {
+  // Router used for backend selection.
+  std::shared_ptr<core::Router> router;
+  // Receives the outcome of every backend connection attempt.
+  std::shared_ptr<monitor::PassiveMonitor> passive_monitor;
+  // TLS contexts and session state for both legs of a connection.
+  std::shared_ptr<utils::TlsContextManager> tls;
+  // Warm connections to every backend, for handlers that reuse them.
+  std::shared_ptr<ConnectionPoolManager> pools;
+  // I/O buffers borrowed by relays while their connections are busy.
+  std::shared_ptr<utils::BufferPool> buffers;
+  // Limits applied when parsing HTTP messages.
+  HttpParserLimits http_limits;
+  // How HTTP requests are assigned to backends.
+  HttpRouting http_routing = HttpRouting::kPerRequest;
+  // HTTP/2 frontend settings.
+  Http2Config http2;
+  // Connect deadline and failover budget.
+  ConnectConfig connect;
+  // Turns the timings of routed work into rewards.
+  rl::RewardConfig reward;
+};
+
+}  // namespace protocols
+}  // namespace load_balancer
+
+#endif  // LOAD_BALANCER_HANDLER_CONTEXT_H
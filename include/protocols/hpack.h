@@ -0,0 +1,71 @@
+#ifndef LOAD_BALANCER_HPACK_H
+#define LOAD_BALANCER_HPACK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace load_balancer {
+namespace protocols {
+
+// A decoded HTTP/2 header field.
+struct HpackHeader {
+  std::string name;
+  std::string value;
+};
+
+// Decodes HTTP/2 header blocks (RFC 7541).
+// The decoder keeps the dynamic table shared by every header block of a
+// connection, so blocks must be decoded in the order they were received,
+// including those of streams that are ignored.
+class HpackDecoder {
+ public:
+  // 'max_table_size' is the SETTINGS_HEADER_TABLE_SIZE advertised to the
+  // peer; the encoder may not use a larger dynamic table.
+  explicit HpackDecoder(size_t max_table_size = 4096);
+
+  // Decodes a complete header block into 'headers', which is cleared first.
+  // Fails if the block is malformed or the decoded header list exceeds
+  // 'max_list_size' bytes (counted as in SETTINGS_MAX_HEADER_LIST_SIZE).
+  // A failure is a connection error: the dynamic table is out of sync.
+  bool Decode(std::string_view block, size_t max_list_size,
+              std::vector<HpackHeader>& headers);
+
+ private:
+  // Looks up the entry at 'index' of the combined static and dynamic table.
+  bool Lookup(uint64_t index, std::string_view& name,
+              std::string_view& value) const;
+  // Inserts an entry at the front of the dynamic table, evicting as needed.
+  void Insert(HpackHeader header);
+  // Evicts entries until the dynamic table fits in 'size'.
+  void EvictTo(size_t size);
+
+  // Limit announced to the peer.
+  size_t max_table_size_;
+  // Current limit set by the peer with dynamic table size updates.
+  size_t table_size_limit_;
+  // Size of the dynamic table in RFC 7541 terms.
+  size_t table_size_ = 0;
+  // Dynamic table, newest entry first.
+  std::deque<HpackHeader> table_;
+};
+
+// Encodes HTTP/2 header blocks (RFC 7541).
+// Fields are emitted as indexed static entries or as literals that are never
+// added to the dynamic table, so the peer's table stays empty and no table
+// size bookkeeping is needed.
+class HpackEncoder {
+ public:
+  // Appends the representation of one header field to 'block'. 'name' must
+  // be lowercase.
+  void Encode(std::string_view name, std::string_view value,
+              std::string& block) const;
+};
+
+}  // namespace protocols
+}  // namespace load_balancer
+
+#endif  // LOAD_BALANCER_HPACK_H
@@ -0,0 +1,176 @@
+#ifndef LOAD_BALANCER_HTTP2_SESSION_H
+#define LOAD_BALANCER_HTTP2_SESSION_H
+
+#include "protocols/handler_context.h"
+#include "protocols/hpack.h"
+#include "protocols/http_parser.h"
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <openssl/ssl.h>
+#include <poll.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace load_balancer {
+namespace protocols {
+
+// Serves one HTTP/2 client connection (RFC 9113) from a single thread.
+// Every stream is an independent request: it is routed on its own, translated
+// to HTTP/1.1 and sent over a pooled backend connection, and the response is
+// translated back into HEADERS and DATA frames on the stream. Any number of
+// concurrent requests thus share one client TLS session. A stream whose
+// backend has no idle connection opens one without blocking, so a cold pool
+// or a slow backend never stalls the other streams. Flow control is
+// honored in both directions: request bodies are only acknowledged with
+// WINDOW_UPDATE once they were written to the backend, and response bodies
+// are sent within the client's windows, with backend reads paused while a
+// stream's backlog is full. Server push is never used.
+class Http2Session {
+ public:
+  // 'client' must be established, non-blocking and have negotiated "h2".
+  Http2Session(SSL* client, std::shared_ptr<HandlerContext> context);
+  ~Http2Session();
+
+  // This class is not copyable or movable.
+  Http2Session(const Http2Session& other) = delete;
+  Http2Session& operator=(const Http2Session& other) = delete;
+  Http2Session(Http2Session&& other) = delete;
+  Http2Session& operator=(Http2Session&& other) = delete;
+
+  // Serves the connection until the client closes it, a connection error
+  // occurs, or the client sent GOAWAY and every stream finished.
+  void Run();
+
+ private:
+  struct Stream;
+
+  // Reads and processes frames from the client. Returns true on progress.
+  bool ReadClient();
+  // Processes one complete frame. Returns false after a connection error.
+  bool HandleFrame(uint8_t type, uint8_t flags, uint32_t stream_id,
+                   std::string_view payload);
+  bool HandleHeaders(uint8_t flags, uint32_t stream_id,
+                     std::string_view payload);
+  bool HandleContinuation(uint8_t flags, uint32_t stream_id,
+                          std::string_view payload);
+  bool HandleData(uint8_t flags, uint32_t stream_id, std::string_view payload);
+  bool HandleSettings(uint8_t flags, uint32_t stream_id,
+                      std::string_view payload);
+  bool HandleWindowUpdate(uint32_t stream_id, std::string_view payload);
+  // Decodes the complete header block of 'stream' and acts on it.
+  bool CompleteHeaderBlock(Stream& stream);
+  // Translates the request headers of 'stream' into an HTTP/1.1 request
+  // head and connects the stream to a backend.
+  void OpenStream(Stream& stream);
+  // Borrows an idle connection for 'stream', or starts opening one, from
+  // the backends its failover returns, without blocking. Answers 502 once
+  // none is left.
+  void ConnectStream(Stream& stream);
+  // Advances the connection being opened for 'stream', failing over if it
+  // fails. Returns true on progress.
+  bool AdvanceConnect(Stream& stream);
+  // Takes the routing outcome of 'stream' once it has a connection.
+  void ConnectedStream(Stream& stream);
+
+  // Moves request bytes to the backend and response bytes from it. Returns
+  // true on progress.
+  bool PumpStream(Stream& stream);
+  // Feeds response bytes received from the backend to the stream.
+  bool ProcessResponse(Stream& stream, std::string_view data);
+  // Queues the response head parsed on 'stream' as a HEADERS frame.
+  void QueueResponseHead(Stream& stream);
+  // Queues DATA frames within the flow-control windows. Returns true on
+  // progress.
+  bool SendData();
+  // Writes queued frames to the client. Returns true on progress.
+  bool WriteClient();
+
+  // Ends 'stream' after its backend failed: with a 502 response if none was
+  // started yet, otherwise with RST_STREAM.
+  void FailStream(Stream& stream, const char* reason);
+  // Answers 'stream' with an empty response carrying 'status'.
+  void RespondWithError(Stream& stream, std::string_view status);
+  // Ends 'stream' with RST_STREAM carrying 'error_code'.
+  void ResetStream(Stream& stream, uint32_t error_code);
+  // Returns the backend connection of 'stream' to its pool and forgets it.
+  void ReleaseConnection(Stream& stream, bool reusable);
+  // Removes streams that finished.
+  void ReapStreams();
+  // Queues GOAWAY and stops reading; the session ends once it is written.
+  bool ConnectionError(uint32_t error_code, const char* reason);
+
+  // Appends a frame to the output queue.
+  void QueueFrame(uint8_t type, uint8_t flags, uint32_t stream_id,
+                  std::string_view payload);
+  // Appends a header block as HEADERS and CONTINUATION frames.
+  void QueueHeaders(uint32_t stream_id, std::string_view block,
+                    bool end_stream);
+  // Appends a WINDOW_UPDATE frame.
+  void QueueWindowUpdate(uint32_t stream_id, uint32_t increment);
+  // Sleeps until a socket the session waits on becomes ready. Returns false
+  // if there is nothing to wait for.
+  bool Wait();
+
+  // Client TLS connection; owned by the caller.
+  SSL* client_;
+  // State shared by every handler of the server.
+  std::shared_ptr<HandlerContext> context_;
+
+  // Bytes received from the client that do not form a complete frame yet.
+  std::vector<char> input_;
+  size_t input_length_ = 0;
+  // True once the connection preface was received.
+  bool preface_received_ = false;
+  // Frames queued for the client and the number of bytes written.
+  std::string output_;
+  size_t output_sent_ = 0;
+  // Length of a client write that must be retried unchanged, or 0.
+  size_t output_retry_length_ = 0;
+  // SSL errors the last client read and write blocked on, or 0.
+  int read_wait_ = 0;
+  int write_wait_ = 0;
+
+  // Open streams by identifier.
+  std::map<uint32_t, std::unique_ptr<Stream>> streams_;
+  // Highest stream identifier opened by the client.
+  uint32_t last_stream_id_ = 0;
+  // Stream whose header block continues in CONTINUATION frames, or 0.
+  uint32_t continuation_stream_ = 0;
+
+  // Settings announced by the client.
+  uint32_t peer_initial_window_ = 65535;
+  uint32_t peer_max_frame_size_ = 16384;
+  // Remaining connection-level send window.
+  int64_t send_window_ = 65535;
+  // Connection-level DATA bytes received but not yet acknowledged.
+  uint32_t unacknowledged_ = 0;
+
+  // Header compression state of both directions.
+  HpackDecoder decoder_;
+  HpackEncoder encoder_;
+  // Scratch storage reused for every header block.
+  std::vector<HpackHeader> headers_;
+  std::string block_;
+  std::string field_name_;
+
+  // True after the client's EOF, a fatal error, or a GOAWAY was queued.
+  bool closing_ = false;
+  // True once the client connection is unusable.
+  bool client_closed_ = false;
+  // True once the client sent GOAWAY.
+  bool goaway_received_ = false;
+
+  // Buffer for backend reads, shared by all streams.
+  std::array<char, 16384> read_buffer_;
+  // Sockets polled by Wait().
+  std::vector<pollfd> poll_fds_;
+};
+
+}  // namespace protocols
+}  // namespace load_balancer
+
+#endif  // LOAD_BALANCER_HTTP2_SESSION_H
@@ -2,18 +2,23 @@
 #define LOAD_BALANCER_HTTP_HANDLER_H
 
 #include "protocol_handler.h"
+#include "protocols/http_stream.h"
 
-#include <string>
+#include <string_view>
 
 namespace load_balancer {
 namespace protocols {
 
 // Handles HTTP/HTTPS traffic forwarding.
 // This class extends ProtocolHandler to specifically manage HTTP and HTTPS
-// client connections, including TLS handshakes and data proxying.
+// client connections, including TLS handshakes and data proxying. With
+// 'HttpRouting::kPerRequest' every request and response is framed, so each
+// request of a keep-alive connection is routed on its own and the backend
+// connection returns to its pool once the response is delivered. Clients that
+// negotiate "h2" with ALPN are served by an Http2Session instead.
 class HttpHandler : public ProtocolHandler {
  public:
-  HttpHandler(int client_socket, std::shared_ptr<core::Router> router);
+  HttpHandler(int client_socket, std::shared_ptr<HandlerContext> context);
   ~HttpHandler() override;
 
   // Forwards HTTP/HTTPS traffic between client and backend.
@@ -21,12 +26,54 @@ class HttpHandler : public ProtocolHandler {
   // then proxies data bidirectionally.
   void Forward() override;
 
+ protected:
+  const char* Name() const override { return "HTTP"; }
+  bool UsesConnectionPool() const override { return true; }
+
  private:
-  // Reads an incoming HTTP request from the client socket.
-  std::string ReadHttpRequest();
+  // Outcome of forwarding one request and its response.
+  enum class ExchangeResult {
+    // Both messages were delivered; the connections may carry more.
+    kDelivered,
+    // The connection ends without error: the response was delimited by
+    // closing, the protocol was switched, or the response came before the
+    // whole request was sent.
+    kEnded,
+    // A TLS, socket or framing error occurred.
+    kFailed,
+  };
+
+  // Routes the first request and relays the rest of the connection to the
+  // same backend.
+  void ForwardConnection(SSL* ssl_client);
+
+  // Routes every request of the connection separately.
+  void ForwardRequests(SSL* ssl_client);
+
+  // Reads from the client until the head of the next request is complete.
+  // Returns false if the client closed the connection or the request is
+  // malformed, in which case an error response has already been sent.
+  bool ReadHttpRequest(SSL* ssl_client);
+
+  // Forwards the rest of the current request to the backend and its
+  // response to the client, recording the response's progress and the
+  // backend's failures in 'decision'.
+  ExchangeResult ExchangeHttpMessages(SSL* ssl_client, SSL* ssl_backend,
+                                      bool request_was_head,
+                                      RoutingDecision& decision);
+
+  // Relays the rest of the connection opaquely, after flushing every
+  // buffered byte in both directions.
+  void TunnelConnection(SSL* ssl_client, SSL* ssl_backend,
+                        RoutingDecision& decision);
+
+  // Sends a complete error response to the client.
+  void SendErrorResponse(SSL* ssl_client, std::string_view response);
 
-  // Forwards an HTTP request to the selected backend server.
-  void ForwardHttpRequest(const std::string& request, int backend_socket);
+  // Requests received from the client.
+  HttpStream request_stream_;
+  // Responses received from the backend of the current request.
+  HttpStream response_stream_;
 };
 
 }  // namespace protocols
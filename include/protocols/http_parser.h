@@ -0,0 +1,206 @@
+#ifndef LOAD_BALANCER_HTTP_PARSER_H
+#define LOAD_BALANCER_HTTP_PARSER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace load_balancer {
+namespace protocols {
+
+// Limits protecting the parser against oversized or abusive messages.
+struct HttpParserLimits {
+  // Maximum number of header fields in a message head.
+  size_t max_headers = 64;
+  // Maximum size in bytes of a message head, start line included. Also
+  // bounds chunk-size and trailer lines of chunked bodies.
+  size_t max_head_size = 16384;
+};
+
+// A single header field. Views point into the parsed receive buffer.
+struct HttpHeader {
+  std::string_view name;
+  std::string_view value;
+};
+
+// How the end of a message body is determined.
+enum class BodyFraming {
+  // The message has no body.
+  kNone,
+  // The body has exactly 'content_length' bytes.
+  kContentLength,
+  // The body uses chunked transfer coding.
+  kChunked,
+  // The body ends when the connection closes (responses only).
+  kUntilClose,
+};
+
+// A parsed message head.
+// All views point into the receive buffer passed to HttpParser::ParseHead and
+// stay valid as long as the head bytes in that buffer are not moved or
+// modified.
+struct HttpHead {
+  // Request method, e.g. "GET" (requests only).
+  std::string_view method;
+  // Request target, e.g. "/index.html" (requests only).
+  std::string_view target;
+  // Status code (responses only).
+  int status_code = 0;
+  // Reason phrase (responses only).
+  std::string_view reason;
+  // Minor HTTP version: 0 for HTTP/1.0, 1 for HTTP/1.1.
+  int minor_version = 1;
+  // Header fields in order of appearance.
+  std::span<const HttpHeader> headers;
+  // How the body following the head is delimited.
+  BodyFraming framing = BodyFraming::kNone;
+  // Body length for 'BodyFraming::kContentLength'.
+  uint64_t content_length = 0;
+  // True if the connection may carry another message after this one.
+  bool keep_alive = false;
+
+  // Returns the value of the first header named 'name', compared
+  // case-insensitively, or std::nullopt.
+  std::optional<std::string_view> Header(std::string_view name) const;
+};
+
+// Incremental HTTP/1.x message parser.
+// Heads are parsed line by line as bytes arrive; every call resumes where the
+// previous one stopped, so each byte is examined once no matter how the data
+// was split across reads. The parser never copies message data: it records
+// offsets while the head is incomplete and hands out views into the caller's
+// buffer once it is complete. Bodies are not decoded, only delimited, so the
+// caller can forward them verbatim and knows exactly where the next message
+// starts. Header storage is reserved once per parser, so parsing a message
+// allocates nothing.
+class HttpParser {
+ public:
+  // Kind of messages the parser expects.
+  enum class Type { kRequest, kResponse };
+
+  // Result of a parsing step.
+  enum class Status {
+    // More data is needed.
+    kIncomplete,
+    // The head (ParseHead) or the body (ConsumeBody) is complete.
+    kComplete,
+    // The message is malformed or exceeds a limit; see Error().
+    kError,
+  };
+
+  explicit HttpParser(Type type, HttpParserLimits limits = {});
+
+  // Parses the head of the current message. 'buffer' must hold every byte
+  // received for this message so far, starting at its first byte; it may have
+  // been reallocated since the previous call. Once kComplete is returned,
+  // Head() describes the message and HeadSize() bytes of 'buffer' belong to
+  // the head.
+  Status ParseHead(std::string_view buffer);
+
+  // Delimits the body of the current message. 'data' holds bytes that follow
+  // the head or the body bytes consumed by earlier calls. Sets 'consumed' to
+  // the number of leading bytes of 'data' that belong to the body; bytes
+  // beyond it start the next message. Returns kComplete once the body ended.
+  Status ConsumeBody(std::string_view data, size_t& consumed);
+
+  // Like ConsumeBody, but also decodes the body: stops after the first run of
+  // payload bytes in 'data' and sets 'payload' to it, with chunked framing
+  // removed. 'payload' is empty if 'data' only held framing. Callers loop
+  // over the remaining bytes.
+  Status DecodeBody(std::string_view data, size_t& consumed,
+                    std::string_view& payload);
+
+  // Prepares the parser for the next message on the same connection. For
+  // response parsers, 'request_was_head' tells that the matching request used
+  // the HEAD method, so the response carries no body.
+  void Reset(bool request_was_head = false);
+
+  // Accessor methods for the parsing results.
+  const HttpHead& Head() const { return head_; }
+  size_t HeadSize() const { return head_size_; }
+  const char* Error() const { return error_; }
+
+ private:
+  // A byte range of the receive buffer.
+  struct Span {
+    uint32_t offset = 0;
+    uint32_t length = 0;
+  };
+
+  // Header field recorded as byte ranges until the head is complete.
+  struct HeaderSpan {
+    Span name;
+    Span value;
+  };
+
+  // Position inside a chunked body.
+  enum class ChunkState {
+    kSize,
+    kExtension,
+    kSizeLf,
+    kData,
+    kDataCr,
+    kDataLf,
+    kTrailer,
+    kDone,
+  };
+
+  // Parses the start line in 'line', located at 'offset' of the buffer.
+  bool ParseStartLine(std::string_view line, uint32_t offset);
+  // Parses a header field line located at 'offset' of the buffer.
+  bool ParseHeaderLine(std::string_view line, uint32_t offset);
+  // Resolves spans into views and determines the body framing.
+  bool FinishHead(std::string_view buffer);
+  // Advances the chunked body state machine over 'data'. With 'payload',
+  // stops after the first run of chunk data and returns it there.
+  Status ConsumeChunked(std::string_view data, size_t& consumed,
+                        std::string_view* payload);
+  // Records 'error' and returns Status::kError.
+  Status Fail(const char* error);
+
+  // Kind of messages parsed.
+  Type type_;
+  // Limits applied to every message.
+  HttpParserLimits limits_;
+  // True if the matching request was a HEAD request (responses only).
+  bool request_was_head_ = false;
+
+  // Offset where the search for the next line feed resumes.
+  size_t scan_offset_ = 0;
+  // Offset of the first byte of the current line.
+  size_t line_start_ = 0;
+  // True once the start line has been parsed.
+  bool start_line_done_ = false;
+  // Start line components recorded as spans.
+  Span method_;
+  Span target_;
+  Span reason_;
+  // Header fields recorded as spans.
+  std::vector<HeaderSpan> header_spans_;
+  // Header fields as views, valid once the head is complete.
+  std::vector<HttpHeader> headers_;
+  // Size of the complete head in bytes, or 0.
+  size_t head_size_ = 0;
+  // The parsed head.
+  HttpHead head_;
+
+  // Body bytes still expected for the current chunk or Content-Length body.
+  uint64_t body_remaining_ = 0;
+  // Position inside a chunked body.
+  ChunkState chunk_state_ = ChunkState::kSize;
+  // True once a hex digit of the current chunk size was seen.
+  bool chunk_size_digits_ = false;
+  // Length of the current chunk-size or trailer line.
+  size_t chunk_line_length_ = 0;
+
+  // Description of the last error, or nullptr.
+  const char* error_ = nullptr;
+};
+
+}  // namespace protocols
+}  // namespace load_balancer
+
+#endif  // LOAD_BALANCER_HTTP_PARSER_H
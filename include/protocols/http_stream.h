@@ -0,0 +1,117 @@
+#ifndef LOAD_BALANCER_HTTP_STREAM_H
+#define LOAD_BALANCER_HTTP_STREAM_H
+
+#include "protocols/http_parser.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <openssl/ssl.h>
+#include <vector>
+
+namespace load_balancer {
+namespace protocols {
+
+// One direction of HTTP traffic, framed into messages.
+// Bytes are read from a TLS connection into a fixed buffer, delimited with an
+// HttpParser and written verbatim to another connection, one message at a
+// time. Reading stops at the end of the current message, so pipelined bytes
+// of the next message stay buffered until StartMessage is called. Reads and
+// writes never block; SSL_ERROR_WANT_READ and SSL_ERROR_WANT_WRITE are
+// tracked per operation like in Relay.
+class HttpStream {
+ public:
+  // Result of a non-blocking read or write.
+  enum class Result {
+    // Bytes were transferred.
+    kProgress,
+    // Nothing to do, or the operation has to wait for socket readiness.
+    kBlocked,
+    // The peer closed its sending side (reads only).
+    kEof,
+    // A fatal TLS error, or a malformed or oversized message.
+    kFailed,
+  };
+
+  HttpStream(HttpParser::Type type, const HttpParserLimits& limits);
+
+  // This class is not copyable or movable.
+  HttpStream(const HttpStream& other) = delete;
+  HttpStream& operator=(const HttpStream& other) = delete;
+  HttpStream(HttpStream&& other) = delete;
+  HttpStream& operator=(HttpStream&& other) = delete;
+
+  // Begins the next message. Bytes buffered beyond the previous message are
+  // kept and parsed first. 'request_was_head' is passed to HttpParser::Reset.
+  void StartMessage(bool request_was_head = false);
+
+  // Drops every buffered byte and begins the next message.
+  // 'request_was_head' is passed to StartMessage.
+  void Clear(bool request_was_head = false);
+
+  // Reads from 'from' until the buffer is full, the current message is
+  // complete, or the read would block.
+  Result Fill(SSL* from);
+
+  // Writes the buffered bytes of the current message to 'to' until they are
+  // all written or the write would block.
+  Result Flush(SSL* to);
+
+  // Writes every buffered byte, including those beyond the current message,
+  // to 'to'. Used when the connection stops being framed, e.g. after an
+  // upgrade.
+  Result FlushAll(SSL* to);
+
+  // True once the head of the current message was parsed. Head() views are
+  // only valid until the first Flush after that.
+  bool HeadComplete() const { return head_complete_; }
+  const HttpHead& Head() const { return parser_.Head(); }
+  // True once the whole current message was read.
+  bool MessageComplete() const { return message_complete_; }
+  // True once every byte of the current message was written.
+  bool MessageDelivered() const {
+    return message_complete_ && sent_ == framed_;
+  }
+  // True if the buffer holds bytes beyond the current message.
+  bool HasExcessBytes() const { return length_ > framed_; }
+  // Number of bytes of the current message written so far.
+  uint64_t BytesDelivered() const { return delivered_; }
+  // Description of the last framing error, or nullptr.
+  const char* Error() const { return parser_.Error(); }
+
+  // SSL errors the last read and write blocked on, or 0.
+  int ReadWait() const { return read_wait_; }
+  int WriteWait() const { return write_wait_; }
+
+ private:
+  // Feeds unframed buffered bytes to the parser.
+  bool Frame();
+  // Writes buffer bytes up to 'end' to 'to'.
+  Result WriteUpTo(SSL* to, size_t end);
+
+  // Delimits messages in this direction.
+  HttpParser parser_;
+  // Receive buffer; it starts with the current message until its head is
+  // complete, and is reused for body bytes after that.
+  std::vector<char> buffer_;
+  // Number of valid bytes in 'buffer_'.
+  size_t length_ = 0;
+  // Number of leading buffer bytes that belong to the current message.
+  size_t framed_ = 0;
+  // Number of leading buffer bytes written out.
+  size_t sent_ = 0;
+  // Length of a write that must be retried with identical arguments, or 0.
+  size_t retry_length_ = 0;
+  // Bytes of the current message written out, head included.
+  uint64_t delivered_ = 0;
+  // Progress of the current message.
+  bool head_complete_ = false;
+  bool message_complete_ = false;
+  // SSL errors the last read and write blocked on, or 0.
+  int read_wait_ = 0;
+  int write_wait_ = 0;
+};
+
+}  // namespace protocols
+}  // namespace load_balancer
+
+#endif  // LOAD_BALANCER_HTTP_STREAM_H
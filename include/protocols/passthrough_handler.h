@@ -0,0 +1,32 @@
+#ifndef LOAD_BALANCER_PASSTHROUGH_HANDLER_H
+#define LOAD_BALANCER_PASSTHROUGH_HANDLER_H
+
+#include "protocol_handler.h"
+
+namespace load_balancer {
+namespace protocols {
+
+// Handles plain layer 4 forwarding without TLS termination.
+// This class extends ProtocolHandler to forward client connections verbatim
+// to a backend chosen by the router, for services that terminate TLS
+// themselves or speak plain TCP. Bytes are relayed with splice(), so payload
+// never enters userspace.
+class PassthroughHandler : public ProtocolHandler {
+ public:
+  PassthroughHandler(int client_socket,
+                     std::shared_ptr<HandlerContext> context);
+  ~PassthroughHandler() override;
+
+  // Connects to a backend and relays bytes in both directions until both
+  // sides closed the connection.
+  void Forward() override;
+
+ protected:
+  const char* Name() const override { return "Passthrough"; }
+  bool TerminatesTls() const override { return false; }
+};
+
+}  // namespace protocols
+}  // namespace load_balancer
+
+#endif  // LOAD_BALANCER_PASSTHROUGH_HANDLER_H
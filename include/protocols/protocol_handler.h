@@ -1,8 +1,14 @@
 #ifndef LOAD_BALANCER_PROTOCOL_HANDLER_H
 #define LOAD_BALANCER_PROTOCOL_HANDLER_H
 
+#include "core/event_loop.h"
 #include "core/router.h"
+#include "protocols/backend_failover.h"
+#include "protocols/handler_context.h"
+#include "protocols/relay.h"
+#include "protocols/splice_relay.h"
 
+#include <memory>
 #include <openssl/ssl.h>
 
 namespace load_balancer {
@@ -10,26 +16,129 @@ namespace protocols {
 
 // Abstract base class for handling different network protocols.
 // Defines the interface for protocol-specific handlers responsible for
-// forwarding client traffic to backend servers.
-class ProtocolHandler {
+// forwarding client traffic to backend servers. Handlers can either run
+// blocking on a dedicated thread (Forward) or as a non-blocking state machine
+// driven by an event loop (Start).
+class ProtocolHandler : public core::EventHandler,
+                        public std::enable_shared_from_this<ProtocolHandler> {
  public:
-  virtual ~ProtocolHandler() = default;
+  ~ProtocolHandler() override = default;
 
   // Derived classes must implement this to define how client traffic is handled
   // and forwarded according to the specific protocol.
   virtual void Forward() = 0;
 
+  // Starts forwarding on 'loop' without blocking the calling thread.
+  // The handler takes ownership of the client socket, registers its sockets
+  // with the loop and keeps itself alive until the session ends. Connecting,
+  // TLS handshakes and relaying all advance as readiness events arrive. Must
+  // be called on the loop thread.
+  void Start(core::EventLoop* loop);
+
+  // Drives the session state machine on socket readiness.
+  void HandleEvent(int fd, uint32_t events) override;
+
  protected:
-  ProtocolHandler(int client_socket, std::shared_ptr<core::Router> router)
-      : client_socket_(client_socket), router_(std::move(router)) {}
+  ProtocolHandler(int client_socket, std::shared_ptr<HandlerContext> context)
+      : client_socket_(client_socket), context_(std::move(context)),
+        router_(context_->router), failover_(*context_) {}
+
+  // Relays data in both directions between two established TLS connections
+  // on the calling thread until both sides are done or an error occurs, and
+  // records when the first response byte reached the client in 'decision'.
+  void RelayTraffic(SSL* ssl_client, SSL* ssl_backend,
+                    RoutingDecision& decision);
+
+  // Connects a blocking socket to a backend, failing over to other backends
+  // when one refuses or misses the connect deadline. Stores the backend in
+  // 'backend' and returns the socket, or returns -1. The backend counts the
+  // connection as active until the handler is destroyed.
+  int ConnectWithFailover(std::shared_ptr<core::BackendServer>* backend);
+
+  // The pending outcome of the backend ConnectWithFailover connected to.
+  RoutingDecision& Decision() { return failover_.Decision(); }
+
+  // Returns a short protocol name used in log messages.
+  virtual const char* Name() const = 0;
 
-  // Proxies data between two SSL connections.
-  void Proxy(SSL* from, SSL* to);
+  // Returns true if backend connections come from the warm connection pools.
+  virtual bool UsesConnectionPool() const { return false; }
+
+  // Returns true if the handler terminates TLS on both legs. Handlers that
+  // do not relay the raw bytes with a SpliceRelay instead.
+  virtual bool TerminatesTls() const { return true; }
 
   // File descriptor for the client's socket.
   int client_socket_;
+  // State shared by every handler of the server.
+  std::shared_ptr<HandlerContext> context_;
   // Shared pointer to the Router for backend selection.
   std::shared_ptr<core::Router> router_;
+
+ private:
+  // Phases of a non-blocking forwarding session.
+  enum class State {
+    // Waiting for the backend TCP connection to complete.
+    kConnecting,
+    // TLS handshake with the client (load balancer acts as server).
+    kClientHandshake,
+    // TLS handshake with the backend (load balancer acts as client).
+    kBackendHandshake,
+    // Relaying application data in both directions.
+    kRelaying,
+    // Session finished; all resources released.
+    kClosed,
+  };
+
+  // Outcome of a non-blocking step.
+  enum class StepResult { kDone, kBlocked, kFailed };
+
+  // Starts a non-blocking connect to 'backend_', registers the socket and
+  // arms the connect deadline. Returns false on failure.
+  bool ConnectToBackend();
+  // Connects to 'backend_', moving on to the backends the failover picks
+  // next while connects fail right away. Returns false once none is left.
+  bool ConnectToAnyBackend();
+  // Abandons the pending connect to 'backend_' and connects to the next
+  // backend, closing the session once none is left.
+  void RetryConnect(int error);
+  // Closes the backend socket and its TLS connection.
+  void ReleaseBackendSocket();
+  // Starts or restarts the connect deadline.
+  bool ArmConnectTimer();
+  // Stops the connect deadline for good.
+  void CloseConnectTimer();
+  // Advances the state machine until it blocks on I/O or finishes.
+  void Advance();
+  // Runs a non-blocking TLS handshake step on 'ssl'.
+  StepResult Handshake(SSL* ssl);
+  // Releases every resource held by the session and schedules destruction.
+  void Close();
+
+  // Current phase of the non-blocking session.
+  State state_ = State::kConnecting;
+  // The loop driving this session, if started with Start.
+  core::EventLoop* loop_ = nullptr;
+  // Keeps the handler alive while it is registered with 'loop_'.
+  std::shared_ptr<ProtocolHandler> self_;
+  // The backend selected for this session.
+  std::shared_ptr<core::BackendServer> backend_;
+  // Picks the backends to connect to and reports the outcomes.
+  BackendFailover failover_;
+  // File descriptor for the backend's socket.
+  int backend_socket_ = -1;
+  // Timer firing when the pending backend connect missed its deadline.
+  int connect_timer_ = -1;
+  // TLS connections for both legs of the session.
+  SSL* ssl_client_ = nullptr;
+  SSL* ssl_backend_ = nullptr;
+  // Owns the backend socket and TLS connection when they were borrowed from
+  // a connection pool.
+  std::unique_ptr<BackendConnection> pooled_connection_;
+  // Moves data between both legs once the handshakes are done.
+  std::unique_ptr<Relay> relay_;
+  // Moves raw bytes between both sockets when TLS is not terminated.
+  std::unique_ptr<SpliceRelay> splice_relay_;
 };
 
 }  // namespace protocols
@@ -0,0 +1,164 @@
+#ifndef LOAD_BALANCER_RELAY_H
+#define LOAD_BALANCER_RELAY_H
+
+#include "utils/buffer_pool.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <openssl/ssl.h>
+
+namespace load_balancer {
+namespace protocols {
+
+// Moves application data in both directions between two established TLS
+// connections from a single thread.
+// Both sockets must be non-blocking. Each direction has its own bounded
+// buffer: once it is full the relay stops reading from that side until the
+// other side has drained it, so a slow reader pushes back on the sender
+// through TCP flow control instead of growing memory. Buffers come from a
+// BufferPool and adapt to the traffic: a read that fills an empty buffer
+// moves the direction to the next size class, so bulk transfers settle on
+// whole TLS records per call, while a direction that goes idle with nothing
+// buffered hands its buffer back and shrinks its next one if its reads were
+// small. Idle connections hold no buffer memory at all. SSL_ERROR_WANT_READ
+// and SSL_ERROR_WANT_WRITE are tracked per operation, so a TLS read that needs
+// the socket to become writable (or the reverse) waits for the right event.
+// When the kernel decrypts records on the reading side and encrypts them on
+// the writing side (kTLS), a direction moves application data with splice()
+// through a pipe, so payload never enters userspace. Records that carry no
+// application data, like alerts or session tickets, are still handed to
+// OpenSSL.
+class Relay {
+ public:
+  // Result of advancing the relay.
+  enum class Status {
+    // Data may still flow; wait for socket readiness and step again.
+    kActive,
+    // Both sides closed their sending direction and all data was delivered.
+    kFinished,
+    // A fatal TLS or socket error ended the relay.
+    kFailed,
+  };
+
+  // Buffers are borrowed from 'buffers', which must outlive the relay.
+  Relay(SSL* client, SSL* backend, utils::BufferPool& buffers);
+  ~Relay();
+
+  // This class is not copyable or movable.
+  Relay(const Relay& other) = delete;
+  Relay& operator=(const Relay& other) = delete;
+  Relay(Relay&& other) = delete;
+  Relay& operator=(Relay&& other) = delete;
+
+  // Sets the modes non-blocking forwarding relies on: partial and moving
+  // writes, and end of stream on a plain TCP close.
+  static void PrepareConnection(SSL* ssl);
+
+  // Moves as much data as possible in both directions without blocking.
+  Status Step();
+
+  // Runs the relay to completion on the calling thread, sleeping in 'poll'
+  // whenever no direction can make progress.
+  Status Run();
+
+  // Returns the poll events the relay is waiting for on the socket of 'ssl'.
+  short WantedEvents(const SSL* ssl) const;
+
+  // Number of bytes delivered from the client to the backend.
+  uint64_t BytesToBackend() const { return upstream_.bytes_written; }
+  // Number of bytes delivered from the backend to the client.
+  uint64_t BytesToClient() const { return downstream_.bytes_written; }
+  // Steady clock time in nanoseconds of the step that first delivered bytes
+  // to the client, or 0.
+  int64_t FirstByteToClientNs() const { return first_byte_to_client_ns_; }
+
+  // True if the given direction moves data with splice().
+  bool SplicesToBackend() const { return upstream_.pipe_read >= 0; }
+  bool SplicesToClient() const { return downstream_.pipe_read >= 0; }
+
+ private:
+  // State of one relay direction.
+  struct Direction {
+    // Connection data is read from.
+    SSL* from = nullptr;
+    // Connection data is written to.
+    SSL* to = nullptr;
+    // Data read from 'from' that has not been written to 'to' yet. Only held
+    // while the direction is busy.
+    utils::PooledBuffer buffer;
+    // Size of the next buffer taken from the pool.
+    size_t preferred_size = 0;
+    // Largest single read since the buffer was taken.
+    size_t largest_read = 0;
+    // Offset of the first unwritten byte.
+    size_t offset = 0;
+    // Number of valid bytes in the buffer.
+    size_t length = 0;
+    // Length of a write that must be retried with identical arguments, or 0.
+    size_t retry_length = 0;
+    // SSL error the last read blocked on, or 0 when not blocked.
+    int read_wait = 0;
+    // SSL error the last write blocked on, or 0 when not blocked.
+    int write_wait = 0;
+    // True once 'from' closed its sending side.
+    bool eof = false;
+    // True once the closure was propagated to 'to', i.e. SSL_shutdown sent
+    // close_notify.
+    bool shutdown_sent = false;
+    // Total number of bytes written to 'to'.
+    uint64_t bytes_written = 0;
+    // Pipe that spliced data passes through, or -1 without kTLS on both
+    // 'from' (receiving) and 'to' (sending).
+    int pipe_read = -1;
+    int pipe_write = -1;
+    // Capacity of the pipe and the number of bytes in it. Spliced bytes
+    // precede those in 'buffer'.
+    size_t pipe_capacity = 0;
+    size_t pipe_length = 0;
+  };
+
+  // Outcome of a splice() call.
+  enum class SpliceResult {
+    // Bytes were moved.
+    kProgress,
+    // The socket is not ready.
+    kBlocked,
+    // The peer closed its sending side.
+    kEof,
+    // The next record carries no application data and must be read with
+    // OpenSSL.
+    kNotData,
+    // A fatal socket error.
+    kFailed,
+  };
+
+  // Creates the pipe of 'direction' if both of its legs use kTLS.
+  static void SetUpSplice(Direction& direction);
+  // Splices bytes received on 'from' into the pipe.
+  static SpliceResult FillPipe(Direction& direction);
+  // Splices bytes from the pipe to 'to'.
+  static SpliceResult DrainPipe(Direction& direction);
+
+  // Advances one direction until it blocks. Returns false on a fatal error.
+  bool Pump(Direction& direction);
+  // Moves the buffered bytes of 'direction' into a buffer of the next size
+  // class.
+  void GrowBuffer(Direction& direction);
+  // Returns the empty buffer of an idle direction to the pool, halving the
+  // preferred size if reads went into it but none used a quarter of it.
+  void ReleaseBuffer(Direction& direction);
+
+  // Pool the directions' buffers are borrowed from.
+  utils::BufferPool& buffers_;
+  // Client to backend direction.
+  Direction upstream_;
+  // Backend to client direction.
+  Direction downstream_;
+  // See FirstByteToClientNs.
+  int64_t first_byte_to_client_ns_ = 0;
+};
+
+}  // namespace protocols
+}  // namespace load_balancer
+
+#endif  // LOAD_BALANCER_RELAY_H
@@ -0,0 +1,100 @@
+#ifndef LOAD_BALANCER_SPLICE_RELAY_H
+#define LOAD_BALANCER_SPLICE_RELAY_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace load_balancer {
+namespace protocols {
+
+// Moves bytes in both directions between two plain TCP sockets from a single
+// thread without copying them into userspace.
+// Each direction splices from its source socket into a pipe and from the pipe
+// into its destination socket, so payload only moves between kernel buffers.
+// Both sockets must be non-blocking. A full pipe stops reads from that side
+// until the destination drained it, which pushes back on the sender through
+// TCP flow control. A side closing its sending direction is propagated with a
+// half-close, so request/response protocols that rely on it keep working.
+class SpliceRelay {
+ public:
+  // Result of advancing the relay.
+  enum class Status {
+    // Data may still flow; wait for socket readiness and step again.
+    kActive,
+    // Both sides closed their sending direction and all data was delivered.
+    kFinished,
+    // A socket error ended the relay, or its pipes could not be created.
+    kFailed,
+  };
+
+  SpliceRelay(int client_socket, int backend_socket);
+  ~SpliceRelay();
+
+  // This class is not copyable or movable.
+  SpliceRelay(const SpliceRelay& other) = delete;
+  SpliceRelay& operator=(const SpliceRelay& other) = delete;
+  SpliceRelay(SpliceRelay&& other) = delete;
+  SpliceRelay& operator=(SpliceRelay&& other) = delete;
+
+  // Moves as much data as possible in both directions without blocking.
+  Status Step();
+
+  // Runs the relay to completion on the calling thread, sleeping in 'poll'
+  // whenever no direction can make progress.
+  Status Run();
+
+  // Returns the poll events the relay is waiting for on 'socket'.
+  short WantedEvents(int socket) const;
+
+  // Number of bytes delivered from the client to the backend.
+  uint64_t BytesToBackend() const { return upstream_.bytes_written; }
+  // Number of bytes delivered from the backend to the client.
+  uint64_t BytesToClient() const { return downstream_.bytes_written; }
+  // Steady clock time in nanoseconds of the step that first delivered bytes
+  // to the client, or 0.
+  int64_t FirstByteToClientNs() const { return first_byte_to_client_ns_; }
+
+ private:
+  // State of one relay direction.
+  struct Direction {
+    // Socket data is read from.
+    int from = -1;
+    // Socket data is written to.
+    int to = -1;
+    // Pipe the data passes through.
+    int pipe_read = -1;
+    int pipe_write = -1;
+    // Capacity of the pipe and the number of bytes in it.
+    size_t pipe_capacity = 0;
+    size_t pipe_length = 0;
+    // True while the last read or write would have blocked.
+    bool read_blocked = false;
+    bool write_blocked = false;
+    // True once 'from' closed its sending side.
+    bool eof = false;
+    // True once the closure was propagated to 'to'.
+    bool shutdown_sent = false;
+    // Total number of bytes written to 'to'.
+    uint64_t bytes_written = 0;
+  };
+
+  // Creates the pipe of 'direction'. Returns false on failure.
+  static bool OpenPipe(Direction& direction);
+
+  // Advances one direction until it blocks. Returns false on a fatal error.
+  static bool Pump(Direction& direction);
+
+  // Client to backend direction.
+  Direction upstream_;
+  // Backend to client direction.
+  Direction downstream_;
+  // See FirstByteToClientNs.
+  int64_t first_byte_to_client_ns_ = 0;
+  // False if a pipe could not be created.
+  bool valid_;
+};
+
+}  // namespace protocols
+}  // namespace load_balancer
+
+#endif  // LOAD_BALANCER_SPLICE_RELAY_H
@@ -11,13 +11,16 @@ namespace protocols {
 // including TLS handshakes and bidirectional data proxying.
 class TcpHandler : public ProtocolHandler {
  public:
-  TcpHandler(int client_socket, std::shared_ptr<core::Router> router);
+  TcpHandler(int client_socket, std::shared_ptr<HandlerContext> context);
   ~TcpHandler() override;
 
   // Forwards raw TCP traffic between client and backend.
   // This method establishes a connection to a backend, performs TLS handshakes,
   // and then proxies data bidirectionally.
   void Forward() override;
+
+ protected:
+  const char* Name() const override { return "TCP"; }
 };
 
 }  // namespace protocols
@@ -0,0 +1,136 @@
+#ifndef LOAD_BALANCER_URING_PASSTHROUGH_SESSION_H
+#define LOAD_BALANCER_URING_PASSTHROUGH_SESSION_H
+
+#include "core/router.h"
+#include "core/uring_loop.h"
+#include "protocols/backend_failover.h"
+#include "protocols/handler_context.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <linux/time_types.h>
+#include <memory>
+#include <netinet/in.h>
+
+namespace load_balancer {
+namespace protocols {
+
+// Plain layer 4 forwarding of one client driven by a UringLoop.
+// Both sockets live only in the ring's fixed file table. The backend socket
+// is created and connected by the kernel, with a timeout and the first client
+// bytes linked behind the connect so they leave as soon as it completes. A
+// failed or timed out connect moves on to the next backend of the failover
+// budget while the client bytes stay buffered. Each direction
+// then alternates one read into a registered buffer with sends of what was
+// read, and half-closes are propagated with a shutdown. The session destroys
+// itself through the loop once its last operation completed.
+class UringPassthroughSession : public core::CompletionHandler {
+ public:
+  UringPassthroughSession(core::UringLoop* loop, int client_file,
+                          std::shared_ptr<HandlerContext> context);
+  ~UringPassthroughSession() override;
+
+  // Selects a backend and submits the first operations. Must be called on
+  // the loop thread after the session was adopted by the loop.
+  void Start();
+
+  // Advances the session with the result of operation 'op'.
+  void HandleCompletion(uint8_t op, int32_t result, uint32_t flags) override;
+
+ private:
+  // Tags of the session's operations.
+  enum Op : uint8_t {
+    kSocket,
+    kConnect,
+    kConnectTimeout,
+    kUpstreamRead,
+    kUpstreamSend,
+    kDownstreamRead,
+    kDownstreamSend,
+    // Shutdowns and cancellations, whose results are not needed.
+    kControl,
+    kOpCount,
+  };
+
+  // Bytes moving from one socket to the other.
+  struct Direction {
+    // Fixed file slots read from and written to.
+    int from = -1;
+    int to = -1;
+    // Operation tags used for this direction.
+    Op read_op;
+    Op send_op;
+    // Index of the registered buffer, or -1 when 'pooled' is used instead.
+    int buffer = -1;
+    // Buffer holding bytes read but not yet sent, and its size. A pooled
+    // buffer may be smaller than the loop's registered ones.
+    char* data = nullptr;
+    size_t capacity = 0;
+    utils::PooledBuffer pooled;
+    // Bytes held in 'data' and how many of them were already sent.
+    size_t length = 0;
+    size_t offset = 0;
+    // True once the source reached end of stream.
+    bool eof = false;
+    // True once the end of stream was forwarded with a shutdown.
+    bool shutdown = false;
+  };
+
+  // Prepares operation 'op' and counts it as in flight.
+  io_uring_sqe* Submit(Op op);
+  // Creates a socket for 'backend_' in the fixed file table.
+  void OpenBackend();
+  // Connects the backend socket, linking the deadline and a send of buffered
+  // client bytes.
+  void Connect();
+  // Handles a failed connect to 'backend_' by opening the next backend.
+  void OnConnectFailed(int32_t result);
+  // Reads the next chunk of 'direction'.
+  void Read(Direction& direction);
+  // Sends the unsent bytes of 'direction'.
+  void Send(Direction& direction);
+  // Sends buffered bytes or forwards the end of stream, if the destination is
+  // ready and nothing else is in flight for it.
+  void Flush(Direction& direction);
+  // Handles a read completion of 'direction'.
+  void OnRead(Direction& direction, int32_t result);
+  // Handles a send completion of 'direction'.
+  void OnSent(Direction& direction, int32_t result);
+  // Cancels every outstanding operation and starts closing the session.
+  void Fail();
+  // Releases the session's resources once nothing is in flight.
+  void MaybeRelease();
+
+  // The loop driving this session.
+  core::UringLoop* loop_;
+  // State shared by every handler of the server.
+  std::shared_ptr<HandlerContext> context_;
+  // Picks the backends to connect to and reports the outcomes.
+  BackendFailover failover_;
+  // The backend selected for this session.
+  std::shared_ptr<core::BackendServer> backend_;
+  // Address 'connect' reads from while the operation is in flight.
+  sockaddr_in backend_address_{};
+  // Deadline the linked timeout reads while the connect is in flight.
+  __kernel_timespec connect_timeout_{};
+  // Fixed file slots of both sockets.
+  int client_file_;
+  int backend_file_ = -1;
+  // True once the backend connection is established.
+  bool connected_ = false;
+  // True once no further operations are started.
+  bool closing_ = false;
+  // True once the session handed itself back to the loop.
+  bool released_ = false;
+  // Client to backend and backend to client traffic.
+  Direction upstream_;
+  Direction downstream_;
+  // Operations in flight per tag.
+  std::array<uint8_t, kOpCount> in_flight_{};
+};
+
+}  // namespace protocols
+}  // namespace load_balancer
+
+#endif  // LOAD_BALANCER_URING_PASSTHROUGH_SESSION_H
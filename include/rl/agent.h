@@ -0,0 +1,122 @@
+#ifndef LOAD_BALANCER_AGENT_H
+#define LOAD_BALANCER_AGENT_H
+
+#include "core/backend_server.h"
+#include "rl/features.h"
+#include "rl/reward.h"
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+namespace load_balancer {
+namespace rl {
+
+// The outcome of one routing decision, as learned from.
+struct Experience {
+  // The backend routed to.
+  std::shared_ptr<core::BackendServer> backend;
+  // The backend's features when it was picked.
+  FeatureVector features{};
+  // The observed reward.
+  double reward = 0.0;
+  // When the phases of the routed work were reached, and whether it
+  // succeeded.
+  RequestTiming timing;
+  bool success = false;
+  // The replica that made the decision, as returned by
+  // Agent::DecisionReplica when the backend was picked, or -1.
+  int replica = -1;
+};
+
+// A routing policy that learns from the outcome of its decisions.
+// SelectAction is called concurrently by every connection handler and must
+// neither block nor allocate. Update and UpdateBatch may be called
+// concurrently with it; they are meant to run off the request path, on a
+// Trainer's thread.
+class Agent {
+ public:
+  virtual ~Agent() = default;
+
+  // Selects the backend to route a new connection to, never one listed in
+  // 'excluded', such as those a failover already tried. 'backends' is never
+  // empty. 'set_version' is the version of the router's BackendSet when
+  // 'backends' are its routable backends, or 0 for any other list; policies
+  // may cache per-backend state under a nonzero version. Returns an index
+  // into 'backends', or -1 if no backend is both allowed and healthy, which
+  // leaves the choice among the rest to the caller.
+  virtual int SelectAction(
+      const std::vector<std::shared_ptr<core::BackendServer>>& backends,
+      uint64_t set_version,
+      std::span<const std::shared_ptr<core::BackendServer>> excluded) = 0;
+
+  // Returns the replica of a policy that keeps several which decisions on
+  // the calling thread are made by, or -1. Callers record it with the pick,
+  // so the outcome is learned by the replica that decided.
+  virtual int DecisionReplica() const { return -1; }
+
+  // Returns the probability of routing to each of 'backends', for policies
+  // that pick by sampling a distribution, or an empty vector for policies
+  // that decide per request. Called off the request path, whenever the
+  // backend set changes or the policy learned a batch; the router samples
+  // the result in constant time in between and only calls SelectAction
+  // once the samples it draws are all excluded or unhealthy.
+  virtual std::vector<double> ActionProbabilities(
+      const std::vector<std::shared_ptr<core::BackendServer>>& /*backends*/)
+      const {
+    return {};
+  }
+
+  // Learns from 'reward', observed after routing to 'backend' when its
+  // features were 'features'. Higher rewards are better; policies expect
+  // them roughly in [-1, 1].
+  virtual void Update(const core::BackendServer& backend,
+                      const FeatureVector& features, double reward) = 0;
+
+  // Learns from every experience of 'batch'. Policies that publish their
+  // parameters to SelectAction override this to publish once per batch.
+  virtual void UpdateBatch(std::span<const Experience> batch) {
+    for (const Experience& experience : batch)
+      Update(*experience.backend, experience.features, experience.reward);
+  }
+
+  // Returns the number of parameter sets published to SelectAction so far,
+  // or 0 if the policy does not track it.
+  virtual uint64_t PolicyVersion() const { return 0; }
+  // Continues the count PolicyVersion returns from 'version', that of a
+  // checkpoint just loaded. Policies that do not track it ignore it.
+  virtual void RestorePolicyVersion(uint64_t /*version*/) {}
+
+  // Names the layout of the parameters SaveParameters returns, or returns
+  // nullptr if the policy cannot be checkpointed. Checkpoints are only
+  // loaded into agents of the kind that saved them.
+  virtual const char* CheckpointKind() const { return nullptr; }
+  // Returns a consistent copy of everything the policy learned.
+  virtual std::vector<double> SaveParameters() const { return {}; }
+  // Replaces what the policy learned with 'parameters' and publishes it to
+  // SelectAction. Returns false, changing nothing, if they do not fit.
+  virtual bool LoadParameters(std::span<const double> /*parameters*/) {
+    return false;
+  }
+  // Combines the parameters of replicas that each started from 'base' and
+  // learned from different experiences. 'replicas' is never empty and every
+  // set has the size of 'base'. The default averages them, which suits
+  // parameters fitted by gradient steps; policies whose parameters are sums
+  // over experiences add what every replica learned instead.
+  virtual std::vector<double> MergeParameters(
+      std::span<const double> base,
+      std::span<const std::vector<double>> replicas) const {
+    std::vector<double> merged(base.size(), 0.0);
+    for (const std::vector<double>& parameters : replicas) {
+      for (size_t i = 0; i < merged.size(); ++i) merged[i] += parameters[i];
+    }
+    for (double& value : merged) value /= replicas.size();
+    return merged;
+  }
+};
+
+}  // namespace rl
+}  // namespace load_balancer
+
+#endif  // LOAD_BALANCER_AGENT_H
@@ -0,0 +1,66 @@
+#ifndef LOAD_BALANCER_CHECKPOINT_H
+#define LOAD_BALANCER_CHECKPOINT_H
+
+#include "rl/agent.h"
+
+#include <cstdint>
+#include <string>
+
+namespace load_balancer {
+namespace rl {
+
+// Identifies checkpoint files, and their byte order: "LBPOLICY" as read by
+// a little-endian machine.
+inline constexpr uint64_t kCheckpointMagic = 0x5943494c4f50424cULL;
+// Incremented by every incompatible change of the layout below.
+inline constexpr uint32_t kCheckpointFormat = 1;
+
+// The first 256 bytes of a checkpoint file. The file is the header followed
+// by the agent's parameters as doubles, starting at a 64-byte boundary, so a
+// mapped file is used in place: loading validates the header and hands the
+// agent a view of the mapping, with nothing to parse.
+struct alignas(64) CheckpointHeader {
+  uint64_t magic;
+  uint32_t format;
+  uint32_t header_size;
+  // Agent::CheckpointKind of the agent saved, NUL-padded.
+  char kind[32];
+  // Agent::PolicyVersion when saved and the wall-clock time in nanoseconds
+  // since the Unix epoch.
+  uint64_t policy_version;
+  uint64_t saved_unix_ns;
+  // A compatibility stamp of the feature schema the parameters were learned
+  // over: the feature count and the scaling constants of rl/features.h when
+  // saved. They are not statistics of the traffic; a checkpoint is refused
+  // if any differs from this build's, since a model does not carry over to
+  // other features.
+  uint32_t feature_count;
+  uint32_t reserved;
+  double connection_scale;
+  double latency_scale_ms;
+  double max_weight;
+  // Offset and number of the parameters, and the FNV-1a hash of their bytes.
+  uint64_t parameters_offset;
+  uint64_t parameter_count;
+  uint64_t checksum;
+  uint8_t padding[136];
+};
+static_assert(sizeof(CheckpointHeader) == 256, "checkpoint header layout");
+
+// Saves the parameters of 'agent' to 'path' atomically: the checkpoint is
+// written and synced to a temporary file in the same directory, which then
+// replaces 'path' by rename, so readers see the old or the new file, never
+// a partial one. Returns false if the agent cannot be checkpointed or the
+// file cannot be written.
+bool WriteCheckpoint(const std::string& path, const Agent& agent);
+
+// Maps the checkpoint at 'path' and loads it into 'agent', whose policy
+// version then continues from the saved one. Returns false, leaving the
+// agent as it was, if there is no such file or it does not match the agent
+// kind, the feature schema or its checksum.
+bool LoadCheckpoint(const std::string& path, Agent* agent);
+
+}  // namespace rl
+}  // namespace load_balancer
+
+#endif  // LOAD_BALANCER_CHECKPOINT_H
@@ -0,0 +1,64 @@
+#ifndef LOAD_BALANCER_FEATURE_MATRIX_H
+#define LOAD_BALANCER_FEATURE_MATRIX_H
+
+#include "rl/features.h"
+
+#include <cstddef>
+
+namespace load_balancer {
+namespace rl {
+
+// Features of many backends laid out as structure of arrays.
+// Every feature is a contiguous, 64-byte aligned column of floats, so a
+// scoring kernel loads the same feature of 16 backends with one instruction.
+// A penalty column excludes rows from selection. Columns are padded to a
+// multiple of 16 rows; padding rows carry an excluding penalty and never win
+// over a row without one.
+class FeatureMatrix {
+ public:
+  // Rows per SIMD block; columns are padded to a multiple of it.
+  static constexpr size_t kBlockRows = 16;
+  // Penalty of rows that must not be selected. It swamps every score, so
+  // such a row only wins when every row has a penalty, which callers check
+  // for rather than taking the row.
+  static constexpr float kExcluded = -1e30f;
+
+  FeatureMatrix() = default;
+  ~FeatureMatrix();
+
+  // This class is movable but not copyable.
+  FeatureMatrix(const FeatureMatrix& other) = delete;
+  FeatureMatrix& operator=(const FeatureMatrix& other) = delete;
+  FeatureMatrix(FeatureMatrix&& other) noexcept;
+  FeatureMatrix& operator=(FeatureMatrix&& other) noexcept;
+
+  // Sets the number of rows. Existing storage is reused when large enough;
+  // row contents are unspecified afterwards.
+  void Resize(size_t rows);
+  // Stores the features and penalty of 'row'.
+  void Set(size_t row, const FeatureVector& features, float penalty = 0.0f);
+
+  size_t Rows() const { return rows_; }
+  // Rows that fit without reallocating the storage.
+  size_t Capacity() const { return capacity_; }
+  // Rows including padding, a multiple of kBlockRows.
+  size_t PaddedRows() const { return padded_rows_; }
+  const float* Column(Feature feature) const {
+    return data_ + feature * capacity_;
+  }
+  const float* Penalty() const { return data_ + kFeatureCount * capacity_; }
+
+ private:
+  float* MutableColumn(size_t column) { return data_ + column * capacity_; }
+
+  // All columns, followed by the penalty column, 'capacity_' floats apart.
+  float* data_ = nullptr;
+  size_t capacity_ = 0;
+  size_t rows_ = 0;
+  size_t padded_rows_ = 0;
+};
+
+}  // namespace rl
+}  // namespace load_balancer
+
+#endif  // LOAD_BALANCER_FEATURE_MATRIX_H
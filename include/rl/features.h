@@ -0,0 +1,41 @@
+#ifndef LOAD_BALANCER_FEATURES_H
+#define LOAD_BALANCER_FEATURES_H
+
+#include "core/backend_server.h"
+
+#include <array>
+#include <cstddef>
+
+namespace load_balancer {
+namespace rl {
+
+// Positions of the observations an agent decides on. Every feature except
+// the constant bias is scaled to [0, 1) so none dominates a linear model.
+enum Feature : size_t {
+  kBias,
+  kActiveConnections,
+  kLatency,
+  kErrorRate,
+  kWeight,
+  kFeatureCount,
+};
+
+// Values at which the saturating features reach one half, and the weight
+// whose feature is one. Checkpoints record them, since a model learned over
+// one scaling does not apply to another.
+inline constexpr double kConnectionScale = 32.0;
+inline constexpr double kLatencyScaleMs = 50.0;
+inline constexpr double kMaxWeight = 255.0;
+
+// Observations of one backend at the time of a decision.
+using FeatureVector = std::array<double, kFeatureCount>;
+
+// Reads the current features of 'backend' from its FeatureStore slot. Takes
+// a few relaxed loads from one cache line and no locks.
+FeatureVector ExtractFeatures(const core::BackendFeatures& backend);
+FeatureVector ExtractFeatures(const core::BackendServer& backend);
+
+}  // namespace rl
+}  // namespace load_balancer
+
+#endif  // LOAD_BALANCER_FEATURES_H
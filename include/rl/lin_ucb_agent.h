@@ -0,0 +1,206 @@
+#ifndef LOAD_BALANCER_LIN_UCB_AGENT_H
+#define LOAD_BALANCER_LIN_UCB_AGENT_H
+
+#include "rl/agent.h"
+#include "rl/feature_matrix.h"
+#include "rl/scoring_kernel.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <vector>
+
+namespace load_balancer {
+namespace rl {
+
+// Tuning of a LinUcbAgent.
+struct LinUcbConfig {
+  // Weight of the exploration bonus; 0 always picks the best estimate.
+  double alpha = 0.5;
+  // Ridge regularization of the reward model before any update.
+  double regularization = 1.0;
+  // Age after which the cached backend features are read again. Decisions
+  // in between see the same features.
+  std::chrono::microseconds feature_refresh_interval{100};
+  // Temperature of a softmax over the healthy backends' expected rewards,
+  // which the router samples instead of asking for every decision. 0 picks
+  // the highest upper confidence bound per decision.
+  double softmax_temperature = 0.0;
+};
+
+// Contextual bandit routing with a linear upper confidence bound (LinUCB).
+// One ridge regression model maps backend features to expected reward, so
+// backends can be added and removed without per-backend state. Each decision
+// picks the healthy backend with the highest estimate plus an exploration
+// bonus that shrinks as similar feature vectors are observed; ties are
+// broken at random so concurrent decisions do not herd onto one backend.
+//
+// Decisions score a FeatureMatrix with the SIMD kernel rather than walking
+// the backends. The matrix of the router's current backend set is cached
+// under the set's version and rebuilt by one decision once it is older than
+// the refresh interval or the set changes. A published snapshot is never
+// written again: a rebuild fills a spare one, publishes it and retires the
+// previous one through epochs, which hand it back as a spare once no
+// decision can read it anymore. Rebuilds thus only allocate until enough
+// snapshots circulate, or when the set outgrows their storage.
+// Any other list, or an older set still read by a decision, is scored from
+// the per-thread matrix and never replaces the cached one. Excluded backends
+// get a penalty in a per-thread copy of the penalty column, so a failover's
+// decision still scores the cached matrix. Unhealthy and excluded backends
+// are never picked; if no other is left, the decision is left to the caller.
+// Decisions read the model through a sequence lock: they copy the parameters
+// without locking and retry only if an update was published meanwhile.
+// Updates are serialized, add to the design matrix and apply a
+// Sherman-Morrison step to its inverse, so neither side allocates. The
+// writer's copy of the model is a shadow of the published one: a batch is
+// applied to it in full and then published once.
+class LinUcbAgent : public Agent {
+ public:
+  explicit LinUcbAgent(LinUcbConfig config = {});
+  ~LinUcbAgent() override;
+
+  // This class is not copyable or movable.
+  LinUcbAgent(const LinUcbAgent& other) = delete;
+  LinUcbAgent& operator=(const LinUcbAgent& other) = delete;
+  LinUcbAgent(LinUcbAgent&& other) = delete;
+  LinUcbAgent& operator=(LinUcbAgent&& other) = delete;
+
+  int SelectAction(
+      const std::vector<std::shared_ptr<core::BackendServer>>& backends,
+      uint64_t set_version,
+      std::span<const std::shared_ptr<core::BackendServer>> excluded) override;
+
+  void Update(const core::BackendServer& backend,
+              const FeatureVector& features, double reward) override;
+  void UpdateBatch(std::span<const Experience> batch) override;
+
+  // A softmax of the expected rewards if 'softmax_temperature' is positive.
+  // Unhealthy backends get no probability; if none is healthy, the vector
+  // is all zero.
+  std::vector<double> ActionProbabilities(
+      const std::vector<std::shared_ptr<core::BackendServer>>& backends)
+      const override;
+
+  uint64_t PolicyVersion() const override;
+  void RestorePolicyVersion(uint64_t version) override;
+
+  // Checkpoints hold the regularized design matrix followed by the reward
+  // sum; the inverse and the coefficients are computed again when loading.
+  // Loading fails if the matrix is not positive definite.
+  const char* CheckpointKind() const override { return "linucb-design"; }
+  std::vector<double> SaveParameters() const override;
+  bool LoadParameters(std::span<const double> parameters) override;
+  // The design matrix and reward sum are sums over experiences, so replicas
+  // merge into the base plus what every replica added to it.
+  std::vector<double> MergeParameters(
+      std::span<const double> base,
+      std::span<const std::vector<double>> replicas) const override;
+
+ private:
+  // Number of entries of the design matrix and its inverse.
+  static constexpr size_t kMatrixSize = kFeatureCount * kFeatureCount;
+
+  // The model read by decisions.
+  struct Parameters {
+    // Inverse of the regularized design matrix, row-major.
+    std::array<double, kMatrixSize> a_inverse;
+    // Coefficients of the expected reward.
+    std::array<double, kFeatureCount> theta;
+  };
+
+  struct SnapshotPool;
+
+  // Features of the routable backends of one backend set, as read at
+  // 'built_at_ns'. Immutable once published; decisions read it without
+  // locking under an epoch guard.
+  struct FeatureSnapshot {
+    // Version of the backend set the rows were read from, or 0 if none.
+    uint64_t set_version = 0;
+    // When the rows were read, on the steady clock.
+    int64_t built_at_ns = 0;
+    FeatureMatrix matrix;
+    // Takes the snapshot back once it is reclaimed.
+    std::shared_ptr<SnapshotPool> pool;
+  };
+
+  // Snapshots no decision can read anymore, reused by rebuilds. Retired
+  // snapshots keep it alive, as they may be reclaimed after the agent is
+  // gone.
+  struct SnapshotPool {
+    std::mutex mutex;
+    std::vector<FeatureSnapshot*> spares;
+    // Set by the agent's destructor; snapshots reclaimed later are deleted.
+    bool closed = false;
+  };
+
+  // Copies a consistent snapshot of the published parameters.
+  Parameters ReadParameters() const;
+  // Returns the published features of 'backends', the routable backends of
+  // the set with 'set_version', rebuilding them if they are stale and no
+  // other decision is doing so. Returns nullptr if no snapshot of that set
+  // is available or 'set_version' is 0. Must be called under an epoch
+  // guard, which keeps the snapshot alive.
+  const FeatureSnapshot* CurrentFeatures(
+      const std::vector<std::shared_ptr<core::BackendServer>>& backends,
+      uint64_t set_version);
+  // Returns the penalty column of 'matrix', the features of 'backends', or,
+  // if any are 'excluded', a per-thread copy of it that also excludes
+  // their rows.
+  static const float* Penalties(
+      const FeatureMatrix& matrix,
+      const std::vector<std::shared_ptr<core::BackendServer>>& backends,
+      std::span<const std::shared_ptr<core::BackendServer>> excluded);
+  // Returns a spare snapshot, or a new one if there is none.
+  FeatureSnapshot* TakeSnapshot();
+  // Epoch deleter of retired snapshots: hands them back to their pool.
+  static void RecycleSnapshot(const void* retired);
+  // Reads the features of 'backends' from the FeatureStore into 'matrix'.
+  static void FillMatrix(
+      const std::vector<std::shared_ptr<core::BackendServer>>& backends,
+      FeatureMatrix* matrix);
+  // Applies one observation to the design matrix, its inverse and the
+  // reward sum. Must be called with 'update_mutex_' held.
+  void Learn(const FeatureVector& features, double reward);
+  // Recomputes the coefficients of 'parameters_' from the inverse design
+  // matrix and reward sum. Must be called with 'update_mutex_' held.
+  void SolveTheta();
+  // Publishes 'parameters_'. Must be called with 'update_mutex_' held.
+  void PublishParameters();
+
+  // Tuning of the policy.
+  LinUcbConfig config_;
+
+  // Odd while the published parameters are being rewritten.
+  std::atomic<uint64_t> sequence_{0};
+  // Added to the publications counted by 'sequence_' to make up the policy
+  // version, so it continues from a restored checkpoint's.
+  std::atomic<uint64_t> version_offset_{0};
+  // Published parameters: the inverse matrix followed by the coefficients.
+  std::array<std::atomic<double>, kMatrixSize + kFeatureCount> published_;
+
+  // Serializes updates.
+  mutable std::mutex update_mutex_;
+  // The writer's copy of the model.
+  Parameters parameters_;
+  // Regularized design matrix: the regularization plus the outer products
+  // of all observed feature vectors, row-major.
+  std::array<double, kMatrixSize> design_{};
+  // Reward-weighted sum of observed feature vectors.
+  std::array<double, kFeatureCount> reward_sum_{};
+
+  // The snapshot published last, read by decisions under an epoch guard.
+  std::atomic<const FeatureSnapshot*> features_{nullptr};
+  // Held by the decision rebuilding a snapshot.
+  std::mutex refresh_mutex_;
+  // Spare snapshots for rebuilds.
+  std::shared_ptr<SnapshotPool> snapshot_pool_;
+};
+
+}  // namespace rl
+}  // namespace load_balancer
+
+#endif  // LOAD_BALANCER_LIN_UCB_AGENT_H
@@ -0,0 +1,205 @@
+#ifndef LOAD_BALANCER_MLP_H
+#define LOAD_BALANCER_MLP_H
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace load_balancer {
+namespace rl {
+
+// The vector width follows the target the including code is compiled for,
+// and so does the code of every inline member. Each target gets its own
+// inline namespace, so translation units built for different targets
+// instantiate distinct classes rather than two definitions of one; passing
+// a network between them fails to link instead of running the wrong code.
+#if defined(__AVX512F__)
+#define LOAD_BALANCER_MLP_TARGET avx512
+#define LOAD_BALANCER_MLP_LANES 16
+#elif defined(__AVX__)
+#define LOAD_BALANCER_MLP_TARGET avx
+#define LOAD_BALANCER_MLP_LANES 8
+#else
+#define LOAD_BALANCER_MLP_TARGET sse
+#define LOAD_BALANCER_MLP_LANES 4
+#endif
+
+inline namespace LOAD_BALANCER_MLP_TARGET {
+
+// A fully connected network whose layer widths are template parameters, for
+// Q-functions small enough to evaluate on the request path. Mlp<5, 32, 32, 1>
+// maps 5 inputs through two ReLU layers of 32 units to one linear output.
+//
+// All weights and biases live in one 64-byte aligned array inside the
+// object, so evaluating never allocates and swapping architectures is a
+// change of template arguments. Every layer's width is padded to a multiple
+// of 16 floats with zero weights, so each matrix-vector product runs over
+// whole, aligned vectors with a trip count known at compile time and needs
+// no tail handling. The products use GCC vector types as wide as the target
+// the including code is compiled for (SSE, AVX or AVX-512); unlike the
+// scoring kernel there is no runtime dispatch, since every instantiation is
+// compiled into its user, in the namespace of its target. The activation is
+// applied as each layer's accumulators are written out.
+template <size_t... kSizes>
+class Mlp {
+  static_assert(sizeof...(kSizes) >= 2, "Mlp needs inputs and outputs");
+  static_assert(((kSizes > 0) && ...), "Mlp layers must not be empty");
+
+ public:
+  // Number of weight layers.
+  static constexpr size_t kLayerCount = sizeof...(kSizes) - 1;
+  static constexpr size_t kInputs = std::array<size_t, sizeof...(kSizes)>{
+      kSizes...}[0];
+  static constexpr size_t kOutputs = std::array<size_t, sizeof...(kSizes)>{
+      kSizes...}[kLayerCount];
+
+ private:
+  // Floats per vector register of the target the code is compiled for.
+  static constexpr size_t kLanes = LOAD_BALANCER_MLP_LANES;
+  using Vector = float __attribute__((vector_size(kLanes * sizeof(float))));
+
+  // Width of a layer rounded up to whole 64-byte vectors.
+  static constexpr size_t Padded(size_t width) {
+    return (width + 15) / 16 * 16;
+  }
+
+  static constexpr std::array<size_t, sizeof...(kSizes)> kWidths{kSizes...};
+
+  // Layer 'layer' maps kWidths[layer] inputs to kWidths[layer + 1] outputs.
+  // Its weights are stored input-major, one padded row of output weights per
+  // input, followed by its padded biases.
+  static constexpr size_t WeightOffset(size_t layer) {
+    size_t offset = 0;
+    for (size_t i = 0; i < layer; ++i)
+      offset += (kWidths[i] + 1) * Padded(kWidths[i + 1]);
+    return offset;
+  }
+  static constexpr size_t BiasOffset(size_t layer) {
+    return WeightOffset(layer) + kWidths[layer] * Padded(kWidths[layer + 1]);
+  }
+
+  // Widest padded layer output, which sizes the scratch activations.
+  static constexpr size_t MaxPaddedWidth() {
+    size_t width = 0;
+    for (size_t layer = 1; layer < kWidths.size(); ++layer)
+      width = width > Padded(kWidths[layer]) ? width : Padded(kWidths[layer]);
+    return width;
+  }
+
+ public:
+  // Number of floats of weight storage, padding included.
+  static constexpr size_t kParameterCount = WeightOffset(kLayerCount);
+
+  // Starts with every weight and bias zero.
+  Mlp() { parameters_.fill(0.0f); }
+
+  // Computes the outputs for 'input'.
+  std::array<float, kOutputs> Forward(
+      const std::array<float, kInputs>& input) const {
+    std::array<float, kOutputs> output;
+    Forward(input.data(), output.data());
+    return output;
+  }
+
+  // Computes the kOutputs outputs for the kInputs values at 'input'.
+  void Forward(const float* input, float* output) const {
+    alignas(64) float activations[2][MaxPaddedWidth()];
+    RunLayers<0>(input, activations[0], activations[1], output);
+  }
+
+  // The weight from 'input' to 'output' of layer 'layer', and the bias of
+  // 'output'.
+  float& Weight(size_t layer, size_t input, size_t output) {
+    return parameters_[WeightOffset(layer) +
+                       input * Padded(kWidths[layer + 1]) + output];
+  }
+  float& Bias(size_t layer, size_t output) {
+    return parameters_[BiasOffset(layer) + output];
+  }
+
+  // The contiguous weight storage, for loading and saving a whole network.
+  // Padding entries must stay zero.
+  std::span<float, kParameterCount> Parameters() { return parameters_; }
+  std::span<const float, kParameterCount> Parameters() const {
+    return parameters_;
+  }
+
+  // Draws every weight uniformly within the He bound of its layer from a
+  // generator seeded with 'seed', and zeroes the biases and padding.
+  void Initialize(uint64_t seed) {
+    parameters_.fill(0.0f);
+    uint64_t state = seed * 0x9e3779b97f4a7c15ULL | 1;
+    for (size_t layer = 0; layer < kLayerCount; ++layer) {
+      float bound = std::sqrt(6.0f / static_cast<float>(kWidths[layer]));
+      for (size_t input = 0; input < kWidths[layer]; ++input) {
+        for (size_t output = 0; output < kWidths[layer + 1]; ++output) {
+          state ^= state << 13;
+          state ^= state >> 7;
+          state ^= state << 17;
+          float unit = static_cast<float>(state >> 40) / (1u << 24);
+          Weight(layer, input, output) = (2.0f * unit - 1.0f) * bound;
+        }
+      }
+    }
+  }
+
+ private:
+  // Evaluates layers 'kLayer' onwards, alternating between the two scratch
+  // buffers, and writes the network's outputs to 'output'.
+  template <size_t kLayer>
+  void RunLayers(const float* input, float* scratch, float* spare,
+                 float* output) const {
+    constexpr size_t kIn = kWidths[kLayer];
+    constexpr size_t kOut = Padded(kWidths[kLayer + 1]);
+    const float* __restrict weights = parameters_.data() + WeightOffset(kLayer);
+    const float* __restrict bias = parameters_.data() + BiasOffset(kLayer);
+
+    // The accumulators of all outputs stay in registers while the inputs
+    // are streamed through.
+    constexpr size_t kVectors = kOut / kLanes;
+    Vector accumulators[kVectors];
+#pragma GCC unroll 64
+    for (size_t v = 0; v < kVectors; ++v)
+      __builtin_memcpy(&accumulators[v], bias + v * kLanes, sizeof(Vector));
+    for (size_t i = 0; i < kIn; ++i) {
+      const float value = input[i];
+      const float* __restrict row = weights + i * kOut;
+#pragma GCC unroll 64
+      for (size_t v = 0; v < kVectors; ++v) {
+        Vector row_weights;
+        __builtin_memcpy(&row_weights, row + v * kLanes, sizeof(Vector));
+        accumulators[v] += row_weights * value;
+      }
+    }
+
+    if constexpr (kLayer + 1 == kLayerCount) {
+      alignas(64) float sums[kOut];
+      __builtin_memcpy(sums, accumulators, sizeof(sums));
+      for (size_t j = 0; j < kWidths[kLayer + 1]; ++j) output[j] = sums[j];
+    } else {
+      // ReLU on the accumulators as they are stored as the next layer's
+      // input. Padding stays zero since its weights and biases are.
+      const Vector zero = {};
+#pragma GCC unroll 64
+      for (size_t v = 0; v < kVectors; ++v) {
+        Vector activated = accumulators[v] > zero ? accumulators[v] : zero;
+        __builtin_memcpy(scratch + v * kLanes, &activated, sizeof(Vector));
+      }
+      RunLayers<kLayer + 1>(scratch, spare, scratch, output);
+    }
+  }
+
+  alignas(64) std::array<float, kParameterCount> parameters_;
+};
+
+}  // namespace LOAD_BALANCER_MLP_TARGET
+
+#undef LOAD_BALANCER_MLP_LANES
+#undef LOAD_BALANCER_MLP_TARGET
+
+}  // namespace rl
+}  // namespace load_balancer
+
+#endif  // LOAD_BALANCER_MLP_H
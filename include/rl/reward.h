@@ -0,0 +1,55 @@
+#ifndef LOAD_BALANCER_REWARD_H
+#define LOAD_BALANCER_REWARD_H
+
+#include <cstdint>
+
+namespace load_balancer {
+namespace rl {
+
+// When the phases of one routed connection or request were reached, in
+// nanoseconds of the steady clock. Phases not reached are 0.
+struct RequestTiming {
+  // The backend was picked.
+  int64_t picked_ns = 0;
+  // The TCP connection to the backend was established, or a pooled one was
+  // borrowed.
+  int64_t connected_ns = 0;
+  // The TLS handshake with the backend finished.
+  int64_t handshake_ns = 0;
+  // The first byte of the backend's response reached the client.
+  int64_t first_byte_ns = 0;
+  // The request was answered in full.
+  int64_t completed_ns = 0;
+};
+
+// How the phases of a request are turned into a reward in [-1, 1].
+// Each phase reached earns 1 - d / (d + scale) for its duration d, so a
+// phase as slow as its scale earns one half. The reward is the average of
+// the phases reached, weighted by their shares; a phase with a zero share
+// is ignored.
+struct RewardConfig {
+  // Connect: from the pick until the backend accepted.
+  double connect_scale_ms = 50.0;
+  double connect_share = 1.0;
+  // Handshake: from the connect until the backend's TLS handshake finished.
+  double handshake_scale_ms = 100.0;
+  double handshake_share = 1.0;
+  // Time to first byte: from the connect, or the handshake if there was
+  // one, until the response started.
+  double first_byte_scale_ms = 200.0;
+  double first_byte_share = 2.0;
+  // Completion: from the pick until the response was delivered.
+  double completion_scale_ms = 1000.0;
+  double completion_share = 1.0;
+  // Reward of a backend that refused, timed out or failed mid-request.
+  double failure_reward = -1.0;
+};
+
+// Returns the reward of a request timed as 'timing'.
+double ComputeReward(const RequestTiming& timing, bool success,
+                     const RewardConfig& config);
+
+}  // namespace rl
+}  // namespace load_balancer
+
+#endif  // LOAD_BALANCER_REWARD_H
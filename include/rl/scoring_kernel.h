@@ -0,0 +1,46 @@
+#ifndef LOAD_BALANCER_SCORING_KERNEL_H
+#define LOAD_BALANCER_SCORING_KERNEL_H
+
+#include "rl/feature_matrix.h"
+#include "rl/features.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace load_balancer {
+namespace rl {
+
+// Coefficients of a linear upper confidence bound, in the precision the
+// kernels compute in.
+struct UcbWeights {
+  // Expected reward per feature.
+  std::array<float, kFeatureCount> theta{};
+  // Inverse design matrix, row-major and symmetric.
+  std::array<float, kFeatureCount * kFeatureCount> a_inverse{};
+  // Weight of the exploration bonus.
+  float alpha = 0.0f;
+};
+
+// Scores every row of 'matrix' as
+//   theta.x + alpha * sqrt(x' A^-1 x) + penalty + jitter
+// and returns the row with the highest score, in a single pass over the
+// columns. The jitter is below 1e-5 and derived from 'seed', so rows with
+// equal scores win at random across calls. 'matrix' must have rows.
+//
+// The implementation is chosen once per process from the CPU's features:
+// AVX-512, AVX2 with FMA, or portable scalar code.
+size_t ArgmaxUcb(const FeatureMatrix& matrix, const UcbWeights& weights,
+                 uint32_t seed);
+// Like the above, with 'penalty' in place of the matrix's penalty column. It
+// must hold PaddedRows() values and needs no particular alignment.
+size_t ArgmaxUcb(const FeatureMatrix& matrix, const float* penalty,
+                 const UcbWeights& weights, uint32_t seed);
+
+// Returns the name of the implementation ArgmaxUcb dispatches to.
+const char* ScoringKernelName();
+
+}  // namespace rl
+}  // namespace load_balancer
+
+#endif  // LOAD_BALANCER_SCORING_KERNEL_H
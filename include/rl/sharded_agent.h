@@ -0,0 +1,165 @@
+#ifndef LOAD_BALANCER_SHARDED_AGENT_H
+#define LOAD_BALANCER_SHARDED_AGENT_H
+
+#include "rl/agent.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+
+namespace load_balancer {
+namespace rl {
+
+// Tuning of a ShardedAgent.
+struct ShardedAgentConfig {
+  // Number of replicas. Zero uses one per available core.
+  size_t shards = 0;
+  // How often the merger merges the replicas.
+  std::chrono::milliseconds sync_interval{100};
+};
+
+// Counters of a ShardedAgent.
+struct ShardedAgentStats {
+  size_t shards = 0;
+  // Merges that combined diverged replicas so far.
+  uint64_t merges = 0;
+  // Time since the replicas were last known to agree.
+  std::chrono::milliseconds since_merge{0};
+  // Experiences learned by the replicas since the last merge: all of them
+  // and the most any one replica learned.
+  uint64_t pending_updates = 0;
+  uint64_t max_pending_updates = 0;
+  // Largest root mean square distance a replica's parameters moved from the
+  // previous merged state, as of the last merge.
+  double divergence = 0.0;
+};
+
+// Runs one replica of a policy per core, so decisions on different cores
+// share no model state. A decision is made by the replica of the core it
+// runs on, which callers record through DecisionReplica, and its outcome is
+// learned by that replica alone; experiences without a recorded replica
+// are spread over all of them. Every sync interval a merger thread
+// combines the replicas' parameters with Agent::MergeParameters, against
+// the state all of them started from at the previous merge, and loads the
+// result back into all of them. Between merges the replicas drift apart,
+// which the stats report.
+// Merging needs replicas that support SaveParameters and LoadParameters;
+// without, every replica keeps learning on its own. Each replica learns
+// under a lock of its own, so learning for different cores never contends;
+// a merge takes every replica's lock. Decisions never wait for either.
+// The agent exposes no action probabilities, even over replicas that have
+// them: the router would sample one table, built on whichever core
+// refreshed it, in place of the deciding core's replica, and the outcome
+// would be learned by a replica that never decided. Every pick is made by
+// SelectAction.
+class ShardedAgent : public Agent {
+ public:
+  // 'make_replica' is called once per shard.
+  explicit ShardedAgent(std::function<std::unique_ptr<Agent>()> make_replica,
+                        ShardedAgentConfig config = {});
+  ~ShardedAgent() override;
+
+  // This class is not copyable or movable.
+  ShardedAgent(const ShardedAgent& other) = delete;
+  ShardedAgent& operator=(const ShardedAgent& other) = delete;
+  ShardedAgent(ShardedAgent&& other) = delete;
+  ShardedAgent& operator=(ShardedAgent&& other) = delete;
+
+  int SelectAction(
+      const std::vector<std::shared_ptr<core::BackendServer>>& backends,
+      uint64_t set_version,
+      std::span<const std::shared_ptr<core::BackendServer>> excluded) override;
+
+  void Update(const core::BackendServer& backend,
+              const FeatureVector& features, double reward) override;
+  void UpdateBatch(std::span<const Experience> batch) override;
+
+  // The replica of the calling thread's core.
+  int DecisionReplica() const override;
+
+  // The sum of the replicas' versions, continued from a restored
+  // checkpoint's.
+  uint64_t PolicyVersion() const override;
+  void RestorePolicyVersion(uint64_t version) override;
+
+  // Checkpoints hold the replicas merged as at a sync, in their own layout,
+  // so they load into a single replica's agent as well.
+  const char* CheckpointKind() const override;
+  std::vector<double> SaveParameters() const override;
+  bool LoadParameters(std::span<const double> parameters) override;
+
+  // Merges the replicas now rather than at the next sync.
+  void Merge();
+
+  ShardedAgentStats Stats() const;
+
+ private:
+  // A replica and the experiences it learned since the last merge, on a
+  // cache line of its own.
+  struct alignas(64) Shard {
+    std::unique_ptr<Agent> agent;
+    std::atomic<uint64_t> pending{0};
+    // Serializes the replica's learning with merges.
+    std::mutex mutex;
+    // The replica's share of the batch being learned, reused across
+    // batches. Guarded by 'mutex'.
+    std::vector<Experience> batch;
+  };
+
+  // Returns the index of the shard of the calling thread's core.
+  size_t CurrentShardIndex() const;
+  Shard& CurrentShard() const { return shards_[CurrentShardIndex()]; }
+  // Locks every shard, in order, for as long as the returned locks live.
+  std::vector<std::unique_lock<std::mutex>> LockShards() const;
+  // Merges the replicas. Must be called with every shard locked.
+  void MergeLocked();
+  // Returns the replicas' parameters merged against 'base_', and stores
+  // every replica's own in 'replicas'. Returns an empty vector if they do
+  // not fit together. Must be called with every shard locked.
+  std::vector<double> MergedParametersLocked(
+      std::vector<std::vector<double>>* replicas) const;
+  // The main loop of the merger thread.
+  void MergeLoop();
+
+  ShardedAgentConfig config_;
+  // One replica per shard.
+  std::unique_ptr<Shard[]> shards_;
+  size_t shard_count_ = 0;
+  // True if there are several replicas and they can be merged.
+  bool mergeable_ = false;
+
+  // Replica the next experience without a recorded one is learned by.
+  std::atomic<size_t> next_shard_{0};
+  // Parameters every replica was loaded with at the last merge. Guarded by
+  // every shard's lock.
+  std::vector<double> base_;
+
+  // Added to the replicas' versions so the policy version continues from a
+  // restored checkpoint's.
+  std::atomic<uint64_t> version_offset_{0};
+
+  std::atomic<uint64_t> merges_{0};
+  std::atomic<int64_t> merged_at_ns_{0};
+  std::atomic<double> divergence_{0.0};
+
+  // Atomic flag to control the running state of the merger thread.
+  std::atomic<bool> running_{false};
+  // The thread that merges the replicas.
+  std::thread merger_thread_;
+  // Wakes the merger thread early when stopping.
+  std::condition_variable stop_cv_;
+  // Mutex used with 'stop_cv_'.
+  std::mutex stop_mutex_;
+};
+
+}  // namespace rl
+}  // namespace load_balancer
+
+#endif  // LOAD_BALANCER_SHARDED_AGENT_H
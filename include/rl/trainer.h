@@ -0,0 +1,128 @@
+#ifndef LOAD_BALANCER_TRAINER_H
+#define LOAD_BALANCER_TRAINER_H
+
+#include "rl/agent.h"
+#include "utils/mpsc_ring.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+
+namespace load_balancer {
+namespace rl {
+
+// Limits and timings of a Trainer.
+struct TrainerConfig {
+  // Experiences buffered between the request path and the trainer thread.
+  // Rounded up to a power of two.
+  size_t queue_capacity = 4096;
+  // Most experiences applied to the agent in one update.
+  size_t batch_size = 256;
+  // How long the trainer thread sleeps when no experience is waiting.
+  std::chrono::milliseconds idle_interval{1};
+  // Called on the trainer thread with every batch after the agent learned
+  // from it, for bookkeeping such as metrics. May be empty.
+  std::function<void(std::span<const Experience>)> observer;
+  // File the agent is checkpointed to, or empty for none. A checkpoint
+  // found there is loaded when the trainer starts, so routing resumes with
+  // the last learned policy. A new one is written by the trainer thread
+  // once the policy changed and 'checkpoint_interval' passed since the last,
+  // and when the trainer stops.
+  std::string checkpoint_path;
+  std::chrono::milliseconds checkpoint_interval{10000};
+};
+
+// Counters of a Trainer.
+struct TrainerStats {
+  // Experiences accepted and dropped because the queue was full.
+  uint64_t submitted = 0;
+  uint64_t dropped = 0;
+  // Experiences applied to the agent, and the batches they came in.
+  uint64_t trained = 0;
+  uint64_t batches = 0;
+  // The agent's policy version after the last batch.
+  uint64_t policy_version = 0;
+  // Checkpoints written, and the policy version of the last one.
+  uint64_t checkpoints = 0;
+  uint64_t checkpoint_version = 0;
+};
+
+// Moves learning off the request path. Handlers submit experiences to a
+// lock-free ring; a dedicated thread drains it in batches and hands each
+// batch to the agent, which updates its shadow of the policy and publishes
+// it to SelectAction. Submitting never blocks: when the trainer falls
+// behind, new experiences are dropped and counted.
+class Trainer {
+ public:
+  // 'agent' may be null to only pass batches to the observer.
+  explicit Trainer(std::shared_ptr<Agent> agent, TrainerConfig config = {});
+  ~Trainer();
+
+  // This class is not copyable or movable.
+  Trainer(const Trainer& other) = delete;
+  Trainer& operator=(const Trainer& other) = delete;
+  Trainer(Trainer&& other) = delete;
+  Trainer& operator=(Trainer&& other) = delete;
+
+  // Loads the checkpoint, if configured and present, and starts the trainer
+  // thread.
+  void Start();
+  // Stops the trainer thread after applying the experiences already queued
+  // and checkpointing the result.
+  void Stop();
+
+  // Queues 'experience' for training. Returns false if it was dropped.
+  bool Submit(Experience experience);
+
+  TrainerStats Stats() const;
+
+ private:
+  // The main loop of the trainer thread.
+  void TrainLoop();
+  // Applies up to one batch of queued experiences. Returns the number
+  // applied.
+  size_t TrainBatch();
+  // Writes a checkpoint if the policy changed since the last one and, unless
+  // 'force' is set, the checkpoint interval passed.
+  void MaybeCheckpoint(bool force);
+
+  // The agent trained.
+  std::shared_ptr<Agent> agent_;
+  // Limits and timings.
+  TrainerConfig config_;
+  // Experiences waiting for the trainer thread.
+  utils::MpscRing<Experience> queue_;
+  // The batch being applied, reused across batches.
+  std::vector<Experience> batch_;
+
+  std::atomic<uint64_t> submitted_{0};
+  std::atomic<uint64_t> dropped_{0};
+  std::atomic<uint64_t> trained_{0};
+  std::atomic<uint64_t> batches_{0};
+  std::atomic<uint64_t> checkpoints_{0};
+  std::atomic<uint64_t> checkpoint_version_{0};
+  // When the last checkpoint was written or loaded. Only used by the
+  // trainer thread once started.
+  std::chrono::steady_clock::time_point checkpointed_at_;
+
+  // Atomic flag to control the running state of the trainer thread.
+  std::atomic<bool> running_{false};
+  // The thread that runs the training loop.
+  std::thread trainer_thread_;
+  // Wakes the trainer thread early when stopping.
+  std::condition_variable stop_cv_;
+  // Mutex used with 'stop_cv_'.
+  std::mutex stop_mutex_;
+};
+
+}  // namespace rl
+}  // namespace load_balancer
+
+#endif  // LOAD_BALANCER_TRAINER_H
@@ -0,0 +1,141 @@
+#ifndef LOAD_BALANCER_SIMULATOR_H
+#define LOAD_BALANCER_SIMULATOR_H
+
+#include "rl/agent.h"
+#include "rl/reward.h"
+#include "sim/trace.h"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace load_balancer {
+namespace sim {
+
+// Distribution of the time a backend spends serving one request.
+enum class ServiceDistribution {
+  // Always the mean.
+  kConstant,
+  // Exponential with the given mean.
+  kExponential,
+  // Log-normal with the given mean and 'shape' as the standard deviation of
+  // the underlying normal.
+  kLogNormal,
+  // Pareto with the given mean and 'shape' as the tail index, which must
+  // exceed one. Heavy-tailed for indices close to one.
+  kPareto,
+};
+
+// A window of time in which a backend misbehaves.
+struct Fault {
+  // Start and end of the window in nanoseconds since the start of the trace.
+  int64_t start_ns = 0;
+  int64_t end_ns = 0;
+  // Multiplies connect and service times.
+  double slowdown = 1.0;
+  // Refuses every connect.
+  bool down = false;
+};
+
+// How a simulated backend serves requests.
+struct BackendModel {
+  // Weight the backend is registered with.
+  int weight = 1;
+  // Requests served at once. Requests beyond it wait in a FIFO queue.
+  int capacity = 8;
+  // Most requests waiting; connects beyond it are refused.
+  int queue_limit = 1024;
+  // Time from the pick until the backend accepts, in milliseconds.
+  double connect_ms = 0.5;
+  // Service time of a request of unit work.
+  ServiceDistribution distribution = ServiceDistribution::kExponential;
+  double mean_service_ms = 10.0;
+  double shape = 1.0;
+  // Probability that a served request fails instead of answering.
+  double failure_probability = 0.0;
+  // Windows in which the backend slows down or refuses connects.
+  std::vector<Fault> faults;
+};
+
+// One run of a policy against a set of backends and an arrival trace.
+struct Scenario {
+  // Labels of the run in reports.
+  std::string name;
+  std::string policy;
+  // Creates the agent routed with, or is empty to route by weight alone.
+  // Called once per run, on the thread that runs it.
+  std::function<std::shared_ptr<rl::Agent>()> make_agent;
+  std::vector<BackendModel> backends;
+  // Requests replayed; shared between scenarios that use the same trace.
+  std::shared_ptr<const std::vector<Arrival>> arrivals;
+  // Turns request timings into rewards, as in the server.
+  rl::RewardConfig reward;
+  // Backends tried per request, the first pick included.
+  int max_attempts = 3;
+  // Experiences the agent learns from at once, as its trainer would batch
+  // them.
+  size_t batch_size = 256;
+  // Seed of the service times and failures.
+  uint64_t seed = 1;
+};
+
+// What one backend did during a run.
+struct BackendResult {
+  // Requests routed to the backend, failed ones included.
+  uint64_t requests = 0;
+  uint64_t failures = 0;
+  // Fraction of the backend's capacity busy over the run.
+  double utilization = 0.0;
+};
+
+// What a run measured.
+struct ScenarioResult {
+  std::string name;
+  std::string policy;
+  // Requests answered and requests that failed on every backend tried.
+  uint64_t completed = 0;
+  uint64_t failed = 0;
+  // Connects retried on another backend.
+  uint64_t retries = 0;
+  // Latency from arrival until the response, in milliseconds, over the
+  // answered requests.
+  double mean_ms = 0.0;
+  double p50_ms = 0.0;
+  double p90_ms = 0.0;
+  double p99_ms = 0.0;
+  double p999_ms = 0.0;
+  double max_ms = 0.0;
+  // Mean reward the agent learned from.
+  double mean_reward = 0.0;
+  std::vector<BackendResult> backends;
+  // Simulated and wall-clock length of the run.
+  double simulated_seconds = 0.0;
+  double wall_seconds = 0.0;
+};
+
+// Replays the arrivals of 'scenario' against its backend models in
+// simulated time, routing every request with a core::Router over the
+// scenario's agent. The router, its backends' FeatureStore slots and the
+// agent are the production code; only the network and the backends are
+// modeled. Each request is picked, connects after the backend's connect
+// time, fails over like BackendFailover when a backend refuses, then waits
+// for a free unit of the backend's capacity and is served. Connect outcomes
+// feed the backends' moving averages, active connections count in flight
+// while a request is at a backend, and every outcome is turned into a
+// reward by rl::ComputeReward and learned from in batches on the calling
+// thread. Runs are deterministic given the scenario, apart from the
+// agent's own randomness.
+ScenarioResult Simulate(const Scenario& scenario);
+
+// Runs every scenario of 'scenarios' on a pool of 'threads' threads, zero
+// meaning one per core, and returns their results in the same order.
+std::vector<ScenarioResult> SimulateAll(std::span<const Scenario> scenarios,
+                                        int threads = 0);
+
+}  // namespace sim
+}  // namespace load_balancer
+
+#endif  // LOAD_BALANCER_SIMULATOR_H
@@ -0,0 +1,50 @@
+#ifndef LOAD_BALANCER_TRACE_H
+#define LOAD_BALANCER_TRACE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace load_balancer {
+namespace sim {
+
+// One request of an arrival trace.
+struct Arrival {
+  // Time of arrival in nanoseconds since the start of the trace.
+  int64_t at_ns = 0;
+  // Multiplies the service time drawn for the request, for traces that
+  // record how expensive each request was.
+  float work = 1.0f;
+};
+
+// Shape of a synthetic arrival trace.
+struct TraceConfig {
+  // Number of requests generated.
+  uint64_t requests = 1000000;
+  // Mean arrival rate in requests per second.
+  double rate = 10000.0;
+  // Arrivals alternate between bursts at 'burst_factor' times the rate and
+  // quiet phases at the rate divided by it. Phase lengths are exponentially
+  // distributed so that the mean rate stays 'rate' and a burst and the quiet
+  // phase after it last 'burst_period_ms' on average. A factor of one
+  // generates a plain Poisson process.
+  double burst_factor = 1.0;
+  double burst_period_ms = 100.0;
+  // Seed of the generator; equal configs generate equal traces.
+  uint64_t seed = 1;
+};
+
+// Generates the arrivals described by 'config'.
+std::vector<Arrival> GenerateTrace(const TraceConfig& config);
+
+// Reads a recorded trace from 'path': one request per line, its arrival in
+// microseconds since any fixed origin and optionally its work multiplier,
+// separated by whitespace. Empty lines and lines starting with '#' are
+// skipped. Arrivals are sorted and shifted to start at zero. Returns false
+// if the file cannot be read or a line is malformed.
+bool LoadTrace(const std::string& path, std::vector<Arrival>* arrivals);
+
+}  // namespace sim
+}  // namespace load_balancer
+
+#endif  // LOAD_BALANCER_TRACE_H
@@ -0,0 +1,48 @@
+#ifndef LOAD_BALANCER_ALIAS_TABLE_H
+#define LOAD_BALANCER_ALIAS_TABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace load_balancer {
+namespace utils {
+
+// Samples indices in proportion to fixed weights in constant time, using
+// Vose's alias method. Building is linear in the number of weights; each
+// sample then reads a single entry, chosen uniformly, whose integer
+// threshold decides between the entry's own index and its alias. Tables
+// are immutable once built, so readers may share one without locking.
+class AliasTable {
+ public:
+  // An empty table.
+  AliasTable() = default;
+  // Builds a table for 'weights'. Negative weights count as zero; if no
+  // weight is positive the table is empty.
+  explicit AliasTable(std::span<const double> weights);
+
+  // Returns an index with probability proportional to its weight, using the
+  // 64 bits of 'random'. The table must not be empty.
+  size_t Sample(uint64_t random) const;
+  // Like Sample(uint64_t), drawing from a per-thread generator.
+  size_t Sample() const;
+
+  bool Empty() const { return entries_.empty(); }
+  size_t Size() const { return entries_.size(); }
+
+ private:
+  struct Entry {
+    // The entry's own index is kept if the low 32 random bits are below
+    // 'threshold'; 2^32 - 1 keeps it almost always.
+    uint32_t threshold;
+    uint32_t alias;
+  };
+
+  std::vector<Entry> entries_;
+};
+
+}  // namespace utils
+}  // namespace load_balancer
+
+#endif  // LOAD_BALANCER_ALIAS_TABLE_H
@@ -0,0 +1,144 @@
+#ifndef LOAD_BALANCER_BUFFER_POOL_H
+#define LOAD_BALANCER_BUFFER_POOL_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace load_balancer {
+namespace utils {
+
+class BufferPool;
+
+// Limits of a BufferPool.
+struct BufferPoolConfig {
+  // Size of the smallest buffer handed out. Sizes double from here up to
+  // 'max_buffer_size'.
+  size_t min_buffer_size = 4096;
+  // Size of the largest buffer handed out, which bounds the memory a single
+  // connection direction can hold.
+  size_t max_buffer_size = 65536;
+  // Total bytes kept in free lists for reuse; buffers released beyond it are
+  // returned to the system.
+  size_t max_cached_bytes = 32 * 1024 * 1024;
+};
+
+// Memory accounting of a BufferPool.
+struct BufferPoolStats {
+  // Buffers held by connections and their total size.
+  size_t buffers_in_use = 0;
+  size_t bytes_in_use = 0;
+  // Highest 'bytes_in_use' observed.
+  size_t peak_bytes_in_use = 0;
+  // Bytes kept in free lists.
+  size_t bytes_cached = 0;
+  // Buffers obtained from the system and served from the free lists.
+  uint64_t allocations = 0;
+  uint64_t reuses = 0;
+};
+
+// A buffer borrowed from a BufferPool and returned when reset or destroyed.
+class PooledBuffer {
+ public:
+  PooledBuffer() = default;
+  ~PooledBuffer() { Reset(); }
+
+  // This class is movable but not copyable.
+  PooledBuffer(const PooledBuffer& other) = delete;
+  PooledBuffer& operator=(const PooledBuffer& other) = delete;
+  PooledBuffer(PooledBuffer&& other) noexcept;
+  PooledBuffer& operator=(PooledBuffer&& other) noexcept;
+
+  // Returns the buffer to its pool.
+  void Reset();
+
+  char* Data() const { return data_; }
+  size_t Size() const { return size_; }
+  explicit operator bool() const { return data_ != nullptr; }
+
+ private:
+  friend class BufferPool;
+  PooledBuffer(BufferPool* pool, char* data, size_t size)
+      : pool_(pool), data_(data), size_(size) {}
+
+  // Pool the buffer is returned to.
+  BufferPool* pool_ = nullptr;
+  // The buffer memory and its size.
+  char* data_ = nullptr;
+  size_t size_ = 0;
+};
+
+// Size-classed pool of per-connection I/O buffers.
+// Buffers come in power-of-two sizes between the configured bounds and are
+// cache-line aligned. Released buffers are kept in free lists sharded by the
+// CPU the caller runs on, so connections served by different threads rarely
+// share a lock, and are reused before new memory is requested. The free
+// lists are capped, which bounds the memory kept around after a traffic
+// peak. Every operation is thread-safe and the accounting is lock-free.
+class BufferPool {
+ public:
+  explicit BufferPool(BufferPoolConfig config = {});
+  ~BufferPool();
+
+  // This class is not copyable or movable.
+  BufferPool(const BufferPool& other) = delete;
+  BufferPool& operator=(const BufferPool& other) = delete;
+  BufferPool(BufferPool&& other) = delete;
+  BufferPool& operator=(BufferPool&& other) = delete;
+
+  // Returns a buffer of at least 'size' bytes, rounded up to a size class
+  // and clamped to the largest one.
+  PooledBuffer Acquire(size_t size);
+
+  // Returns the size class following 'size', or 'size' if it is the largest.
+  size_t NextSize(size_t size) const;
+
+  size_t MinBufferSize() const { return config_.min_buffer_size; }
+  size_t MaxBufferSize() const { return config_.max_buffer_size; }
+
+  // Returns a snapshot of the memory accounting.
+  BufferPoolStats Stats() const;
+
+ private:
+  friend class PooledBuffer;
+
+  // Number of free list shards.
+  static constexpr size_t kShards = 16;
+  // Maximum number of size classes.
+  static constexpr size_t kMaxClasses = 16;
+
+  // Free lists of one shard, one per size class.
+  struct alignas(64) Shard {
+    std::mutex mutex;
+    std::array<std::vector<char*>, kMaxClasses> free_lists;
+  };
+
+  // Takes back a buffer released by a PooledBuffer.
+  void Release(char* data, size_t size);
+  // Returns the size class index of 'size', which must be a class size.
+  size_t ClassOf(size_t size) const;
+  // Returns the shard of the calling thread.
+  Shard& LocalShard();
+
+  // Limits of the pool.
+  BufferPoolConfig config_;
+  // Number of size classes in use.
+  size_t classes_;
+  // Free lists sharded by CPU.
+  std::array<Shard, kShards> shards_;
+  // Memory accounting.
+  std::atomic<size_t> buffers_in_use_{0};
+  std::atomic<size_t> bytes_in_use_{0};
+  std::atomic<size_t> peak_bytes_in_use_{0};
+  std::atomic<size_t> bytes_cached_{0};
+  std::atomic<uint64_t> allocations_{0};
+  std::atomic<uint64_t> reuses_{0};
+};
+
+}  // namespace utils
+}  // namespace load_balancer
+
+#endif  // LOAD_BALANCER_BUFFER_POOL_H
@@ -0,0 +1,61 @@
+#ifndef LOAD_BALANCER_EPOCH_H
+#define LOAD_BALANCER_EPOCH_H
+
+#include <cstddef>
+
+namespace load_balancer {
+namespace utils {
+
+// Epoch-based reclamation of objects shared with lock-free readers.
+// Readers access shared objects only inside an EpochGuard, which announces
+// the current epoch in a per-thread record without locking or writing to
+// shared cache lines. A writer that unpublished an object retires it, which
+// advances the epoch; the object is deleted once every reader that entered
+// before it was retired has left. Thread records are created on a thread's
+// first guard and reused after the thread exits.
+class Epoch {
+ public:
+  // Deletes 'object' once no reader can still hold it. The object must
+  // already be unreachable for new readers.
+  template <typename T>
+  static void Retire(const T* object) {
+    Retire(object, [](const void* retired) {
+      delete static_cast<const T*>(retired);
+    });
+  }
+
+  // Calls 'deleter' with 'object' once no reader can still hold it, for
+  // objects that are recycled rather than deleted.
+  static void Retire(const void* object, void (*deleter)(const void*));
+
+  // Deletes every retired object no reader can still hold. Returns the
+  // number of objects still waiting.
+  static size_t Reclaim();
+
+ private:
+  friend class EpochGuard;
+
+  // Marks the calling thread as reading. Nested calls are counted.
+  static void Enter();
+  static void Leave();
+};
+
+// Keeps objects read by the calling thread alive for the guard's lifetime.
+// Guards nest and must not be held across blocking operations, as they delay
+// the reclamation of everything retired meanwhile.
+class EpochGuard {
+ public:
+  EpochGuard() { Epoch::Enter(); }
+  ~EpochGuard() { Epoch::Leave(); }
+
+  // This class is not copyable or movable.
+  EpochGuard(const EpochGuard& other) = delete;
+  EpochGuard& operator=(const EpochGuard& other) = delete;
+  EpochGuard(EpochGuard&& other) = delete;
+  EpochGuard& operator=(EpochGuard&& other) = delete;
+};
+
+}  // namespace utils
+}  // namespace load_balancer
+
+#endif  // LOAD_BALANCER_EPOCH_H
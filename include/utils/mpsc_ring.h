@@ -0,0 +1,98 @@
+#ifndef LOAD_BALANCER_MPSC_RING_H
+#define LOAD_BALANCER_MPSC_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+namespace load_balancer {
+namespace utils {
+
+// A bounded queue with any number of producers and a single consumer,
+// neither of which blocks or allocates. Each slot carries a sequence number
+// telling whose turn it is: producers claim a position with a compare and
+// swap on the tail and publish the slot by advancing its sequence, so a
+// producer preempted between the two only delays the consumer at that slot.
+// A push into a full ring fails instead of waiting.
+template <typename T>
+class MpscRing {
+ public:
+  // 'capacity' is rounded up to a power of two.
+  explicit MpscRing(size_t capacity) {
+    size_t size = 2;
+    while (size < capacity) size <<= 1;
+    mask_ = size - 1;
+    slots_ = std::make_unique<Slot[]>(size);
+    for (size_t i = 0; i < size; ++i)
+      slots_[i].sequence.store(i, std::memory_order_relaxed);
+  }
+
+  // This class is not copyable or movable.
+  MpscRing(const MpscRing& other) = delete;
+  MpscRing& operator=(const MpscRing& other) = delete;
+  MpscRing(MpscRing&& other) = delete;
+  MpscRing& operator=(MpscRing&& other) = delete;
+
+  // Appends 'value'. Returns false, leaving 'value' untouched, if the ring
+  // is full. Safe to call from any thread.
+  bool TryPush(T&& value) {
+    uint64_t position = tail_.load(std::memory_order_relaxed);
+    while (true) {
+      Slot& slot = slots_[position & mask_];
+      uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+      auto lag = static_cast<int64_t>(sequence - position);
+      if (lag == 0) {
+        if (tail_.compare_exchange_weak(position, position + 1,
+                                        std::memory_order_relaxed)) {
+          slot.value = std::move(value);
+          slot.sequence.store(position + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (lag < 0) {
+        // The consumer has not freed this slot since the last lap.
+        return false;
+      } else {
+        position = tail_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // Moves the oldest value into 'value'. Returns false if the ring is empty
+  // or its oldest value is still being written. Must only be called from
+  // the consumer thread.
+  bool TryPop(T* value) {
+    Slot& slot = slots_[head_ & mask_];
+    uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+    if (sequence != head_ + 1) return false;
+    *value = std::move(slot.value);
+    slot.value = T();
+    slot.sequence.store(head_ + mask_ + 1, std::memory_order_release);
+    ++head_;
+    return true;
+  }
+
+  size_t Capacity() const { return mask_ + 1; }
+
+ private:
+  struct alignas(64) Slot {
+    // Equals the position for a free slot and the position plus one for a
+    // written one.
+    std::atomic<uint64_t> sequence{0};
+    T value{};
+  };
+
+  // The next position producers claim.
+  alignas(64) std::atomic<uint64_t> tail_{0};
+  // The next position the consumer reads. Not shared with producers, which
+  // only look at slot sequences.
+  alignas(64) uint64_t head_ = 0;
+  size_t mask_ = 0;
+  std::unique_ptr<Slot[]> slots_;
+};
+
+}  // namespace utils
+}  // namespace load_balancer
+
+#endif  // LOAD_BALANCER_MPSC_RING_H
@@ -0,0 +1,25 @@
+#ifndef LOAD_BALANCER_RANDOM_H
+#define LOAD_BALANCER_RANDOM_H
+
+#include <cstdint>
+
+namespace load_balancer {
+namespace utils {
+
+// Returns a pseudo-random number from a per-thread xorshift generator, for
+// spreading decisions on the request path. Each thread is seeded from the
+// address of its state, so it takes no locks and no system calls; the
+// numbers are not fit for anything that must be unpredictable.
+inline uint64_t NextRandom() {
+  thread_local uint64_t state =
+      reinterpret_cast<uintptr_t>(&state) * 0x9e3779b97f4a7c15ULL | 1;
+  state ^= state << 13;
+  state ^= state >> 7;
+  state ^= state << 17;
+  return state;
+}
+
+}  // namespace utils
+}  // namespace load_balancer
+
+#endif  // LOAD_BALANCER_RANDOM_H
@@ -0,0 +1,28 @@
+#ifndef LOAD_BALANCER_SOCKET_UTILS_H
+#define LOAD_BALANCER_SOCKET_UTILS_H
+
+#include <chrono>
+#include <string>
+
+namespace load_balancer {
+namespace utils {
+
+// Provides utility functions for plain socket operations.
+class SocketUtils {
+ public:
+  // Connects a new TCP socket to 'ip':'port', giving up once 'timeout' has
+  // passed. Returns the connected socket in blocking mode, or -1 with errno
+  // set; a missed deadline is reported as ETIMEDOUT.
+  static int ConnectWithTimeout(const std::string& ip, int port,
+                                std::chrono::milliseconds timeout);
+
+  // Starts connecting a new non-blocking TCP socket to 'ip':'port'. Returns
+  // the socket, which becomes writable once the connect finished and then
+  // reports its outcome as SO_ERROR, or -1 with errno set.
+  static int StartConnect(const std::string& ip, int port);
+};
+
+}  // namespace utils
+}  // namespace load_balancer
+
+#endif  // LOAD_BALANCER_SOCKET_UTILS_H
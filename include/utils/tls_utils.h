@@ -1,8 +1,16 @@
 #ifndef LOAD_BALANCER_TLS_UTILS_H
 #define LOAD_BALANCER_TLS_UTILS_H
 
+#include <array>
+#include <chrono>
+#include <memory>
 #include <openssl/ssl.h>
+#include <shared_mutex>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
 
 namespace load_balancer {
 namespace utils {
@@ -23,6 +31,158 @@ class TlsUtils {
   // Configures an SSL context with a certificate and private key.
   static void ConfigureContext(SSL_CTX* ctx, const std::string& cert_file,
                                const std::string& key_file);
+
+  // Enables ALPN on a server context. 'protocols' lists the supported
+  // protocols in wire format (each prefixed by its length), most preferred
+  // first, and must outlive the context. Clients offering none of them
+  // proceed without ALPN.
+  static void ConfigureAlpn(SSL_CTX* ctx,
+                            const std::vector<unsigned char>& protocols);
+
+  // Returns the protocol negotiated with ALPN on 'ssl', or an empty view.
+  static std::string_view NegotiatedProtocol(const SSL* ssl);
+
+  // Asks OpenSSL to hand record encryption and decryption of connections
+  // created from 'ctx' to the kernel (Linux kTLS) once their handshake is
+  // done. Connections whose cipher, protocol version, kernel or OpenSSL
+  // build lack support silently keep userspace TLS.
+  static void EnableKtls(SSL_CTX* ctx);
+
+  // Return true if the kernel encrypts records sent on 'ssl' or decrypts
+  // records received on it. Plain socket I/O then carries application data.
+  static bool KtlsSendActive(SSL* ssl);
+  static bool KtlsReceiveActive(SSL* ssl);
+};
+
+// Settings for the long-lived TLS contexts of a server.
+struct TlsConfig {
+  // PEM file holding the certificate presented to clients.
+  std::string cert_file = "cert.pem";
+  // PEM file holding the private key of 'cert_file'.
+  std::string key_file = "key.pem";
+  // Maximum number of sessions kept in the shared server-side cache.
+  long session_cache_size = 20480;
+  // Lifetime of cached sessions and issued session tickets.
+  std::chrono::seconds session_timeout{300};
+  // Interval after which a new session ticket key takes over encryption.
+  std::chrono::seconds ticket_key_rotation{3600};
+  // Number of retired ticket keys still accepted for decryption, so tickets
+  // issued shortly before a rotation keep resuming.
+  size_t retired_ticket_keys = 2;
+  // Application protocols offered to clients with ALPN, most preferred
+  // first. Empty disables ALPN.
+  std::vector<std::string> alpn_protocols{};
+  // Offloads TLS records to the kernel on both legs after the handshake, so
+  // relays can move data with splice() instead of copying it through
+  // userspace. Requires the Linux "tls" module and OpenSSL built with kTLS;
+  // OpenSSL 3.0 only offloads receiving for TLS 1.2. Unsupported connections
+  // fall back to userspace TLS.
+  bool ktls = false;
+};
+
+// Owns the TLS contexts shared by every connection of a server.
+// Credentials are loaded once at construction instead of per connection. The
+// server context keeps a shared session cache for session-ID resumption and
+// issues session tickets encrypted with keys that rotate lazily: the first
+// handshake after 'ticket_key_rotation' elapsed generates a fresh key, and the
+// newest retired keys are still accepted (tickets decrypted with them are
+// renewed). Resuming clients skip certificate exchange and key agreement.
+// The client context used towards backends caches the most recent session of
+// every backend, so reconnecting to the same backend resumes instead of
+// running a full handshake.
+// All methods are thread-safe.
+class TlsContextManager {
+ public:
+  explicit TlsContextManager(TlsConfig config);
+  ~TlsContextManager();
+
+  // This class is not copyable or movable.
+  TlsContextManager(const TlsContextManager& other) = delete;
+  TlsContextManager& operator=(const TlsContextManager& other) = delete;
+  TlsContextManager(TlsContextManager&& other) = delete;
+  TlsContextManager& operator=(TlsContextManager&& other) = delete;
+
+  // Context for client-facing connections (load balancer acts as server).
+  // Connections created from it hold their own reference.
+  SSL_CTX* ServerContext() const { return server_ctx_; }
+
+  // Context for backend connections (load balancer acts as client).
+  // Connections created from it hold their own reference.
+  SSL_CTX* ClientContext() const { return client_ctx_; }
+
+  // Replaces the current session ticket key with a freshly generated one.
+  void RotateTicketKeys();
+
+  // Number of client handshakes resumed from the cache or a ticket.
+  long ResumedSessions() const;
+
+  // Prepares a connection to the backend identified by 'backend' (usually
+  // "ip:port"): offers its cached session, if any, and arranges for sessions
+  // the backend issues on this connection to be cached. Must be called
+  // before the handshake starts.
+  void PrepareBackendConnection(SSL* ssl, const std::string& backend);
+
+  // Drops the cached session of 'backend' and forgets the backend, e.g.
+  // after a failed handshake or once it was removed, so the next connection
+  // performs a full handshake.
+  void EvictBackendSession(const std::string& backend);
+
+ private:
+  // Key material for encrypting and authenticating session tickets.
+  struct TicketKey {
+    // Identifies the key in tickets it encrypted.
+    std::array<unsigned char, 16> name;
+    // AES-256-CBC key.
+    std::array<unsigned char, 32> aes_key;
+    // HMAC-SHA256 key.
+    std::array<unsigned char, 32> hmac_key;
+    // Time the key was generated.
+    std::chrono::steady_clock::time_point created;
+  };
+
+  // Cached client session of a single backend.
+  struct BackendSession {
+    ~BackendSession();
+
+    // Session offered on the next connection, or nullptr. Owns a reference.
+    SSL_SESSION* session = nullptr;
+  };
+
+  // OpenSSL callback that stores sessions issued by backends.
+  static int NewBackendSessionCallback(SSL* ssl, SSL_SESSION* session);
+
+  // OpenSSL callback that encrypts new tickets and decrypts presented ones.
+  static int TicketKeyCallback(SSL* ssl, unsigned char* key_name,
+                               unsigned char* iv, EVP_CIPHER_CTX* cipher_ctx,
+                               EVP_MAC_CTX* mac_ctx, int encrypt);
+
+  // Creates and configures the shared server context.
+  SSL_CTX* CreateServerContext();
+  // Creates and configures the shared client context.
+  SSL_CTX* CreateClientContext();
+  // Generates a new key and puts it in front of 'ticket_keys_'. The caller
+  // must hold 'keys_mutex_' exclusively.
+  void RotateTicketKeysLocked();
+
+  // Configuration the contexts were built from.
+  TlsConfig config_;
+  // 'config_.alpn_protocols' in ALPN wire format.
+  std::vector<unsigned char> alpn_wire_;
+  // Shared context for client-facing connections.
+  SSL_CTX* server_ctx_;
+  // Shared context for backend connections.
+  SSL_CTX* client_ctx_;
+  // Cached sessions keyed by backend identity. Connections hold a reference
+  // to their backend's entry until they are freed, so entries are erased
+  // by eviction while connections still refer to them.
+  std::unordered_map<std::string, std::shared_ptr<BackendSession>>
+      backend_sessions_;
+  // Mutex to protect access to 'backend_sessions_' field.
+  std::mutex sessions_mutex_;
+  // Ticket keys, newest (used for encryption) first.
+  std::vector<TicketKey> ticket_keys_;
+  // Mutex to protect access to 'ticket_keys_' field.
+  mutable std::shared_mutex keys_mutex_;
 };
 
 }  // namespace utils
@@ -6,25 +6,76 @@ namespace load_balancer {
 namespace core {
 
 BackendServer::BackendServer(std::string ip, int port, int weight)
-    : ip_(std::move(ip)), port_(port), weight_(weight),
-      healthy_(true), active_connections_(0),
-      last_checked_(std::chrono::steady_clock::now()) {}
+    : id_(FeatureStore::Instance().Acquire()),
+      features_(&FeatureStore::Instance().Features(id_)),
+      health_(&FeatureStore::Instance().Health(id_)),
+      ip_(std::move(ip)),
+      port_(port) {
+  features_->weight.store(weight, std::memory_order_relaxed);
+  UpdateLastChecked();
+}
+
+BackendServer::~BackendServer() { FeatureStore::Instance().Release(id_); }
 
 std::chrono::steady_clock::time_point BackendServer::LastChecked() const {
-  std::lock_guard<std::mutex> lock(time_mutex_);
-  return last_checked_;
+  return std::chrono::steady_clock::time_point(std::chrono::nanoseconds(
+      health_->last_checked_ns.load(std::memory_order_relaxed)));
 }
 
 void BackendServer::DecrementConnections() {
-  int curr = active_connections_;
-  if (curr > 0) {
-    active_connections_--;
+  int current = features_->in_flight.load(std::memory_order_relaxed);
+  while (current > 0 &&
+         !features_->in_flight.compare_exchange_weak(
+             current, current - 1, std::memory_order_relaxed)) {
   }
 }
 
+void BackendServer::RecordOutcome(std::chrono::microseconds latency,
+                                  bool success) {
+  // Recent outcomes dominate after a few dozen samples.
+  constexpr double kSmoothing = 0.1;
+  double error = success ? 0.0 : 1.0;
+  double rate = features_->error_rate.load(std::memory_order_relaxed);
+  features_->error_rate.store(rate + kSmoothing * (error - rate),
+                              std::memory_order_relaxed);
+  if (!success) return;
+  double sample = latency.count() / 1000.0;
+  double average = features_->latency_ms.load(std::memory_order_relaxed);
+  features_->latency_ms.store(
+      average == 0 ? sample : average + kSmoothing * (sample - average),
+      std::memory_order_relaxed);
+
+  // The rate implied by the gap since the previous success.
+  int64_t now = SteadyNowNs();
+  int64_t previous =
+      features_->last_success_ns.exchange(now, std::memory_order_relaxed);
+  if (previous == 0 || now <= previous) return;
+  double instant = 1e9 / static_cast<double>(now - previous);
+  double throughput = features_->throughput.load(std::memory_order_relaxed);
+  features_->throughput.store(throughput + kSmoothing * (instant - throughput),
+                              std::memory_order_relaxed);
+}
+
 void BackendServer::UpdateLastChecked() {
-  std::lock_guard<std::mutex> lock(time_mutex_);
-  last_checked_ = std::chrono::steady_clock::now();
+  health_->last_checked_ns.store(SteadyNowNs(), std::memory_order_relaxed);
+}
+
+ActiveConnection::ActiveConnection(std::shared_ptr<BackendServer> backend)
+    : backend_(std::move(backend)) {
+  if (backend_) backend_->IncrementConnections();
+}
+
+ActiveConnection::~ActiveConnection() {
+  if (backend_) backend_->DecrementConnections();
+}
+
+ActiveConnection& ActiveConnection::operator=(
+    ActiveConnection&& other) noexcept {
+  if (this != &other) {
+    if (backend_) backend_->DecrementConnections();
+    backend_ = std::move(other.backend_);
+  }
+  return *this;
 }
 
 }  // namespace core
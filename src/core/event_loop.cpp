@@ -0,0 +1,221 @@
+#include "core/event_loop.h"
+#include "spdlog/spdlog.h"
+
+#include <cerrno>
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace load_balancer {
+namespace core {
+
+// Maximum number of events collected by a single 'epoll_wait' call.
+constexpr int MAX_EVENTS_PER_WAIT = 256;
+
+EventLoop::EventLoop()
+    : epoll_fd_(-1), wake_fd_(-1), running_(false), next_generation_(1),
+      accepting_tasks_(true) {}
+
+EventLoop::~EventLoop() {
+  // Ensure resources are released.
+  Stop();
+}
+
+bool EventLoop::Start(const std::vector<int>& cpus) {
+  if (running_) return true;
+
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd_ < 0) {
+    spdlog::error("Failed to create epoll instance: {}", strerror(errno));
+    return false;
+  }
+
+  wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (wake_fd_ < 0) {
+    spdlog::error("Failed to create wakeup eventfd: {}", strerror(errno));
+    close(epoll_fd_);
+    epoll_fd_ = -1;
+    return false;
+  }
+
+  // The wakeup descriptor is level-triggered and uses generation zero.
+  epoll_event event{};
+  event.events = EPOLLIN;
+  event.data.u64 = MakeToken(wake_fd_, 0);
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &event) < 0) {
+    spdlog::error("Failed to register wakeup eventfd: {}", strerror(errno));
+    close(wake_fd_);
+    close(epoll_fd_);
+    wake_fd_ = epoll_fd_ = -1;
+    return false;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(tasks_mutex_);
+    accepting_tasks_ = true;
+  }
+  running_ = true;
+  thread_ = std::thread(&EventLoop::Run, this);
+
+  if (!cpus.empty()) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) CPU_SET(cpu, &set);
+    int result = pthread_setaffinity_np(thread_.native_handle(), sizeof(set),
+                                        &set);
+    if (result != 0) {
+      spdlog::warn("Failed to pin event loop to {} CPU(s) from {}: {}",
+                   cpus.size(), cpus.front(), strerror(result));
+    }
+  }
+  return true;
+}
+
+void EventLoop::Stop() {
+  if (!running_) return;
+
+  running_ = false;
+  Wakeup();
+  if (thread_.joinable()) thread_.join();
+
+  close(wake_fd_);
+  close(epoll_fd_);
+  wake_fd_ = epoll_fd_ = -1;
+}
+
+bool EventLoop::Add(int fd, uint32_t events, EventHandler* handler) {
+  uint32_t generation = next_generation_++;
+  if (next_generation_ == 0) next_generation_ = 1;
+
+  epoll_event event{};
+  event.events = events;
+  event.data.u64 = MakeToken(fd, generation);
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) < 0) {
+    spdlog::error("Failed to register fd {} with epoll: {}", fd,
+                  strerror(errno));
+    return false;
+  }
+
+  if (static_cast<size_t>(fd) >= handlers_.size()) handlers_.resize(fd + 1);
+  handlers_[fd] = Registration{handler, generation};
+  return true;
+}
+
+bool EventLoop::Modify(int fd, uint32_t events) {
+  if (static_cast<size_t>(fd) >= handlers_.size() || !handlers_[fd].handler)
+    return false;
+
+  epoll_event event{};
+  event.events = events;
+  event.data.u64 = MakeToken(fd, handlers_[fd].generation);
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &event) < 0) {
+    spdlog::error("Failed to modify fd {} in epoll: {}", fd, strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+void EventLoop::Remove(int fd) {
+  epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+  if (static_cast<size_t>(fd) < handlers_.size())
+    handlers_[fd].handler = nullptr;
+}
+
+void EventLoop::Post(std::function<void()> task) {
+  {
+    // The loop thread only stops accepting under the mutex and exits after
+    // that, so the wakeup descriptor is still open while tasks are accepted.
+    std::lock_guard<std::mutex> lock(tasks_mutex_);
+    if (accepting_tasks_) {
+      pending_tasks_.push_back(std::move(task));
+      Wakeup();
+      return;
+    }
+  }
+  task();
+}
+
+bool EventLoop::InLoopThread() const {
+  return thread_.get_id() == std::this_thread::get_id();
+}
+
+void EventLoop::Run() {
+  epoll_event events[MAX_EVENTS_PER_WAIT];
+
+  while (running_) {
+    int ready = epoll_wait(epoll_fd_, events, MAX_EVENTS_PER_WAIT, -1);
+    if (ready < 0) {
+      if (errno == EINTR) continue;
+      spdlog::error("Call to 'epoll_wait' failed: {}", strerror(errno));
+      break;
+    }
+
+    for (int i = 0; i < ready; ++i) {
+      uint64_t token = events[i].data.u64;
+      int fd = static_cast<int>(token & 0xffffffffu);
+      uint32_t generation = static_cast<uint32_t>(token >> 32);
+      if (generation == 0) {
+        uint64_t counter;
+        while (read(wake_fd_, &counter, sizeof(counter)) > 0) {}
+        continue;
+      }
+
+      // The descriptor may have been removed by an earlier event in this
+      // batch, and its number reused by a new registration.
+      if (static_cast<size_t>(fd) >= handlers_.size()) continue;
+      const Registration& registration = handlers_[fd];
+      if (!registration.handler || registration.generation != generation)
+        continue;
+      registration.handler->HandleEvent(fd, events[i].events);
+    }
+
+    RunPendingTasks();
+  }
+
+  // Run tasks posted before the stop, report descriptors that are still
+  // registered as failed, then run the tasks their owners post while tearing
+  // down until none is left.
+  RunPendingTasks();
+  for (size_t fd = 0; fd < handlers_.size(); ++fd) {
+    EventHandler* handler = handlers_[fd].handler;
+    if (handler) handler->HandleEvent(fd, EPOLLHUP | EPOLLERR);
+  }
+  while (true) {
+    RunPendingTasks();
+    std::lock_guard<std::mutex> lock(tasks_mutex_);
+    if (pending_tasks_.empty()) {
+      accepting_tasks_ = false;
+      break;
+    }
+  }
+}
+
+void EventLoop::RunPendingTasks() {
+  std::vector<std::function<void()>> tasks;
+  {
+    std::lock_guard<std::mutex> lock(tasks_mutex_);
+    tasks.swap(pending_tasks_);
+  }
+
+  for (auto& task : tasks) task();
+}
+
+uint64_t EventLoop::MakeToken(int fd, uint32_t generation) {
+  return (static_cast<uint64_t>(generation) << 32) |
+         static_cast<uint32_t>(fd);
+}
+
+void EventLoop::Wakeup() {
+  // Tasks posted before Start are run once the loop starts.
+  if (wake_fd_ < 0) return;
+  uint64_t one = 1;
+  if (write(wake_fd_, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+    spdlog::warn("Failed to wake event loop: {}", strerror(errno));
+  }
+}
+
+}  // namespace core
+}  // namespace load_balancer
@@ -0,0 +1,64 @@
+#include "core/feature_store.h"
+
+#include <cstdlib>
+#include <new>
+#include <spdlog/spdlog.h>
+#include <sys/mman.h>
+
+namespace load_balancer {
+namespace core {
+
+namespace {
+
+// Reserves zero-filled memory for 'count' slots of T, committed on first
+// touch.
+template <typename T>
+T* ReserveSlots(size_t count) {
+  void* memory = mmap(nullptr, count * sizeof(T), PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (memory == MAP_FAILED) {
+    spdlog::critical("Failed to reserve the backend feature store");
+    std::abort();
+  }
+  return static_cast<T*>(memory);
+}
+
+}  // namespace
+
+FeatureStore& FeatureStore::Instance() {
+  // Never destroyed, so backends outliving static destruction stay valid.
+  static FeatureStore* store = new FeatureStore();
+  return *store;
+}
+
+FeatureStore::FeatureStore()
+    : features_(ReserveSlots<BackendFeatures>(kMaxBackends)),
+      health_(ReserveSlots<BackendHealth>(kMaxBackends)) {}
+
+uint32_t FeatureStore::Acquire() {
+  uint32_t id;
+  {
+    std::lock_guard<std::mutex> lock(ids_mutex_);
+    if (!free_ids_.empty()) {
+      id = free_ids_.back();
+      free_ids_.pop_back();
+    } else if (next_id_ < kMaxBackends) {
+      id = next_id_++;
+    } else {
+      spdlog::critical("More than {} backend servers exist", kMaxBackends);
+      std::abort();
+    }
+  }
+  // The slots are unused until 'id' is returned, so they are reset in place.
+  new (&features_[id]) BackendFeatures();
+  new (&health_[id]) BackendHealth();
+  return id;
+}
+
+void FeatureStore::Release(uint32_t id) {
+  std::lock_guard<std::mutex> lock(ids_mutex_);
+  free_ids_.push_back(id);
+}
+
+}  // namespace core
+}  // namespace load_balancer
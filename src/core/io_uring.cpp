@@ -0,0 +1,186 @@
+#include "core/io_uring.h"
+#include "spdlog/spdlog.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+
+namespace load_balancer {
+namespace core {
+
+namespace {
+
+int SetupRing(unsigned entries, io_uring_params* params) {
+  return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int EnterRing(int fd, unsigned to_submit, unsigned min_complete,
+              unsigned flags) {
+  return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit,
+                                  min_complete, flags, nullptr, 0));
+}
+
+int RegisterWithRing(int fd, unsigned opcode, const void* arg,
+                     unsigned nr_args) {
+  return static_cast<int>(
+      syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+}
+
+// Returns a pointer 'offset' bytes into the mapped region 'base'.
+template <typename T>
+T* At(void* base, uint32_t offset) {
+  return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+}
+
+}  // namespace
+
+IoUring::~IoUring() {
+  // Ensure resources are released.
+  Close();
+}
+
+bool IoUring::Supports(std::initializer_list<uint8_t> ops) {
+  IoUring ring;
+  if (!ring.Init(2)) return false;
+
+  // The probe reports every opcode the running kernel knows.
+  std::vector<char> storage(sizeof(io_uring_probe) +
+                            256 * sizeof(io_uring_probe_op));
+  auto* probe = reinterpret_cast<io_uring_probe*>(storage.data());
+  if (RegisterWithRing(ring.fd_, IORING_REGISTER_PROBE, probe, 256) < 0)
+    return false;
+  for (uint8_t op : ops) {
+    if (op > probe->last_op ||
+        !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool IoUring::Init(unsigned entries) {
+  // Keep submitting past failed entries, and skip interrupting the thread for
+  // completions it will collect on its next submission anyway.
+  io_uring_params params{};
+  params.flags = IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN;
+  fd_ = SetupRing(entries, &params);
+  if (fd_ < 0 && errno == EINVAL) {
+    params = {};
+    fd_ = SetupRing(entries, &params);
+  }
+  if (fd_ < 0) {
+    spdlog::debug("Failed to create io_uring instance: {}", strerror(errno));
+    return false;
+  }
+
+  sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cq_ring_size_ =
+      params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+
+  sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+  cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+  void* sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+  if (sq_ring_ == MAP_FAILED || cq_ring_ == MAP_FAILED || sqes == MAP_FAILED) {
+    spdlog::error("Failed to map io_uring rings: {}", strerror(errno));
+    if (sq_ring_ == MAP_FAILED) sq_ring_ = nullptr;
+    if (cq_ring_ == MAP_FAILED) cq_ring_ = nullptr;
+    if (sqes != MAP_FAILED) sqes_ = static_cast<io_uring_sqe*>(sqes);
+    Close();
+    return false;
+  }
+  sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+  sq_head_ = At<unsigned>(sq_ring_, params.sq_off.head);
+  sq_tail_ = At<unsigned>(sq_ring_, params.sq_off.tail);
+  sq_mask_ = *At<unsigned>(sq_ring_, params.sq_off.ring_mask);
+  sq_entries_ = *At<unsigned>(sq_ring_, params.sq_off.ring_entries);
+  sqe_tail_ = *sq_tail_;
+  cq_head_ = At<unsigned>(cq_ring_, params.cq_off.head);
+  cq_tail_ = At<unsigned>(cq_ring_, params.cq_off.tail);
+  cq_mask_ = *At<unsigned>(cq_ring_, params.cq_off.ring_mask);
+  cqes_ = At<io_uring_cqe>(cq_ring_, params.cq_off.cqes);
+
+  // Submission slots map one to one onto entries.
+  unsigned* array = At<unsigned>(sq_ring_, params.sq_off.array);
+  for (unsigned i = 0; i < sq_entries_; ++i) array[i] = i;
+  return true;
+}
+
+void IoUring::Close() {
+  if (sqes_) munmap(sqes_, sqes_size_);
+  if (cq_ring_) munmap(cq_ring_, cq_ring_size_);
+  if (sq_ring_) munmap(sq_ring_, sq_ring_size_);
+  sqes_ = nullptr;
+  cq_ring_ = sq_ring_ = nullptr;
+  if (fd_ >= 0) close(fd_);
+  fd_ = -1;
+}
+
+io_uring_sqe* IoUring::GetSqe() {
+  unsigned head = std::atomic_ref<unsigned>(*sq_head_).load(
+      std::memory_order_acquire);
+  if (sqe_tail_ - head >= sq_entries_) return nullptr;
+
+  io_uring_sqe* sqe = &sqes_[sqe_tail_ & sq_mask_];
+  ++sqe_tail_;
+  std::memset(sqe, 0, sizeof(*sqe));
+  return sqe;
+}
+
+int IoUring::Submit(unsigned wait_for) {
+  // Publish the prepared entries; the kernel reads them after the tail.
+  std::atomic_ref<unsigned>(*sq_tail_).store(sqe_tail_,
+                                             std::memory_order_release);
+  unsigned pending = sqe_tail_ - std::atomic_ref<unsigned>(*sq_head_).load(
+                                     std::memory_order_acquire);
+  if (pending == 0 && wait_for == 0) return 0;
+
+  int result = EnterRing(fd_, pending, wait_for,
+                         wait_for > 0 ? IORING_ENTER_GETEVENTS : 0);
+  return result < 0 ? -errno : result;
+}
+
+io_uring_cqe* IoUring::PeekCqe() {
+  unsigned head = *cq_head_;
+  unsigned tail = std::atomic_ref<unsigned>(*cq_tail_).load(
+      std::memory_order_acquire);
+  return head == tail ? nullptr : &cqes_[head & cq_mask_];
+}
+
+void IoUring::SeenCqe() {
+  // The kernel may reuse the slot once the new head is visible.
+  std::atomic_ref<unsigned>(*cq_head_).store(*cq_head_ + 1,
+                                             std::memory_order_release);
+}
+
+bool IoUring::RegisterBuffers(const iovec* buffers, unsigned count) {
+  if (RegisterWithRing(fd_, IORING_REGISTER_BUFFERS, buffers, count) < 0) {
+    spdlog::warn("Failed to register io_uring buffers: {}", strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+bool IoUring::RegisterSparseFiles(unsigned count) {
+  io_uring_rsrc_register files{};
+  files.nr = count;
+  files.flags = IORING_RSRC_REGISTER_SPARSE;
+  if (RegisterWithRing(fd_, IORING_REGISTER_FILES2, &files, sizeof(files)) <
+      0) {
+    spdlog::error("Failed to register io_uring file table: {}",
+                  strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+}  // namespace core
+}  // namespace load_balancer
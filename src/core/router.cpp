@@ -1,18 +1,253 @@
 #include "core/router.h"
+#include "utils/epoch.h"
+
+#include <algorithm>
+#include <functional>
+#include <span>
+#include <spdlog/spdlog.h>
 
 namespace load_balancer {
 namespace core {
 
-Router::Router(std::shared_ptr<rl::Agent> agent) : agent_(std::move(agent)) {}
+namespace {
+
+// Returns the position of the server with 'address' in 'backends'.
+std::vector<std::shared_ptr<BackendServer>>::const_iterator Find(
+    const std::vector<std::shared_ptr<BackendServer>>& backends,
+    const std::string& address) {
+  return std::find_if(backends.begin(), backends.end(),
+                      [&address](const auto& backend) {
+                        return backend->Address() == address;
+                      });
+}
+
+// Samples drawn from the alias table before falling back to a scan for an
+// eligible backend.
+constexpr int WEIGHTED_SAMPLE_ATTEMPTS = 8;
+
+// Returns 'config' with an observer that calls 'refresh' after every batch,
+// before the configured one.
+rl::TrainerConfig WithRefresh(rl::TrainerConfig config,
+                              std::function<void()> refresh) {
+  config.observer = [observer = std::move(config.observer),
+                     refresh = std::move(refresh)](
+                        std::span<const rl::Experience> batch) {
+    refresh();
+    if (observer) observer(batch);
+  };
+  return config;
+}
+
+}  // namespace
+
+Router::Router(std::shared_ptr<rl::Agent> agent,
+               rl::TrainerConfig trainer_config)
+    : backends_(new BackendSet()),
+      agent_(std::move(agent)),
+      trainer_(agent_, WithRefresh(std::move(trainer_config),
+                                   [this]() { RefreshPolicy(); })) {
+  trainer_.Start();
+}
+
+Router::~Router() {
+  trainer_.Stop();
+  // No reader can outlive the router, so the last set is deleted directly.
+  delete backends_.load(std::memory_order_relaxed);
+  utils::Epoch::Reclaim();
+}
+
+bool Router::AddBackendServer(std::shared_ptr<BackendServer> backend_server) {
+  std::lock_guard<std::mutex> lock(update_mutex_);
+  const BackendSet* current = backends_.load(std::memory_order_relaxed);
+  std::string address = backend_server->Address();
+  if (Find(current->routable, address) != current->routable.end() ||
+      Find(current->draining, address) != current->draining.end()) {
+    spdlog::warn("Backend server {} is already managed", address);
+    return false;
+  }
+
+  auto next = std::make_unique<BackendSet>(*current);
+  next->routable.push_back(std::move(backend_server));
+  Publish(std::move(next));
+  spdlog::info("Added backend server {}", address);
+  return true;
+}
+
+bool Router::RemoveBackendServer(const std::string& address) {
+  std::lock_guard<std::mutex> lock(update_mutex_);
+  auto next = std::make_unique<BackendSet>(
+      *backends_.load(std::memory_order_relaxed));
+  for (auto* backends : {&next->routable, &next->draining}) {
+    auto it = Find(*backends, address);
+    if (it == backends->end()) continue;
+    backends->erase(it);
+    Publish(std::move(next));
+    spdlog::info("Removed backend server {}", address);
+    return true;
+  }
+  return false;
+}
+
+bool Router::DrainBackendServer(const std::string& address) {
+  std::lock_guard<std::mutex> lock(update_mutex_);
+  auto next = std::make_unique<BackendSet>(
+      *backends_.load(std::memory_order_relaxed));
+  auto it = Find(next->routable, address);
+  if (it == next->routable.end()) return false;
+  next->draining.push_back(*it);
+  next->routable.erase(it);
+  Publish(std::move(next));
+  spdlog::info("Draining backend server {}", address);
+  return true;
+}
+
+bool Router::SetBackendWeight(const std::string& address, int weight) {
+  std::lock_guard<std::mutex> lock(update_mutex_);
+  const BackendSet* current = backends_.load(std::memory_order_relaxed);
+  auto it = Find(current->routable, address);
+  if (it == current->routable.end()) {
+    it = Find(current->draining, address);
+    if (it == current->draining.end()) return false;
+  }
+  (*it)->SetWeight(weight);
+
+  // The members are unchanged, but a new version tells consumers of the set
+  // to rebuild what they derived from the weights.
+  Publish(std::make_unique<BackendSet>(*current));
+  return true;
+}
+
+std::vector<std::shared_ptr<BackendServer>> Router::BackendServers() const {
+  utils::EpochGuard guard;
+  const BackendSet* current = backends_.load(std::memory_order_acquire);
+  std::vector<std::shared_ptr<BackendServer>> backends = current->routable;
+  backends.insert(backends.end(), current->draining.begin(),
+                  current->draining.end());
+  return backends;
+}
 
-void Router::AddBackendServer(std::shared_ptr<BackendServer> backend_server) {
-  backend_servers_.push_back(std::move(backend_server));
+uint64_t Router::Version() const {
+  utils::EpochGuard guard;
+  return backends_.load(std::memory_order_acquire)->version;
 }
 
 std::shared_ptr<BackendServer> Router::PickBackendServer() {
-  if (backend_servers_.empty()) return nullptr;
-  int selected_index = agent_->SelectAction(backend_servers_);
-  return backend_servers_.at(selected_index);
+  return PickBackendServer({});
+}
+
+std::shared_ptr<BackendServer> Router::PickWeightedBackendServer() {
+  utils::EpochGuard guard;
+  return SampleWeighted(*backends_.load(std::memory_order_acquire), {});
+}
+
+std::shared_ptr<BackendServer> Router::PickBackendServer(
+    const std::vector<std::shared_ptr<BackendServer>>& excluded) {
+  utils::EpochGuard guard;
+  const BackendSet* current = backends_.load(std::memory_order_acquire);
+  const auto& backends = current->routable;
+  if (backends.empty()) return nullptr;
+  if (!agent_) return SampleWeighted(*current, excluded);
+  if (!current->policy.Empty()) {
+    if (auto backend = SampleHealthy(*current, current->policy, excluded))
+      return backend;
+  }
+  // The agent scores the whole set, so it can use what it cached for this
+  // version, and leaves the choice to the weights if nothing healthy is
+  // allowed.
+  int selected_index =
+      agent_->SelectAction(backends, current->version, excluded);
+  if (selected_index < 0) return SampleWeighted(*current, excluded);
+  return backends.at(selected_index);
+}
+
+int Router::DecisionReplica() const {
+  return agent_ ? agent_->DecisionReplica() : -1;
+}
+
+void Router::ReportReward(rl::Experience experience) {
+  trainer_.Submit(std::move(experience));
+}
+
+rl::TrainerStats Router::TrainingStats() const { return trainer_.Stats(); }
+
+std::shared_ptr<BackendServer> Router::SampleHealthy(
+    const BackendSet& backends, const utils::AliasTable& table,
+    const std::vector<std::shared_ptr<BackendServer>>& excluded) {
+  for (int attempt = 0; attempt < WEIGHTED_SAMPLE_ATTEMPTS; ++attempt) {
+    const auto& backend = backends.routable[table.Sample()];
+    if (backend->IsHealthy() &&
+        std::find(excluded.begin(), excluded.end(), backend) ==
+            excluded.end()) {
+      return backend;
+    }
+  }
+  return nullptr;
+}
+
+std::shared_ptr<BackendServer> Router::SampleWeighted(
+    const BackendSet& backends,
+    const std::vector<std::shared_ptr<BackendServer>>& excluded) {
+  if (backends.weights.Empty()) return nullptr;
+  auto allowed = [&excluded](const std::shared_ptr<BackendServer>& backend) {
+    return std::find(excluded.begin(), excluded.end(), backend) ==
+           excluded.end();
+  };
+  // An allowed unhealthy backend drawn by weight, taken if no healthy one
+  // is left, so such picks still spread over the pool.
+  std::shared_ptr<BackendServer> unhealthy;
+  for (int attempt = 0; attempt < WEIGHTED_SAMPLE_ATTEMPTS; ++attempt) {
+    const auto& backend = backends.routable[backends.weights.Sample()];
+    if (!allowed(backend)) continue;
+    if (backend->IsHealthy()) return backend;
+    if (!unhealthy) unhealthy = backend;
+  }
+
+  // Most of the weight is ineligible. Take any allowed backend with weight,
+  // an unhealthy one only if no healthy one is left.
+  for (const auto& backend : backends.routable) {
+    if (backend->Weight() <= 0 || !allowed(backend)) continue;
+    if (backend->IsHealthy()) return backend;
+    if (!unhealthy) unhealthy = backend;
+  }
+  return unhealthy;
+}
+
+void Router::RefreshPolicy() {
+  if (!agent_) return;
+  std::lock_guard<std::mutex> lock(update_mutex_);
+  const BackendSet* current = backends_.load(std::memory_order_relaxed);
+  std::vector<double> probabilities =
+      agent_->ActionProbabilities(current->routable);
+  // Agents that decide per request never need a new set.
+  if (current->policy.Empty() && probabilities.empty()) return;
+
+  // Only the policy changes, so the version that agents cache derived state
+  // under is kept.
+  auto next = std::make_unique<BackendSet>(*current);
+  next->policy = utils::AliasTable(probabilities);
+  next->policy_version = current->policy_version + 1;
+  Install(std::move(next));
+}
+
+void Router::Publish(std::unique_ptr<BackendSet> next) {
+  const BackendSet* current = backends_.load(std::memory_order_relaxed);
+  std::vector<double> weights;
+  weights.reserve(next->routable.size());
+  for (const auto& backend : next->routable)
+    weights.push_back(backend->Weight());
+  next->weights = utils::AliasTable(weights);
+  next->policy = agent_ ? utils::AliasTable(agent_->ActionProbabilities(
+                              next->routable))
+                        : utils::AliasTable();
+  next->version = current->version + 1;
+  next->policy_version = current->policy_version + 1;
+  Install(std::move(next));
+}
+
+void Router::Install(std::unique_ptr<BackendSet> next) {
+  const BackendSet* current = backends_.load(std::memory_order_relaxed);
+  backends_.store(next.release(), std::memory_order_seq_cst);
+  utils::Epoch::Retire(current);
 }
 
 }  // namespace core
@@ -1,21 +1,85 @@
 #include "core/server.h"
+#include "protocols/http_handler.h"
+#include "protocols/passthrough_handler.h"
 #include "protocols/tcp_handler.h"
+#include "protocols/uring_passthrough_session.h"
 #include "spdlog/spdlog.h"
 
+#include <algorithm>
 #include <arpa/inet.h>
 #include <csignal>
+#include <linux/filter.h>
+#include <pthread.h>
+#include <sched.h>
 #include <unistd.h>
+#include <utility>
 
 namespace load_balancer {
 namespace core {
 
-// Maximum number of pending connections allowed in the socket's listen queue.
-constexpr int CONNECTIONS_QUEUE_SIZE = 100;
+namespace {
+
+// Returns the number of cores, or 1 if it cannot be determined.
+int AvailableCores() {
+  return static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+}
+
+// Returns the CPUs whose connections the steering program hands to listener
+// 'index' of 'listeners': those with 'cpu % listeners == index'. A listener
+// no CPU maps to gets a core of its own anyway.
+std::vector<int> SteeredCpus(int index, int listeners) {
+  std::vector<int> cpus;
+  for (int cpu = index; cpu < AvailableCores(); cpu += listeners)
+    cpus.push_back(cpu);
+  if (cpus.empty()) cpus.push_back(index % AvailableCores());
+  return cpus;
+}
+
+// Pins the calling thread to 'cpus'.
+void PinCurrentThread(const std::vector<int>& cpus) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int cpu : cpus) CPU_SET(cpu, &set);
+  int result = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  if (result != 0) {
+    spdlog::warn("Failed to pin accept loop to {} CPU(s) from {}: {}",
+                 cpus.size(), cpus.front(), strerror(result));
+  }
+}
+
+}  // namespace
 
 Server::Server(int port, std::shared_ptr<Router> router)
-    : port_(port), server_socket_(-1), running_(false),
-      router_(std::move(router)) {
-  spdlog::debug("Server created on port {}", port_);
+    : Server(ServerConfig{.port = port}, std::move(router)) {}
+
+Server::Server(ServerConfig config, std::shared_ptr<Router> router)
+    : config_(config), running_(false),
+      context_(std::make_shared<protocols::HandlerContext>()) {
+  // Long-lived state is built once here rather than per connection.
+  context_->router = std::move(router);
+  if (config_.http2.enabled) {
+    if (config_.protocol == Protocol::kHttp &&
+        config_.io_mode == IoMode::kThreadPerConnection) {
+      config_.tls.alpn_protocols = {"h2", "http/1.1"};
+    } else {
+      spdlog::warn("HTTP/2 needs the HTTP protocol in thread-per-connection "
+                   "mode; serving HTTP/1.1 only");
+    }
+  }
+  // Passthrough listeners never touch TLS, so they need no credentials.
+  if (config_.protocol != Protocol::kPassthrough)
+    context_->tls = std::make_shared<utils::TlsContextManager>(config_.tls);
+  config_.connection_pool.connect_timeout = config_.connect.timeout;
+  context_->pools = std::make_shared<protocols::ConnectionPoolManager>(
+      context_->router, context_->tls, config_.connection_pool);
+  context_->passive_monitor = std::make_shared<monitor::PassiveMonitor>();
+  context_->connect = config_.connect;
+  context_->buffers = std::make_shared<utils::BufferPool>(config_.buffers);
+  context_->http_limits = config_.http_limits;
+  context_->http_routing = config_.http_routing;
+  context_->http2 = config_.http2;
+  context_->reward = config_.reward;
+  spdlog::debug("Server created on port {}", config_.port);
 }
 
 Server::~Server() {
@@ -24,11 +88,161 @@ Server::~Server() {
 }
 
 void Server::Start() {
+  // OpenSSL drives the socket I/O of TLS connections itself, so only plain
+  // passthrough can hand its I/O to the kernel as submissions.
+  if (config_.io_mode == IoMode::kIoUring) {
+    if (config_.protocol != Protocol::kPassthrough) {
+      spdlog::warn("io_uring serves passthrough listeners only; using epoll "
+                   "event loops");
+      config_.io_mode = IoMode::kEventLoop;
+    } else if (!UringLoop::Supported()) {
+      spdlog::warn("io_uring is unavailable; using epoll event loops");
+      config_.io_mode = IoMode::kEventLoop;
+    }
+  }
+
+  // Event loops route an HTTP connection once and relay it opaquely, so they
+  // cannot honour per-request routing; refuse rather than ignore it.
+  if (config_.protocol == Protocol::kHttp &&
+      config_.io_mode != IoMode::kThreadPerConnection &&
+      config_.http_routing == protocols::HttpRouting::kPerRequest) {
+    spdlog::error("Per-request HTTP routing needs thread-per-connection mode; "
+                  "set 'http_routing' to per-connection to serve HTTP from "
+                  "event loops");
+    return;
+  }
+
+  int num_listeners = config_.listeners > 0 ? config_.listeners
+                                            : AvailableCores();
+  bool reuse_port = num_listeners > 1;
+  bool steer = reuse_port && config_.steer_by_cpu;
+
+  // Bind every listener before any of them accepts, so the SO_REUSEPORT group
+  // is complete when the steering program starts indexing into it.
+  for (int i = 0; i < num_listeners; ++i) {
+    auto shard = std::make_unique<ListenerShard>();
+    shard->socket = OpenListeningSocket(reuse_port);
+    if (shard->socket < 0) {
+      CloseShards(std::exchange(shards_, {}));
+      return;
+    }
+    if (steer) shard->cpus = SteeredCpus(i, num_listeners);
+    shards_.push_back(std::move(shard));
+  }
+
+  if (steer && !AttachCpuSteeringProgram()) {
+    spdlog::warn("Falling back to hash-based SO_REUSEPORT distribution");
+  }
+
+  // Spin up the event loops before the first connection is dispatched. Loops
+  // are assigned to shards round-robin so every shard owns at least one.
+  if (config_.io_mode == IoMode::kEventLoop) {
+    int loops = std::max(config_.event_loop_threads > 0
+                             ? config_.event_loop_threads
+                             : AvailableCores(),
+                         num_listeners);
+    for (int i = 0; i < loops; ++i) {
+      auto& shard = *shards_[i % num_listeners];
+      auto loop = std::make_unique<EventLoop>();
+      if (!loop->Start(shard.cpus)) {
+        CloseShards(std::exchange(shards_, {}));
+        return;
+      }
+      shard.event_loops.push_back(std::move(loop));
+    }
+    spdlog::info("Started {} event loop threads", loops);
+  }
+
+  // Pre-warm the backend connection pools so the first requests already find
+  // handshaked connections.
+  if (config_.protocol == Protocol::kHttp) {
+    context_->pools->Warm(context_->router->BackendServers());
+    context_->pools->Start();
+  }
+
+  // Spawn the shard workers under 'stop_mutex_', so a concurrent Stop waits
+  // for them instead of tearing the shards down mid-iteration.
+  std::unique_lock<std::mutex> lock(stop_mutex_);
+  running_ = true;
+  // A Stop that ran while the shards were being set up found nothing to
+  // release; carry it out now that they are published.
+  if (stop_requested_) {
+    stop_requested_ = false;
+    lock.unlock();
+    Stop();
+    return;
+  }
+  spdlog::info("Server listening on port {} with {} listener(s)", config_.port,
+               num_listeners);
+
+  // Every shard accepts on its own thread, or from its io_uring loop.
+  for (auto& shard : shards_) {
+    if (config_.io_mode == IoMode::kIoUring) {
+      if (!StartUringLoop(*shard)) {
+        lock.unlock();
+        Stop();
+        return;
+      }
+      continue;
+    }
+    ListenerShard* listener = shard.get();
+    listener->accept_thread = std::thread([this, listener]() {
+      AcceptConnections(*listener);
+    });
+  }
+
+  // Block until Stop has released every shard.
+  stopped_.wait(lock, [this]() {
+    return !running_ && shards_.empty() && !closing_shards_;
+  });
+}
+
+void Server::Stop() {
+  std::vector<std::unique_ptr<ListenerShard>> shards;
+  {
+    std::unique_lock<std::mutex> lock(stop_mutex_);
+    if (!running_.exchange(false)) {
+      // Not serving yet: leave the stop for Start to honour. If another Stop
+      // is joining the shards, wait until it is done.
+      stop_requested_ = true;
+      stopped_.wait(lock, [this]() { return !closing_shards_; });
+      return;
+    }
+
+    // Shut down the listening sockets, which wakes every blocked 'accept',
+    // and the client sockets, which ends the relays of the worker threads.
+    for (auto& shard : shards_) {
+      shutdown(shard->socket, SHUT_RDWR);
+      std::lock_guard<std::mutex> workers_lock(shard->workers_mutex);
+      for (auto& worker : shard->workers)
+        if (!worker.done) shutdown(worker.client_socket, SHUT_RDWR);
+    }
+    shards = std::exchange(shards_, {});
+    closing_shards_ = true;
+  }
+
+  // Join outside the lock, so a concurrent Stop or Start is not held up by
+  // connections still winding down.
+  CloseShards(std::move(shards));
+  context_->pools->Stop();
+  utils::BufferPoolStats buffers = context_->buffers->Stats();
+  spdlog::debug("Relay buffers: {} bytes peak, {} allocated, {} reused",
+                buffers.peak_bytes_in_use, buffers.allocations,
+                buffers.reuses);
+  {
+    std::lock_guard<std::mutex> lock(stop_mutex_);
+    closing_shards_ = false;
+  }
+  stopped_.notify_all();
+  spdlog::info("Server shutdown complete.");
+}
+
+int Server::OpenListeningSocket(bool reuse_port) {
   // Create an IPv4 TCP socket stream.
-  server_socket_ = socket(AF_INET, SOCK_STREAM, 0);
-  if (server_socket_ < 0) {
+  int server_socket = socket(AF_INET, SOCK_STREAM, 0);
+  if (server_socket < 0) {
     spdlog::error("Failed to create socket: {}", strerror(errno));
-    return;
+    return -1;
   }
 
   sockaddr_in server_addr{};
@@ -37,61 +251,79 @@ void Server::Start() {
   // Listen to all interfaces.
   server_addr.sin_addr.s_addr = INADDR_ANY;
   // Convert port to network byte order.
-  server_addr.sin_port = htons(port_);
+  server_addr.sin_port = htons(config_.port);
 
   // Allow reuse of the address after the server shuts down.
   int opt = 1;
-  if (setsockopt(server_socket_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) <
+  if (setsockopt(server_socket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) <
       0) {
     spdlog::error("Call to 'setsockopt' failed: {}",
                   strerror(errno));
-    close(server_socket_);
-    return;
+    close(server_socket);
+    return -1;
+  }
+
+  // Let several listeners share the port; the kernel balances between them.
+  if (reuse_port &&
+      setsockopt(server_socket, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) <
+      0) {
+    spdlog::error("Failed to enable SO_REUSEPORT: {}", strerror(errno));
+    close(server_socket);
+    return -1;
   }
 
   // Bind the socket to the address and port.
-  if (bind(server_socket_, reinterpret_cast<sockaddr*>(&server_addr),
+  if (bind(server_socket, reinterpret_cast<sockaddr*>(&server_addr),
            sizeof(server_addr)) < 0) {
     spdlog::error("Bind failed: {}", strerror(errno));
-    close(server_socket_);
-    return;
+    close(server_socket);
+    return -1;
   }
 
   // Start listening for incoming connections.
-  if (listen(server_socket_, CONNECTIONS_QUEUE_SIZE) < 0) {
+  if (listen(server_socket, config_.listen_backlog) < 0) {
     spdlog::error("Listen failed: {}", strerror(errno));
-    close(server_socket_);
-    return;
+    close(server_socket);
+    return -1;
   }
 
-  running_ = true;
-  spdlog::info("Server listening on port {}", port_);
-
-  // Start accepting connections in a blocking loop.
-  AcceptConnections();
+  return server_socket;
 }
 
-void Server::Stop() {
-  if (!running_) return;
-
-  // Close the main server socket.
-  running_ = false;
-  close(server_socket_);
-
-  // Gracefully join all worker threads.
-  for (auto &thread: worker_threads_)
-    if (thread.joinable()) thread.join();
+bool Server::AttachCpuSteeringProgram() {
+  // Select the listener by the CPU that processed the incoming packet, modulo
+  // the number of listeners. Listener 'i' is the i-th socket bound to the group.
+  sock_filter code[] = {
+      {BPF_LD | BPF_W | BPF_ABS, 0, 0,
+       static_cast<uint32_t>(SKF_AD_OFF + SKF_AD_CPU)},
+      {BPF_ALU | BPF_MOD | BPF_K, 0, 0, static_cast<uint32_t>(shards_.size())},
+      {BPF_RET | BPF_A, 0, 0, 0},
+  };
+  sock_fprog program{};
+  program.len = sizeof(code) / sizeof(code[0]);
+  program.filter = code;
 
-  spdlog::info("Server shutdown complete.");
+  // Attaching to any member installs the program for the whole group.
+  if (setsockopt(shards_.front()->socket, SOL_SOCKET,
+                 SO_ATTACH_REUSEPORT_CBPF, &program, sizeof(program)) < 0) {
+    spdlog::error("Failed to attach CPU steering program: {}",
+                  strerror(errno));
+    return false;
+  }
+  spdlog::info("Attached CPU steering program to {} listeners",
+               shards_.size());
+  return true;
 }
 
-void Server::AcceptConnections() {
+void Server::AcceptConnections(ListenerShard& shard) {
+  if (!shard.cpus.empty()) PinCurrentThread(shard.cpus);
+
   while (running_) {
     sockaddr_in client_addr{};
     socklen_t client_len = sizeof(client_addr);
 
     // Accept a new client connection.
-    int client_socket = accept(server_socket_,
+    int client_socket = accept(shard.socket,
                                reinterpret_cast<sockaddr*>(&client_addr),
                                &client_len);
     if (client_socket < 0) {
@@ -104,23 +336,112 @@ void Server::AcceptConnections() {
     spdlog::info("New client connected from {}:{}",
                  inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port));
 
-    // Start a new thread to handle this client.
-    worker_threads_.emplace_back([this, client_socket]() {
-      HandleClient(client_socket);
+    if (config_.io_mode == IoMode::kEventLoop) {
+      DispatchToEventLoop(shard, client_socket);
+      continue;
+    }
+
+    // Start a new thread to handle this client, unless Stop has already shut
+    // down the client sockets and would never see this one.
+    ReapWorkers(shard);
+    std::lock_guard<std::mutex> lock(shard.workers_mutex);
+    if (!running_) {
+      close(client_socket);
+      break;
+    }
+    Worker& worker = shard.workers.emplace_back();
+    worker.client_socket = client_socket;
+    worker.thread = std::thread([this, &shard, &worker]() {
+      HandleClient(shard, worker);
     });
   }
 }
 
-void Server::HandleClient(int client_socket) {
+std::shared_ptr<protocols::ProtocolHandler> Server::CreateHandler(
+    int client_socket) {
+  if (config_.protocol == Protocol::kHttp)
+    return std::make_shared<protocols::HttpHandler>(client_socket, context_);
+  if (config_.protocol == Protocol::kPassthrough) {
+    return std::make_shared<protocols::PassthroughHandler>(client_socket,
+                                                           context_);
+  }
+  return std::make_shared<protocols::TcpHandler>(client_socket, context_);
+}
+
+void Server::HandleClient(ListenerShard& shard, Worker& worker) {
   // Encapsulates protocol logic for this client.
-  protocols::TcpHandler handler(client_socket, router_);
+  auto handler = CreateHandler(worker.client_socket);
 
   // Forward traffic between client and selected backend server.
-  handler.Forward();
+  handler->Forward();
+
+  // Cleanup. Closing under the mutex keeps Stop from shutting down the
+  // descriptor once it has been reused.
+  std::lock_guard<std::mutex> lock(shard.workers_mutex);
+  close(worker.client_socket);
+  worker.done = true;
+  spdlog::debug("CLosed client socket: {}", worker.client_socket);
+}
+
+void Server::ReapWorkers(ListenerShard& shard) {
+  std::lock_guard<std::mutex> lock(shard.workers_mutex);
+  for (auto it = shard.workers.begin(); it != shard.workers.end();) {
+    if (!it->done) {
+      ++it;
+      continue;
+    }
+    // The thread has released the mutex and has nothing left but to return.
+    it->thread.join();
+    it = shard.workers.erase(it);
+  }
+}
+
+void Server::DispatchToEventLoop(ListenerShard& shard, int client_socket) {
+  // Spread connections round-robin over the shard's loops; the chosen loop
+  // owns the session's sockets for their whole lifetime.
+  EventLoop* loop = shard.event_loops[shard.next_event_loop].get();
+  shard.next_event_loop = (shard.next_event_loop + 1) %
+                          shard.event_loops.size();
+
+  loop->Post([this, loop, client_socket]() {
+    CreateHandler(client_socket)->Start(loop);
+  });
+}
+
+bool Server::StartUringLoop(ListenerShard& shard) {
+  shard.uring_loop = std::make_unique<UringLoop>(config_.uring);
+  UringLoop* loop = shard.uring_loop.get();
 
-  // Cleanup.
-  close(client_socket);
-  spdlog::debug("CLosed client socket: {}", client_socket);
+  // Accepted clients are only known by their fixed file slot, so sessions
+  // are created on the loop thread and owned by the loop.
+  return loop->Start(
+      shard.socket,
+      [this, loop](int client_file) {
+        auto session = std::make_unique<protocols::UringPassthroughSession>(
+            loop, client_file, context_);
+        auto* raw = session.get();
+        loop->Adopt(std::move(session));
+        raw->Start();
+      },
+      shard.cpus);
+}
+
+void Server::CloseShards(std::vector<std::unique_ptr<ListenerShard>> shards) {
+  for (auto& shard : shards) {
+    if (shard->accept_thread.joinable()) shard->accept_thread.join();
+
+    // Gracefully join all worker threads. No worker is added once the accept
+    // thread is gone, and they take 'workers_mutex' to finish, so the list
+    // is walked without it.
+    for (auto& worker : shard->workers)
+      if (worker.thread.joinable()) worker.thread.join();
+
+    // Stop the event loops; each one tears down the sessions it still owns.
+    for (auto& loop : shard->event_loops) loop->Stop();
+    if (shard->uring_loop) shard->uring_loop->Stop();
+
+    close(shard->socket);
+  }
 }
 
 }  // namespace core
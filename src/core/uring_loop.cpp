@@ -0,0 +1,286 @@
+#include "core/uring_loop.h"
+#include "spdlog/spdlog.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+namespace load_balancer {
+namespace core {
+
+// Bits of the user data carrying the operation tag. Handlers are at least
+// 8-byte aligned, so the tag fits below the pointer.
+constexpr uint64_t OP_MASK = 0x7;
+
+UringLoop::UringLoop(UringConfig config)
+    : config_(config), running_(false) {}
+
+UringLoop::~UringLoop() {
+  // Ensure resources are released.
+  Stop();
+}
+
+bool UringLoop::Supported() {
+  // Probes every opcode the loop and its sessions submit. Multishot accept,
+  // slot allocation in the fixed file table, sparse file registration and
+  // the cancel-any flags Stop relies on cannot be probed; they shipped in
+  // the same kernel as IORING_OP_SOCKET, so that opcode stands in for them.
+  // The setup flags are checked by creating the probing ring itself.
+  return IoUring::Supports({IORING_OP_ACCEPT, IORING_OP_SOCKET,
+                            IORING_OP_CONNECT, IORING_OP_LINK_TIMEOUT,
+                            IORING_OP_READ_FIXED, IORING_OP_RECV,
+                            IORING_OP_SEND, IORING_OP_SHUTDOWN,
+                            IORING_OP_CLOSE, IORING_OP_ASYNC_CANCEL,
+                            IORING_OP_READ});
+}
+
+bool UringLoop::Start(int listen_socket, AcceptCallback on_accept,
+                      const std::vector<int>& cpus) {
+  if (running_) return true;
+
+  if (!ring_.Init(config_.entries)) {
+    spdlog::error("Failed to create io_uring instance.");
+    return false;
+  }
+
+  // Every session needs a slot for its client and one for its backend;
+  // registering more slots than descriptors allowed fails.
+  rlimit limit{};
+  unsigned files = config_.max_connections * 2;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < files)
+    files = static_cast<unsigned>(limit.rlim_cur);
+  if (!ring_.RegisterSparseFiles(files)) return false;
+
+  // Relay buffers are registered once so the kernel skips pinning the pages
+  // on every read; without registration they are still usable for ordinary
+  // receives.
+  buffer_storage_ = std::make_unique<char[]>(config_.registered_buffers *
+                                             config_.buffer_size);
+  std::vector<iovec> buffers(config_.registered_buffers);
+  for (unsigned i = 0; i < config_.registered_buffers; ++i) {
+    buffers[i].iov_base = buffer_storage_.get() + i * config_.buffer_size;
+    buffers[i].iov_len = config_.buffer_size;
+    free_buffers_.push_back(config_.registered_buffers - 1 - i);
+  }
+  buffers_registered_ =
+      !buffers.empty() && ring_.RegisterBuffers(buffers.data(), buffers.size());
+
+  wake_fd_ = eventfd(0, EFD_CLOEXEC);
+  if (wake_fd_ < 0) {
+    spdlog::error("Failed to create wakeup eventfd: {}", strerror(errno));
+    return false;
+  }
+
+  listen_socket_ = listen_socket;
+  on_accept_ = std::move(on_accept);
+  running_ = true;
+  thread_ = std::thread(&UringLoop::Run, this);
+
+  if (!cpus.empty()) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) CPU_SET(cpu, &set);
+    int result = pthread_setaffinity_np(thread_.native_handle(), sizeof(set),
+                                        &set);
+    if (result != 0) {
+      spdlog::warn("Failed to pin io_uring loop to {} CPU(s) from {}: {}",
+                   cpus.size(), cpus.front(), strerror(result));
+    }
+  }
+  return true;
+}
+
+void UringLoop::Stop() {
+  if (!running_) return;
+
+  running_ = false;
+  uint64_t one = 1;
+  if (write(wake_fd_, &one, sizeof(one)) < 0) {
+    spdlog::warn("Failed to wake io_uring loop: {}", strerror(errno));
+  }
+  if (thread_.joinable()) thread_.join();
+
+  close(wake_fd_);
+  wake_fd_ = -1;
+}
+
+io_uring_sqe* UringLoop::Prepare(CompletionHandler* handler, uint8_t op) {
+  // A full submission queue is flushed to make room; the kernel consumes
+  // every entry it is handed.
+  io_uring_sqe* sqe = ring_.GetSqe();
+  while (!sqe) {
+    ring_.Submit();
+    sqe = ring_.GetSqe();
+  }
+
+  sqe->user_data = UserData(handler, op);
+  ++in_flight_;
+  return sqe;
+}
+
+uint64_t UringLoop::UserData(CompletionHandler* handler, uint8_t op) {
+  return reinterpret_cast<uint64_t>(handler) | (op & OP_MASK);
+}
+
+int UringLoop::AcquireBuffer(char** data) {
+  if (free_buffers_.empty()) return -1;
+
+  int index = free_buffers_.back();
+  free_buffers_.pop_back();
+  *data = buffer_storage_.get() + index * config_.buffer_size;
+  return index;
+}
+
+void UringLoop::ReleaseBuffer(int index) { free_buffers_.push_back(index); }
+
+void UringLoop::CloseFixedFile(int index) {
+  io_uring_sqe* sqe = Prepare(nullptr, kCloseOp);
+  sqe->opcode = IORING_OP_CLOSE;
+  sqe->file_index = index + 1;
+}
+
+CompletionHandler* UringLoop::Adopt(
+    std::unique_ptr<CompletionHandler> handler) {
+  CompletionHandler* raw = handler.get();
+  handlers_.emplace(raw, std::move(handler));
+  return raw;
+}
+
+void UringLoop::Retire(CompletionHandler* handler) {
+  retired_.push_back(handler);
+}
+
+void UringLoop::Run() {
+  ArmAccept();
+  ArmWakeup();
+
+  while (true) {
+    int result = ring_.Submit(1);
+    if (result < 0 && result != -EINTR && result != -EAGAIN &&
+        result != -EBUSY) {
+      spdlog::error("Call to 'io_uring_enter' failed: {}", strerror(-result));
+      break;
+    }
+    if (!DispatchCompletions()) break;
+  }
+
+  // Cancel everything still outstanding and keep reaping until the sessions
+  // have observed their cancellations and released their resources. A
+  // cancellation can race with sessions submitting follow-up operations, so
+  // it is repeated until nothing is left in flight.
+  while (in_flight_ > 0) {
+    if (!cancel_pending_) {
+      io_uring_sqe* sqe = Prepare(nullptr, kCancelOp);
+      sqe->opcode = IORING_OP_ASYNC_CANCEL;
+      sqe->cancel_flags = IORING_ASYNC_CANCEL_ANY | IORING_ASYNC_CANCEL_ALL;
+      cancel_pending_ = true;
+    }
+    int result = ring_.Submit(1);
+    if (result < 0 && result != -EINTR && result != -EAGAIN &&
+        result != -EBUSY) {
+      break;
+    }
+    DispatchCompletions();
+  }
+
+  handlers_.clear();
+  retired_.clear();
+}
+
+bool UringLoop::DispatchCompletions() {
+  while (io_uring_cqe* cqe = ring_.PeekCqe()) {
+    uint64_t user_data = cqe->user_data;
+    int32_t result = cqe->res;
+    uint32_t flags = cqe->flags;
+    ring_.SeenCqe();
+
+    // Multishot operations stay in flight while the kernel reports more.
+    if (!(flags & IORING_CQE_F_MORE)) --in_flight_;
+
+    auto* handler = reinterpret_cast<CompletionHandler*>(user_data & ~OP_MASK);
+    uint8_t op = user_data & OP_MASK;
+    if (handler) {
+      handler->HandleCompletion(op, result, flags);
+    } else {
+      HandleInternal(op, result, flags);
+    }
+  }
+
+  for (CompletionHandler* handler : retired_) handlers_.erase(handler);
+  retired_.clear();
+  return running_;
+}
+
+void UringLoop::ArmAccept() {
+  // Accepted clients go straight into a free slot of the fixed file table.
+  io_uring_sqe* sqe = Prepare(nullptr, kAcceptOp);
+  sqe->opcode = IORING_OP_ACCEPT;
+  sqe->fd = listen_socket_;
+  sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+  sqe->file_index = IORING_FILE_INDEX_ALLOC;
+  accept_armed_ = true;
+}
+
+void UringLoop::ArmWakeup() {
+  io_uring_sqe* sqe = Prepare(nullptr, kWakeupOp);
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = wake_fd_;
+  sqe->addr = reinterpret_cast<uint64_t>(&wake_counter_);
+  sqe->len = sizeof(wake_counter_);
+}
+
+void UringLoop::HandleInternal(uint8_t op, int32_t result, uint32_t flags) {
+  switch (op) {
+    case kAcceptOp:
+      if (result >= 0) {
+        on_accept_(result);
+      } else if (result == -ENFILE) {
+        // The fixed file table is full. The kernel had already accepted this
+        // client and closes it for want of a slot; accepting stops until a
+        // session frees one, so later clients wait in the listen backlog.
+        spdlog::warn("Fixed file table is full; dropped a client and paused "
+                     "accepting.");
+        accept_paused_ = true;
+      } else if (result != -ECANCELED && result != -EINVAL &&
+                 result != -EBADF) {
+        spdlog::error("Failed to accept connection: {}", strerror(-result));
+      }
+
+      // The kernel ends a multishot accept on errors; it is re-armed unless
+      // the listener is gone or the loop is stopping.
+      if (!(flags & IORING_CQE_F_MORE)) {
+        accept_armed_ = false;
+        if (running_ && !accept_paused_ && result != -EINVAL &&
+            result != -EBADF && result != -ECANCELED) {
+          ArmAccept();
+        }
+      }
+      break;
+
+    case kWakeupOp:
+      // Stop signals the eventfd after clearing 'running_'.
+      if (running_ && result != -ECANCELED) ArmWakeup();
+      break;
+
+    case kCloseOp:
+      if (result < 0)
+        spdlog::warn("Failed to close fixed file: {}", strerror(-result));
+      if (accept_paused_ && running_) {
+        accept_paused_ = false;
+        if (!accept_armed_) ArmAccept();
+      }
+      break;
+
+    case kCancelOp:
+      cancel_pending_ = false;
+      break;
+  }
+}
+
+}  // namespace core
+}  // namespace load_balancer
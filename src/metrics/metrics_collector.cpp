@@ -1,57 +1,80 @@
 #include "metrics/metrics_collector.h"
 
+#include <algorithm>
+
 namespace load_balancer {
 namespace monitor {
 
 void MetricsCollector::RecordRequest(
     const std::shared_ptr<core::BackendServer>& backend) {
   std::lock_guard<std::mutex> lock(metrics_mutex_);
-  metrics_map_[backend->Ip()].total_requests++;
+  metrics_map_[backend->Address()].total_requests++;
 }
 
 void MetricsCollector::RecordSuccess(
     const std::shared_ptr<core::BackendServer>& backend) {
   std::lock_guard<std::mutex> lock(metrics_mutex_);
-  metrics_map_[backend->Ip()].total_successes++;
+  metrics_map_[backend->Address()].total_successes++;
 }
 
 void MetricsCollector::RecordFailure(
     const std::shared_ptr<core::BackendServer>& backend) {
   std::lock_guard<std::mutex> lock(metrics_mutex_);
-  metrics_map_[backend->Ip()].total_failures++;
+  metrics_map_[backend->Address()].total_failures++;
 }
 
 void MetricsCollector::RecordLatency(
     const std::shared_ptr<core::BackendServer>& backend,
     std::chrono::milliseconds latency) {
   std::lock_guard<std::mutex> lock(metrics_mutex_);
-  auto& metrics = metrics_map_[backend->Ip()];
+  auto& metrics = metrics_map_[backend->Address()];
   metrics.total_latency_ms += latency.count();
   metrics.latency_samples++;
 }
 
+void MetricsCollector::RecordExperiences(
+    std::span<const rl::Experience> batch) {
+  std::lock_guard<std::mutex> lock(metrics_mutex_);
+  for (const rl::Experience& experience : batch) {
+    auto& metrics = metrics_map_[experience.backend->Address()];
+    metrics.total_requests++;
+    if (!experience.success) {
+      metrics.total_failures++;
+      continue;
+    }
+    metrics.total_successes++;
+
+    const rl::RequestTiming& timing = experience.timing;
+    int64_t last_ns = std::max({timing.connected_ns, timing.handshake_ns,
+                                timing.first_byte_ns, timing.completed_ns});
+    if (timing.picked_ns == 0 || last_ns == 0) continue;
+    metrics.total_latency_ms += (last_ns - timing.picked_ns) / 1000000;
+    metrics.latency_samples++;
+  }
+}
+
 int MetricsCollector::GetRequestCount(
     const std::shared_ptr<core::BackendServer>& backend) {
   std::lock_guard<std::mutex> lock(metrics_mutex_);
-  return metrics_map_[backend->Ip()].total_requests;
+  return metrics_map_[backend->Address()].total_requests;
 }
 
 int MetricsCollector::GetSuccessCount(
     const std::shared_ptr<core::BackendServer>& backend) {
   std::lock_guard<std::mutex> lock(metrics_mutex_);
-  return metrics_map_[backend->Ip()].total_successes;
+  return metrics_map_[backend->Address()].total_successes;
 }
 
 int MetricsCollector::GetFailureCount(
     const std::shared_ptr<core::BackendServer>& backend) {
   std::lock_guard<std::mutex> lock(metrics_mutex_);
-  return metrics_map_[backend->Ip()].total_failures;
+  return metrics_map_[backend->Address()].total_failures;
 }
 
 double MetricsCollector::GetAverageLatency(
     const std::shared_ptr<core::BackendServer>& backend) {
   std::lock_guard<std::mutex> lock(metrics_mutex_);
-  const auto& metrics = metrics_map_[backend->Ip()];
+  const auto& metrics = metrics_map_[backend->Address()];
   if (metrics.latency_samples == 0) return 0.0;
   return static_cast<double>(metrics.total_latency_ms) / metrics.latency_samples;
 }
@@ -59,13 +82,13 @@ double MetricsCollector::GetAverageLatency(
 double MetricsCollector::GetCpuUsage(
     const std::shared_ptr<core::BackendServer>& backend) {
   std::lock_guard<std::mutex> lock(metrics_mutex_);
-  return metrics_map_[backend->Ip()].cpu_usage_percent;
+  return metrics_map_[backend->Address()].cpu_usage_percent;
 }
 
 double MetricsCollector::GetMemoryUsage(
     const std::shared_ptr<core::BackendServer>& backend) {
   std::lock_guard<std::mutex> lock(metrics_mutex_);
-  return metrics_map_[backend->Ip()].memory_usage_mb;
+  return metrics_map_[backend->Address()].memory_usage_mb;
 }
 
 const std::unordered_map<std::string, Metrics> MetricsCollector::MetricsMap() {
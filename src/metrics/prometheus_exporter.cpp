@@ -52,26 +52,26 @@ PrometheusExporter::PrometheusExporter(
 void PrometheusExporter::Export() {
   // Get a consistent snapshot of all backend metrics.
   const auto backend_to_metrics_map = metrics_collector_->MetricsMap();
-  for (const auto& [backend_ip, metrics] : backend_to_metrics_map) {
+  for (const auto& [address, metrics] : backend_to_metrics_map) {
     // --- Update Counter Metrics ---
-    auto& req_counter = request_counter_family_.Add({{"backend", backend_ip}});
+    auto& req_counter = request_counter_family_.Add({{"backend", address}});
     req_counter.Increment(metrics.total_requests);
 
-    auto& success_counter = success_counter_family_.Add({{"backend", backend_ip}});
+    auto& success_counter = success_counter_family_.Add({{"backend", address}});
     success_counter.Increment();
 
-    auto& fail_counter = failure_counter_family_.Add({{"backend", backend_ip}});
+    auto& fail_counter = failure_counter_family_.Add({{"backend", address}});
     fail_counter.Increment(metrics.total_failures);
 
     // --- Update Gauge Metrics ---
-    auto& latency_gauge = latency_gauge_family_.Add({{"backend", backend_ip}});
+    auto& latency_gauge = latency_gauge_family_.Add({{"backend", address}});
     latency_gauge.Set(metrics.total_latency_ms);
 
-    auto& cpu_gauge = cpu_usage_gauge_family_.Add({{"backend", backend_ip}});
+    auto& cpu_gauge = cpu_usage_gauge_family_.Add({{"backend", address}});
     cpu_gauge.Set(metrics.cpu_usage_percent);
 
     auto& memory_gauge =
-        memory_usage_gauge_family_.Add({{"backend", backend_ip}});
+        memory_usage_gauge_family_.Add({{"backend", address}});
     memory_gauge.Set(metrics.memory_usage_mb);
   }
 }
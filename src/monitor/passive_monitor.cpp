@@ -7,49 +7,47 @@ namespace monitor {
 
 void PassiveMonitor::RecordFailure(
     const std::shared_ptr<core::BackendServer>& backend) {
-  std::lock_guard<std::mutex> lock(stats_mutex_);
-  auto& stats = backend_stats_[backend->Ip()];
-  stats.failure_count++;
-  stats.last_failure_time = std::chrono::steady_clock::now();
+  core::BackendHealth& health = backend->Health();
+  int failures =
+      health.consecutive_failures.fetch_add(1, std::memory_order_relaxed) + 1;
+  health.consecutive_successes.store(0, std::memory_order_relaxed);
+  health.last_failure_ns.store(core::SteadyNowNs(), std::memory_order_relaxed);
   spdlog::warn("Recorded failure for backend {}: failure count = {}",
-               backend->Ip(), stats.failure_count);
+               backend->Address(), failures);
 }
 
 void PassiveMonitor::RecordSuccess(
     const std::shared_ptr<core::BackendServer>& backend) {
-  std::lock_guard<std::mutex> lock(stats_mutex_);
-  auto& stats = backend_stats_[backend->Ip()];
-  stats.success_count++;
+  core::BackendHealth& health = backend->Health();
+  // Backends without failures have nothing to reset.
+  if (health.consecutive_failures.load(std::memory_order_relaxed) == 0) return;
+  int successes =
+      health.consecutive_successes.fetch_add(1, std::memory_order_relaxed) + 1;
 
   // If enough consecutive successes, reset failure counts.
-  if (stats.success_count >= kSuccessResetThreshold) {
-    stats.failure_count = 0;
-    stats.success_count = 0;
+  if (successes >= kSuccessResetThreshold) {
+    health.consecutive_failures.store(0, std::memory_order_relaxed);
+    health.consecutive_successes.store(0, std::memory_order_relaxed);
     spdlog::info(
         "Reset failure count for backend {} after consecutive successes",
-        backend->Ip());
+        backend->Address());
   }
 }
 
 bool PassiveMonitor::IsBackendSuspect(
     const std::shared_ptr<core::BackendServer>& backend) {
-  std::lock_guard<std::mutex> lock(stats_mutex_);
-
-  // Find the backend's statistics. If not found, it's not suspect.
-  auto it = backend_stats_.find(backend->Ip());
-  if (it == backend_stats_.end()) return false;
-
-  // Get a reference to the statistics.
-  const auto& stats = it->second;
+  const core::BackendHealth& health = backend->Health();
 
   // Check if failure count has reached the threshold.
-  if (stats.failure_count >= kFailureThreshold) {
-    auto now = std::chrono::steady_clock::now();
-    auto time_since_last_failure = now - stats.last_failure_time;
+  if (health.consecutive_failures.load(std::memory_order_relaxed) >=
+      kFailureThreshold) {
+    auto time_since_last_failure = std::chrono::nanoseconds(
+        core::SteadyNowNs() -
+        health.last_failure_ns.load(std::memory_order_relaxed));
     // Check if it's within the quarantine period.
     if (time_since_last_failure < kQuarantineTime) {
       spdlog::debug("Backend {} is quarantined due to failure threshold",
-                    backend->Ip());
+                    backend->Address());
       return true;
     }
   }
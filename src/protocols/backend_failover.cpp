@@ -0,0 +1,171 @@
+#include "protocols/backend_failover.h"
+
+#include <algorithm>
+#include <chrono>
+#include <spdlog/spdlog.h>
+#include <utility>
+
+namespace load_balancer {
+namespace protocols {
+
+RoutingDecision::RoutingDecision(const HandlerContext& context,
+                                 std::shared_ptr<core::BackendServer> backend,
+                                 const rl::FeatureVector& features,
+                                 const rl::RequestTiming& timing,
+                                 int replica)
+    : context_(&context), backend_(std::move(backend)), features_(features),
+      timing_(timing), replica_(replica) {}
+
+RoutingDecision::~RoutingDecision() {
+  if (Pending()) Finish(true);
+}
+
+RoutingDecision::RoutingDecision(RoutingDecision&& other) noexcept
+    : context_(std::exchange(other.context_, nullptr)),
+      backend_(std::move(other.backend_)), features_(other.features_),
+      timing_(other.timing_), replica_(other.replica_) {}
+
+RoutingDecision& RoutingDecision::operator=(RoutingDecision&& other) noexcept {
+  if (this != &other) {
+    if (Pending()) Finish(true);
+    context_ = std::exchange(other.context_, nullptr);
+    backend_ = std::move(other.backend_);
+    features_ = other.features_;
+    timing_ = other.timing_;
+    replica_ = other.replica_;
+  }
+  return *this;
+}
+
+void RoutingDecision::HandshakeDone() {
+  if (Pending() && timing_.handshake_ns == 0)
+    timing_.handshake_ns = core::SteadyNowNs();
+}
+
+void RoutingDecision::FirstByte() { FirstByteAt(core::SteadyNowNs()); }
+
+void RoutingDecision::FirstByteAt(int64_t at_ns) {
+  if (Pending() && timing_.first_byte_ns == 0) timing_.first_byte_ns = at_ns;
+}
+
+void RoutingDecision::Complete() {
+  if (!Pending()) return;
+  timing_.completed_ns = core::SteadyNowNs();
+  if (timing_.first_byte_ns == 0) timing_.first_byte_ns = timing_.completed_ns;
+  Finish(true);
+}
+
+void RoutingDecision::Finish(bool success) {
+  if (!Pending()) return;
+  const HandlerContext& context = *std::exchange(context_, nullptr);
+  if (!success) {
+    // The connect was counted as a success; what followed was not.
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::nanoseconds(core::SteadyNowNs() - timing_.picked_ns));
+    backend_->RecordOutcome(elapsed, false);
+    if (context.passive_monitor)
+      context.passive_monitor->RecordFailure(backend_);
+  }
+  double reward = rl::ComputeReward(timing_, success, context.reward);
+  context.router->ReportReward(rl::Experience{
+      std::move(backend_), features_, reward, timing_, success, replica_});
+}
+
+BackendFailover::BackendFailover(const HandlerContext& context)
+    : context_(context) {}
+
+std::shared_ptr<core::BackendServer> BackendFailover::Next() {
+  if (attempts_ >= context_.connect.max_attempts) return nullptr;
+
+  // The common case costs no more than a plain pick.
+  if (attempts_ == 0) {
+    current_ = context_.router->PickBackendServer();
+  } else {
+    // Backends that keep failing are skipped while others are left.
+    std::vector<std::shared_ptr<core::BackendServer>> excluded = tried_;
+    if (context_.passive_monitor) {
+      for (const auto& backend : context_.router->BackendServers()) {
+        if (std::find(tried_.begin(), tried_.end(), backend) == tried_.end() &&
+            context_.passive_monitor->IsBackendSuspect(backend)) {
+          excluded.push_back(backend);
+        }
+      }
+    }
+    current_ = context_.router->PickBackendServer(excluded);
+    if (!current_ && excluded.size() > tried_.size())
+      current_ = context_.router->PickBackendServer(tried_);
+    if (current_) {
+      spdlog::info("Failing over to backend {} (attempt {} of {})",
+                   current_->Address(), attempts_ + 1,
+                   context_.connect.max_attempts);
+    }
+  }
+
+  if (current_) {
+    ++attempts_;
+    features_ = rl::ExtractFeatures(*current_);
+    picked_ns_ = core::SteadyNowNs();
+    replica_ = context_.router->DecisionReplica();
+  }
+  return current_;
+}
+
+void BackendFailover::Failed() {
+  if (!current_) return;
+  rl::RequestTiming timing;
+  timing.picked_ns = picked_ns_;
+  auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::nanoseconds(core::SteadyNowNs() - picked_ns_));
+  current_->RecordOutcome(latency, false);
+  if (context_.passive_monitor)
+    context_.passive_monitor->RecordFailure(current_);
+  context_.router->ReportReward(
+      rl::Experience{current_, features_,
+                     rl::ComputeReward(timing, false, context_.reward), timing,
+                     false, replica_});
+  tried_.push_back(std::move(current_));
+}
+
+void BackendFailover::Succeeded() {
+  if (!current_) return;
+  rl::RequestTiming timing;
+  timing.picked_ns = picked_ns_;
+  timing.connected_ns = core::SteadyNowNs();
+  auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::nanoseconds(timing.connected_ns - picked_ns_));
+  current_->RecordOutcome(latency, true);
+  if (context_.passive_monitor)
+    context_.passive_monitor->RecordSuccess(current_);
+  active_ = core::ActiveConnection(current_);
+  decision_ = RoutingDecision(context_, current_, features_, timing, replica_);
+}
+
+std::shared_ptr<core::BackendServer> BackendFailover::Connect(
+    const std::function<bool(const std::shared_ptr<core::BackendServer>&)>&
+        connect) {
+  while (auto backend = Next()) {
+    if (connect(backend)) {
+      Succeeded();
+      return backend;
+    }
+    Failed();
+  }
+  return nullptr;
+}
+
+std::unique_ptr<BackendConnection> BackendFailover::AcquirePooled(
+    std::shared_ptr<core::BackendServer>* backend) {
+  std::unique_ptr<BackendConnection> connection;
+  *backend = Connect([&](const auto& candidate) {
+    connection = context_.pools->PoolFor(candidate)->Acquire();
+    if (!connection) {
+      spdlog::error("Failed to obtain a connection to backend {}",
+                    candidate->Address());
+    }
+    return connection != nullptr;
+  });
+  return connection;
+}
+
+}  // namespace protocols
+}  // namespace load_balancer
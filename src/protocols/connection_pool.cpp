@@ -0,0 +1,297 @@
+#include "protocols/connection_pool.h"
+#include "utils/socket_utils.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <openssl/err.h>
+#include <poll.h>
+#include <spdlog/spdlog.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <utility>
+
+namespace load_balancer {
+namespace protocols {
+
+BackendConnection::BackendConnection(int socket, SSL* ssl)
+    : socket_(socket), ssl_(ssl),
+      idle_since_(std::chrono::steady_clock::now()) {}
+
+BackendConnection::~BackendConnection() {
+  if (ssl_) {
+    if (SSL_is_init_finished(ssl_)) SSL_shutdown(ssl_);
+    SSL_free(ssl_);
+  }
+  if (socket_ >= 0) close(socket_);
+}
+
+bool BackendConnection::IsAlive() {
+  char byte;
+  ssize_t peeked = recv(socket_, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+  // The backend closed the connection.
+  if (peeked == 0) return false;
+  // Nothing pending: the connection is idle as expected.
+  if (peeked < 0) return errno == EAGAIN || errno == EWOULDBLOCK;
+
+  // Something arrived while idle. Let TLS consume records such as session
+  // tickets; any application data or alert means the connection is unusable.
+  int bytes = SSL_read(ssl_, &byte, 1);
+  if (bytes > 0) return false;
+  return SSL_get_error(ssl_, bytes) == SSL_ERROR_WANT_READ;
+}
+
+PendingConnection::PendingConnection(
+    std::shared_ptr<core::BackendServer> backend,
+    std::shared_ptr<utils::TlsContextManager> tls, int socket,
+    std::chrono::steady_clock::time_point deadline)
+    : backend_(std::move(backend)), tls_(std::move(tls)), socket_(socket),
+      deadline_(deadline), events_(POLLOUT) {}
+
+PendingConnection::~PendingConnection() {
+  if (ssl_) SSL_free(ssl_);
+  if (socket_ >= 0) close(socket_);
+}
+
+PendingConnection::Status PendingConnection::Advance() {
+  bool expired = std::chrono::steady_clock::now() >= deadline_;
+  if (!ssl_) {
+    // The socket turns writable once the TCP connect finished.
+    pollfd pfd{socket_, POLLOUT, 0};
+    if (poll(&pfd, 1, 0) <= 0) {
+      if (!expired) return Status::kPending;
+      spdlog::error("Failed to connect to backend {} - {}",
+                    backend_->Address(), strerror(ETIMEDOUT));
+      return Status::kFailed;
+    }
+    int error = 0;
+    socklen_t length = sizeof(error);
+    getsockopt(socket_, SOL_SOCKET, SO_ERROR, &error, &length);
+    if (error != 0) {
+      spdlog::error("Failed to connect to backend {} - {}",
+                    backend_->Address(), strerror(error));
+      return Status::kFailed;
+    }
+
+    // --- TLS Handshake with Backend (Load Balancer acts as Client) ---
+    ssl_ = SSL_new(tls_->ClientContext());
+    SSL_set_fd(ssl_, socket_);
+    tls_->PrepareBackendConnection(ssl_, backend_->Address());
+  }
+
+  int result = SSL_connect(ssl_);
+  if (result > 0) return Status::kEstablished;
+  int error = SSL_get_error(ssl_, result);
+  if (error == SSL_ERROR_WANT_READ || error == SSL_ERROR_WANT_WRITE) {
+    events_ = error == SSL_ERROR_WANT_READ ? POLLIN : POLLOUT;
+    if (!expired) return Status::kPending;
+    spdlog::warn("TLS handshake with backend {} timed out",
+                 backend_->Address());
+  } else {
+    spdlog::error("TLS handshake with backend {} failed",
+                  backend_->Address());
+    ERR_print_errors_fp(stderr);
+  }
+  tls_->EvictBackendSession(backend_->Address());
+  return Status::kFailed;
+}
+
+std::unique_ptr<BackendConnection> PendingConnection::Take() {
+  return std::make_unique<BackendConnection>(std::exchange(socket_, -1),
+                                             std::exchange(ssl_, nullptr));
+}
+
+ConnectionPool::ConnectionPool(std::shared_ptr<core::BackendServer> backend,
+                               std::shared_ptr<utils::TlsContextManager> tls,
+                               const ConnectionPoolConfig& config)
+    : backend_(std::move(backend)), tls_(std::move(tls)), config_(config) {}
+
+std::unique_ptr<BackendConnection> ConnectionPool::Acquire() {
+  if (auto connection = TryAcquireIdle()) return connection;
+  return Connect();
+}
+
+std::unique_ptr<BackendConnection> ConnectionPool::TryAcquireIdle() {
+  auto now = std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  // Take the most recently used connection; stale or dead ones are dropped.
+  while (!idle_.empty()) {
+    auto connection = std::move(idle_.back());
+    idle_.pop_back();
+    if (now - connection->IdleSince() < config_.idle_timeout &&
+        connection->IsAlive()) {
+      return connection;
+    }
+  }
+  return nullptr;
+}
+
+void ConnectionPool::Release(std::unique_ptr<BackendConnection> connection,
+                             bool reusable) {
+  if (!connection || !reusable) return;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (idle_.size() >= config_.max_idle) return;
+  connection->MarkIdle();
+  idle_.push_back(std::move(connection));
+}
+
+void ConnectionPool::Maintain() {
+  auto now = std::chrono::steady_clock::now();
+  size_t missing = 0;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::erase_if(idle_, [&](const std::unique_ptr<BackendConnection>& conn) {
+      return now - conn->IdleSince() >= config_.idle_timeout;
+    });
+    if (idle_.size() < config_.min_idle) missing = config_.min_idle -
+                                                   idle_.size();
+  }
+
+  // Connect without holding the lock so borrowers are never stalled.
+  for (size_t i = 0; i < missing; ++i) {
+    auto connection = Connect();
+    if (!connection) break;
+    Release(std::move(connection), true);
+  }
+}
+
+size_t ConnectionPool::IdleCount() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return idle_.size();
+}
+
+std::unique_ptr<PendingConnection> ConnectionPool::StartConnect() {
+  // The connect and the TLS handshake share one deadline, so a backend that
+  // accepts but never answers cannot stall warm-up or a borrower.
+  auto deadline = std::chrono::steady_clock::now() + config_.connect_timeout;
+  int backend_socket =
+      utils::SocketUtils::StartConnect(backend_->Ip(), backend_->Port());
+  if (backend_socket < 0) {
+    spdlog::error("Failed to connect to backend {} - {}", backend_->Address(),
+                  strerror(errno));
+    return nullptr;
+  }
+  return std::make_unique<PendingConnection>(backend_, tls_, backend_socket,
+                                             deadline);
+}
+
+std::unique_ptr<BackendConnection> ConnectionPool::Connect() {
+  std::unique_ptr<PendingConnection> pending = StartConnect();
+  if (!pending) return nullptr;
+  while (true) {
+    switch (pending->Advance()) {
+      case PendingConnection::Status::kEstablished:
+        return pending->Take();
+      case PendingConnection::Status::kFailed:
+        return nullptr;
+      case PendingConnection::Status::kPending:
+        break;
+    }
+
+    // Wait for the socket; the next Advance notices a missed deadline.
+    pollfd pfd{pending->Socket(), pending->Events(), 0};
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+        pending->Deadline() - std::chrono::steady_clock::now());
+    poll(&pfd, 1, std::max<int>(0, remaining.count() + 1));
+  }
+}
+
+ConnectionPoolManager::ConnectionPoolManager(
+    std::shared_ptr<core::Router> router,
+    std::shared_ptr<utils::TlsContextManager> tls, ConnectionPoolConfig config)
+    : router_(std::move(router)), tls_(std::move(tls)), config_(config),
+      running_(false) {}
+
+ConnectionPoolManager::~ConnectionPoolManager() {
+  Stop();
+}
+
+std::shared_ptr<ConnectionPool> ConnectionPoolManager::PoolFor(
+    const std::shared_ptr<core::BackendServer>& backend) {
+  std::lock_guard<std::mutex> lock(pools_mutex_);
+  // A backend removed and added again under the same address gets a fresh
+  // pool rather than the one that still refers to its old instance.
+  auto& pool = pools_[backend->Address()];
+  if (!pool || pool->Backend() != backend)
+    pool = std::make_shared<ConnectionPool>(backend, tls_, config_);
+  return pool;
+}
+
+void ConnectionPoolManager::Warm(
+    const std::vector<std::shared_ptr<core::BackendServer>>& backends) {
+  for (const auto& backend : backends) {
+    std::shared_ptr<ConnectionPool> pool = PoolFor(backend);
+    pool->Maintain();
+    spdlog::info("Warmed connection pool for {} with {} connections",
+                 backend->Address(), pool->IdleCount());
+  }
+}
+
+void ConnectionPoolManager::Prune(
+    const std::vector<std::shared_ptr<core::BackendServer>>& backends) {
+  // Pools are destroyed after the lock is released, so closing their
+  // connections does not block PoolFor callers.
+  std::vector<std::shared_ptr<ConnectionPool>> dropped;
+  {
+    std::lock_guard<std::mutex> lock(pools_mutex_);
+    for (auto it = pools_.begin(); it != pools_.end();) {
+      if (std::find(backends.begin(), backends.end(),
+                    it->second->Backend()) != backends.end()) {
+        ++it;
+        continue;
+      }
+      dropped.push_back(std::move(it->second));
+      it = pools_.erase(it);
+    }
+  }
+  for (const auto& pool : dropped) {
+    // A removed backend's cached session would never be offered again.
+    if (tls_) tls_->EvictBackendSession(pool->Backend()->Address());
+    spdlog::info("Dropped connection pool for removed backend {}",
+                 pool->Backend()->Address());
+  }
+}
+
+void ConnectionPoolManager::Start() {
+  if (running_) return;
+  running_ = true;
+  maintenance_thread_ = std::thread(&ConnectionPoolManager::MaintenanceLoop,
+                                    this);
+}
+
+void ConnectionPoolManager::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(stop_mutex_);
+    running_ = false;
+  }
+  stop_cv_.notify_all();
+  if (maintenance_thread_.joinable()) maintenance_thread_.join();
+}
+
+void ConnectionPoolManager::MaintenanceLoop() {
+  while (running_) {
+    {
+      // Sleep for the maintenance interval, or until stopped.
+      std::unique_lock<std::mutex> lock(stop_mutex_);
+      stop_cv_.wait_for(lock, config_.maintenance_interval,
+                        [this]() { return !running_; });
+    }
+    if (!running_) break;
+
+    // Removed backends are neither reconnected to nor kept alive by a pool.
+    Prune(router_->BackendServers());
+
+    // Snapshot the pools so maintenance does not block PoolFor callers.
+    std::vector<std::shared_ptr<ConnectionPool>> pools;
+    {
+      std::lock_guard<std::mutex> lock(pools_mutex_);
+      for (auto& [address, pool] : pools_) pools.push_back(pool);
+    }
+    for (const auto& pool : pools) pool->Maintain();
+  }
+}
+
+}  // namespace protocols
+}  // namespace load_balancer
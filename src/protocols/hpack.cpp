@@ -0,0 +1,390 @@
+#include "protocols/hpack.h"
+
+#include <iterator>
+
+namespace load_balancer {
+namespace protocols {
+
+namespace {
+
+// An entry of the HPACK static table.
+struct StaticEntry {
+  std::string_view name;
+  std::string_view value;
+};
+
+// The HPACK static table (RFC 7541 Appendix A); index 1 is the first entry.
+constexpr StaticEntry STATIC_TABLE[] = {
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""},
+};
+
+// Number of entries in the static table.
+constexpr size_t STATIC_TABLE_SIZE = std::size(STATIC_TABLE);
+
+// Overhead added to every dynamic table entry (RFC 7541 4.1).
+constexpr size_t ENTRY_OVERHEAD = 32;
+
+// A code of the HPACK Huffman code, most significant bit first.
+struct HuffmanCode {
+  uint32_t code;
+  uint8_t length;
+};
+
+// The HPACK Huffman code (RFC 7541 Appendix B), indexed by symbol; symbol 256
+// is the end-of-string marker.
+constexpr HuffmanCode HUFFMAN_CODES[] = {
+    {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28},
+    {0xfffffe4, 28}, {0xfffffe5, 28}, {0xfffffe6, 28}, {0xfffffe7, 28},
+    {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+    {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28},
+    {0xfffffed, 28}, {0xfffffee, 28}, {0xfffffef, 28}, {0xffffff0, 28},
+    {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+    {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28},
+    {0xffffff8, 28}, {0xffffff9, 28}, {0xffffffa, 28}, {0xffffffb, 28},
+    {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12}, {0x1ff9, 13}, {0x15, 6},
+    {0xf8, 8}, {0x7fa, 11}, {0x3fa, 10}, {0x3fb, 10}, {0xf9, 8}, {0x7fb, 11},
+    {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6}, {0x0, 5}, {0x1, 5}, {0x2, 5},
+    {0x19, 6}, {0x1a, 6}, {0x1b, 6}, {0x1c, 6}, {0x1d, 6}, {0x1e, 6}, {0x1f, 6},
+    {0x5c, 7}, {0xfb, 8}, {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10},
+    {0x1ffa, 13}, {0x21, 6}, {0x5d, 7}, {0x5e, 7}, {0x5f, 7}, {0x60, 7},
+    {0x61, 7}, {0x62, 7}, {0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7}, {0x67, 7},
+    {0x68, 7}, {0x69, 7}, {0x6a, 7}, {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+    {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7}, {0xfc, 8}, {0x73, 7}, {0xfd, 8},
+    {0x1ffb, 13}, {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+    {0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5}, {0x24, 6}, {0x5, 5}, {0x25, 6},
+    {0x26, 6}, {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7}, {0x28, 6}, {0x29, 6},
+    {0x2a, 6}, {0x7, 5}, {0x2b, 6}, {0x76, 7}, {0x2c, 6}, {0x8, 5}, {0x9, 5},
+    {0x2d, 6}, {0x77, 7}, {0x78, 7}, {0x79, 7}, {0x7a, 7}, {0x7b, 7},
+    {0x7ffe, 15}, {0x7fc, 11}, {0x3ffd, 14}, {0x1ffd, 13}, {0xffffffc, 28},
+    {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20}, {0x3fffd3, 22},
+    {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23}, {0x3fffd6, 22},
+    {0x7fffda, 23}, {0x7fffdb, 23}, {0x7fffdc, 23}, {0x7fffdd, 23},
+    {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23}, {0xffffec, 24},
+    {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23}, {0xffffee, 24},
+    {0x7fffe1, 23}, {0x7fffe2, 23}, {0x7fffe3, 23}, {0x7fffe4, 23},
+    {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23}, {0x3fffd9, 22},
+    {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24}, {0x3fffda, 22},
+    {0x1fffdd, 21}, {0xfffe9, 20}, {0x3fffdb, 22}, {0x3fffdc, 22},
+    {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21}, {0x7fffea, 23},
+    {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24}, {0x1fffdf, 21},
+    {0x3fffdf, 22}, {0x7fffeb, 23}, {0x7fffec, 23}, {0x1fffe0, 21},
+    {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21}, {0x7fffed, 23},
+    {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23}, {0xfffea, 20},
+    {0x3fffe2, 22}, {0x3fffe3, 22}, {0x3fffe4, 22}, {0x7ffff0, 23},
+    {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23}, {0x3ffffe0, 26},
+    {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19}, {0x3fffe7, 22},
+    {0x7ffff2, 23}, {0x3fffe8, 22}, {0x1ffffec, 25}, {0x3ffffe2, 26},
+    {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27}, {0x7ffffdf, 27},
+    {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25}, {0x7fff2, 19},
+    {0x1fffe3, 21}, {0x3ffffe6, 26}, {0x7ffffe0, 27}, {0x7ffffe1, 27},
+    {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24}, {0x1fffe4, 21},
+    {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26}, {0xffffffd, 28},
+    {0x7ffffe3, 27}, {0x7ffffe4, 27}, {0x7ffffe5, 27}, {0xfffec, 20},
+    {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21}, {0x3fffe9, 22},
+    {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23}, {0x3fffea, 22},
+    {0x3fffeb, 22}, {0x1ffffee, 25}, {0x1ffffef, 25}, {0xfffff4, 24},
+    {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23}, {0x3ffffeb, 26},
+    {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26}, {0x7ffffe7, 27},
+    {0x7ffffe8, 27}, {0x7ffffe9, 27}, {0x7ffffea, 27}, {0x7ffffeb, 27},
+    {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27}, {0x7ffffee, 27},
+    {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26}, {0x3fffffff, 30},
+};
+
+// Symbol of the end-of-string marker, which must never be decoded.
+constexpr int HUFFMAN_EOS = 256;
+
+// Binary decoding tree of the Huffman code, built once on first use.
+class HuffmanTree {
+ public:
+  HuffmanTree() {
+    nodes_.emplace_back();
+    for (int symbol = 0; symbol < static_cast<int>(std::size(HUFFMAN_CODES));
+         ++symbol) {
+      const HuffmanCode& code = HUFFMAN_CODES[symbol];
+      size_t node = 0;
+      for (int bit = code.length - 1; bit >= 0; --bit) {
+        int branch = (code.code >> bit) & 1;
+        if (nodes_[node].children[branch] < 0) {
+          nodes_[node].children[branch] = static_cast<int16_t>(nodes_.size());
+          nodes_.emplace_back();
+        }
+        node = nodes_[node].children[branch];
+      }
+      nodes_[node].symbol = static_cast<int16_t>(symbol);
+    }
+  }
+
+  // Appends the decoding of 'input' to 'output'. Fails on the end-of-string
+  // symbol and on padding that is longer than 7 bits or not all ones.
+  bool Decode(std::string_view input, std::string& output) const {
+    size_t node = 0;
+    int pending_bits = 0;
+    bool all_ones = true;
+    for (unsigned char byte : input) {
+      for (int bit = 7; bit >= 0; --bit) {
+        int branch = (byte >> bit) & 1;
+        int16_t next = nodes_[node].children[branch];
+        if (next < 0) return false;
+        node = next;
+        ++pending_bits;
+        all_ones = all_ones && branch == 1;
+
+        int16_t symbol = nodes_[node].symbol;
+        if (symbol < 0) continue;
+        if (symbol == HUFFMAN_EOS) return false;
+        output.push_back(static_cast<char>(symbol));
+        node = 0;
+        pending_bits = 0;
+        all_ones = true;
+      }
+    }
+    return pending_bits < 8 && all_ones;
+  }
+
+ private:
+  // A node of the tree; leaves carry a symbol.
+  struct Node {
+    int16_t children[2] = {-1, -1};
+    int16_t symbol = -1;
+  };
+
+  // Tree nodes; the root is the first one.
+  std::vector<Node> nodes_;
+};
+
+// Returns the shared Huffman decoding tree.
+const HuffmanTree& Huffman() {
+  static const HuffmanTree tree;
+  return tree;
+}
+
+// Decodes an integer with an N-bit prefix (RFC 7541 5.1) from the front of
+// 'input' and removes it.
+bool DecodeInteger(std::string_view& input, int prefix_bits, uint64_t& value) {
+  if (input.empty()) return false;
+  uint64_t mask = (uint64_t{1} << prefix_bits) - 1;
+  value = static_cast<unsigned char>(input.front()) & mask;
+  input.remove_prefix(1);
+  if (value < mask) return true;
+
+  for (int shift = 0; shift <= 56; shift += 7) {
+    if (input.empty()) return false;
+    auto byte = static_cast<unsigned char>(input.front());
+    input.remove_prefix(1);
+    value += static_cast<uint64_t>(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) return true;
+  }
+  return false;
+}
+
+// Decodes a string literal (RFC 7541 5.2) from the front of 'input' and
+// removes it.
+bool DecodeString(std::string_view& input, std::string& output) {
+  if (input.empty()) return false;
+  bool huffman = static_cast<unsigned char>(input.front()) & 0x80;
+  uint64_t length = 0;
+  if (!DecodeInteger(input, 7, length) || length > input.size()) return false;
+
+  std::string_view literal = input.substr(0, length);
+  input.remove_prefix(length);
+  output.clear();
+  if (huffman) return Huffman().Decode(literal, output);
+  output.assign(literal);
+  return true;
+}
+
+// Appends an integer with an N-bit prefix to 'output'; 'flags' fills the
+// bits of the first byte above the prefix.
+void EncodeInteger(uint64_t value, int prefix_bits, uint8_t flags,
+                   std::string& output) {
+  uint64_t mask = (uint64_t{1} << prefix_bits) - 1;
+  if (value < mask) {
+    output.push_back(static_cast<char>(flags | value));
+    return;
+  }
+  output.push_back(static_cast<char>(flags | mask));
+  value -= mask;
+  while (value >= 0x80) {
+    output.push_back(static_cast<char>((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  output.push_back(static_cast<char>(value));
+}
+
+// Appends a raw string literal to 'output'.
+void EncodeString(std::string_view value, std::string& output) {
+  EncodeInteger(value.size(), 7, 0x00, output);
+  output.append(value);
+}
+
+}  // namespace
+
+HpackDecoder::HpackDecoder(size_t max_table_size)
+    : max_table_size_(max_table_size), table_size_limit_(max_table_size) {}
+
+bool HpackDecoder::Decode(std::string_view block, size_t max_list_size,
+                          std::vector<HpackHeader>& headers) {
+  headers.clear();
+  size_t list_size = 0;
+
+  while (!block.empty()) {
+    auto first = static_cast<unsigned char>(block.front());
+    HpackHeader header;
+    uint64_t index = 0;
+
+    if (first & 0x80) {
+      // Indexed header field.
+      std::string_view name, value;
+      if (!DecodeInteger(block, 7, index) || !Lookup(index, name, value))
+        return false;
+      header.name.assign(name);
+      header.value.assign(value);
+    } else if ((first & 0xe0) == 0x20) {
+      // Dynamic table size update; only allowed before the first field.
+      if (!DecodeInteger(block, 5, index) || !headers.empty() ||
+          index > max_table_size_) {
+        return false;
+      }
+      table_size_limit_ = index;
+      EvictTo(table_size_limit_);
+      continue;
+    } else {
+      // Literal header field, with incremental indexing (01), without
+      // indexing (0000) or never indexed (0001).
+      bool indexing = (first & 0xc0) == 0x40;
+      if (!DecodeInteger(block, indexing ? 6 : 4, index)) return false;
+      if (index) {
+        std::string_view name, value;
+        if (!Lookup(index, name, value)) return false;
+        header.name.assign(name);
+      } else if (!DecodeString(block, header.name)) {
+        return false;
+      }
+      if (!DecodeString(block, header.value)) return false;
+      if (indexing) Insert(header);
+    }
+
+    list_size += header.name.size() + header.value.size() + ENTRY_OVERHEAD;
+    if (list_size > max_list_size) return false;
+    headers.push_back(std::move(header));
+  }
+  return true;
+}
+
+bool HpackDecoder::Lookup(uint64_t index, std::string_view& name,
+                          std::string_view& value) const {
+  if (index == 0) return false;
+  if (index <= STATIC_TABLE_SIZE) {
+    name = STATIC_TABLE[index - 1].name;
+    value = STATIC_TABLE[index - 1].value;
+    return true;
+  }
+  index -= STATIC_TABLE_SIZE + 1;
+  if (index >= table_.size()) return false;
+  name = table_[index].name;
+  value = table_[index].value;
+  return true;
+}
+
+void HpackDecoder::Insert(HpackHeader header) {
+  size_t size = header.name.size() + header.value.size() + ENTRY_OVERHEAD;
+  // An entry larger than the table empties it and is not added.
+  if (size > table_size_limit_) {
+    EvictTo(0);
+    return;
+  }
+  EvictTo(table_size_limit_ - size);
+  table_.push_front(std::move(header));
+  table_size_ += size;
+}
+
+void HpackDecoder::EvictTo(size_t size) {
+  while (table_size_ > size) {
+    const HpackHeader& oldest = table_.back();
+    table_size_ -= oldest.name.size() + oldest.value.size() + ENTRY_OVERHEAD;
+    table_.pop_back();
+  }
+}
+
+void HpackEncoder::Encode(std::string_view name, std::string_view value,
+                          std::string& block) const {
+  // A complete static match is a single index; otherwise a static name saves
+  // sending the name.
+  size_t name_index = 0;
+  for (size_t i = 0; i < STATIC_TABLE_SIZE; ++i) {
+    if (STATIC_TABLE[i].name != name) continue;
+    if (STATIC_TABLE[i].value == value) {
+      EncodeInteger(i + 1, 7, 0x80, block);
+      return;
+    }
+    if (!name_index) name_index = i + 1;
+  }
+
+  // Literal header field without indexing.
+  EncodeInteger(name_index, 4, 0x00, block);
+  if (!name_index) EncodeString(name, block);
+  EncodeString(value, block);
+}
+
+}  // namespace protocols
+}  // namespace load_balancer
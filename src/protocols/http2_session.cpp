@@ -0,0 +1,1145 @@
+#include "protocols/http2_session.h"
+#include "protocols/backend_failover.h"
+#include "protocols/relay.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <poll.h>
+#include <spdlog/spdlog.h>
+
+namespace load_balancer {
+namespace protocols {
+
+namespace {
+
+// Frame types (RFC 9113 6).
+constexpr uint8_t FRAME_DATA = 0x0;
+constexpr uint8_t FRAME_HEADERS = 0x1;
+constexpr uint8_t FRAME_PRIORITY = 0x2;
+constexpr uint8_t FRAME_RST_STREAM = 0x3;
+constexpr uint8_t FRAME_SETTINGS = 0x4;
+constexpr uint8_t FRAME_PUSH_PROMISE = 0x5;
+constexpr uint8_t FRAME_PING = 0x6;
+constexpr uint8_t FRAME_GOAWAY = 0x7;
+constexpr uint8_t FRAME_WINDOW_UPDATE = 0x8;
+constexpr uint8_t FRAME_CONTINUATION = 0x9;
+
+// Frame flags.
+constexpr uint8_t FLAG_END_STREAM = 0x1;
+constexpr uint8_t FLAG_ACK = 0x1;
+constexpr uint8_t FLAG_END_HEADERS = 0x4;
+constexpr uint8_t FLAG_PADDED = 0x8;
+constexpr uint8_t FLAG_PRIORITY = 0x20;
+
+// Error codes (RFC 9113 7).
+constexpr uint32_t ERROR_NONE = 0x0;
+constexpr uint32_t ERROR_PROTOCOL = 0x1;
+constexpr uint32_t ERROR_INTERNAL = 0x2;
+constexpr uint32_t ERROR_FLOW_CONTROL = 0x3;
+constexpr uint32_t ERROR_STREAM_CLOSED = 0x5;
+constexpr uint32_t ERROR_FRAME_SIZE = 0x6;
+constexpr uint32_t ERROR_REFUSED_STREAM = 0x7;
+constexpr uint32_t ERROR_COMPRESSION = 0x9;
+constexpr uint32_t ERROR_ENHANCE_YOUR_CALM = 0xb;
+
+// Setting identifiers (RFC 9113 6.5.2).
+constexpr uint16_t SETTINGS_ENABLE_PUSH = 0x2;
+constexpr uint16_t SETTINGS_MAX_CONCURRENT_STREAMS = 0x3;
+constexpr uint16_t SETTINGS_INITIAL_WINDOW_SIZE = 0x4;
+constexpr uint16_t SETTINGS_MAX_FRAME_SIZE = 0x5;
+constexpr uint16_t SETTINGS_MAX_HEADER_LIST_SIZE = 0x6;
+
+// The first bytes a client sends on every connection.
+constexpr std::string_view CONNECTION_PREFACE =
+    "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+// Size of the fixed frame header.
+constexpr size_t FRAME_HEADER_SIZE = 9;
+// Largest frame payload accepted; the protocol default, never raised.
+constexpr uint32_t MAX_FRAME_SIZE = 16384;
+// Window sizes may not exceed 2^31 - 1.
+constexpr int64_t MAX_WINDOW = 0x7fffffff;
+// Window every stream and the connection start with.
+constexpr uint32_t DEFAULT_WINDOW = 65535;
+// Decoded response bytes buffered per stream before backend reads pause.
+constexpr size_t STREAM_BACKLOG_LIMIT = 65536;
+// Queued output above which client reads and DATA generation pause.
+constexpr size_t OUTPUT_HIGH_WATER = 262144;
+
+uint32_t ReadUint24(const char* data) {
+  auto bytes = reinterpret_cast<const unsigned char*>(data);
+  return (uint32_t{bytes[0]} << 16) | (uint32_t{bytes[1]} << 8) | bytes[2];
+}
+
+uint32_t ReadUint32(const char* data) {
+  auto bytes = reinterpret_cast<const unsigned char*>(data);
+  return (uint32_t{bytes[0]} << 24) | (uint32_t{bytes[1]} << 16) |
+         (uint32_t{bytes[2]} << 8) | bytes[3];
+}
+
+void AppendUint16(std::string& output, uint16_t value) {
+  output.push_back(static_cast<char>(value >> 8));
+  output.push_back(static_cast<char>(value));
+}
+
+void AppendUint32(std::string& output, uint32_t value) {
+  AppendUint16(output, static_cast<uint16_t>(value >> 16));
+  AppendUint16(output, static_cast<uint16_t>(value));
+}
+
+// Returns true for HTTP/1.1 header fields that HTTP/2 forbids (RFC 9113
+// 8.2.2).
+bool IsConnectionSpecific(std::string_view name) {
+  return name == "connection" || name == "keep-alive" ||
+         name == "proxy-connection" || name == "transfer-encoding" ||
+         name == "upgrade";
+}
+
+// Returns true if 'value' can be forwarded in an HTTP/1.1 header field.
+bool IsValidFieldValue(std::string_view value) {
+  return value.find_first_of(std::string_view("\r\n\0", 3)) ==
+         std::string_view::npos;
+}
+
+// Returns true if 'name' is a lowercase HTTP/2 field name.
+bool IsValidFieldName(std::string_view name) {
+  if (name.empty()) return false;
+  for (char c : name) {
+    if ((c >= 'A' && c <= 'Z') || c == ' ' || c == ':' || c == '\r' ||
+        c == '\n' || c == '\0') {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Translates the SSL error an operation blocked on into poll events.
+short ToPollEvents(int wait) {
+  if (wait == SSL_ERROR_WANT_READ) return POLLIN;
+  if (wait == SSL_ERROR_WANT_WRITE) return POLLOUT;
+  return 0;
+}
+
+}  // namespace
+
+// State of one request/response exchange.
+struct Http2Session::Stream {
+  Stream(uint32_t id, const HttpParserLimits& limits, int64_t receive_window,
+         int64_t send_window)
+      : id(id), receive_window(receive_window), send_window(send_window),
+        response_parser(HttpParser::Type::kResponse, limits) {}
+
+  // Stream identifier.
+  uint32_t id;
+  // Header block fragments collected until END_HEADERS.
+  std::string header_block;
+  // END_STREAM flag of the HEADERS frame that started 'header_block'.
+  bool header_block_ends_stream = false;
+  // True once the request headers were processed.
+  bool headers_received = false;
+  // True once the client ended its side of the stream.
+  bool request_ended = false;
+  // True if the request body is sent to the backend in chunked coding.
+  bool request_chunked = false;
+  // True if the request used the HEAD method.
+  bool request_was_head = false;
+  // Remaining window for request DATA.
+  int64_t receive_window;
+  // Request DATA bytes not yet returned to the client's window.
+  uint32_t unacknowledged = 0;
+  // Remaining window for response DATA.
+  int64_t send_window;
+
+  // Routes the stream, failing over, until it has a connection.
+  std::unique_ptr<BackendFailover> failover;
+  // The backend chosen for this stream and the connection borrowed from its
+  // pool, or being opened to it if none was idle.
+  std::shared_ptr<core::BackendServer> backend;
+  std::unique_ptr<BackendConnection> connection;
+  std::unique_ptr<PendingConnection> pending;
+  // Counts the stream as an active connection of 'backend'.
+  core::ActiveConnection active;
+  // The pending outcome of routing the stream to 'backend'.
+  RoutingDecision decision;
+  // HTTP/1.1 request bytes for the backend and the number already written.
+  std::string upstream;
+  size_t upstream_sent = 0;
+  // Length of a backend write that must be retried unchanged, or 0.
+  size_t upstream_retry_length = 0;
+  // SSL errors the last backend read and write blocked on, or 0.
+  int read_wait = 0;
+  int write_wait = 0;
+
+  // Frames the HTTP/1.1 response.
+  HttpParser response_parser;
+  // Response bytes buffered until the response head is complete.
+  std::string response_head;
+  // Decoded response body bytes and the number already sent as DATA.
+  std::string downstream;
+  size_t downstream_sent = 0;
+  // Progress of the response.
+  bool response_started = false;
+  bool response_complete = false;
+  bool end_stream_sent = false;
+  // True if the backend sent bytes beyond the response.
+  bool response_excess = false;
+  // True once the stream is done and can be removed.
+  bool closed = false;
+  // True once a RST_STREAM was sent for the stream.
+  bool reset_sent = false;
+};
+
+Http2Session::Http2Session(SSL* client,
+                           std::shared_ptr<HandlerContext> context)
+    : client_(client), context_(std::move(context)),
+      input_(2 * (FRAME_HEADER_SIZE + MAX_FRAME_SIZE)) {}
+
+Http2Session::~Http2Session() {
+  for (auto& [id, stream] : streams_) ReleaseConnection(*stream, false);
+}
+
+void Http2Session::Run() {
+  const Http2Config& config = context_->http2;
+
+  // Announce the limits of this endpoint. Push is never used.
+  std::string settings;
+  AppendUint16(settings, SETTINGS_MAX_CONCURRENT_STREAMS);
+  AppendUint32(settings, config.max_concurrent_streams);
+  AppendUint16(settings, SETTINGS_INITIAL_WINDOW_SIZE);
+  AppendUint32(settings, config.initial_window_size);
+  AppendUint16(settings, SETTINGS_ENABLE_PUSH);
+  AppendUint32(settings, 0);
+  AppendUint16(settings, SETTINGS_MAX_HEADER_LIST_SIZE);
+  AppendUint32(settings, config.max_header_list_size);
+  QueueFrame(FRAME_SETTINGS, 0, 0, settings);
+
+  // Stream windows, not the connection window, bound buffering, so the
+  // connection window is opened for all streams at once.
+  int64_t connection_window =
+      std::min<int64_t>(MAX_WINDOW, int64_t{config.max_concurrent_streams} *
+                                        config.initial_window_size);
+  if (connection_window > DEFAULT_WINDOW) {
+    QueueWindowUpdate(0, static_cast<uint32_t>(connection_window -
+                                               DEFAULT_WINDOW));
+  }
+
+  while (true) {
+    bool progressed = ReadClient();
+    if (!closing_) {
+      for (auto& [id, stream] : streams_) progressed |= PumpStream(*stream);
+      progressed |= SendData();
+    }
+    progressed |= WriteClient();
+    ReapStreams();
+
+    if (client_closed_) break;
+    if (closing_ && output_.empty()) break;
+    if (goaway_received_ && streams_.empty() && output_.empty()) break;
+    if (!progressed && !Wait()) break;
+  }
+
+  // Streams still open when the session ends were cut short.
+  for (auto& [id, stream] : streams_) stream->decision.Finish(false);
+}
+
+bool Http2Session::ReadClient() {
+  read_wait_ = 0;
+  bool progressed = false;
+
+  // Reading pauses while the client does not drain its responses.
+  while (!closing_ && output_.size() - output_sent_ < OUTPUT_HIGH_WATER &&
+         input_length_ < input_.size()) {
+    int bytes = SSL_read(client_, input_.data() + input_length_,
+                         static_cast<int>(input_.size() - input_length_));
+    if (bytes <= 0) {
+      int error = SSL_get_error(client_, bytes);
+      if (error == SSL_ERROR_WANT_READ || error == SSL_ERROR_WANT_WRITE) {
+        read_wait_ = error;
+        break;
+      }
+      // The client closed the connection or it failed; nothing more can be
+      // delivered.
+      client_closed_ = closing_ = true;
+      return true;
+    }
+    input_length_ += bytes;
+    progressed = true;
+
+    size_t offset = 0;
+    if (!preface_received_) {
+      if (input_length_ < CONNECTION_PREFACE.size()) continue;
+      if (std::string_view(input_.data(), CONNECTION_PREFACE.size()) !=
+          CONNECTION_PREFACE) {
+        ConnectionError(ERROR_PROTOCOL, "invalid connection preface");
+        break;
+      }
+      offset = CONNECTION_PREFACE.size();
+      preface_received_ = true;
+    }
+
+    // Process every complete frame.
+    while (!closing_ && input_length_ - offset >= FRAME_HEADER_SIZE) {
+      const char* header = input_.data() + offset;
+      uint32_t length = ReadUint24(header);
+      if (length > MAX_FRAME_SIZE) {
+        ConnectionError(ERROR_FRAME_SIZE, "frame exceeds maximum size");
+        break;
+      }
+      if (input_length_ - offset < FRAME_HEADER_SIZE + length) break;
+
+      offset += FRAME_HEADER_SIZE + length;
+      if (!HandleFrame(static_cast<uint8_t>(header[3]),
+                       static_cast<uint8_t>(header[4]),
+                       ReadUint32(header + 5) & 0x7fffffff,
+                       std::string_view(header + FRAME_HEADER_SIZE, length))) {
+        break;
+      }
+    }
+    std::memmove(input_.data(), input_.data() + offset, input_length_ - offset);
+    input_length_ -= offset;
+  }
+  return progressed;
+}
+
+bool Http2Session::HandleFrame(uint8_t type, uint8_t flags, uint32_t stream_id,
+                               std::string_view payload) {
+  // A header block must not be interleaved with other frames.
+  if (continuation_stream_ && type != FRAME_CONTINUATION)
+    return ConnectionError(ERROR_PROTOCOL, "expected CONTINUATION");
+
+  switch (type) {
+    case FRAME_DATA:
+      return HandleData(flags, stream_id, payload);
+    case FRAME_HEADERS:
+      return HandleHeaders(flags, stream_id, payload);
+    case FRAME_CONTINUATION:
+      return HandleContinuation(flags, stream_id, payload);
+    case FRAME_SETTINGS:
+      return HandleSettings(flags, stream_id, payload);
+    case FRAME_WINDOW_UPDATE:
+      return HandleWindowUpdate(stream_id, payload);
+
+    case FRAME_PRIORITY:
+      // Prioritization is deprecated and ignored.
+      if (stream_id == 0)
+        return ConnectionError(ERROR_PROTOCOL, "PRIORITY on stream 0");
+      if (payload.size() != 5)
+        return ConnectionError(ERROR_FRAME_SIZE, "invalid PRIORITY size");
+      return true;
+
+    case FRAME_RST_STREAM: {
+      if (stream_id == 0)
+        return ConnectionError(ERROR_PROTOCOL, "RST_STREAM on stream 0");
+      if (payload.size() != 4)
+        return ConnectionError(ERROR_FRAME_SIZE, "invalid RST_STREAM size");
+      if (stream_id > last_stream_id_)
+        return ConnectionError(ERROR_PROTOCOL, "RST_STREAM on idle stream");
+      auto it = streams_.find(stream_id);
+      if (it != streams_.end()) {
+        // The backend connection is mid-exchange, so it cannot be reused.
+        it->second->decision.Finish(false);
+        ReleaseConnection(*it->second, false);
+        it->second->closed = true;
+      }
+      return true;
+    }
+
+    case FRAME_PUSH_PROMISE:
+      return ConnectionError(ERROR_PROTOCOL, "client sent PUSH_PROMISE");
+
+    case FRAME_PING:
+      if (stream_id != 0)
+        return ConnectionError(ERROR_PROTOCOL, "PING on a stream");
+      if (payload.size() != 8)
+        return ConnectionError(ERROR_FRAME_SIZE, "invalid PING size");
+      if (!(flags & FLAG_ACK)) QueueFrame(FRAME_PING, FLAG_ACK, 0, payload);
+      return true;
+
+    case FRAME_GOAWAY:
+      if (stream_id != 0)
+        return ConnectionError(ERROR_PROTOCOL, "GOAWAY on a stream");
+      if (payload.size() < 8)
+        return ConnectionError(ERROR_FRAME_SIZE, "invalid GOAWAY size");
+      // Open streams are finished; no new ones will arrive.
+      goaway_received_ = true;
+      return true;
+
+    default:
+      // Unknown frame types must be ignored.
+      return true;
+  }
+}
+
+bool Http2Session::HandleHeaders(uint8_t flags, uint32_t stream_id,
+                                 std::string_view payload) {
+  if (stream_id == 0 || stream_id % 2 == 0)
+    return ConnectionError(ERROR_PROTOCOL, "invalid stream identifier");
+
+  // Strip padding and the deprecated priority fields.
+  std::string_view fragment = payload;
+  if (flags & FLAG_PADDED) {
+    if (fragment.empty())
+      return ConnectionError(ERROR_FRAME_SIZE, "invalid HEADERS size");
+    auto padding = static_cast<unsigned char>(fragment.front());
+    fragment.remove_prefix(1);
+    if (padding > fragment.size())
+      return ConnectionError(ERROR_PROTOCOL, "invalid HEADERS padding");
+    fragment.remove_suffix(padding);
+  }
+  if (flags & FLAG_PRIORITY) {
+    if (fragment.size() < 5)
+      return ConnectionError(ERROR_FRAME_SIZE, "invalid HEADERS size");
+    fragment.remove_prefix(5);
+  }
+
+  Stream* stream = nullptr;
+  auto it = streams_.find(stream_id);
+  if (it != streams_.end()) {
+    // A second header block carries trailers and ends the request. On a
+    // stream the client already ended, or that is closed, it is answered
+    // once decoded.
+    stream = it->second.get();
+    if (!stream->closed && !stream->headers_received)
+      return ConnectionError(ERROR_STREAM_CLOSED, "HEADERS on closed stream");
+    if (!stream->closed && !stream->request_ended &&
+        !(flags & FLAG_END_STREAM)) {
+      return ConnectionError(ERROR_PROTOCOL, "trailers without END_STREAM");
+    }
+  } else {
+    // Stream IDs only grow, so a lower one names a stream that is closed,
+    // whether or not the client already sent GOAWAY.
+    if (stream_id <= last_stream_id_) {
+      return ConnectionError(ERROR_STREAM_CLOSED,
+                             "HEADERS on a closed stream");
+    }
+    last_stream_id_ = stream_id;
+    const Http2Config& config = context_->http2;
+    // Data sent before our SETTINGS arrive may use the default window.
+    int64_t receive_window =
+        std::max<int64_t>(config.initial_window_size, DEFAULT_WINDOW);
+    auto created = std::make_unique<Stream>(stream_id, context_->http_limits,
+                                            receive_window,
+                                            peer_initial_window_);
+    stream = created.get();
+    streams_.emplace(stream_id, std::move(created));
+  }
+
+  stream->header_block.assign(fragment);
+  stream->header_block_ends_stream = flags & FLAG_END_STREAM;
+  if (!(flags & FLAG_END_HEADERS)) {
+    continuation_stream_ = stream_id;
+    return true;
+  }
+  return CompleteHeaderBlock(*stream);
+}
+
+bool Http2Session::HandleContinuation(uint8_t flags, uint32_t stream_id,
+                                      std::string_view payload) {
+  if (!continuation_stream_ || stream_id != continuation_stream_)
+    return ConnectionError(ERROR_PROTOCOL, "unexpected CONTINUATION");
+
+  Stream& stream = *streams_.at(stream_id);
+  stream.header_block.append(payload);
+  if (stream.header_block.size() > context_->http2.max_header_list_size) {
+    return ConnectionError(ERROR_ENHANCE_YOUR_CALM,
+                           "header block exceeds limit");
+  }
+  if (!(flags & FLAG_END_HEADERS)) return true;
+
+  continuation_stream_ = 0;
+  return CompleteHeaderBlock(stream);
+}
+
+bool Http2Session::CompleteHeaderBlock(Stream& stream) {
+  // Every block is decoded, even for streams that are ignored, to keep the
+  // dynamic table in sync with the client.
+  bool decoded = decoder_.Decode(stream.header_block,
+                                 context_->http2.max_header_list_size,
+                                 headers_);
+  stream.header_block.clear();
+  if (!decoded) return ConnectionError(ERROR_COMPRESSION, "bad header block");
+
+  // Past the client's END_STREAM the stream is half-closed (remote) or
+  // closed, and more HEADERS are a stream error (RFC 9113 5.1). Frames that
+  // crossed a RST_STREAM sent here are ignored instead.
+  if (stream.closed || (stream.headers_received && stream.request_ended)) {
+    if (!stream.reset_sent) ResetStream(stream, ERROR_STREAM_CLOSED);
+    return true;
+  }
+
+  if (stream.headers_received) {
+    // Trailer fields end the request body; they are not forwarded.
+    stream.request_ended = true;
+    if (stream.request_chunked) stream.upstream.append("0\r\n\r\n");
+    return true;
+  }
+
+  stream.headers_received = true;
+  stream.request_ended = stream.header_block_ends_stream;
+  if (streams_.size() > context_->http2.max_concurrent_streams) {
+    ResetStream(stream, ERROR_REFUSED_STREAM);
+    return true;
+  }
+  OpenStream(stream);
+  return true;
+}
+
+void Http2Session::OpenStream(Stream& stream) {
+  std::string_view method, scheme, authority, path;
+  bool regular_seen = false;
+  bool has_host = false;
+  bool has_length = false;
+  bool has_cookie = false;
+
+  // Validate the request (RFC 9113 8.2 and 8.3).
+  for (const HpackHeader& header : headers_) {
+    std::string_view name = header.name;
+    std::string_view value = header.value;
+    // HPACK admits literal fields with an empty name; HTTP does not.
+    if (name.empty() || !IsValidFieldValue(value) ||
+        (name.front() != ':' && !IsValidFieldName(name))) {
+      ResetStream(stream, ERROR_PROTOCOL);
+      return;
+    }
+
+    if (name.front() == ':') {
+      std::string_view* pseudo = name == ":method"      ? &method
+                                 : name == ":scheme"    ? &scheme
+                                 : name == ":authority" ? &authority
+                                 : name == ":path"      ? &path
+                                                        : nullptr;
+      if (regular_seen || !pseudo || !pseudo->empty() || value.empty()) {
+        ResetStream(stream, ERROR_PROTOCOL);
+        return;
+      }
+      *pseudo = value;
+      continue;
+    }
+
+    regular_seen = true;
+    if (IsConnectionSpecific(name) || (name == "te" && value != "trailers")) {
+      ResetStream(stream, ERROR_PROTOCOL);
+      return;
+    }
+    has_host |= name == "host";
+    has_length |= name == "content-length";
+    has_cookie |= name == "cookie";
+  }
+
+  if (method == "CONNECT") {
+    RespondWithError(stream, "501");
+    return;
+  }
+  if (method.empty() || scheme.empty() || path.empty()) {
+    ResetStream(stream, ERROR_PROTOCOL);
+    return;
+  }
+
+  // Translate to an HTTP/1.1 request head.
+  std::string& request = stream.upstream;
+  request.append(method).append(" ").append(path).append(" HTTP/1.1\r\n");
+  if (!has_host && !authority.empty())
+    request.append("host: ").append(authority).append("\r\n");
+  for (const HpackHeader& header : headers_) {
+    if (header.name.front() == ':' || header.name == "te" ||
+        header.name == "cookie") {
+      continue;
+    }
+    request.append(header.name).append(": ").append(header.value);
+    request.append("\r\n");
+  }
+  // Cookie crumbs are joined into one field for HTTP/1.1 (RFC 9113 8.2.3).
+  if (has_cookie) {
+    request.append("cookie: ");
+    bool first = true;
+    for (const HpackHeader& header : headers_) {
+      if (header.name != "cookie") continue;
+      if (!first) request.append("; ");
+      request.append(header.value);
+      first = false;
+    }
+    request.append("\r\n");
+  }
+  // A body of unknown length is streamed in chunked coding.
+  if (!stream.request_ended && !has_length) {
+    request.append("transfer-encoding: chunked\r\n");
+    stream.request_chunked = true;
+  }
+  request.append("\r\n");
+
+  stream.request_was_head = method == "HEAD";
+  stream.response_parser.Reset(stream.request_was_head);
+  spdlog::debug("HTTP/2 stream {}: {} {}", stream.id, method, path);
+
+  // Every stream gets its own routing decision.
+  stream.failover = std::make_unique<BackendFailover>(*context_);
+  ConnectStream(stream);
+}
+
+void Http2Session::ConnectStream(Stream& stream) {
+  while (auto backend = stream.failover->Next()) {
+    std::shared_ptr<ConnectionPool> pool = context_->pools->PoolFor(backend);
+    stream.backend = backend;
+    if (auto connection = pool->TryAcquireIdle()) {
+      stream.connection = std::move(connection);
+      ConnectedStream(stream);
+      return;
+    }
+    // Opened alongside the other streams rather than blocking them.
+    stream.pending = pool->StartConnect();
+    if (stream.pending) return;
+    stream.failover->Failed();
+  }
+  spdlog::error("No backend available for HTTP/2 forwarding.");
+  RespondWithError(stream, "502");
+}
+
+bool Http2Session::AdvanceConnect(Stream& stream) {
+  switch (stream.pending->Advance()) {
+    case PendingConnection::Status::kPending:
+      return false;
+    case PendingConnection::Status::kEstablished:
+      stream.connection = stream.pending->Take();
+      stream.pending.reset();
+      ConnectedStream(stream);
+      return true;
+    case PendingConnection::Status::kFailed:
+      spdlog::error("Failed to obtain a connection to backend {}",
+                    stream.backend->Address());
+      stream.pending.reset();
+      stream.failover->Failed();
+      ConnectStream(stream);
+      return true;
+  }
+  return false;
+}
+
+void Http2Session::ConnectedStream(Stream& stream) {
+  stream.failover->Succeeded();
+  stream.active = stream.failover->TakeActiveConnection();
+  stream.decision = stream.failover->TakeDecision();
+  stream.failover.reset();
+  Relay::PrepareConnection(stream.connection->Ssl());
+}
+
+bool Http2Session::HandleData(uint8_t flags, uint32_t stream_id,
+                              std::string_view payload) {
+  if (stream_id == 0) return ConnectionError(ERROR_PROTOCOL, "DATA on stream 0");
+  if (stream_id > last_stream_id_)
+    return ConnectionError(ERROR_PROTOCOL, "DATA on idle stream");
+
+  // Flow control counts whole frames, padding included. The connection
+  // window is replenished right away; stream windows bound the buffering.
+  auto length = static_cast<uint32_t>(payload.size());
+  unacknowledged_ += length;
+  if (unacknowledged_ >= MAX_FRAME_SIZE) {
+    QueueWindowUpdate(0, unacknowledged_);
+    unacknowledged_ = 0;
+  }
+
+  std::string_view data = payload;
+  if (flags & FLAG_PADDED) {
+    if (data.empty())
+      return ConnectionError(ERROR_FRAME_SIZE, "invalid DATA size");
+    auto padding = static_cast<unsigned char>(data.front());
+    data.remove_prefix(1);
+    if (padding > data.size())
+      return ConnectionError(ERROR_PROTOCOL, "invalid DATA padding");
+    data.remove_suffix(padding);
+  }
+
+  // Data for streams that already finished is dropped.
+  auto it = streams_.find(stream_id);
+  if (it == streams_.end() || it->second->closed) return true;
+  Stream& stream = *it->second;
+  if (!stream.headers_received || stream.request_ended) {
+    ResetStream(stream, ERROR_STREAM_CLOSED);
+    return true;
+  }
+
+  stream.receive_window -= length;
+  if (stream.receive_window < 0) {
+    ResetStream(stream, ERROR_FLOW_CONTROL);
+    return true;
+  }
+  stream.unacknowledged += length;
+
+  if (stream.request_chunked && !data.empty()) {
+    char size[20];
+    int size_length = std::snprintf(size, sizeof(size), "%zx\r\n", data.size());
+    stream.upstream.append(size, size_length).append(data).append("\r\n");
+  } else {
+    stream.upstream.append(data);
+  }
+  if (flags & FLAG_END_STREAM) {
+    stream.request_ended = true;
+    if (stream.request_chunked) stream.upstream.append("0\r\n\r\n");
+  }
+  return true;
+}
+
+bool Http2Session::HandleSettings(uint8_t flags, uint32_t stream_id,
+                                  std::string_view payload) {
+  if (stream_id != 0)
+    return ConnectionError(ERROR_PROTOCOL, "SETTINGS on a stream");
+  if (flags & FLAG_ACK) {
+    if (!payload.empty())
+      return ConnectionError(ERROR_FRAME_SIZE, "SETTINGS ack with payload");
+    return true;
+  }
+  if (payload.size() % 6 != 0)
+    return ConnectionError(ERROR_FRAME_SIZE, "invalid SETTINGS size");
+
+  for (size_t offset = 0; offset < payload.size(); offset += 6) {
+    auto id = static_cast<uint16_t>(
+        (static_cast<unsigned char>(payload[offset]) << 8) |
+        static_cast<unsigned char>(payload[offset + 1]));
+    uint32_t value = ReadUint32(payload.data() + offset + 2);
+
+    if (id == SETTINGS_INITIAL_WINDOW_SIZE) {
+      if (value > MAX_WINDOW)
+        return ConnectionError(ERROR_FLOW_CONTROL, "invalid window size");
+      // The change applies to every open stream (RFC 9113 6.9.2).
+      int64_t delta = int64_t{value} - peer_initial_window_;
+      for (auto& [id, stream] : streams_) {
+        stream->send_window += delta;
+        if (stream->send_window > MAX_WINDOW)
+          return ConnectionError(ERROR_FLOW_CONTROL, "window overflow");
+      }
+      peer_initial_window_ = value;
+    } else if (id == SETTINGS_MAX_FRAME_SIZE) {
+      if (value < 16384 || value > 16777215)
+        return ConnectionError(ERROR_PROTOCOL, "invalid maximum frame size");
+      peer_max_frame_size_ = value;
+    } else if (id == SETTINGS_ENABLE_PUSH && value > 1) {
+      return ConnectionError(ERROR_PROTOCOL, "invalid ENABLE_PUSH");
+    }
+    // The header table size needs no handling: the encoder never indexes.
+  }
+
+  QueueFrame(FRAME_SETTINGS, FLAG_ACK, 0, {});
+  return true;
+}
+
+bool Http2Session::HandleWindowUpdate(uint32_t stream_id,
+                                      std::string_view payload) {
+  if (payload.size() != 4)
+    return ConnectionError(ERROR_FRAME_SIZE, "invalid WINDOW_UPDATE size");
+  uint32_t increment = ReadUint32(payload.data()) & 0x7fffffff;
+
+  if (stream_id == 0) {
+    if (increment == 0)
+      return ConnectionError(ERROR_PROTOCOL, "zero window increment");
+    send_window_ += increment;
+    if (send_window_ > MAX_WINDOW)
+      return ConnectionError(ERROR_FLOW_CONTROL, "window overflow");
+    return true;
+  }
+
+  if (stream_id > last_stream_id_)
+    return ConnectionError(ERROR_PROTOCOL, "WINDOW_UPDATE on idle stream");
+  auto it = streams_.find(stream_id);
+  if (it == streams_.end() || it->second->closed) return true;
+  Stream& stream = *it->second;
+  if (increment == 0) {
+    ResetStream(stream, ERROR_PROTOCOL);
+    return true;
+  }
+  stream.send_window += increment;
+  if (stream.send_window > MAX_WINDOW) ResetStream(stream, ERROR_FLOW_CONTROL);
+  return true;
+}
+
+bool Http2Session::PumpStream(Stream& stream) {
+  if (stream.closed) return false;
+  if (stream.pending && !AdvanceConnect(stream)) return false;
+  if (stream.closed || !stream.connection) return stream.closed;
+  SSL* backend = stream.connection->Ssl();
+  bool progressed = false;
+
+  // Request bytes to the backend.
+  stream.write_wait = 0;
+  while (stream.upstream_sent < stream.upstream.size()) {
+    size_t length = stream.upstream_retry_length
+                        ? stream.upstream_retry_length
+                        : stream.upstream.size() - stream.upstream_sent;
+    int written = SSL_write(backend, stream.upstream.data() +
+                                         stream.upstream_sent,
+                            static_cast<int>(length));
+    if (written <= 0) {
+      int error = SSL_get_error(backend, written);
+      if (error != SSL_ERROR_WANT_READ && error != SSL_ERROR_WANT_WRITE) {
+        FailStream(stream, "failed to send request to backend");
+        return true;
+      }
+      stream.upstream_retry_length = length;
+      stream.write_wait = error;
+      break;
+    }
+    stream.upstream_sent += written;
+    stream.upstream_retry_length = 0;
+    progressed = true;
+  }
+
+  // Once everything buffered reached the backend, the client may send more.
+  if (stream.upstream_sent > 0 &&
+      stream.upstream_sent == stream.upstream.size()) {
+    stream.upstream.clear();
+    stream.upstream_sent = 0;
+    if (stream.unacknowledged > 0 && !stream.request_ended) {
+      QueueWindowUpdate(stream.id, stream.unacknowledged);
+      stream.receive_window += stream.unacknowledged;
+    }
+    stream.unacknowledged = 0;
+  }
+
+  // Response bytes from the backend, while the stream's backlog has room.
+  stream.read_wait = 0;
+  while (!stream.response_complete &&
+         stream.downstream.size() - stream.downstream_sent <
+             STREAM_BACKLOG_LIMIT) {
+    int bytes = SSL_read(backend, read_buffer_.data(),
+                         static_cast<int>(read_buffer_.size()));
+    if (bytes <= 0) {
+      int error = SSL_get_error(backend, bytes);
+      if (error == SSL_ERROR_WANT_READ || error == SSL_ERROR_WANT_WRITE) {
+        stream.read_wait = error;
+        break;
+      }
+      // Closing the connection ends responses without a length.
+      if (error == SSL_ERROR_ZERO_RETURN && stream.response_started &&
+          stream.response_parser.Head().framing == BodyFraming::kUntilClose) {
+        stream.response_complete = true;
+        return true;
+      }
+      FailStream(stream, "backend closed the connection");
+      return true;
+    }
+    progressed = true;
+    if (!ProcessResponse(stream, std::string_view(read_buffer_.data(), bytes)))
+      return true;
+  }
+  return progressed;
+}
+
+bool Http2Session::ProcessResponse(Stream& stream, std::string_view data) {
+  if (!stream.response_started) {
+    stream.response_head.append(data);
+    while (true) {
+      HttpParser& parser = stream.response_parser;
+      HttpParser::Status status = parser.ParseHead(stream.response_head);
+      if (status == HttpParser::Status::kIncomplete) return true;
+      if (status == HttpParser::Status::kError) {
+        FailStream(stream, parser.Error());
+        return false;
+      }
+      if (parser.Head().status_code == 101) {
+        FailStream(stream, "protocol switch is not possible over HTTP/2");
+        return false;
+      }
+
+      QueueResponseHead(stream);
+      size_t head_size = parser.HeadSize();
+      if (stream.response_started) {
+        // The bytes after the head start the body.
+        data = std::string_view(stream.response_head).substr(head_size);
+        break;
+      }
+      // Interim responses were forwarded; parse the next head.
+      stream.response_head.erase(0, head_size);
+      parser.Reset(stream.request_was_head);
+    }
+  }
+
+  bool ok = true;
+  while (!stream.response_complete && !data.empty()) {
+    size_t consumed = 0;
+    std::string_view payload;
+    HttpParser::Status status =
+        stream.response_parser.DecodeBody(data, consumed, payload);
+    if (status == HttpParser::Status::kError) {
+      FailStream(stream, stream.response_parser.Error());
+      ok = false;
+      break;
+    }
+    stream.downstream.append(payload);
+    data.remove_prefix(consumed);
+    if (status == HttpParser::Status::kComplete) stream.response_complete = true;
+  }
+  // A body without bytes may already be complete.
+  if (ok && !stream.response_complete && stream.response_started) {
+    size_t consumed = 0;
+    std::string_view payload;
+    if (stream.response_parser.DecodeBody({}, consumed, payload) ==
+        HttpParser::Status::kComplete) {
+      stream.response_complete = true;
+    }
+  }
+  if (!data.empty()) stream.response_excess = true;
+  stream.response_head.clear();
+  return ok;
+}
+
+void Http2Session::QueueResponseHead(Stream& stream) {
+  const HttpHead& head = stream.response_parser.Head();
+  char status[3] = {static_cast<char>('0' + head.status_code / 100 % 10),
+                    static_cast<char>('0' + head.status_code / 10 % 10),
+                    static_cast<char>('0' + head.status_code % 10)};
+
+  block_.clear();
+  encoder_.Encode(":status", std::string_view(status, 3), block_);
+  for (const HttpHeader& header : head.headers) {
+    // HTTP/2 field names are lowercase.
+    field_name_.assign(header.name);
+    std::transform(field_name_.begin(), field_name_.end(),
+                   field_name_.begin(), [](char c) {
+                     return c >= 'A' && c <= 'Z' ? static_cast<char>(c + 32)
+                                                 : c;
+                   });
+    if (IsConnectionSpecific(field_name_)) continue;
+    encoder_.Encode(field_name_, header.value, block_);
+  }
+
+  bool final = head.status_code >= 200;
+  bool end_stream = final && head.framing == BodyFraming::kNone;
+  QueueHeaders(stream.id, block_, end_stream);
+  if (final) {
+    stream.response_started = true;
+    stream.decision.FirstByte();
+  }
+  if (end_stream) stream.response_complete = stream.end_stream_sent = true;
+}
+
+bool Http2Session::SendData() {
+  bool progressed = false;
+  for (auto& [id, stream_ptr] : streams_) {
+    Stream& stream = *stream_ptr;
+    if (stream.closed || !stream.response_started || stream.end_stream_sent)
+      continue;
+
+    while (output_.size() - output_sent_ < OUTPUT_HIGH_WATER) {
+      size_t pending = stream.downstream.size() - stream.downstream_sent;
+      int64_t window = std::min(stream.send_window, send_window_);
+      size_t length = std::min<size_t>(
+          {pending, static_cast<size_t>(std::max<int64_t>(window, 0)),
+           peer_max_frame_size_});
+      bool end_stream = stream.response_complete && length == pending;
+      if (length == 0 && !end_stream) break;
+
+      QueueFrame(FRAME_DATA, end_stream ? FLAG_END_STREAM : 0, id,
+                 std::string_view(stream.downstream.data() +
+                                      stream.downstream_sent,
+                                  length));
+      stream.downstream_sent += length;
+      stream.send_window -= length;
+      send_window_ -= length;
+      progressed = true;
+      if (end_stream) {
+        stream.end_stream_sent = true;
+        break;
+      }
+    }
+
+    // Reclaim the space of sent bytes.
+    if (stream.downstream_sent == stream.downstream.size()) {
+      stream.downstream.clear();
+      stream.downstream_sent = 0;
+    } else if (stream.downstream_sent >= STREAM_BACKLOG_LIMIT / 2) {
+      stream.downstream.erase(0, stream.downstream_sent);
+      stream.downstream_sent = 0;
+    }
+  }
+  return progressed;
+}
+
+bool Http2Session::WriteClient() {
+  write_wait_ = 0;
+  bool progressed = false;
+  while (output_sent_ < output_.size()) {
+    size_t length = output_retry_length_ ? output_retry_length_
+                                         : output_.size() - output_sent_;
+    int written = SSL_write(client_, output_.data() + output_sent_,
+                            static_cast<int>(length));
+    if (written <= 0) {
+      int error = SSL_get_error(client_, written);
+      if (error == SSL_ERROR_WANT_READ || error == SSL_ERROR_WANT_WRITE) {
+        output_retry_length_ = length;
+        write_wait_ = error;
+        break;
+      }
+      client_closed_ = closing_ = true;
+      return true;
+    }
+    output_sent_ += written;
+    output_retry_length_ = 0;
+    progressed = true;
+  }
+
+  // Appending to the queue may move it, which the SSL modes set on the
+  // client connection allow for retried writes.
+  if (output_sent_ == output_.size()) {
+    output_.clear();
+    output_sent_ = 0;
+  }
+  return progressed;
+}
+
+void Http2Session::FailStream(Stream& stream, const char* reason) {
+  spdlog::error("HTTP/2 stream {} failed: {}", stream.id, reason);
+  stream.decision.Finish(false);
+  if (stream.response_started) {
+    ResetStream(stream, ERROR_INTERNAL);
+  } else {
+    RespondWithError(stream, "502");
+  }
+}
+
+void Http2Session::RespondWithError(Stream& stream, std::string_view status) {
+  block_.clear();
+  encoder_.Encode(":status", status, block_);
+  encoder_.Encode("content-length", "0", block_);
+  QueueHeaders(stream.id, block_, true);
+  stream.response_started = stream.response_complete = true;
+  stream.end_stream_sent = true;
+
+  // The rest of the request is not needed anymore.
+  if (!stream.request_ended) {
+    std::string code;
+    AppendUint32(code, ERROR_NONE);
+    QueueFrame(FRAME_RST_STREAM, 0, stream.id, code);
+    stream.reset_sent = true;
+  }
+  ReleaseConnection(stream, false);
+  stream.closed = true;
+}
+
+void Http2Session::ResetStream(Stream& stream, uint32_t error_code) {
+  stream.decision.Finish(false);
+  std::string code;
+  AppendUint32(code, error_code);
+  QueueFrame(FRAME_RST_STREAM, 0, stream.id, code);
+  stream.reset_sent = true;
+  ReleaseConnection(stream, false);
+  stream.closed = true;
+}
+
+void Http2Session::ReleaseConnection(Stream& stream, bool reusable) {
+  // A connection still being opened is abandoned.
+  stream.pending.reset();
+  stream.failover.reset();
+  if (!stream.connection) return;
+  context_->pools->PoolFor(stream.backend)
+      ->Release(std::move(stream.connection), reusable);
+  stream.active = core::ActiveConnection();
+}
+
+void Http2Session::ReapStreams() {
+  for (auto it = streams_.begin(); it != streams_.end();) {
+    Stream& stream = *it->second;
+    if (!stream.closed && stream.end_stream_sent) {
+      stream.decision.Complete();
+      if (stream.request_ended && stream.upstream.empty()) {
+        // Both messages were delimited, so the backend connection is clean
+        // unless the backend wants to close it or sent more.
+        ReleaseConnection(stream, stream.response_parser.Head().keep_alive &&
+                                      !stream.response_excess);
+      } else {
+        // The response came first; the rest of the request is not needed.
+        if (!stream.request_ended) {
+          std::string code;
+          AppendUint32(code, ERROR_NONE);
+          QueueFrame(FRAME_RST_STREAM, 0, stream.id, code);
+          stream.reset_sent = true;
+        }
+        ReleaseConnection(stream, false);
+      }
+      stream.closed = true;
+    }
+
+    // A stream whose header block is still arriving must stay for decoding.
+    if (stream.closed && stream.id != continuation_stream_) {
+      it = streams_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+bool Http2Session::ConnectionError(uint32_t error_code, const char* reason) {
+  spdlog::warn("HTTP/2 connection error: {}", reason);
+  std::string payload;
+  AppendUint32(payload, last_stream_id_);
+  AppendUint32(payload, error_code);
+  QueueFrame(FRAME_GOAWAY, 0, 0, payload);
+  closing_ = true;
+  return false;
+}
+
+void Http2Session::QueueFrame(uint8_t type, uint8_t flags, uint32_t stream_id,
+                              std::string_view payload) {
+  auto length = static_cast<uint32_t>(payload.size());
+  output_.push_back(static_cast<char>(length >> 16));
+  output_.push_back(static_cast<char>(length >> 8));
+  output_.push_back(static_cast<char>(length));
+  output_.push_back(static_cast<char>(type));
+  output_.push_back(static_cast<char>(flags));
+  AppendUint32(output_, stream_id);
+  output_.append(payload);
+}
+
+void Http2Session::QueueHeaders(uint32_t stream_id, std::string_view block,
+                                bool end_stream) {
+  // Blocks larger than a frame continue in CONTINUATION frames.
+  uint8_t type = FRAME_HEADERS;
+  uint8_t flags = end_stream ? FLAG_END_STREAM : 0;
+  do {
+    std::string_view fragment = block.substr(0, peer_max_frame_size_);
+    block.remove_prefix(fragment.size());
+    QueueFrame(type, flags | (block.empty() ? FLAG_END_HEADERS : 0), stream_id,
+               fragment);
+    type = FRAME_CONTINUATION;
+    flags = 0;
+  } while (!block.empty());
+}
+
+void Http2Session::QueueWindowUpdate(uint32_t stream_id, uint32_t increment) {
+  std::string payload;
+  AppendUint32(payload, increment);
+  QueueFrame(FRAME_WINDOW_UPDATE, 0, stream_id, payload);
+}
+
+bool Http2Session::Wait() {
+  poll_fds_.clear();
+  short client_events = ToPollEvents(read_wait_) | ToPollEvents(write_wait_);
+  if (client_events)
+    poll_fds_.push_back({SSL_get_fd(client_), client_events, 0});
+  // Connections being opened also wake the session at their deadline.
+  int timeout_ms = -1;
+  auto now = std::chrono::steady_clock::now();
+  for (auto& [id, stream] : streams_) {
+    if (stream->pending) {
+      poll_fds_.push_back(
+          {stream->pending->Socket(), stream->pending->Events(), 0});
+      auto remaining = std::chrono::ceil<std::chrono::milliseconds>(
+          stream->pending->Deadline() - now);
+      int remaining_ms = std::max<int>(0, remaining.count());
+      if (timeout_ms < 0 || remaining_ms < timeout_ms)
+        timeout_ms = remaining_ms;
+      continue;
+    }
+    if (!stream->connection) continue;
+    short events =
+        ToPollEvents(stream->read_wait) | ToPollEvents(stream->write_wait);
+    if (events)
+      poll_fds_.push_back({stream->connection->Socket(), events, 0});
+  }
+
+  // Nothing can wake the session anymore.
+  if (poll_fds_.empty()) return false;
+  return poll(poll_fds_.data(), poll_fds_.size(), timeout_ms) >= 0 ||
+         errno == EINTR;
+}
+
+}  // namespace protocols
+}  // namespace load_balancer
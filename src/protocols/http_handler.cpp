@@ -1,132 +1,326 @@
 #include "protocols/http_handler.h"
+#include "protocols/backend_failover.h"
+#include "protocols/http2_session.h"
 #include "utils/tls_utils.h"
 
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
 #include <openssl/err.h>
+#include <poll.h>
 #include <spdlog/spdlog.h>
-#include <unistd.h>
-#include <netinet/in.h>
-#include <arpa/inet.h>
-#include <thread>
 
 namespace load_balancer {
 namespace protocols {
 
-HttpHandler::HttpHandler(int client_socket,
-                         std::shared_ptr<core::Router> router)
-    : ProtocolHandler(client_socket, std::move(router)) {}
+namespace {
 
-HttpHandler::~HttpHandler() = default;
+// Response sent to clients whose request cannot be parsed.
+constexpr std::string_view BAD_REQUEST_RESPONSE =
+    "HTTP/1.1 400 Bad Request\r\n"
+    "Content-Length: 0\r\n"
+    "Connection: close\r\n"
+    "\r\n";
 
-void HttpHandler::Forward() {
-  // Select a backend server to forward the load.
-  auto backend = router_->PickBackendServer();
-  if (!backend) {
-    spdlog::error("No backend available for HTTP forwarding.");
-    return;
-  }
+// Response sent to clients whose request cannot reach a backend.
+constexpr std::string_view BAD_GATEWAY_RESPONSE =
+    "HTTP/1.1 502 Bad Gateway\r\n"
+    "Content-Length: 0\r\n"
+    "Connection: close\r\n"
+    "\r\n";
 
-  // Create a socket for the connection to the backend server.
-  int backend_socket = socket(AF_INET, SOCK_STREAM, 0);
-  if (backend_socket < 0) {
-    spdlog::error("Failed to create backend socket: {}", strerror(errno));
-    return;
-  }
+// Translates the SSL error an operation blocked on into poll events.
+short ToPollEvents(int wait) {
+  if (wait == SSL_ERROR_WANT_READ) return POLLIN;
+  if (wait == SSL_ERROR_WANT_WRITE) return POLLOUT;
+  return 0;
+}
 
-  // Configure the backend server address structure.
-  sockaddr_in backend_addr{};
-  backend_addr.sin_family = AF_INET;
-  backend_addr.sin_port = htons(backend->Port());
-  inet_pton(AF_INET, backend->Ip().c_str(), &backend_addr.sin_addr);
-
-  // Connect to the backend server.
-  if (connect(backend_socket, reinterpret_cast<sockaddr*>(&backend_addr),
-              sizeof(backend_addr)) < 0) {
-    spdlog::error("Failed to connect to backend {}:{} - {}",
-                  backend->Ip(), backend->Port(), strerror(errno));
-    close(backend_socket);
-    return;
+// Waits until the socket of 'ssl' is ready for the operation that blocked
+// with 'wait'. Returns false on a poll error.
+bool WaitFor(SSL* ssl, int wait) {
+  pollfd fd{SSL_get_fd(ssl), ToPollEvents(wait), 0};
+  return poll(&fd, 1, -1) >= 0 || errno == EINTR;
+}
+
+// Writes all of 'data' to 'ssl', waiting for the socket whenever the write
+// would block. Works for blocking and non-blocking sockets alike.
+bool WriteAll(SSL* ssl, const char* data, size_t length) {
+  while (length > 0) {
+    int written = SSL_write(ssl, data, static_cast<int>(length));
+    if (written > 0) {
+      data += written;
+      length -= written;
+      continue;
+    }
+
+    int error = SSL_get_error(ssl, written);
+    if (error != SSL_ERROR_WANT_READ && error != SSL_ERROR_WANT_WRITE)
+      return false;
+    if (!WaitFor(ssl, error)) return false;
   }
+  return true;
+}
 
-  // --- TLS Handshake with Client (Load Balancer acts as Server) ---
-  SSL_CTX* client_ctx = utils::TlsUtils::CreateContext(true);
-  utils::TlsUtils::ConfigureContext(client_ctx, "cert.pem", "key.pem");
+// Switches 'fd' to non-blocking mode.
+bool MakeNonBlocking(int fd) {
+  int flags = fcntl(fd, F_GETFL, 0);
+  return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) >= 0;
+}
+
+}  // namespace
+
+HttpHandler::HttpHandler(int client_socket,
+                         std::shared_ptr<HandlerContext> context)
+    : ProtocolHandler(client_socket, std::move(context)),
+      request_stream_(HttpParser::Type::kRequest, context_->http_limits),
+      response_stream_(HttpParser::Type::kResponse, context_->http_limits) {}
+
+HttpHandler::~HttpHandler() = default;
 
-  SSL* ssl_client = SSL_new(client_ctx);
+void HttpHandler::Forward() {
+  // --- TLS Handshake with Client (Load Balancer acts as Server) ---
+  SSL* ssl_client = SSL_new(context_->tls->ServerContext());
   SSL_set_fd(ssl_client, client_socket_);
   // Perform TLS handshake with client.
   if (SSL_accept(ssl_client) <= 0) {
     spdlog::error("TLS handshake with client failed");
     ERR_print_errors_fp(stderr);
     SSL_free(ssl_client);
-    SSL_CTX_free(client_ctx);
     return;
   }
 
-  // --- TLS Handshake with Backend (Load Balancer acts as Client) ---
-  SSL_CTX* backend_ctx = utils::TlsUtils::CreateContext(false);
-  SSL* ssl_backend = SSL_new(backend_ctx);
-  SSL_set_fd(ssl_backend, backend_socket);
-  // Perform TLS handshake with backend.
-  if (SSL_connect(ssl_backend) <= 0) {
-    spdlog::error("TLS handshake with backend failed");
-    ERR_print_errors_fp(stderr);
-    SSL_free(ssl_backend);
-    SSL_CTX_free(backend_ctx);
-    return;
+  // Like the pooled backend connections, the client connection is served
+  // without blocking from here on, so both legs can be driven together.
+  Relay::PrepareConnection(ssl_client);
+  if (!MakeNonBlocking(client_socket_)) {
+    spdlog::error("Failed to make client socket non-blocking: {}",
+                  strerror(errno));
+  } else if (utils::TlsUtils::NegotiatedProtocol(ssl_client) == "h2") {
+    // HTTP/2 multiplexes requests as streams; each is routed on its own.
+    Http2Session(ssl_client, context_).Run();
+  } else if (context_->http_routing == HttpRouting::kPerRequest) {
+    ForwardRequests(ssl_client);
+  } else {
+    ForwardConnection(ssl_client);
   }
 
-  // -- Bidirectional Data Forwarding --
-  std::thread client_to_backend([=, this]() {
-    // Proxy data from client to backend.
-    Proxy(ssl_client, ssl_backend);
-  });
-  std::thread backend_to_client([=, this]() {
-    // Proxy data from backend to client.
-    Proxy(ssl_backend, ssl_client);
-  });
-
-  // Wait for both proxying threads to complete.
-  client_to_backend.join();
-  backend_to_client.join();
-
   // --- Cleanup SSL/TLS Resources ---
   SSL_shutdown(ssl_client);
   SSL_free(ssl_client);
-  SSL_CTX_free(client_ctx);
+}
+
+void HttpHandler::ForwardConnection(SSL* ssl_client) {
+  // The request head is parsed before a backend is chosen, so malformed
+  // requests never reach a backend.
+  request_stream_.StartMessage();
+  if (!ReadHttpRequest(ssl_client)) return;
+  const HttpHead& head = request_stream_.Head();
+  spdlog::debug("HTTP request {} {}", head.method, head.target);
+
+  // Select a backend server and borrow a warm, already handshaked connection
+  // to it, or open a new one if none is idle.
+  std::shared_ptr<core::BackendServer> backend;
+  BackendFailover failover(*context_);
+  auto connection = failover.AcquirePooled(&backend);
+  if (!connection) {
+    spdlog::error("No backend available for HTTP forwarding.");
+    SendErrorResponse(ssl_client, BAD_GATEWAY_RESPONSE);
+    return;
+  }
+  std::shared_ptr<ConnectionPool> pool = context_->pools->PoolFor(backend);
+  Relay::PrepareConnection(connection->Ssl());
+
+  // -- Bidirectional Data Forwarding --
+  TunnelConnection(ssl_client, connection->Ssl(), failover.Decision());
+
+  // The relay does not delimit responses, so the backend connection's state
+  // is unknown and it cannot be reused.
+  pool->Release(std::move(connection), false);
+}
+
+void HttpHandler::ForwardRequests(SSL* ssl_client) {
+  while (true) {
+    request_stream_.StartMessage();
+    if (!ReadHttpRequest(ssl_client)) return;
+    const HttpHead& request = request_stream_.Head();
+    bool request_was_head = request.method == "HEAD";
+    bool keep_alive = request.keep_alive;
+    spdlog::debug("HTTP request {} {}", request.method, request.target);
+
+    // Every request gets its own routing decision.
+    std::shared_ptr<core::BackendServer> backend;
+    BackendFailover failover(*context_);
+    auto connection = failover.AcquirePooled(&backend);
+    if (!connection) {
+      spdlog::error("No backend available for HTTP forwarding.");
+      SendErrorResponse(ssl_client, BAD_GATEWAY_RESPONSE);
+      return;
+    }
+    std::shared_ptr<ConnectionPool> pool = context_->pools->PoolFor(backend);
+    Relay::PrepareConnection(connection->Ssl());
 
-  SSL_shutdown(ssl_backend);
-  SSL_free(ssl_backend);
-  SSL_CTX_free(backend_ctx);
+    // A response to HEAD has no body, whatever its head announces.
+    response_stream_.Clear(request_was_head);
+    ExchangeResult result = ExchangeHttpMessages(
+        ssl_client, connection->Ssl(), request_was_head, failover.Decision());
 
-  // Close the backend socket.
-  close(backend_socket);
+    // The backend connection is only clean if both messages were delimited,
+    // neither side asked to close, and nothing unsolicited arrived.
+    keep_alive = keep_alive && response_stream_.Head().keep_alive;
+    bool reusable = result == ExchangeResult::kDelivered && keep_alive &&
+                    !response_stream_.HasExcessBytes();
+    pool->Release(std::move(connection), reusable);
+    if (result != ExchangeResult::kDelivered || !keep_alive) return;
+  }
+}
+
+bool HttpHandler::ReadHttpRequest(SSL* ssl_client) {
+  // Pipelined bytes may already hold the head; otherwise read until the
+  // parser, which resumes where it stopped, sees its end.
+  while (!request_stream_.HeadComplete()) {
+    HttpStream::Result result = request_stream_.Fill(ssl_client);
+    if (result == HttpStream::Result::kEof) return false;
+    if (result == HttpStream::Result::kFailed) {
+      if (request_stream_.Error()) {
+        spdlog::warn("Rejected HTTP request: {}", request_stream_.Error());
+        SendErrorResponse(ssl_client, BAD_REQUEST_RESPONSE);
+      }
+      return false;
+    }
+    if (result == HttpStream::Result::kBlocked &&
+        !WaitFor(ssl_client, request_stream_.ReadWait())) {
+      return false;
+    }
+  }
+  return true;
 }
 
-std::string HttpHandler::ReadHttpRequest() {
-  constexpr size_t BUFFER_SIZE = 4096;
-  char buffer[BUFFER_SIZE];
-  std::string request;
+HttpHandler::ExchangeResult HttpHandler::ExchangeHttpMessages(
+    SSL* ssl_client, SSL* ssl_backend, bool request_was_head,
+    RoutingDecision& decision) {
+  using Result = HttpStream::Result;
 
-  // Read from the client socket until no more bytes or end of request.
   while (true) {
-    ssize_t bytes = read(client_socket_, buffer, BUFFER_SIZE);
-    if (bytes <= 0) break;
+    bool progressed = false;
+    Result result;
+
+    // Client to backend: the rest of the request.
+    if (!request_stream_.MessageDelivered()) {
+      result = request_stream_.Flush(ssl_backend);
+      if (result == Result::kFailed) {
+        decision.Finish(false);
+        return ExchangeResult::kFailed;
+      }
+      progressed |= result == Result::kProgress;
+
+      result = request_stream_.Fill(ssl_client);
+      if (result == Result::kFailed || result == Result::kEof) {
+        spdlog::debug("HTTP request body ended early: {}",
+                      request_stream_.Error() ? request_stream_.Error()
+                                              : "connection closed");
+        decision.Finish(false);
+        return ExchangeResult::kFailed;
+      }
+      progressed |= result == Result::kProgress;
+    }
+
+    // Backend to client: the response.
+    result = response_stream_.Fill(ssl_backend);
+    // A response delimited by closing the connection may be read together
+    // with that close; the tunnel below still delivers it.
+    bool closed_after_head =
+        result == Result::kEof && response_stream_.HeadComplete() &&
+        response_stream_.Head().framing == BodyFraming::kUntilClose;
+    if ((result == Result::kFailed || result == Result::kEof) &&
+        !closed_after_head) {
+      if (response_stream_.BytesDelivered() == 0) {
+        spdlog::error("Backend failed to answer HTTP request: {}",
+                      response_stream_.Error() ? response_stream_.Error()
+                                               : "connection closed");
+        SendErrorResponse(ssl_client, BAD_GATEWAY_RESPONSE);
+      }
+      decision.Finish(false);
+      return ExchangeResult::kFailed;
+    }
+    progressed |= result == Result::kProgress;
 
-    request.append(buffer, bytes);
+    if (response_stream_.HeadComplete()) {
+      const HttpHead& response = response_stream_.Head();
+      // Responses delimited by closing the connection and switched protocols
+      // cannot be framed any further.
+      if (response.framing == BodyFraming::kUntilClose) {
+        TunnelConnection(ssl_client, ssl_backend, decision);
+        return ExchangeResult::kEnded;
+      }
 
-    // Check if the end of the HTTP headers has been reached.
-    if (request.find("\r\n\r\n") != std::string::npos) break;
+      result = response_stream_.Flush(ssl_client);
+      if (result == Result::kFailed) {
+        decision.Finish(false);
+        return ExchangeResult::kFailed;
+      }
+      progressed |= result == Result::kProgress;
+      if (response_stream_.BytesDelivered() > 0) decision.FirstByte();
+
+      if (response_stream_.MessageDelivered()) {
+        // Interim responses precede the final one.
+        if (response.status_code < 200) {
+          response_stream_.StartMessage(request_was_head);
+          continue;
+        }
+        decision.Complete();
+        return request_stream_.MessageDelivered() ? ExchangeResult::kDelivered
+                                                  : ExchangeResult::kEnded;
+      }
+    }
+    if (progressed) continue;
+
+    // Sleep until a blocked operation can continue. A socket nothing waits
+    // on is left out, so a finished request does not wake the loop.
+    bool request_pending = !request_stream_.MessageDelivered();
+    short client_events =
+        ToPollEvents(response_stream_.WriteWait()) |
+        (request_pending ? ToPollEvents(request_stream_.ReadWait()) : 0);
+    short backend_events =
+        ToPollEvents(response_stream_.ReadWait()) |
+        (request_pending ? ToPollEvents(request_stream_.WriteWait()) : 0);
+    pollfd fds[2] = {
+        {client_events ? SSL_get_fd(ssl_client) : -1, client_events, 0},
+        {backend_events ? SSL_get_fd(ssl_backend) : -1, backend_events, 0}};
+    if (poll(fds, 2, -1) < 0 && errno != EINTR) {
+      decision.Finish(false);
+      return ExchangeResult::kFailed;
+    }
+  }
+}
+
+void HttpHandler::TunnelConnection(SSL* ssl_client, SSL* ssl_backend,
+                                   RoutingDecision& decision) {
+  // Bytes read while framing go out before the relay takes over.
+  for (auto [stream, to] : {std::pair{&request_stream_, ssl_backend},
+                            std::pair{&response_stream_, ssl_client}}) {
+    while (true) {
+      if (stream->FlushAll(to) == HttpStream::Result::kFailed) {
+        decision.Finish(false);
+        return;
+      }
+      if (!stream->WriteWait()) break;
+      if (!WaitFor(to, stream->WriteWait())) {
+        decision.Finish(false);
+        return;
+      }
+    }
   }
 
-  return request;
+  // -- Bidirectional Data Forwarding --
+  // Both directions are relayed from this thread.
+  RelayTraffic(ssl_client, ssl_backend, decision);
 }
 
-void HttpHandler::ForwardHttpRequest(const std::string& request,
-                                     int backend_socket) {
-  // Send the entire request string to the backend socket.
-  ssize_t bytes_sent = send(backend_socket, request.c_str(), request.size(), 0);
-  if (bytes_sent < 0) {
-    spdlog::error("Failed to send request to backend: {}", strerror(errno));
+void HttpHandler::SendErrorResponse(SSL* ssl_client,
+                                    std::string_view response) {
+  if (!WriteAll(ssl_client, response.data(), response.size())) {
+    spdlog::debug("Failed to send error response to client");
   }
 }
 
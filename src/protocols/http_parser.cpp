@@ -0,0 +1,456 @@
+#include "protocols/http_parser.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace load_balancer {
+namespace protocols {
+
+namespace {
+
+// Returns the ASCII lowercase form of 'c'.
+char ToLower(char c) {
+  return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+// Compares two strings ASCII case-insensitively.
+bool EqualsIgnoreCase(std::string_view a, std::string_view b) {
+  if (a.size() != b.size()) return false;
+  for (size_t i = 0; i < a.size(); ++i) {
+    if (ToLower(a[i]) != ToLower(b[i])) return false;
+  }
+  return true;
+}
+
+// Removes optional whitespace around 'value'.
+std::string_view TrimWhitespace(std::string_view value) {
+  while (!value.empty() && (value.front() == ' ' || value.front() == '\t'))
+    value.remove_prefix(1);
+  while (!value.empty() && (value.back() == ' ' || value.back() == '\t'))
+    value.remove_suffix(1);
+  return value;
+}
+
+// Calls 'visit' for each element of a comma-separated header value.
+template <typename Visitor>
+void ForEachToken(std::string_view value, Visitor&& visit) {
+  while (!value.empty()) {
+    size_t comma = value.find(',');
+    std::string_view token = TrimWhitespace(value.substr(0, comma));
+    if (!token.empty()) visit(token);
+    if (comma == std::string_view::npos) break;
+    value.remove_prefix(comma + 1);
+  }
+}
+
+// Returns true if 'c' is a decimal digit.
+bool IsDigit(char c) {
+  return c >= '0' && c <= '9';
+}
+
+// Returns true if 'c' may appear in a header field name or method (RFC 9110
+// token characters).
+bool IsTokenChar(char c) {
+  if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || IsDigit(c))
+    return true;
+  return c != '\0' && std::strchr("!#$%&'*+-.^_`|~", c) != nullptr;
+}
+
+// Returns true if 'value' is a non-empty token.
+bool IsToken(std::string_view value) {
+  if (value.empty()) return false;
+  for (char c : value) {
+    if (!IsTokenChar(c)) return false;
+  }
+  return true;
+}
+
+// Parses "HTTP/1.0" or "HTTP/1.1" and stores the minor version.
+bool ParseVersion(std::string_view version, int& minor_version) {
+  if (version.size() != 8 || version.substr(0, 7) != "HTTP/1.") return false;
+  if (version[7] != '0' && version[7] != '1') return false;
+  minor_version = version[7] - '0';
+  return true;
+}
+
+// Parses a decimal Content-Length value.
+bool ParseContentLength(std::string_view value, uint64_t& length) {
+  if (value.empty()) return false;
+  uint64_t result = 0;
+  for (char c : value) {
+    if (!IsDigit(c)) return false;
+    if (result > (std::numeric_limits<uint64_t>::max() - (c - '0')) / 10)
+      return false;
+    result = result * 10 + (c - '0');
+  }
+  length = result;
+  return true;
+}
+
+// Returns the value of hexadecimal digit 'c', or -1.
+int HexValue(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+}  // namespace
+
+std::optional<std::string_view> HttpHead::Header(std::string_view name) const {
+  for (const HttpHeader& header : headers) {
+    if (EqualsIgnoreCase(header.name, name)) return header.value;
+  }
+  return std::nullopt;
+}
+
+HttpParser::HttpParser(Type type, HttpParserLimits limits)
+    : type_(type), limits_(limits) {
+  header_spans_.reserve(limits_.max_headers);
+  headers_.reserve(limits_.max_headers);
+}
+
+void HttpParser::Reset(bool request_was_head) {
+  request_was_head_ = request_was_head;
+  scan_offset_ = 0;
+  line_start_ = 0;
+  start_line_done_ = false;
+  method_ = target_ = reason_ = Span{};
+  // Clearing keeps the capacity, so the next message allocates nothing.
+  header_spans_.clear();
+  headers_.clear();
+  head_size_ = 0;
+  head_ = HttpHead{};
+  body_remaining_ = 0;
+  chunk_state_ = ChunkState::kSize;
+  chunk_size_digits_ = false;
+  chunk_line_length_ = 0;
+  error_ = nullptr;
+}
+
+HttpParser::Status HttpParser::Fail(const char* error) {
+  error_ = error;
+  return Status::kError;
+}
+
+HttpParser::Status HttpParser::ParseHead(std::string_view buffer) {
+  if (error_) return Status::kError;
+  if (head_size_) return Status::kComplete;
+
+  while (scan_offset_ < buffer.size()) {
+    const void* found = std::memchr(buffer.data() + scan_offset_, '\n',
+                                    buffer.size() - scan_offset_);
+    if (!found) {
+      scan_offset_ = buffer.size();
+      break;
+    }
+
+    size_t line_end = static_cast<const char*>(found) - buffer.data();
+    if (line_end + 1 > limits_.max_head_size)
+      return Fail("message head too large");
+
+    std::string_view line = buffer.substr(line_start_, line_end - line_start_);
+    if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+    auto offset = static_cast<uint32_t>(line_start_);
+    line_start_ = scan_offset_ = line_end + 1;
+
+    if (!start_line_done_) {
+      // Empty lines before a request line are ignored (RFC 9112 2.2).
+      if (line.empty() && type_ == Type::kRequest) continue;
+      if (!ParseStartLine(line, offset)) return Status::kError;
+      start_line_done_ = true;
+    } else if (line.empty()) {
+      head_size_ = line_end + 1;
+      return FinishHead(buffer) ? Status::kComplete : Status::kError;
+    } else if (!ParseHeaderLine(line, offset)) {
+      return Status::kError;
+    }
+  }
+
+  // Without a line feed the head cannot end within the limit anymore.
+  if (buffer.size() >= limits_.max_head_size)
+    return Fail("message head too large");
+  return Status::kIncomplete;
+}
+
+bool HttpParser::ParseStartLine(std::string_view line, uint32_t offset) {
+  size_t first_space = line.find(' ');
+  if (first_space == std::string_view::npos) {
+    Fail("malformed start line");
+    return false;
+  }
+
+  if (type_ == Type::kRequest) {
+    // method SP request-target SP HTTP-version
+    size_t last_space = line.rfind(' ');
+    std::string_view method = line.substr(0, first_space);
+    std::string_view target =
+        line.substr(first_space + 1, last_space - first_space - 1);
+    if (last_space == first_space || !IsToken(method) || target.empty() ||
+        target.find(' ') != std::string_view::npos ||
+        !ParseVersion(line.substr(last_space + 1), head_.minor_version)) {
+      Fail("malformed request line");
+      return false;
+    }
+    method_ = {offset, static_cast<uint32_t>(method.size())};
+    target_ = {offset + static_cast<uint32_t>(first_space + 1),
+               static_cast<uint32_t>(target.size())};
+    return true;
+  }
+
+  // HTTP-version SP status-code SP [ reason-phrase ]
+  std::string_view status = line.substr(first_space + 1, 3);
+  if (!ParseVersion(line.substr(0, first_space), head_.minor_version) ||
+      status.size() != 3 || !IsDigit(status[0]) || !IsDigit(status[1]) ||
+      !IsDigit(status[2])) {
+    Fail("malformed status line");
+    return false;
+  }
+  head_.status_code =
+      (status[0] - '0') * 100 + (status[1] - '0') * 10 + (status[2] - '0');
+
+  size_t reason_start = first_space + 4;
+  if (reason_start < line.size()) {
+    if (line[reason_start] != ' ') {
+      Fail("malformed status line");
+      return false;
+    }
+    reason_ = {offset + static_cast<uint32_t>(reason_start + 1),
+               static_cast<uint32_t>(line.size() - reason_start - 1)};
+  }
+  return true;
+}
+
+bool HttpParser::ParseHeaderLine(std::string_view line, uint32_t offset) {
+  // Obsolete line folding is rejected, as is whitespace before the colon;
+  // both are classic request smuggling vectors.
+  size_t colon = line.find(':');
+  if (colon == std::string_view::npos || !IsToken(line.substr(0, colon))) {
+    Fail("malformed header field");
+    return false;
+  }
+  if (header_spans_.size() >= limits_.max_headers) {
+    Fail("too many header fields");
+    return false;
+  }
+
+  std::string_view raw_value = line.substr(colon + 1);
+  std::string_view value = TrimWhitespace(raw_value);
+  auto value_offset = static_cast<uint32_t>(
+      offset + colon + 1 + (value.data() - raw_value.data()));
+  header_spans_.push_back({{offset, static_cast<uint32_t>(colon)},
+                           {value_offset, static_cast<uint32_t>(value.size())}});
+  return true;
+}
+
+bool HttpParser::FinishHead(std::string_view buffer) {
+  auto view = [&](Span span) {
+    return buffer.substr(span.offset, span.length);
+  };
+  head_.method = view(method_);
+  head_.target = view(target_);
+  head_.reason = view(reason_);
+  for (const HeaderSpan& span : header_spans_)
+    headers_.push_back({view(span.name), view(span.value)});
+  head_.headers = headers_;
+
+  // Collect the headers that decide framing and connection persistence.
+  bool has_content_length = false;
+  bool has_transfer_encoding = false;
+  bool chunked = false;
+  bool close = false;
+  bool keep_alive = false;
+  for (const HttpHeader& header : headers_) {
+    if (EqualsIgnoreCase(header.name, "Content-Length")) {
+      uint64_t length = 0;
+      // Repeated Content-Length fields must agree.
+      if (!ParseContentLength(header.value, length) ||
+          (has_content_length && length != head_.content_length)) {
+        Fail("invalid Content-Length");
+        return false;
+      }
+      has_content_length = true;
+      head_.content_length = length;
+    } else if (EqualsIgnoreCase(header.name, "Transfer-Encoding")) {
+      has_transfer_encoding = true;
+      // Only a final "chunked" coding delimits the body.
+      ForEachToken(header.value, [&](std::string_view coding) {
+        chunked = EqualsIgnoreCase(coding, "chunked");
+      });
+    } else if (EqualsIgnoreCase(header.name, "Connection")) {
+      ForEachToken(header.value, [&](std::string_view option) {
+        if (EqualsIgnoreCase(option, "close")) close = true;
+        if (EqualsIgnoreCase(option, "keep-alive")) keep_alive = true;
+      });
+    }
+  }
+
+  // A message with both is ambiguous between hops (RFC 9112 6.1).
+  if (has_transfer_encoding && has_content_length) {
+    Fail("both Transfer-Encoding and Content-Length present");
+    return false;
+  }
+  head_.keep_alive = head_.minor_version >= 1 ? !close : keep_alive && !close;
+
+  if (type_ == Type::kRequest) {
+    if (has_transfer_encoding && !chunked) {
+      Fail("unsupported Transfer-Encoding");
+      return false;
+    }
+    if (chunked) {
+      head_.framing = BodyFraming::kChunked;
+    } else if (head_.content_length > 0) {
+      head_.framing = BodyFraming::kContentLength;
+    }
+  } else {
+    int status = head_.status_code;
+    if (status == 101) {
+      // The connection switches protocols and is tunneled until closed.
+      head_.framing = BodyFraming::kUntilClose;
+    } else if (request_was_head_ || (status >= 100 && status < 200) ||
+               status == 204 || status == 304) {
+      head_.framing = BodyFraming::kNone;
+    } else if (chunked) {
+      head_.framing = BodyFraming::kChunked;
+    } else if (has_transfer_encoding || !has_content_length) {
+      head_.framing = BodyFraming::kUntilClose;
+    } else if (head_.content_length > 0) {
+      head_.framing = BodyFraming::kContentLength;
+    }
+    if (head_.framing == BodyFraming::kUntilClose) head_.keep_alive = false;
+  }
+
+  body_remaining_ = head_.content_length;
+  return true;
+}
+
+HttpParser::Status HttpParser::ConsumeBody(std::string_view data,
+                                           size_t& consumed) {
+  consumed = 0;
+  if (error_) return Status::kError;
+
+  switch (head_.framing) {
+    case BodyFraming::kNone:
+      return Status::kComplete;
+    case BodyFraming::kContentLength: {
+      uint64_t take = std::min<uint64_t>(body_remaining_, data.size());
+      consumed = static_cast<size_t>(take);
+      body_remaining_ -= take;
+      return body_remaining_ == 0 ? Status::kComplete : Status::kIncomplete;
+    }
+    case BodyFraming::kChunked:
+      return ConsumeChunked(data, consumed, nullptr);
+    case BodyFraming::kUntilClose:
+      consumed = data.size();
+      return Status::kIncomplete;
+  }
+  return Status::kIncomplete;
+}
+
+HttpParser::Status HttpParser::DecodeBody(std::string_view data,
+                                          size_t& consumed,
+                                          std::string_view& payload) {
+  if (head_.framing == BodyFraming::kChunked) {
+    payload = {};
+    consumed = 0;
+    if (error_) return Status::kError;
+    return ConsumeChunked(data, consumed, &payload);
+  }
+  Status status = ConsumeBody(data, consumed);
+  payload = data.substr(0, consumed);
+  return status;
+}
+
+HttpParser::Status HttpParser::ConsumeChunked(std::string_view data,
+                                              size_t& consumed,
+                                              std::string_view* payload) {
+  size_t position = 0;
+  while (position < data.size() && chunk_state_ != ChunkState::kDone) {
+    // Chunk data is skipped in bulk; everything else is framing.
+    if (chunk_state_ == ChunkState::kData) {
+      uint64_t take =
+          std::min<uint64_t>(body_remaining_, data.size() - position);
+      if (payload) *payload = data.substr(position, take);
+      position += static_cast<size_t>(take);
+      body_remaining_ -= take;
+      if (body_remaining_ == 0) chunk_state_ = ChunkState::kDataCr;
+      if (payload) break;
+      continue;
+    }
+
+    // Line terminators do not count towards the line length limit.
+    char c = data[position++];
+    if (c != '\r' && c != '\n' &&
+        ++chunk_line_length_ > limits_.max_head_size) {
+      return Fail("chunk framing line too long");
+    }
+
+    switch (chunk_state_) {
+      case ChunkState::kSize: {
+        int digit = HexValue(c);
+        if (digit >= 0) {
+          if (body_remaining_ > (std::numeric_limits<uint64_t>::max() >> 4))
+            return Fail("chunk size too large");
+          body_remaining_ = (body_remaining_ << 4) | digit;
+          chunk_size_digits_ = true;
+          break;
+        }
+        if (!chunk_size_digits_) return Fail("malformed chunk size");
+        if (c == ';' || c == ' ' || c == '\t') {
+          chunk_state_ = ChunkState::kExtension;
+        } else if (c == '\r') {
+          chunk_state_ = ChunkState::kSizeLf;
+        } else if (c == '\n') {
+          --position;
+          chunk_state_ = ChunkState::kSizeLf;
+        } else {
+          return Fail("malformed chunk size");
+        }
+        break;
+      }
+      case ChunkState::kExtension:
+        // Chunk extensions are forwarded untouched and otherwise ignored.
+        if (c == '\n') {
+          --position;
+          chunk_state_ = ChunkState::kSizeLf;
+        }
+        break;
+      case ChunkState::kSizeLf:
+        if (c != '\n') return Fail("malformed chunk size line");
+        chunk_line_length_ = 0;
+        chunk_size_digits_ = false;
+        // The last chunk has size zero and is followed by the trailer section.
+        chunk_state_ = body_remaining_ == 0 ? ChunkState::kTrailer
+                                            : ChunkState::kData;
+        break;
+      case ChunkState::kDataCr:
+        if (c == '\r') {
+          chunk_state_ = ChunkState::kDataLf;
+          break;
+        }
+        [[fallthrough]];
+      case ChunkState::kDataLf:
+        if (c != '\n') return Fail("missing CRLF after chunk data");
+        chunk_line_length_ = 0;
+        chunk_state_ = ChunkState::kSize;
+        break;
+      case ChunkState::kTrailer:
+        if (c != '\n') break;
+        // An empty line ends the trailer section and with it the message.
+        if (chunk_line_length_ == 0) chunk_state_ = ChunkState::kDone;
+        chunk_line_length_ = 0;
+        break;
+      case ChunkState::kData:
+      case ChunkState::kDone:
+        break;
+    }
+  }
+
+  consumed = position;
+  return chunk_state_ == ChunkState::kDone ? Status::kComplete
+                                           : Status::kIncomplete;
+}
+
+}  // namespace protocols
+}  // namespace load_balancer
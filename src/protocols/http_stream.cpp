@@ -0,0 +1,117 @@
+#include "protocols/http_stream.h"
+
+#include <cstring>
+#include <string_view>
+
+namespace load_balancer {
+namespace protocols {
+
+HttpStream::HttpStream(HttpParser::Type type, const HttpParserLimits& limits)
+    : parser_(type, limits), buffer_(limits.max_head_size) {}
+
+void HttpStream::StartMessage(bool request_was_head) {
+  // Keep what was read past the previous message; it starts the next one.
+  std::memmove(buffer_.data(), buffer_.data() + framed_, length_ - framed_);
+  length_ -= framed_;
+  framed_ = sent_ = retry_length_ = 0;
+  delivered_ = 0;
+  head_complete_ = message_complete_ = false;
+  parser_.Reset(request_was_head);
+  Frame();
+}
+
+void HttpStream::Clear(bool request_was_head) {
+  framed_ = length_;
+  StartMessage(request_was_head);
+}
+
+HttpStream::Result HttpStream::Fill(SSL* from) {
+  read_wait_ = 0;
+  if (parser_.Error()) return Result::kFailed;
+
+  Result result = Result::kBlocked;
+  while (!message_complete_ && length_ < buffer_.size()) {
+    int bytes = SSL_read(from, buffer_.data() + length_,
+                         static_cast<int>(buffer_.size() - length_));
+    if (bytes > 0) {
+      length_ += bytes;
+      if (!Frame()) return Result::kFailed;
+      result = Result::kProgress;
+      continue;
+    }
+
+    int error = SSL_get_error(from, bytes);
+    if (error == SSL_ERROR_WANT_READ || error == SSL_ERROR_WANT_WRITE) {
+      read_wait_ = error;
+      return result;
+    }
+    return error == SSL_ERROR_ZERO_RETURN ? Result::kEof : Result::kFailed;
+  }
+  return result;
+}
+
+HttpStream::Result HttpStream::Flush(SSL* to) {
+  return WriteUpTo(to, framed_);
+}
+
+HttpStream::Result HttpStream::FlushAll(SSL* to) {
+  return WriteUpTo(to, length_);
+}
+
+bool HttpStream::Frame() {
+  if (!head_complete_) {
+    HttpParser::Status status =
+        parser_.ParseHead(std::string_view(buffer_.data(), length_));
+    if (status == HttpParser::Status::kError) return false;
+    if (status == HttpParser::Status::kIncomplete) return true;
+    head_complete_ = true;
+    framed_ = parser_.HeadSize();
+  }
+
+  if (!message_complete_) {
+    size_t consumed = 0;
+    HttpParser::Status status = parser_.ConsumeBody(
+        std::string_view(buffer_.data() + framed_, length_ - framed_),
+        consumed);
+    if (status == HttpParser::Status::kError) return false;
+    framed_ += consumed;
+    message_complete_ = status == HttpParser::Status::kComplete;
+  }
+  return true;
+}
+
+HttpStream::Result HttpStream::WriteUpTo(SSL* to, size_t end) {
+  write_wait_ = 0;
+  Result result = Result::kBlocked;
+  while (sent_ < end) {
+    size_t length = retry_length_ ? retry_length_ : end - sent_;
+    int written = SSL_write(to, buffer_.data() + sent_,
+                            static_cast<int>(length));
+    if (written <= 0) {
+      int error = SSL_get_error(to, written);
+      if (error != SSL_ERROR_WANT_READ && error != SSL_ERROR_WANT_WRITE)
+        return Result::kFailed;
+      retry_length_ = length;
+      write_wait_ = error;
+      break;
+    }
+    sent_ += written;
+    delivered_ += written;
+    retry_length_ = 0;
+    result = Result::kProgress;
+  }
+
+  // Once the head is parsed the written bytes are no longer needed, so the
+  // space is reclaimed for the rest of the body, unless a blocked write still
+  // refers to it.
+  if (head_complete_ && sent_ > 0 && retry_length_ == 0) {
+    std::memmove(buffer_.data(), buffer_.data() + sent_, length_ - sent_);
+    length_ -= sent_;
+    framed_ = framed_ > sent_ ? framed_ - sent_ : 0;
+    sent_ = 0;
+  }
+  return result;
+}
+
+}  // namespace protocols
+}  // namespace load_balancer
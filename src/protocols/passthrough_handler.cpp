@@ -0,0 +1,58 @@
+#include "protocols/passthrough_handler.h"
+#include "protocols/splice_relay.h"
+
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <spdlog/spdlog.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <utility>
+
+namespace load_balancer {
+namespace protocols {
+
+PassthroughHandler::PassthroughHandler(int client_socket,
+                                       std::shared_ptr<HandlerContext> context)
+    : ProtocolHandler(client_socket, std::move(context)) {}
+
+PassthroughHandler::~PassthroughHandler() = default;
+
+void PassthroughHandler::Forward() {
+  // Select a backend server and connect to it.
+  std::shared_ptr<core::BackendServer> backend;
+  int backend_socket = ConnectWithFailover(&backend);
+  if (backend_socket < 0) {
+    spdlog::error("No backend available for passthrough forwarding.");
+    return;
+  }
+
+  // The relay serves both directions from this thread, so neither socket
+  // may block.
+  for (int fd : {client_socket_, backend_socket}) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+      spdlog::error("Failed to make socket non-blocking: {}", strerror(errno));
+      Decision().Finish(false);
+      close(backend_socket);
+      return;
+    }
+  }
+
+  // --- Bidirectional Data Forwarding ---
+  SpliceRelay relay(client_socket_, backend_socket);
+  SpliceRelay::Status status = relay.Run();
+  Decision().FirstByteAt(relay.FirstByteToClientNs());
+  if (status == SpliceRelay::Status::kFailed) {
+    spdlog::debug("{} relay ended with an error.", Name());
+    Decision().Finish(false);
+  }
+
+  // Close the backend socket.
+  close(backend_socket);
+}
+
+}  // namespace protocols
+}  // namespace load_balancer
@@ -1,18 +1,390 @@
 #include "protocols/protocol_handler.h"
+#include "protocols/backend_failover.h"
+#include "utils/socket_utils.h"
+#include "utils/tls_utils.h"
+
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <openssl/err.h>
+#include <spdlog/spdlog.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
 
 namespace load_balancer {
 namespace protocols {
 
-void ProtocolHandler::Proxy(SSL* from, SSL* to) {
-  constexpr size_t BUFFER_SIZE = 4096;
-  char buffer[BUFFER_SIZE];
+// Events every session socket is registered for. Sockets stay registered for
+// both directions; edge-triggered delivery means the state machine is only
+// woken when readiness changes.
+constexpr uint32_t SESSION_EVENTS = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+
+void ProtocolHandler::RelayTraffic(SSL* ssl_client, SSL* ssl_backend,
+                                   RoutingDecision& decision) {
+  // The relay needs both sockets non-blocking to serve the two directions
+  // from this thread.
+  for (SSL* ssl : {ssl_client, ssl_backend}) {
+    int fd = SSL_get_fd(ssl);
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+      spdlog::error("Failed to make socket non-blocking: {}", strerror(errno));
+      decision.Finish(false);
+      return;
+    }
+  }
+
+  Relay relay(ssl_client, ssl_backend, *context_->buffers);
+  Relay::Status status = relay.Run();
+  decision.FirstByteAt(relay.FirstByteToClientNs());
+  if (status == Relay::Status::kFailed) {
+    spdlog::debug("{} relay ended with an error.", Name());
+    decision.Finish(false);
+  }
+}
+
+int ProtocolHandler::ConnectWithFailover(
+    std::shared_ptr<core::BackendServer>* backend) {
+  int backend_socket = -1;
+  *backend = failover_.Connect([&](const auto& candidate) {
+    backend_socket = utils::SocketUtils::ConnectWithTimeout(
+        candidate->Ip(), candidate->Port(), context_->connect.timeout);
+    if (backend_socket < 0) {
+      spdlog::error("Failed to connect to backend {} - {}",
+                    candidate->Address(), strerror(errno));
+    }
+    return backend_socket >= 0;
+  });
+  return *backend ? backend_socket : -1;
+}
+
+void ProtocolHandler::Start(core::EventLoop* loop) {
+  loop_ = loop;
+  self_ = shared_from_this();
+
+  // Select a backend server for forwarding.
+  backend_ = failover_.Next();
+  if (!backend_) {
+    spdlog::error("No backend available for {} forwarding.", Name());
+    Close();
+    return;
+  }
+
+  // Switch the client socket to non-blocking mode.
+  int flags = fcntl(client_socket_, F_GETFL, 0);
+  if (flags < 0 || fcntl(client_socket_, F_SETFL, flags | O_NONBLOCK) < 0) {
+    spdlog::error("Failed to make client socket non-blocking: {}",
+                  strerror(errno));
+    Close();
+    return;
+  }
+
+  // --- TLS Setup for Client Side (handshake runs once the backend is up) ---
+  if (TerminatesTls()) {
+    ssl_client_ = SSL_new(context_->tls->ServerContext());
+    SSL_set_fd(ssl_client_, client_socket_);
+    SSL_set_accept_state(ssl_client_);
+  }
+
+  // Registration reports the sockets' current readiness, which kicks off the
+  // state machine.
+  if (!loop_->Add(client_socket_, SESSION_EVENTS, this)) {
+    Close();
+    return;
+  }
+
+  // A warm pooled connection skips both the connect and the backend
+  // handshake; otherwise connect now and handshake once connected.
+  if (UsesConnectionPool()) {
+    pooled_connection_ = context_->pools->PoolFor(backend_)->TryAcquireIdle();
+  }
+  if (pooled_connection_) {
+    backend_socket_ = pooled_connection_->Socket();
+    ssl_backend_ = pooled_connection_->Ssl();
+    state_ = State::kClientHandshake;
+    failover_.Succeeded();
+    if (!loop_->Add(backend_socket_, SESSION_EVENTS, this)) Close();
+  } else if (!ConnectToAnyBackend()) {
+    spdlog::error("No backend available for {} forwarding.", Name());
+    Close();
+  }
+}
+
+bool ProtocolHandler::ConnectToAnyBackend() {
+  for (; backend_; backend_ = failover_.Next()) {
+    if (ConnectToBackend()) return true;
+    ReleaseBackendSocket();
+    failover_.Failed();
+  }
+  return false;
+}
+
+void ProtocolHandler::RetryConnect(int error) {
+  spdlog::error("Failed to connect to backend {} - {}", backend_->Address(),
+                strerror(error));
+  ReleaseBackendSocket();
+  failover_.Failed();
+  backend_ = failover_.Next();
+  if (!ConnectToAnyBackend()) {
+    spdlog::error("No backend available for {} forwarding.", Name());
+    Close();
+  }
+}
+
+void ProtocolHandler::ReleaseBackendSocket() {
+  if (ssl_backend_) {
+    SSL_free(ssl_backend_);
+    ssl_backend_ = nullptr;
+  }
+  if (backend_socket_ >= 0) {
+    loop_->Remove(backend_socket_);
+    close(backend_socket_);
+    backend_socket_ = -1;
+  }
+}
+
+bool ProtocolHandler::ArmConnectTimer() {
+  if (connect_timer_ < 0) {
+    connect_timer_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (connect_timer_ < 0) {
+      spdlog::error("Failed to create connect timer: {}", strerror(errno));
+      return false;
+    }
+    if (!loop_->Add(connect_timer_, EPOLLIN, this)) {
+      close(connect_timer_);
+      connect_timer_ = -1;
+      return false;
+    }
+  }
+
+  // Setting a new expiry also discards one that was not read yet.
+  auto timeout = context_->connect.timeout;
+  itimerspec deadline{};
+  deadline.it_value.tv_sec = timeout.count() / 1000;
+  deadline.it_value.tv_nsec = (timeout.count() % 1000) * 1000000;
+  if (deadline.it_value.tv_sec == 0 && deadline.it_value.tv_nsec == 0)
+    deadline.it_value.tv_nsec = 1;
+  return timerfd_settime(connect_timer_, 0, &deadline, nullptr) == 0;
+}
+
+void ProtocolHandler::CloseConnectTimer() {
+  if (connect_timer_ < 0) return;
+  loop_->Remove(connect_timer_);
+  close(connect_timer_);
+  connect_timer_ = -1;
+}
+
+bool ProtocolHandler::ConnectToBackend() {
+  // Create a non-blocking socket to connect to the backend server.
+  backend_socket_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                           0);
+  if (backend_socket_ < 0) {
+    spdlog::error("Failed to create backend socket: {}", strerror(errno));
+    return false;
+  }
+
+  // Configure the backend server address.
+  sockaddr_in backend_addr{};
+  backend_addr.sin_family = AF_INET;
+  backend_addr.sin_port = htons(backend_->Port());
+  inet_pton(AF_INET, backend_->Ip().c_str(), &backend_addr.sin_addr);
+
+  // Start connecting; completion is reported as writability.
+  if (connect(backend_socket_, reinterpret_cast<sockaddr*>(&backend_addr),
+              sizeof(backend_addr)) < 0 &&
+      errno != EINPROGRESS) {
+    spdlog::error("Failed to connect to backend {}:{} - {}", backend_->Ip(),
+                  backend_->Port(), strerror(errno));
+    return false;
+  }
+
+  // --- TLS Setup for Backend Side (Load Balancer acts as Client) ---
+  if (TerminatesTls()) {
+    ssl_backend_ = SSL_new(context_->tls->ClientContext());
+    SSL_set_fd(ssl_backend_, backend_socket_);
+    SSL_set_connect_state(ssl_backend_);
+    context_->tls->PrepareBackendConnection(ssl_backend_, backend_->Address());
+  }
+  return ArmConnectTimer() &&
+         loop_->Add(backend_socket_, SESSION_EVENTS, this);
+}
+
+void ProtocolHandler::HandleEvent(int fd, uint32_t events) {
+  if (state_ == State::kClosed) return;
+
+  // The pending connect missed its deadline.
+  if (fd == connect_timer_) {
+    uint64_t expirations;
+    if (read(connect_timer_, &expirations, sizeof(expirations)) > 0 &&
+        state_ == State::kConnecting) {
+      RetryConnect(ETIMEDOUT);
+    }
+    return;
+  }
+
+  if (state_ == State::kConnecting) {
+    // Only the backend socket tells that 'connect' finished; an error on the
+    // client socket ends the session.
+    if (fd != backend_socket_) {
+      if (events & EPOLLERR) Close();
+      return;
+    }
+    if (!(events & (EPOLLOUT | EPOLLHUP | EPOLLERR))) return;
+
+    int error = 0;
+    socklen_t len = sizeof(error);
+    getsockopt(backend_socket_, SOL_SOCKET, SO_ERROR, &error, &len);
+    if (error != 0 || (events & EPOLLERR)) {
+      RetryConnect(error != 0 ? error : ECONNRESET);
+      return;
+    }
+    CloseConnectTimer();
+    failover_.Succeeded();
+    if (TerminatesTls()) {
+      state_ = State::kClientHandshake;
+    } else {
+      splice_relay_ =
+          std::make_unique<SpliceRelay>(client_socket_, backend_socket_);
+      state_ = State::kRelaying;
+    }
+  } else if (events & EPOLLERR) {
+    // Socket errors end the session in every other state.
+    failover_.Decision().Finish(false);
+    Close();
+    return;
+  }
+
+  Advance();
+}
 
+void ProtocolHandler::Advance() {
   while (true) {
-    int bytes = SSL_read(from, buffer, BUFFER_SIZE);
-    if (bytes <= 0) break;
-    if (SSL_write(to, buffer, bytes) <= 0) break;
+    switch (state_) {
+      case State::kConnecting:
+      case State::kClosed:
+        return;
+
+      case State::kClientHandshake:
+        switch (Handshake(ssl_client_)) {
+          case StepResult::kDone:
+            if (SSL_session_reused(ssl_client_))
+              spdlog::debug("Resumed TLS session with client.");
+            state_ = State::kBackendHandshake;
+            break;
+          case StepResult::kBlocked:
+            return;
+          case StepResult::kFailed:
+            spdlog::error("TLS handshake with client failed.");
+            ERR_print_errors_fp(stderr);
+            failover_.Decision().Finish(false);
+            Close();
+            return;
+        }
+        break;
+
+      case State::kBackendHandshake:
+        switch (Handshake(ssl_backend_)) {
+          case StepResult::kDone:
+            failover_.Decision().HandshakeDone();
+            if (SSL_session_reused(ssl_backend_))
+              spdlog::debug("Resumed TLS session with backend {}.",
+                            backend_->Address());
+            relay_ = std::make_unique<Relay>(ssl_client_, ssl_backend_,
+                                             *context_->buffers);
+            state_ = State::kRelaying;
+            break;
+          case StepResult::kBlocked:
+            return;
+          case StepResult::kFailed:
+            spdlog::error("TLS handshake with backend failed.");
+            ERR_print_errors_fp(stderr);
+            context_->tls->EvictBackendSession(backend_->Address());
+            failover_.Decision().Finish(false);
+            Close();
+            return;
+        }
+        break;
+
+      case State::kRelaying: {
+        // The session ends once both directions are done or one fails.
+        bool active;
+        bool failed;
+        if (relay_) {
+          Relay::Status status = relay_->Step();
+          active = status == Relay::Status::kActive;
+          failed = status == Relay::Status::kFailed;
+        } else {
+          SpliceRelay::Status status = splice_relay_->Step();
+          active = status == SpliceRelay::Status::kActive;
+          failed = status == SpliceRelay::Status::kFailed;
+        }
+        failover_.Decision().FirstByteAt(
+            relay_ ? relay_->FirstByteToClientNs()
+                   : splice_relay_->FirstByteToClientNs());
+        if (failed) failover_.Decision().Finish(false);
+        if (!active) Close();
+        return;
+      }
+    }
   }
 }
 
+ProtocolHandler::StepResult ProtocolHandler::Handshake(SSL* ssl) {
+  int result = SSL_do_handshake(ssl);
+  if (result == 1) return StepResult::kDone;
+
+  int error = SSL_get_error(ssl, result);
+  if (error == SSL_ERROR_WANT_READ || error == SSL_ERROR_WANT_WRITE)
+    return StepResult::kBlocked;
+  return StepResult::kFailed;
+}
+
+void ProtocolHandler::Close() {
+  if (state_ == State::kClosed) return;
+  state_ = State::kClosed;
+
+  // A borrowed connection's state is unknown after relaying, so it is closed
+  // rather than returned for reuse.
+  if (pooled_connection_) {
+    loop_->Remove(backend_socket_);
+    context_->pools->PoolFor(backend_)->Release(std::move(pooled_connection_),
+                                                false);
+    ssl_backend_ = nullptr;
+    backend_socket_ = -1;
+  }
+
+  // --- Cleanup SSL/TLS Resources ---
+  if (ssl_client_) {
+    if (SSL_is_init_finished(ssl_client_)) SSL_shutdown(ssl_client_);
+    SSL_free(ssl_client_);
+    ssl_client_ = nullptr;
+  }
+  if (ssl_backend_) {
+    if (SSL_is_init_finished(ssl_backend_)) SSL_shutdown(ssl_backend_);
+    SSL_free(ssl_backend_);
+    ssl_backend_ = nullptr;
+  }
+
+  // Close both sockets; removing them from the loop first avoids stale events.
+  CloseConnectTimer();
+  if (backend_socket_ >= 0) {
+    loop_->Remove(backend_socket_);
+    close(backend_socket_);
+    backend_socket_ = -1;
+  }
+  if (client_socket_ >= 0) {
+    loop_->Remove(client_socket_);
+    close(client_socket_);
+    client_socket_ = -1;
+  }
+  spdlog::debug("{} session closed.", Name());
+
+  // Release the self-reference once the current dispatch has returned.
+  if (self_) loop_->Post([self = std::move(self_)]() {});
+}
+
 }  // namespace protocols
 }  // namespace load_balancer
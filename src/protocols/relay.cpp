@@ -0,0 +1,309 @@
+#include "protocols/relay.h"
+#include "core/feature_store.h"
+#include "utils/tls_utils.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <spdlog/spdlog.h>
+#include <unistd.h>
+
+namespace load_balancer {
+namespace protocols {
+
+namespace {
+
+// Returns true if 'error' only means the operation has to be retried later.
+bool IsRetryable(int error) {
+  return error == SSL_ERROR_WANT_READ || error == SSL_ERROR_WANT_WRITE;
+}
+
+// Translates the SSL error an operation blocked on into poll events.
+short ToPollEvents(int wait) {
+  if (wait == SSL_ERROR_WANT_READ) return POLLIN;
+  if (wait == SSL_ERROR_WANT_WRITE) return POLLOUT;
+  return 0;
+}
+
+}  // namespace
+
+Relay::Relay(SSL* client, SSL* backend, utils::BufferPool& buffers)
+    : buffers_(buffers) {
+  upstream_.from = downstream_.to = client;
+  upstream_.to = downstream_.from = backend;
+  upstream_.preferred_size = downstream_.preferred_size =
+      buffers_.MinBufferSize();
+
+  PrepareConnection(client);
+  PrepareConnection(backend);
+  SetUpSplice(upstream_);
+  SetUpSplice(downstream_);
+}
+
+Relay::~Relay() {
+  for (Direction* direction : {&upstream_, &downstream_}) {
+    if (direction->pipe_read >= 0) close(direction->pipe_read);
+    if (direction->pipe_write >= 0) close(direction->pipe_write);
+  }
+}
+
+void Relay::SetUpSplice(Direction& direction) {
+  if (!utils::TlsUtils::KtlsReceiveActive(direction.from) ||
+      !utils::TlsUtils::KtlsSendActive(direction.to)) {
+    return;
+  }
+
+  int fds[2];
+  if (pipe2(fds, O_NONBLOCK | O_CLOEXEC) < 0) {
+    spdlog::warn("Failed to create relay pipe, copying instead: {}",
+                 strerror(errno));
+    return;
+  }
+  int capacity = fcntl(fds[0], F_GETPIPE_SZ);
+  direction.pipe_read = fds[0];
+  direction.pipe_write = fds[1];
+  direction.pipe_capacity = capacity > 0 ? capacity : 65536;
+  spdlog::debug("Relaying with splice() over kTLS");
+}
+
+void Relay::PrepareConnection(SSL* ssl) {
+  // Retried writes may continue from a different offset once earlier records
+  // went out, and a plain TCP close is reported as end of stream.
+  SSL_set_mode(ssl, SSL_MODE_ENABLE_PARTIAL_WRITE |
+                    SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+  SSL_set_options(ssl, SSL_OP_IGNORE_UNEXPECTED_EOF);
+}
+
+Relay::Status Relay::Step() {
+  if (!Pump(upstream_) || !Pump(downstream_)) return Status::kFailed;
+  if (first_byte_to_client_ns_ == 0 && downstream_.bytes_written > 0)
+    first_byte_to_client_ns_ = core::SteadyNowNs();
+
+  // A direction is done once its closure reached the other side, which
+  // happens only after everything read before it was delivered.
+  return upstream_.shutdown_sent && downstream_.shutdown_sent
+             ? Status::kFinished
+             : Status::kActive;
+}
+
+Relay::Status Relay::Run() {
+  pollfd fds[2] = {{SSL_get_fd(upstream_.from), 0, 0},
+                   {SSL_get_fd(upstream_.to), 0, 0}};
+
+  while (true) {
+    Status status = Step();
+    if (status != Status::kActive) return status;
+
+    fds[0].events = WantedEvents(upstream_.from);
+    fds[1].events = WantedEvents(upstream_.to);
+    if (poll(fds, 2, -1) < 0 && errno != EINTR) return Status::kFailed;
+  }
+}
+
+short Relay::WantedEvents(const SSL* ssl) const {
+  short events = 0;
+  for (const Direction* direction : {&upstream_, &downstream_}) {
+    if (direction->from == ssl) events |= ToPollEvents(direction->read_wait);
+    if (direction->to == ssl) events |= ToPollEvents(direction->write_wait);
+  }
+  return events;
+}
+
+bool Relay::Pump(Direction& direction) {
+  while (true) {
+    bool progressed = false;
+
+    // Spliced bytes were read before any buffered ones, so they go first.
+    direction.write_wait = 0;
+    if (direction.pipe_length > 0) {
+      SpliceResult result = DrainPipe(direction);
+      if (result == SpliceResult::kFailed) return false;
+      if (result == SpliceResult::kBlocked)
+        direction.write_wait = SSL_ERROR_WANT_WRITE;
+      progressed |= result == SpliceResult::kProgress;
+    }
+
+    // Deliver buffered data first so the buffer frees up for the next read.
+    if (direction.pipe_length == 0 && direction.offset < direction.length) {
+      size_t length = direction.retry_length
+                          ? direction.retry_length
+                          : direction.length - direction.offset;
+      int written = SSL_write(direction.to,
+                              direction.buffer.Data() + direction.offset,
+                              static_cast<int>(length));
+      if (written > 0) {
+        direction.offset += written;
+        direction.bytes_written += written;
+        direction.retry_length = 0;
+        if (direction.offset == direction.length)
+          direction.offset = direction.length = 0;
+        progressed = true;
+      } else {
+        int error = SSL_get_error(direction.to, written);
+        if (!IsRetryable(error)) return false;
+        direction.retry_length = length;
+        direction.write_wait = error;
+      }
+    }
+
+    // Reclaim the space in front of the unwritten data, unless a blocked
+    // write still refers to it.
+    if (direction.offset > 0 && direction.retry_length == 0) {
+      std::memmove(direction.buffer.Data(),
+                   direction.buffer.Data() + direction.offset,
+                   direction.length - direction.offset);
+      direction.length -= direction.offset;
+      direction.offset = 0;
+    }
+
+    // Read only while there is room; a full buffer is the backpressure signal.
+    direction.read_wait = 0;
+    bool read_with_ssl =
+        !direction.eof &&
+        (!direction.buffer || direction.length < direction.buffer.Size());
+
+    // Splice while nothing is buffered in userspace, which keeps bytes in
+    // order; a full pipe is the backpressure signal then.
+    if (read_with_ssl && direction.pipe_read >= 0 && direction.length == 0 &&
+        !SSL_has_pending(direction.from)) {
+      read_with_ssl = false;
+      if (direction.pipe_length < direction.pipe_capacity) {
+        switch (FillPipe(direction)) {
+          case SpliceResult::kProgress:
+            progressed = true;
+            break;
+          case SpliceResult::kBlocked:
+            // A pipe that ran out of slots also refuses more data; the
+            // drain above then decides when to retry.
+            if (direction.pipe_length == 0)
+              direction.read_wait = SSL_ERROR_WANT_READ;
+            break;
+          case SpliceResult::kEof:
+            direction.eof = true;
+            progressed = true;
+            break;
+          case SpliceResult::kNotData:
+            read_with_ssl = true;
+            break;
+          case SpliceResult::kFailed:
+            return false;
+        }
+      }
+    }
+
+    if (read_with_ssl) {
+      if (!direction.buffer)
+        direction.buffer = buffers_.Acquire(direction.preferred_size);
+      size_t room = direction.buffer.Size() - direction.length;
+      int bytes = SSL_read(direction.from,
+                           direction.buffer.Data() + direction.length,
+                           static_cast<int>(room));
+      if (bytes > 0) {
+        // Filling an empty buffer in one read means the peer had more ready.
+        bool filled = direction.length == 0 &&
+                      static_cast<size_t>(bytes) == room;
+        direction.length += bytes;
+        direction.largest_read =
+            std::max(direction.largest_read, static_cast<size_t>(bytes));
+        if (filled) GrowBuffer(direction);
+        progressed = true;
+      } else {
+        int error = SSL_get_error(direction.from, bytes);
+        if (IsRetryable(error)) {
+          direction.read_wait = error;
+        } else if (error == SSL_ERROR_ZERO_RETURN) {
+          direction.eof = true;
+          progressed = true;
+        } else {
+          return false;
+        }
+      }
+    }
+
+    // Propagate the closure once everything read before it was delivered.
+    if (direction.eof && direction.pipe_length == 0 &&
+        direction.offset == direction.length && !direction.shutdown_sent) {
+      // A close_notify that did not fit into the socket is flushed by calling
+      // SSL_shutdown again once it is writable. A peer that is already gone
+      // cannot receive it, which ends the direction just the same.
+      int result = SSL_shutdown(direction.to);
+      int error = result < 0 ? SSL_get_error(direction.to, result) : 0;
+      if (IsRetryable(error)) {
+        direction.write_wait = error;
+      } else {
+        direction.shutdown_sent = true;
+        progressed = true;
+      }
+    }
+
+    if (!progressed) {
+      if (direction.length == 0) ReleaseBuffer(direction);
+      return true;
+    }
+  }
+}
+
+void Relay::GrowBuffer(Direction& direction) {
+  size_t size = buffers_.NextSize(direction.buffer.Size());
+  if (size <= direction.buffer.Size()) return;
+
+  // Blocked writes may resume from the new address since the connections
+  // accept moving write buffers.
+  utils::PooledBuffer buffer = buffers_.Acquire(size);
+  std::memcpy(buffer.Data(), direction.buffer.Data(), direction.length);
+  direction.buffer = std::move(buffer);
+  direction.preferred_size = size;
+}
+
+void Relay::ReleaseBuffer(Direction& direction) {
+  if (!direction.buffer) return;
+
+  // A buffer taken for a read that found nothing says nothing about the
+  // traffic.
+  if (direction.largest_read > 0 &&
+      direction.largest_read * 4 <= direction.buffer.Size()) {
+    direction.preferred_size = std::max(buffers_.MinBufferSize(),
+                                        direction.buffer.Size() / 2);
+  }
+  direction.largest_read = 0;
+  direction.buffer.Reset();
+}
+
+Relay::SpliceResult Relay::FillPipe(Direction& direction) {
+  ssize_t bytes;
+  do {
+    bytes = splice(SSL_get_fd(direction.from), nullptr, direction.pipe_write,
+                   nullptr, direction.pipe_capacity - direction.pipe_length,
+                   SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+  } while (bytes < 0 && errno == EINTR);
+  if (bytes > 0) {
+    direction.pipe_length += bytes;
+    return SpliceResult::kProgress;
+  }
+  if (bytes == 0) return SpliceResult::kEof;
+  if (errno == EAGAIN) return SpliceResult::kBlocked;
+  // kTLS refuses to splice records of other content types.
+  if (errno == EINVAL || errno == EIO) return SpliceResult::kNotData;
+  return SpliceResult::kFailed;
+}
+
+Relay::SpliceResult Relay::DrainPipe(Direction& direction) {
+  ssize_t bytes;
+  do {
+    bytes = splice(direction.pipe_read, nullptr, SSL_get_fd(direction.to),
+                   nullptr, direction.pipe_length,
+                   SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+  } while (bytes < 0 && errno == EINTR);
+  if (bytes > 0) {
+    direction.pipe_length -= bytes;
+    direction.bytes_written += bytes;
+    return SpliceResult::kProgress;
+  }
+  if (bytes < 0 && errno == EAGAIN) return SpliceResult::kBlocked;
+  return SpliceResult::kFailed;
+}
+
+}  // namespace protocols
+}  // namespace load_balancer
@@ -0,0 +1,135 @@
+#include "protocols/splice_relay.h"
+#include "core/feature_store.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <spdlog/spdlog.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace load_balancer {
+namespace protocols {
+
+SpliceRelay::SpliceRelay(int client_socket, int backend_socket) {
+  upstream_.from = downstream_.to = client_socket;
+  upstream_.to = downstream_.from = backend_socket;
+  valid_ = OpenPipe(upstream_) && OpenPipe(downstream_);
+}
+
+SpliceRelay::~SpliceRelay() {
+  for (Direction* direction : {&upstream_, &downstream_}) {
+    if (direction->pipe_read >= 0) close(direction->pipe_read);
+    if (direction->pipe_write >= 0) close(direction->pipe_write);
+  }
+}
+
+bool SpliceRelay::OpenPipe(Direction& direction) {
+  int fds[2];
+  if (pipe2(fds, O_NONBLOCK | O_CLOEXEC) < 0) {
+    spdlog::error("Failed to create relay pipe: {}", strerror(errno));
+    return false;
+  }
+  int capacity = fcntl(fds[0], F_GETPIPE_SZ);
+  direction.pipe_read = fds[0];
+  direction.pipe_write = fds[1];
+  direction.pipe_capacity = capacity > 0 ? capacity : 65536;
+  return true;
+}
+
+SpliceRelay::Status SpliceRelay::Step() {
+  if (!valid_ || !Pump(upstream_) || !Pump(downstream_))
+    return Status::kFailed;
+  if (first_byte_to_client_ns_ == 0 && downstream_.bytes_written > 0)
+    first_byte_to_client_ns_ = core::SteadyNowNs();
+
+  bool upstream_done = upstream_.eof && upstream_.pipe_length == 0;
+  bool downstream_done = downstream_.eof && downstream_.pipe_length == 0;
+  return upstream_done && downstream_done ? Status::kFinished
+                                          : Status::kActive;
+}
+
+SpliceRelay::Status SpliceRelay::Run() {
+  pollfd fds[2] = {{upstream_.from, 0, 0}, {upstream_.to, 0, 0}};
+
+  while (true) {
+    Status status = Step();
+    if (status != Status::kActive) return status;
+
+    fds[0].events = WantedEvents(upstream_.from);
+    fds[1].events = WantedEvents(upstream_.to);
+    if (poll(fds, 2, -1) < 0 && errno != EINTR) return Status::kFailed;
+  }
+}
+
+short SpliceRelay::WantedEvents(int socket) const {
+  short events = 0;
+  for (const Direction* direction : {&upstream_, &downstream_}) {
+    if (direction->from == socket && direction->read_blocked) events |= POLLIN;
+    if (direction->to == socket && direction->write_blocked) events |= POLLOUT;
+  }
+  return events;
+}
+
+bool SpliceRelay::Pump(Direction& direction) {
+  while (true) {
+    bool progressed = false;
+
+    // Drain the pipe first so it has room for the next read.
+    direction.write_blocked = false;
+    if (direction.pipe_length > 0) {
+      ssize_t written = splice(direction.pipe_read, nullptr, direction.to,
+                               nullptr, direction.pipe_length,
+                               SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+      if (written > 0) {
+        direction.pipe_length -= written;
+        direction.bytes_written += written;
+        progressed = true;
+      } else if (written < 0 && errno == EAGAIN) {
+        direction.write_blocked = true;
+      } else if (written < 0 && errno == EINTR) {
+        progressed = true;
+      } else {
+        return false;
+      }
+    }
+
+    // Read only while the pipe has room; a full pipe is the backpressure
+    // signal.
+    direction.read_blocked = false;
+    if (!direction.eof && direction.pipe_length < direction.pipe_capacity) {
+      ssize_t bytes = splice(direction.from, nullptr, direction.pipe_write,
+                             nullptr,
+                             direction.pipe_capacity - direction.pipe_length,
+                             SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+      if (bytes > 0) {
+        direction.pipe_length += bytes;
+        progressed = true;
+      } else if (bytes == 0) {
+        direction.eof = true;
+        progressed = true;
+      } else if (errno == EAGAIN) {
+        // A pipe that ran out of slots also refuses more data; the drain
+        // above then decides when to retry.
+        direction.read_blocked = direction.pipe_length == 0;
+      } else if (errno == EINTR) {
+        progressed = true;
+      } else {
+        return false;
+      }
+    }
+
+    // Propagate the closure once everything read before it was delivered.
+    if (direction.eof && direction.pipe_length == 0 &&
+        !direction.shutdown_sent) {
+      shutdown(direction.to, SHUT_WR);
+      direction.shutdown_sent = true;
+    }
+
+    if (!progressed) return true;
+  }
+}
+
+}  // namespace protocols
+}  // namespace load_balancer
@@ -6,98 +6,68 @@
 #include <unistd.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
-#include <thread>
 #include <utility>
 
 namespace load_balancer {
 namespace protocols {
 
-TcpHandler::TcpHandler(int client_socket, std::shared_ptr<core::Router> router)
-    : ProtocolHandler(client_socket, std::move(router)) {}
+TcpHandler::TcpHandler(int client_socket,
+                       std::shared_ptr<HandlerContext> context)
+    : ProtocolHandler(client_socket, std::move(context)) {}
 
 TcpHandler::~TcpHandler() = default;
 
 void TcpHandler::Forward() {
-  // Select a backend server for forwarding.
-  auto backend = router_->PickBackendServer();
-  if (!backend) {
-    spdlog::error("No backend available for TCP forwarding.");
-    return;
-  }
-
-  // Create a socket to connect to the backend server.
-  int backend_socket = socket(AF_INET, SOCK_STREAM, 0);
+  // Select a backend server and connect to it.
+  std::shared_ptr<core::BackendServer> backend;
+  int backend_socket = ConnectWithFailover(&backend);
   if (backend_socket < 0) {
-    spdlog::error("Failed to create socket: {}", strerror(errno));
-    return;
-  }
-
-  // Configure the backend server address.
-  sockaddr_in backend_addr{};
-  backend_addr.sin_family = AF_INET;
-  backend_addr.sin_port = htons(backend->Port());
-  inet_pton(AF_INET, backend->Ip().c_str(), &backend_addr.sin_addr);
-
-  // Connect to the backend server.
-  if (connect(backend_socket, reinterpret_cast<sockaddr*>(&backend_addr),
-              sizeof(backend_addr)) < 0) {
-    spdlog::error("Failed to connect to backend {}: {}",
-                  backend->Ip(), strerror(errno));
-    close(backend_socket);
+    spdlog::error("No backend available for TCP forwarding.");
     return;
   }
 
   // --- TLS Setup for Client Side (Load Balancer acts as Server) ---
-  SSL_CTX* client_ctx = utils::TlsUtils::CreateContext(true);
-  utils::TlsUtils::ConfigureContext(client_ctx, "cert.pem", "key.pem");
-
-  SSL* ssl_client = SSL_new(client_ctx);
+  SSL* ssl_client = SSL_new(context_->tls->ServerContext());
   SSL_set_fd(ssl_client, client_socket_);
   // Perform TLS handshake.
   if (SSL_accept(ssl_client) <= 0) {
     spdlog::error("TLS handshake with client failed.");
     ERR_print_errors_fp(stderr);
+    Decision().Finish(false);
     SSL_free(ssl_client);
-    SSL_CTX_free(client_ctx);
+    close(backend_socket);
     return;
   }
 
   // --- TLS Setup for Backend Side (Load Balancer acts as Client) ---
-  SSL_CTX* backend_ctx = utils::TlsUtils::CreateContext(false);
-  SSL* ssl_backend = SSL_new(backend_ctx);
+  SSL* ssl_backend = SSL_new(context_->tls->ClientContext());
   SSL_set_fd(ssl_backend, backend_socket);
+  // Offer the session cached from the last connection to this backend.
+  context_->tls->PrepareBackendConnection(ssl_backend, backend->Address());
   // Perform TLS handshake.
   if (SSL_connect(ssl_backend) <= 0) {
     spdlog::error("TLS handshake with backend failed.");
     ERR_print_errors_fp(stderr);
+    context_->tls->EvictBackendSession(backend->Address());
+    Decision().Finish(false);
     SSL_free(ssl_backend);
-    SSL_CTX_free(backend_ctx);
+    SSL_shutdown(ssl_client);
+    SSL_free(ssl_client);
+    close(backend_socket);
     return;
   }
+  Decision().HandshakeDone();
 
   // --- Bidirectional Data Forwarding ---
-  std::thread client_to_backend([=, this]() {
-    // Proxy data from client to backend.
-    Proxy(ssl_client, ssl_backend);
-  });
-
-  std::thread backend_to_client([=, this]() {
-    // Proxy data from backend to client.
-    Proxy(ssl_backend, ssl_client);
-  });
-
-  // Wait for both proxying threads to complete.
-  client_to_backend.join();
-  backend_to_client.join();
+  // Both directions are relayed from this thread.
+  RelayTraffic(ssl_client, ssl_backend, Decision());
 
   // --- Cleanup SSL/TLS Resources ---
   SSL_shutdown(ssl_client);
   SSL_free(ssl_client);
-  SSL_CTX_free(client_ctx);
 
   SSL_shutdown(ssl_backend);
   SSL_free(ssl_backend);
-  SSL_CTX_free(backend_ctx);
 
   // Close the backend socket.
   close(backend_socket);
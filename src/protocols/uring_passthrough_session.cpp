@@ -0,0 +1,293 @@
+#include "protocols/uring_passthrough_session.h"
+
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <numeric>
+#include <spdlog/spdlog.h>
+#include <sys/socket.h>
+#include <utility>
+
+namespace load_balancer {
+namespace protocols {
+
+UringPassthroughSession::UringPassthroughSession(
+    core::UringLoop* loop, int client_file,
+    std::shared_ptr<HandlerContext> context)
+    : loop_(loop), context_(std::move(context)), failover_(*context_),
+      client_file_(client_file) {
+  auto timeout = context_->connect.timeout;
+  connect_timeout_.tv_sec = timeout.count() / 1000;
+  connect_timeout_.tv_nsec = (timeout.count() % 1000) * 1000000;
+  upstream_.read_op = kUpstreamRead;
+  upstream_.send_op = kUpstreamSend;
+  downstream_.read_op = kDownstreamRead;
+  downstream_.send_op = kDownstreamSend;
+}
+
+UringPassthroughSession::~UringPassthroughSession() = default;
+
+void UringPassthroughSession::Start() {
+  // Select a backend server for forwarding.
+  backend_ = failover_.Next();
+  if (!backend_) {
+    spdlog::error("No backend available for passthrough forwarding.");
+    closing_ = true;
+    MaybeRelease();
+    return;
+  }
+
+  // Registered buffers are preferred; sessions beyond the registered pool
+  // borrow from the shared buffer pool.
+  for (Direction* direction : {&upstream_, &downstream_}) {
+    direction->buffer = loop_->AcquireBuffer(&direction->data);
+    direction->capacity = loop_->BufferSize();
+    if (direction->buffer < 0) {
+      direction->pooled = context_->buffers->Acquire(loop_->BufferSize());
+      direction->data = direction->pooled.Data();
+      direction->capacity = direction->pooled.Size();
+    }
+  }
+  upstream_.from = downstream_.to = client_file_;
+
+  // Create the backend socket and read the client's first bytes meanwhile.
+  OpenBackend();
+  Read(upstream_);
+}
+
+void UringPassthroughSession::HandleCompletion(uint8_t op, int32_t result,
+                                               uint32_t /*flags*/) {
+  --in_flight_[op];
+
+  // The slot must be released even if the session already failed.
+  if (op == kSocket && result >= 0) {
+    backend_file_ = result;
+    upstream_.to = downstream_.from = backend_file_;
+  }
+
+  if (!closing_) {
+    switch (op) {
+      case kSocket:
+        if (result < 0) {
+          spdlog::error("Failed to create backend socket: {}",
+                        strerror(-result));
+          Fail();
+        } else {
+          Connect();
+        }
+        break;
+
+      case kConnect:
+        if (result < 0) {
+          OnConnectFailed(result);
+        } else {
+          failover_.Succeeded();
+          connected_ = true;
+          Read(downstream_);
+          Flush(upstream_);
+        }
+        break;
+
+      case kUpstreamRead:
+        OnRead(upstream_, result);
+        break;
+      case kDownstreamRead:
+        OnRead(downstream_, result);
+        break;
+      case kUpstreamSend:
+        // A send linked behind a failed connect is retried once connected.
+        if (!connected_ && result == -ECANCELED) break;
+        OnSent(upstream_, result);
+        break;
+      case kDownstreamSend:
+        if (result > 0) failover_.Decision().FirstByte();
+        OnSent(downstream_, result);
+        break;
+
+      default:
+        break;
+    }
+
+    // Both directions are done once their ends of stream were forwarded.
+    if (upstream_.shutdown && downstream_.shutdown) closing_ = true;
+  }
+
+  MaybeRelease();
+}
+
+io_uring_sqe* UringPassthroughSession::Submit(Op op) {
+  ++in_flight_[op];
+  return loop_->Prepare(this, op);
+}
+
+void UringPassthroughSession::OpenBackend() {
+  // Configure the backend server address.
+  backend_address_ = {};
+  backend_address_.sin_family = AF_INET;
+  backend_address_.sin_port = htons(backend_->Port());
+  inet_pton(AF_INET, backend_->Ip().c_str(), &backend_address_.sin_addr);
+
+  io_uring_sqe* sqe = Submit(kSocket);
+  sqe->opcode = IORING_OP_SOCKET;
+  sqe->fd = AF_INET;
+  sqe->off = SOCK_STREAM;
+  sqe->file_index = IORING_FILE_INDEX_ALLOC;
+}
+
+void UringPassthroughSession::Connect() {
+  io_uring_sqe* sqe = Submit(kConnect);
+  sqe->opcode = IORING_OP_CONNECT;
+  sqe->fd = backend_file_;
+  sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_LINK;
+  sqe->addr = reinterpret_cast<uint64_t>(&backend_address_);
+  sqe->off = sizeof(backend_address_);
+
+  // An expired timeout cancels the connect, which then fails with ECANCELED.
+  sqe = Submit(kConnectTimeout);
+  sqe->opcode = IORING_OP_LINK_TIMEOUT;
+  sqe->fd = -1;
+  sqe->addr = reinterpret_cast<uint64_t>(&connect_timeout_);
+  sqe->len = 1;
+
+  // Client bytes that arrived while the socket was being created follow the
+  // connect in the same submission; the link cancels them if it fails.
+  if (upstream_.length > 0 && in_flight_[kUpstreamSend] == 0) {
+    sqe->flags |= IOSQE_IO_LINK;
+    Send(upstream_);
+  }
+}
+
+void UringPassthroughSession::OnConnectFailed(int32_t result) {
+  int error = result == -ECANCELED ? ETIMEDOUT : -result;
+  spdlog::error("Failed to connect to backend {} - {}", backend_->Address(),
+                strerror(error));
+  failover_.Failed();
+  loop_->CloseFixedFile(backend_file_);
+  backend_file_ = upstream_.to = downstream_.from = -1;
+
+  backend_ = failover_.Next();
+  if (!backend_) {
+    spdlog::error("No backend available for passthrough forwarding.");
+    Fail();
+    return;
+  }
+  OpenBackend();
+}
+
+void UringPassthroughSession::Read(Direction& direction) {
+  io_uring_sqe* sqe = Submit(direction.read_op);
+  sqe->fd = direction.from;
+  sqe->flags = IOSQE_FIXED_FILE;
+  sqe->addr = reinterpret_cast<uint64_t>(direction.data);
+  sqe->len = static_cast<uint32_t>(direction.capacity);
+  if (direction.buffer >= 0 && loop_->BuffersRegistered()) {
+    sqe->opcode = IORING_OP_READ_FIXED;
+    sqe->buf_index = direction.buffer;
+  } else {
+    sqe->opcode = IORING_OP_RECV;
+  }
+}
+
+void UringPassthroughSession::Send(Direction& direction) {
+  // Plain sends rather than fixed writes, so a reset peer is reported as
+  // EPIPE instead of raising SIGPIPE.
+  io_uring_sqe* sqe = Submit(direction.send_op);
+  sqe->opcode = IORING_OP_SEND;
+  sqe->fd = direction.to;
+  sqe->flags = IOSQE_FIXED_FILE;
+  sqe->addr = reinterpret_cast<uint64_t>(direction.data + direction.offset);
+  sqe->len = direction.length - direction.offset;
+  sqe->msg_flags = MSG_NOSIGNAL;
+}
+
+void UringPassthroughSession::Flush(Direction& direction) {
+  // Client bytes wait for the backend connection.
+  if (&direction == &upstream_ && !connected_) return;
+  if (in_flight_[direction.send_op] > 0) return;
+
+  if (direction.offset < direction.length) {
+    Send(direction);
+  } else if (direction.eof && !direction.shutdown) {
+    io_uring_sqe* sqe = Submit(kControl);
+    sqe->opcode = IORING_OP_SHUTDOWN;
+    sqe->fd = direction.to;
+    sqe->flags = IOSQE_FIXED_FILE;
+    sqe->len = SHUT_WR;
+    direction.shutdown = true;
+  }
+}
+
+void UringPassthroughSession::OnRead(Direction& direction, int32_t result) {
+  if (result < 0) {
+    if (result != -ECANCELED && result != -ECONNRESET) {
+      spdlog::debug("Passthrough read failed: {}", strerror(-result));
+    }
+    Fail();
+    return;
+  }
+
+  if (result == 0) {
+    direction.eof = true;
+  } else {
+    direction.length = result;
+    direction.offset = 0;
+  }
+  Flush(direction);
+}
+
+void UringPassthroughSession::OnSent(Direction& direction, int32_t result) {
+  if (result < 0) {
+    if (result != -ECANCELED && result != -EPIPE && result != -ECONNRESET) {
+      spdlog::debug("Passthrough send failed: {}", strerror(-result));
+    }
+    Fail();
+    return;
+  }
+
+  // Partial sends are resubmitted; a drained buffer is refilled.
+  direction.offset += result;
+  if (direction.offset < direction.length) {
+    Send(direction);
+    return;
+  }
+  direction.length = direction.offset = 0;
+  if (direction.eof) {
+    Flush(direction);
+  } else {
+    Read(direction);
+  }
+}
+
+void UringPassthroughSession::Fail() {
+  closing_ = true;
+  failover_.Decision().Finish(false);
+
+  // Reads on idle sockets would otherwise never complete.
+  for (uint8_t op : {kConnect, kUpstreamRead, kUpstreamSend, kDownstreamRead,
+                     kDownstreamSend}) {
+    if (in_flight_[op] == 0) continue;
+    io_uring_sqe* sqe = Submit(kControl);
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = core::UringLoop::UserData(this, op);
+  }
+}
+
+void UringPassthroughSession::MaybeRelease() {
+  if (!closing_ || released_) return;
+  if (std::accumulate(in_flight_.begin(), in_flight_.end(), 0) > 0) return;
+  released_ = true;
+
+  for (Direction* direction : {&upstream_, &downstream_}) {
+    if (direction->buffer >= 0) loop_->ReleaseBuffer(direction->buffer);
+    direction->buffer = -1;
+    direction->pooled.Reset();
+  }
+  if (backend_file_ >= 0) loop_->CloseFixedFile(backend_file_);
+  loop_->CloseFixedFile(client_file_);
+  spdlog::debug("Passthrough session closed.");
+
+  loop_->Retire(this);
+}
+
+}  // namespace protocols
+}  // namespace load_balancer
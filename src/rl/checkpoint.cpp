@@ -0,0 +1,193 @@
+#include "rl/checkpoint.h"
+#include "rl/features.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <spdlog/spdlog.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace load_balancer {
+namespace rl {
+
+namespace {
+
+// Parameters start at the first 64-byte boundary after the header.
+constexpr uint64_t PARAMETERS_OFFSET = sizeof(CheckpointHeader);
+
+// FNV-1a over 'size' bytes at 'data'.
+uint64_t Checksum(const void* data, size_t size) {
+  const auto* bytes = static_cast<const unsigned char*>(data);
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+// Writes all 'size' bytes at 'data' to 'fd'.
+bool WriteAll(int fd, const void* data, size_t size) {
+  const auto* bytes = static_cast<const char*>(data);
+  while (size > 0) {
+    ssize_t written = write(fd, bytes, size);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    bytes += written;
+    size -= written;
+  }
+  return true;
+}
+
+// Syncs the directory holding 'path', so a rename into it survives a crash.
+void SyncDirectory(const std::string& path) {
+  size_t slash = path.rfind('/');
+  std::string directory =
+      slash == std::string::npos ? "." : path.substr(0, slash + 1);
+  int fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) return;
+  fsync(fd);
+  close(fd);
+}
+
+}  // namespace
+
+bool WriteCheckpoint(const std::string& path, const Agent& agent) {
+  const char* kind = agent.CheckpointKind();
+  if (!kind) {
+    spdlog::warn("The routing policy cannot be checkpointed");
+    return false;
+  }
+  // Read the version first: the parameters are at least that recent.
+  uint64_t policy_version = agent.PolicyVersion();
+  std::vector<double> parameters = agent.SaveParameters();
+
+  CheckpointHeader header{};
+  header.magic = kCheckpointMagic;
+  header.format = kCheckpointFormat;
+  header.header_size = sizeof(CheckpointHeader);
+  std::strncpy(header.kind, kind, sizeof(header.kind) - 1);
+  header.policy_version = policy_version;
+  auto since_epoch = std::chrono::system_clock::now().time_since_epoch();
+  header.saved_unix_ns =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(since_epoch)
+          .count();
+  header.feature_count = kFeatureCount;
+  header.connection_scale = kConnectionScale;
+  header.latency_scale_ms = kLatencyScaleMs;
+  header.max_weight = kMaxWeight;
+  header.parameters_offset = PARAMETERS_OFFSET;
+  header.parameter_count = parameters.size();
+  header.checksum =
+      Checksum(parameters.data(), parameters.size() * sizeof(double));
+
+  std::string temporary = path + ".tmp." + std::to_string(getpid());
+  int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                0644);
+  if (fd < 0) {
+    spdlog::error("Failed to create checkpoint {}: {}", temporary,
+                  strerror(errno));
+    return false;
+  }
+  bool written =
+      WriteAll(fd, &header, sizeof(header)) &&
+      WriteAll(fd, parameters.data(), parameters.size() * sizeof(double)) &&
+      fsync(fd) == 0;
+  int error = errno;
+  close(fd);
+  if (!written || rename(temporary.c_str(), path.c_str()) != 0) {
+    if (written) error = errno;
+    spdlog::error("Failed to write checkpoint {}: {}", path, strerror(error));
+    unlink(temporary.c_str());
+    return false;
+  }
+  SyncDirectory(path);
+  spdlog::debug("Wrote checkpoint {} of policy version {}", path,
+                policy_version);
+  return true;
+}
+
+bool LoadCheckpoint(const std::string& path, Agent* agent) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    if (errno != ENOENT) {
+      spdlog::error("Failed to open checkpoint {}: {}", path,
+                    strerror(errno));
+    }
+    return false;
+  }
+  struct stat status;
+  if (fstat(fd, &status) != 0 ||
+      static_cast<size_t>(status.st_size) < sizeof(CheckpointHeader)) {
+    spdlog::warn("Ignoring truncated checkpoint {}", path);
+    close(fd);
+    return false;
+  }
+  auto size = static_cast<size_t>(status.st_size);
+  void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    spdlog::error("Failed to map checkpoint {}: {}", path, strerror(errno));
+    return false;
+  }
+
+  // The mapping is page aligned, so the header and the parameters are
+  // read in place.
+  const auto& header = *static_cast<const CheckpointHeader*>(mapping);
+  const char* kind = agent->CheckpointKind();
+  const char* problem = nullptr;
+  if (header.magic != kCheckpointMagic) {
+    problem = "not a checkpoint or saved with another byte order";
+  } else if (header.format != kCheckpointFormat ||
+             header.header_size != sizeof(CheckpointHeader)) {
+    problem = "unsupported format";
+  } else if (!kind ||
+             strncmp(header.kind, kind, sizeof(header.kind)) != 0) {
+    problem = "saved by another routing policy";
+  } else if (header.feature_count != kFeatureCount ||
+             header.connection_scale != kConnectionScale ||
+             header.latency_scale_ms != kLatencyScaleMs ||
+             header.max_weight != kMaxWeight) {
+    problem = "learned over other features";
+  } else if (header.parameters_offset % alignof(double) != 0 ||
+             header.parameters_offset > size ||
+             header.parameter_count >
+                 (size - header.parameters_offset) / sizeof(double)) {
+    problem = "truncated";
+  }
+
+  std::span<const double> parameters;
+  if (!problem) {
+    parameters = std::span<const double>(
+        reinterpret_cast<const double*>(static_cast<const char*>(mapping) +
+                                        header.parameters_offset),
+        header.parameter_count);
+    if (Checksum(parameters.data(), parameters.size_bytes()) !=
+        header.checksum) {
+      problem = "checksum mismatch";
+    } else if (!agent->LoadParameters(parameters)) {
+      problem = "parameters do not fit the policy";
+    } else {
+      agent->RestorePolicyVersion(header.policy_version);
+    }
+  }
+
+  if (problem) {
+    spdlog::warn("Ignoring checkpoint {}: {}", path, problem);
+  } else {
+    spdlog::info("Loaded checkpoint {} of policy version {}", path,
+                 header.policy_version);
+  }
+  munmap(mapping, size);
+  return problem == nullptr;
+}
+
+}  // namespace rl
+}  // namespace load_balancer
@@ -0,0 +1,68 @@
+#include "rl/feature_matrix.h"
+
+#include <algorithm>
+#include <new>
+#include <utility>
+
+namespace load_balancer {
+namespace rl {
+
+namespace {
+
+// Alignment of the columns; one cache line and one AVX-512 register.
+constexpr std::align_val_t kAlignment{64};
+// Columns stored: every feature plus the penalty.
+constexpr size_t kColumns = kFeatureCount + 1;
+
+}  // namespace
+
+FeatureMatrix::~FeatureMatrix() {
+  if (data_) operator delete[](data_, kAlignment);
+}
+
+FeatureMatrix::FeatureMatrix(FeatureMatrix&& other) noexcept
+    : data_(std::exchange(other.data_, nullptr)),
+      capacity_(std::exchange(other.capacity_, 0)),
+      rows_(std::exchange(other.rows_, 0)),
+      padded_rows_(std::exchange(other.padded_rows_, 0)) {}
+
+FeatureMatrix& FeatureMatrix::operator=(FeatureMatrix&& other) noexcept {
+  if (this != &other) {
+    if (data_) operator delete[](data_, kAlignment);
+    data_ = std::exchange(other.data_, nullptr);
+    capacity_ = std::exchange(other.capacity_, 0);
+    rows_ = std::exchange(other.rows_, 0);
+    padded_rows_ = std::exchange(other.padded_rows_, 0);
+  }
+  return *this;
+}
+
+void FeatureMatrix::Resize(size_t rows) {
+  size_t padded_rows = (rows + kBlockRows - 1) / kBlockRows * kBlockRows;
+  if (padded_rows > capacity_) {
+    if (data_) operator delete[](data_, kAlignment);
+    data_ = static_cast<float*>(
+        operator new[](kColumns * padded_rows * sizeof(float), kAlignment));
+    capacity_ = padded_rows;
+  }
+  rows_ = rows;
+  padded_rows_ = padded_rows;
+
+  // Padding rows are zero and excluded, so kernels need no tail handling.
+  for (size_t column = 0; column < kFeatureCount; ++column) {
+    float* values = MutableColumn(column);
+    std::fill(values + rows_, values + padded_rows_, 0.0f);
+  }
+  std::fill(MutableColumn(kFeatureCount) + rows_,
+            MutableColumn(kFeatureCount) + padded_rows_, kExcluded);
+}
+
+void FeatureMatrix::Set(size_t row, const FeatureVector& features,
+                        float penalty) {
+  for (size_t column = 0; column < kFeatureCount; ++column)
+    MutableColumn(column)[row] = static_cast<float>(features[column]);
+  MutableColumn(kFeatureCount)[row] = penalty;
+}
+
+}  // namespace rl
+}  // namespace load_balancer
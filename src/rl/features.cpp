@@ -0,0 +1,41 @@
+#include "rl/features.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace load_balancer {
+namespace rl {
+
+namespace {
+
+// Maps a non-negative value to [0, 1), reaching 0.5 at 'scale'.
+double Saturate(double value, double scale) {
+  value = std::max(value, 0.0);
+  return value / (value + scale);
+}
+
+}  // namespace
+
+FeatureVector ExtractFeatures(const core::BackendFeatures& backend) {
+  constexpr auto kRelaxed = std::memory_order_relaxed;
+  FeatureVector features{};
+  features[kBias] = 1.0;
+  features[kActiveConnections] =
+      Saturate(backend.in_flight.load(kRelaxed), kConnectionScale);
+  features[kLatency] =
+      Saturate(backend.latency_ms.load(kRelaxed), kLatencyScaleMs);
+  features[kErrorRate] =
+      std::clamp(backend.error_rate.load(kRelaxed), 0.0, 1.0);
+  // Weights are compared on a log scale; doubling one always counts alike.
+  double weight =
+      std::clamp<double>(backend.weight.load(kRelaxed), 0, kMaxWeight);
+  features[kWeight] = std::log2(1.0 + weight) / std::log2(1.0 + kMaxWeight);
+  return features;
+}
+
+FeatureVector ExtractFeatures(const core::BackendServer& backend) {
+  return ExtractFeatures(backend.Features());
+}
+
+}  // namespace rl
+}  // namespace load_balancer
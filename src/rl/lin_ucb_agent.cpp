@@ -0,0 +1,390 @@
+#include "rl/lin_ucb_agent.h"
+#include "core/feature_store.h"
+#include "utils/epoch.h"
+#include "utils/random.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <thread>
+#include <utility>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace load_balancer {
+namespace rl {
+
+namespace {
+
+// Failed attempts to read the parameters after which a decision yields its
+// core instead of spinning on the trainer's publication.
+constexpr int kReadSpinsBeforeYield = 16;
+
+// Hints the core that the caller is spinning.
+void CpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+  _mm_pause();
+#endif
+}
+
+// Inverts the symmetric positive definite n x n 'matrix' into 'inverse'
+// through its Cholesky factorization. Returns false, leaving 'inverse'
+// untouched, if 'matrix' is not positive definite.
+bool InvertPositiveDefinite(const double* matrix, size_t n, double* inverse) {
+  // matrix = L L'.
+  std::vector<double> lower(n * n, 0.0);
+  for (size_t j = 0; j < n; ++j) {
+    double diagonal = matrix[j * n + j];
+    for (size_t k = 0; k < j; ++k)
+      diagonal -= lower[j * n + k] * lower[j * n + k];
+    if (!(diagonal > 0.0)) return false;
+    lower[j * n + j] = std::sqrt(diagonal);
+    for (size_t i = j + 1; i < n; ++i) {
+      double value = matrix[i * n + j];
+      for (size_t k = 0; k < j; ++k)
+        value -= lower[i * n + k] * lower[j * n + k];
+      lower[i * n + j] = value / lower[j * n + j];
+    }
+  }
+
+  // Column c of the inverse solves L y = e_c, then L' x = y.
+  std::vector<double> column(n);
+  for (size_t c = 0; c < n; ++c) {
+    for (size_t i = 0; i < n; ++i) {
+      double value = i == c ? 1.0 : 0.0;
+      for (size_t k = 0; k < i; ++k) value -= lower[i * n + k] * column[k];
+      column[i] = value / lower[i * n + i];
+    }
+    for (size_t i = n; i-- > 0;) {
+      double value = column[i];
+      for (size_t k = i + 1; k < n; ++k) value -= lower[k * n + i] * column[k];
+      column[i] = value / lower[i * n + i];
+    }
+    for (size_t i = 0; i < n; ++i) inverse[i * n + c] = column[i];
+  }
+  return true;
+}
+
+}  // namespace
+
+LinUcbAgent::LinUcbAgent(LinUcbConfig config)
+    : config_(config), snapshot_pool_(std::make_shared<SnapshotPool>()) {
+  // Before any update the design matrix is the regularization alone.
+  parameters_.a_inverse.fill(0.0);
+  for (size_t i = 0; i < kFeatureCount; ++i) {
+    design_[i * kFeatureCount + i] = config_.regularization;
+    parameters_.a_inverse[i * kFeatureCount + i] = 1.0 / config_.regularization;
+  }
+  parameters_.theta.fill(0.0);
+
+  features_.store(TakeSnapshot(), std::memory_order_release);
+
+  std::lock_guard<std::mutex> lock(update_mutex_);
+  PublishParameters();
+}
+
+LinUcbAgent::~LinUcbAgent() {
+  // No decision can outlive the agent, so the published snapshot and the
+  // spares are deleted directly. Retired ones are deleted when reclaimed.
+  delete features_.load(std::memory_order_relaxed);
+  {
+    std::lock_guard<std::mutex> lock(snapshot_pool_->mutex);
+    snapshot_pool_->closed = true;
+    for (FeatureSnapshot* snapshot : snapshot_pool_->spares) delete snapshot;
+    snapshot_pool_->spares.clear();
+  }
+  utils::Epoch::Reclaim();
+}
+
+int LinUcbAgent::SelectAction(
+    const std::vector<std::shared_ptr<core::BackendServer>>& backends,
+    uint64_t set_version,
+    std::span<const std::shared_ptr<core::BackendServer>> excluded) {
+  Parameters parameters = ReadParameters();
+  UcbWeights weights;
+  for (size_t i = 0; i < kMatrixSize; ++i)
+    weights.a_inverse[i] = static_cast<float>(parameters.a_inverse[i]);
+  for (size_t i = 0; i < kFeatureCount; ++i)
+    weights.theta[i] = static_cast<float>(parameters.theta[i]);
+  weights.alpha = static_cast<float>(config_.alpha);
+  auto seed = static_cast<uint32_t>(utils::NextRandom());
+
+  // A row with a penalty only wins when every row has one.
+  utils::EpochGuard guard;
+  const FeatureMatrix* matrix = nullptr;
+  if (const FeatureSnapshot* snapshot =
+          CurrentFeatures(backends, set_version)) {
+    matrix = &snapshot->matrix;
+  } else {
+    thread_local FeatureMatrix scratch;
+    FillMatrix(backends, &scratch);
+    matrix = &scratch;
+  }
+  const float* penalty = Penalties(*matrix, backends, excluded);
+  size_t row = ArgmaxUcb(*matrix, penalty, weights, seed);
+  return penalty[row] < 0.0f ? -1 : static_cast<int>(row);
+}
+
+const LinUcbAgent::FeatureSnapshot* LinUcbAgent::CurrentFeatures(
+    const std::vector<std::shared_ptr<core::BackendServer>>& backends,
+    uint64_t set_version) {
+  if (set_version == 0) return nullptr;
+  const FeatureSnapshot* snapshot = features_.load(std::memory_order_acquire);
+  bool matches = snapshot->set_version == set_version;
+  int64_t now_ns = core::SteadyNowNs();
+  auto age = std::chrono::nanoseconds(now_ns - snapshot->built_at_ns);
+  if (matches && age < config_.feature_refresh_interval) return snapshot;
+  // A decision still reading a replaced set must not evict the current one.
+  if (snapshot->set_version > set_version) return nullptr;
+
+  // Another decision is refreshing; a stale snapshot is still good enough.
+  std::unique_lock<std::mutex> lock(refresh_mutex_, std::try_to_lock);
+  if (!lock.owns_lock()) return matches ? snapshot : nullptr;
+  const FeatureSnapshot* current = features_.load(std::memory_order_relaxed);
+  if (current->set_version > set_version) return nullptr;
+
+  // The spare is unreachable for decisions until it is published, so it is
+  // filled, and its storage grown, in place.
+  FeatureSnapshot* next = TakeSnapshot();
+  next->set_version = set_version;
+  next->built_at_ns = now_ns;
+  FillMatrix(backends, &next->matrix);
+  features_.store(next, std::memory_order_release);
+  utils::Epoch::Retire(current, &RecycleSnapshot);
+  return next;
+}
+
+LinUcbAgent::FeatureSnapshot* LinUcbAgent::TakeSnapshot() {
+  {
+    std::lock_guard<std::mutex> lock(snapshot_pool_->mutex);
+    if (!snapshot_pool_->spares.empty()) {
+      FeatureSnapshot* snapshot = snapshot_pool_->spares.back();
+      snapshot_pool_->spares.pop_back();
+      return snapshot;
+    }
+  }
+  auto* snapshot = new FeatureSnapshot();
+  snapshot->pool = snapshot_pool_;
+  return snapshot;
+}
+
+void LinUcbAgent::RecycleSnapshot(const void* retired) {
+  auto* snapshot = const_cast<FeatureSnapshot*>(
+      static_cast<const FeatureSnapshot*>(retired));
+  // The snapshot's reference may be the last one to the pool.
+  std::shared_ptr<SnapshotPool> pool = snapshot->pool;
+  std::lock_guard<std::mutex> lock(pool->mutex);
+  if (pool->closed) {
+    delete snapshot;
+    return;
+  }
+  pool->spares.push_back(snapshot);
+}
+
+const float* LinUcbAgent::Penalties(
+    const FeatureMatrix& matrix,
+    const std::vector<std::shared_ptr<core::BackendServer>>& backends,
+    std::span<const std::shared_ptr<core::BackendServer>> excluded) {
+  if (excluded.empty()) return matrix.Penalty();
+  thread_local std::vector<float> penalties;
+  penalties.resize(matrix.PaddedRows());
+  std::copy_n(matrix.Penalty(), matrix.PaddedRows(), penalties.begin());
+  for (const auto& backend : excluded) {
+    auto it = std::find(backends.begin(), backends.end(), backend);
+    if (it != backends.end())
+      penalties[it - backends.begin()] = FeatureMatrix::kExcluded;
+  }
+  return penalties.data();
+}
+
+void LinUcbAgent::FillMatrix(
+    const std::vector<std::shared_ptr<core::BackendServer>>& backends,
+    FeatureMatrix* matrix) {
+  // Rows are read straight from the store's contiguous slots by ID rather
+  // than through each server object.
+  const core::BackendFeatures* slots =
+      core::FeatureStore::Instance().FeatureArray();
+  matrix->Resize(backends.size());
+  for (size_t row = 0; row < backends.size(); ++row) {
+    const core::BackendFeatures& backend = slots[backends[row]->Id()];
+    // Unhealthy backends are only picked when no healthy one is left.
+    bool healthy = backend.healthy.load(std::memory_order_relaxed);
+    matrix->Set(row, ExtractFeatures(backend),
+                healthy ? 0.0f : FeatureMatrix::kExcluded);
+  }
+}
+
+void LinUcbAgent::Update(const core::BackendServer& /*backend*/,
+                         const FeatureVector& features, double reward) {
+  std::lock_guard<std::mutex> lock(update_mutex_);
+  Learn(features, reward);
+  SolveTheta();
+  PublishParameters();
+}
+
+void LinUcbAgent::UpdateBatch(std::span<const Experience> batch) {
+  if (batch.empty()) return;
+  std::lock_guard<std::mutex> lock(update_mutex_);
+  for (const Experience& experience : batch)
+    Learn(experience.features, experience.reward);
+  SolveTheta();
+  PublishParameters();
+}
+
+std::vector<double> LinUcbAgent::ActionProbabilities(
+    const std::vector<std::shared_ptr<core::BackendServer>>& backends) const {
+  if (config_.softmax_temperature <= 0.0) return {};
+  Parameters parameters = ReadParameters();
+  std::vector<double> probabilities(backends.size(), 0.0);
+  double best = -std::numeric_limits<double>::infinity();
+  for (size_t i = 0; i < backends.size(); ++i) {
+    if (!backends[i]->IsHealthy()) continue;
+    FeatureVector features = ExtractFeatures(*backends[i]);
+    double estimate = 0.0;
+    for (size_t j = 0; j < kFeatureCount; ++j)
+      estimate += parameters.theta[j] * features[j];
+    probabilities[i] = estimate;
+    best = std::max(best, estimate);
+  }
+
+  // Shifted by the best estimate so the exponentials cannot overflow; the
+  // alias table normalizes them.
+  for (size_t i = 0; i < backends.size(); ++i) {
+    if (!backends[i]->IsHealthy()) continue;
+    probabilities[i] = std::exp((probabilities[i] - best) /
+                                config_.softmax_temperature);
+  }
+  return probabilities;
+}
+
+uint64_t LinUcbAgent::PolicyVersion() const {
+  // Every publication advances the sequence by two.
+  return version_offset_.load(std::memory_order_relaxed) +
+         sequence_.load(std::memory_order_relaxed) / 2;
+}
+
+void LinUcbAgent::RestorePolicyVersion(uint64_t version) {
+  std::lock_guard<std::mutex> lock(update_mutex_);
+  // Wraps around if 'version' is lower, which the sum undoes.
+  uint64_t published = sequence_.load(std::memory_order_relaxed) / 2;
+  version_offset_.store(version - published, std::memory_order_relaxed);
+}
+
+std::vector<double> LinUcbAgent::SaveParameters() const {
+  std::lock_guard<std::mutex> lock(update_mutex_);
+  std::vector<double> parameters(design_.begin(), design_.end());
+  parameters.insert(parameters.end(), reward_sum_.begin(), reward_sum_.end());
+  return parameters;
+}
+
+bool LinUcbAgent::LoadParameters(std::span<const double> parameters) {
+  if (parameters.size() != kMatrixSize + kFeatureCount) return false;
+  std::array<double, kMatrixSize> a_inverse;
+  if (!InvertPositiveDefinite(parameters.data(), kFeatureCount,
+                              a_inverse.data())) {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(update_mutex_);
+  std::copy_n(parameters.begin(), kMatrixSize, design_.begin());
+  std::copy_n(parameters.begin() + kMatrixSize, kFeatureCount,
+              reward_sum_.begin());
+  parameters_.a_inverse = a_inverse;
+  SolveTheta();
+  PublishParameters();
+  return true;
+}
+
+std::vector<double> LinUcbAgent::MergeParameters(
+    std::span<const double> base,
+    std::span<const std::vector<double>> replicas) const {
+  // base + sum(replica - base): the regularization in 'base' is kept once and
+  // every replica's experiences count in full.
+  std::vector<double> merged(base.begin(), base.end());
+  for (const std::vector<double>& parameters : replicas) {
+    for (size_t i = 0; i < merged.size(); ++i)
+      merged[i] += parameters[i] - base[i];
+  }
+  return merged;
+}
+
+void LinUcbAgent::Learn(const FeatureVector& features, double reward) {
+  auto& a_inverse = parameters_.a_inverse;
+
+  // Sherman-Morrison: (A + xx')^-1 = A^-1 - (A^-1 x)(A^-1 x)' / (1 + x'A^-1 x),
+  // using that A^-1 is symmetric.
+  std::array<double, kFeatureCount> u{};
+  double denominator = 1.0;
+  for (size_t i = 0; i < kFeatureCount; ++i) {
+    for (size_t j = 0; j < kFeatureCount; ++j)
+      u[i] += a_inverse[i * kFeatureCount + j] * features[j];
+    denominator += features[i] * u[i];
+  }
+  for (size_t i = 0; i < kFeatureCount; ++i) {
+    for (size_t j = 0; j < kFeatureCount; ++j) {
+      a_inverse[i * kFeatureCount + j] -= u[i] * u[j] / denominator;
+      design_[i * kFeatureCount + j] += features[i] * features[j];
+    }
+  }
+
+  for (size_t i = 0; i < kFeatureCount; ++i)
+    reward_sum_[i] += reward * features[i];
+}
+
+void LinUcbAgent::SolveTheta() {
+  // theta = A^-1 b.
+  const auto& a_inverse = parameters_.a_inverse;
+  for (size_t i = 0; i < kFeatureCount; ++i) {
+    double value = 0.0;
+    for (size_t j = 0; j < kFeatureCount; ++j)
+      value += a_inverse[i * kFeatureCount + j] * reward_sum_[j];
+    parameters_.theta[i] = value;
+  }
+}
+
+LinUcbAgent::Parameters LinUcbAgent::ReadParameters() const {
+  Parameters parameters;
+  for (int attempt = 1;; ++attempt) {
+    uint64_t begin = sequence_.load(std::memory_order_acquire);
+    if (!(begin & 1)) {
+      for (size_t i = 0; i < kMatrixSize; ++i)
+        parameters.a_inverse[i] = published_[i].load(std::memory_order_relaxed);
+      for (size_t i = 0; i < kFeatureCount; ++i) {
+        parameters.theta[i] =
+            published_[kMatrixSize + i].load(std::memory_order_relaxed);
+      }
+      // Orders the parameter loads before the validating load.
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (sequence_.load(std::memory_order_relaxed) == begin)
+        return parameters;
+    }
+
+    // A publication is in progress. It takes well under a microsecond, but
+    // the trainer may have been preempted in the middle of it.
+    if (attempt < kReadSpinsBeforeYield) {
+      CpuRelax();
+    } else {
+      std::this_thread::yield();
+    }
+  }
+}
+
+void LinUcbAgent::PublishParameters() {
+  uint64_t sequence = sequence_.load(std::memory_order_relaxed);
+  sequence_.store(sequence + 1, std::memory_order_relaxed);
+  // Orders the odd sequence before the parameter stores.
+  std::atomic_thread_fence(std::memory_order_release);
+  for (size_t i = 0; i < kMatrixSize; ++i) {
+    published_[i].store(parameters_.a_inverse[i], std::memory_order_relaxed);
+  }
+  for (size_t i = 0; i < kFeatureCount; ++i) {
+    published_[kMatrixSize + i].store(parameters_.theta[i],
+                                      std::memory_order_relaxed);
+  }
+  sequence_.store(sequence + 2, std::memory_order_release);
+}
+
+}  // namespace rl
+}  // namespace load_balancer
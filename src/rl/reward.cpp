@@ -0,0 +1,42 @@
+#include "rl/reward.h"
+
+#include <algorithm>
+
+namespace load_balancer {
+namespace rl {
+
+namespace {
+
+// Adds the score of the phase from 'start_ns' to 'end_ns' to 'sum' and its
+// share to 'shares', if the phase was reached.
+void AddPhase(int64_t start_ns, int64_t end_ns, double scale_ms, double share,
+              double* sum, double* shares) {
+  if (start_ns == 0 || end_ns == 0 || share <= 0.0) return;
+  double ms = std::max<int64_t>(end_ns - start_ns, 0) / 1e6;
+  *sum += share * (1.0 - ms / (ms + std::max(scale_ms, 1e-3)));
+  *shares += share;
+}
+
+}  // namespace
+
+double ComputeReward(const RequestTiming& timing, bool success,
+                     const RewardConfig& config) {
+  if (!success) return config.failure_reward;
+
+  double sum = 0.0;
+  double shares = 0.0;
+  AddPhase(timing.picked_ns, timing.connected_ns, config.connect_scale_ms,
+           config.connect_share, &sum, &shares);
+  AddPhase(timing.connected_ns, timing.handshake_ns, config.handshake_scale_ms,
+           config.handshake_share, &sum, &shares);
+  int64_t response_start_ns =
+      timing.handshake_ns ? timing.handshake_ns : timing.connected_ns;
+  AddPhase(response_start_ns, timing.first_byte_ns,
+           config.first_byte_scale_ms, config.first_byte_share, &sum, &shares);
+  AddPhase(timing.picked_ns, timing.completed_ns, config.completion_scale_ms,
+           config.completion_share, &sum, &shares);
+  return shares > 0.0 ? sum / shares : 0.0;
+}
+
+}  // namespace rl
+}  // namespace load_balancer
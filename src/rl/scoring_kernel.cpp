@@ -0,0 +1,269 @@
+#include "rl/scoring_kernel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LOAD_BALANCER_X86_KERNELS 1
+#endif
+
+namespace load_balancer {
+namespace rl {
+
+namespace {
+
+// Number of distinct entries of the symmetric inverse design matrix.
+constexpr size_t kPairCount = kFeatureCount * (kFeatureCount + 1) / 2;
+
+// The quadratic form x' A^-1 x summed over the upper triangle, with the
+// off-diagonal coefficients doubled.
+struct QuadraticForm {
+  std::array<size_t, kPairCount> first{};
+  std::array<size_t, kPairCount> second{};
+  std::array<float, kPairCount> coefficient{};
+
+  explicit QuadraticForm(const UcbWeights& weights) {
+    size_t pair = 0;
+    for (size_t i = 0; i < kFeatureCount; ++i) {
+      for (size_t j = i; j < kFeatureCount; ++j, ++pair) {
+        first[pair] = i;
+        second[pair] = j;
+        coefficient[pair] = weights.a_inverse[i * kFeatureCount + j] *
+                            (i == j ? 1.0f : 2.0f);
+      }
+    }
+  }
+};
+
+// Multiplicative hash constants of the jitter.
+constexpr uint32_t kRowHash = 0x9e3779b1u;
+constexpr uint32_t kMixHash = 0x85ebca6bu;
+// Largest jitter, and the scale mapping the 24 hash bits used below it.
+constexpr float kJitter = 1e-5f;
+constexpr float kJitterScale = kJitter / (1u << 24);
+
+float Jitter(uint32_t row, uint32_t seed) {
+  uint32_t hash = (row * kRowHash) ^ seed;
+  hash ^= hash >> 16;
+  hash *= kMixHash;
+  hash ^= hash >> 13;
+  return static_cast<float>(hash >> 8) * kJitterScale;
+}
+
+size_t ArgmaxUcbScalar(const FeatureMatrix& matrix, const float* penalty,
+                       const UcbWeights& weights, uint32_t seed) {
+  QuadraticForm form(weights);
+  size_t best_row = 0;
+  float best = -std::numeric_limits<float>::infinity();
+  for (size_t row = 0; row < matrix.Rows(); ++row) {
+    std::array<float, kFeatureCount> x;
+    for (size_t i = 0; i < kFeatureCount; ++i)
+      x[i] = matrix.Column(static_cast<Feature>(i))[row];
+
+    float estimate = 0.0f;
+    for (size_t i = 0; i < kFeatureCount; ++i)
+      estimate += weights.theta[i] * x[i];
+    float variance = 0.0f;
+    for (size_t pair = 0; pair < kPairCount; ++pair)
+      variance += form.coefficient[pair] * x[form.first[pair]] *
+                  x[form.second[pair]];
+
+    float bonus = weights.alpha * std::sqrt(std::max(variance, 0.0f));
+    float score = estimate + bonus + penalty[row] +
+                  Jitter(static_cast<uint32_t>(row), seed);
+    if (score > best) {
+      best = score;
+      best_row = row;
+    }
+  }
+  return best_row;
+}
+
+#ifdef LOAD_BALANCER_X86_KERNELS
+
+__attribute__((target("avx2,fma"))) __m256 Jitter8(__m256i rows,
+                                                    __m256i seed) {
+  __m256i hash = _mm256_xor_si256(
+      _mm256_mullo_epi32(rows, _mm256_set1_epi32(kRowHash)), seed);
+  hash = _mm256_xor_si256(hash, _mm256_srli_epi32(hash, 16));
+  hash = _mm256_mullo_epi32(hash, _mm256_set1_epi32(kMixHash));
+  hash = _mm256_xor_si256(hash, _mm256_srli_epi32(hash, 13));
+  return _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(hash, 8)),
+                       _mm256_set1_ps(kJitterScale));
+}
+
+__attribute__((target("avx2,fma"))) size_t ArgmaxUcbAvx2(
+    const FeatureMatrix& matrix, const float* penalty,
+    const UcbWeights& weights, uint32_t seed) {
+  QuadraticForm form(weights);
+  const float* columns[kFeatureCount];
+  for (size_t i = 0; i < kFeatureCount; ++i)
+    columns[i] = matrix.Column(static_cast<Feature>(i));
+  const __m256 alpha = _mm256_set1_ps(weights.alpha);
+  const __m256i seeds = _mm256_set1_epi32(static_cast<int>(seed));
+
+  __m256 best = _mm256_set1_ps(-std::numeric_limits<float>::infinity());
+  __m256i best_rows = _mm256_setzero_si256();
+  __m256i rows = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  for (size_t row = 0; row < matrix.PaddedRows(); row += 8) {
+    __m256 x[kFeatureCount];
+    for (size_t i = 0; i < kFeatureCount; ++i)
+      x[i] = _mm256_load_ps(columns[i] + row);
+
+    __m256 estimate = _mm256_setzero_ps();
+    for (size_t i = 0; i < kFeatureCount; ++i)
+      estimate = _mm256_fmadd_ps(_mm256_set1_ps(weights.theta[i]), x[i],
+                                 estimate);
+    __m256 variance = _mm256_setzero_ps();
+    for (size_t pair = 0; pair < kPairCount; ++pair) {
+      variance = _mm256_fmadd_ps(
+          _mm256_mul_ps(_mm256_set1_ps(form.coefficient[pair]),
+                        x[form.first[pair]]),
+          x[form.second[pair]], variance);
+    }
+
+    __m256 score = _mm256_fmadd_ps(
+        alpha, _mm256_sqrt_ps(_mm256_max_ps(variance, _mm256_setzero_ps())),
+        estimate);
+    score = _mm256_add_ps(score, _mm256_loadu_ps(penalty + row));
+    score = _mm256_add_ps(score, Jitter8(rows, seeds));
+
+    __m256 better = _mm256_cmp_ps(score, best, _CMP_GT_OQ);
+    best = _mm256_blendv_ps(best, score, better);
+    best_rows =
+        _mm256_blendv_epi8(best_rows, rows, _mm256_castps_si256(better));
+    rows = _mm256_add_epi32(rows, _mm256_set1_epi32(8));
+  }
+
+  // Reduce the lanes, preferring the lower row on equal scores.
+  alignas(32) float scores[8];
+  alignas(32) int32_t indices[8];
+  _mm256_store_ps(scores, best);
+  _mm256_store_si256(reinterpret_cast<__m256i*>(indices), best_rows);
+  size_t lane = 0;
+  for (size_t i = 1; i < 8; ++i) {
+    if (scores[i] > scores[lane] ||
+        (scores[i] == scores[lane] && indices[i] < indices[lane])) {
+      lane = i;
+    }
+  }
+  return static_cast<size_t>(indices[lane]);
+}
+
+// GCC before 13 fills the lanes the unmasked AVX-512 intrinsics leave
+// undefined from a self-initialized vector, and at -O2 warns about every
+// such intrinsic inlined into a target("avx512f") function (GCC bug 105593).
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+__attribute__((target("avx512f"))) __m512 Jitter16(__m512i rows,
+                                                    __m512i seed) {
+  __m512i hash = _mm512_xor_si512(
+      _mm512_mullo_epi32(rows, _mm512_set1_epi32(kRowHash)), seed);
+  hash = _mm512_xor_si512(hash, _mm512_srli_epi32(hash, 16));
+  hash = _mm512_mullo_epi32(hash, _mm512_set1_epi32(kMixHash));
+  hash = _mm512_xor_si512(hash, _mm512_srli_epi32(hash, 13));
+  return _mm512_mul_ps(_mm512_cvtepi32_ps(_mm512_srli_epi32(hash, 8)),
+                       _mm512_set1_ps(kJitterScale));
+}
+
+__attribute__((target("avx512f"))) size_t ArgmaxUcbAvx512(
+    const FeatureMatrix& matrix, const float* penalty,
+    const UcbWeights& weights, uint32_t seed) {
+  QuadraticForm form(weights);
+  const float* columns[kFeatureCount];
+  for (size_t i = 0; i < kFeatureCount; ++i)
+    columns[i] = matrix.Column(static_cast<Feature>(i));
+  const __m512 alpha = _mm512_set1_ps(weights.alpha);
+  const __m512i seeds = _mm512_set1_epi32(static_cast<int>(seed));
+
+  __m512 best = _mm512_set1_ps(-std::numeric_limits<float>::infinity());
+  __m512i best_rows = _mm512_setzero_si512();
+  __m512i rows = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12,
+                                   13, 14, 15);
+  for (size_t row = 0; row < matrix.PaddedRows(); row += 16) {
+    __m512 x[kFeatureCount];
+    for (size_t i = 0; i < kFeatureCount; ++i)
+      x[i] = _mm512_load_ps(columns[i] + row);
+
+    __m512 estimate = _mm512_setzero_ps();
+    for (size_t i = 0; i < kFeatureCount; ++i)
+      estimate = _mm512_fmadd_ps(_mm512_set1_ps(weights.theta[i]), x[i],
+                                 estimate);
+    __m512 variance = _mm512_setzero_ps();
+    for (size_t pair = 0; pair < kPairCount; ++pair) {
+      variance = _mm512_fmadd_ps(
+          _mm512_mul_ps(_mm512_set1_ps(form.coefficient[pair]),
+                        x[form.first[pair]]),
+          x[form.second[pair]], variance);
+    }
+
+    __m512 score = _mm512_fmadd_ps(
+        alpha, _mm512_sqrt_ps(_mm512_max_ps(variance, _mm512_setzero_ps())),
+        estimate);
+    score = _mm512_add_ps(score, _mm512_loadu_ps(penalty + row));
+    score = _mm512_add_ps(score, Jitter16(rows, seeds));
+
+    __mmask16 better = _mm512_cmp_ps_mask(score, best, _CMP_GT_OQ);
+    best = _mm512_mask_blend_ps(better, best, score);
+    best_rows = _mm512_mask_blend_epi32(better, best_rows, rows);
+    rows = _mm512_add_epi32(rows, _mm512_set1_epi32(16));
+  }
+
+  // Among the lanes holding the highest score, take the lowest row.
+  float top = _mm512_reduce_max_ps(best);
+  __mmask16 winners = _mm512_cmp_ps_mask(best, _mm512_set1_ps(top), _CMP_EQ_OQ);
+  return static_cast<size_t>(_mm512_mask_reduce_min_epi32(winners, best_rows));
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+#endif  // LOAD_BALANCER_X86_KERNELS
+
+using Kernel = size_t (*)(const FeatureMatrix&, const float*,
+                          const UcbWeights&, uint32_t);
+
+// The implementation selected for this CPU.
+struct Dispatch {
+  Kernel kernel;
+  const char* name;
+};
+
+Dispatch SelectKernel() {
+#ifdef LOAD_BALANCER_X86_KERNELS
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) return {ArgmaxUcbAvx512, "avx512"};
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    return {ArgmaxUcbAvx2, "avx2"};
+#endif
+  return {ArgmaxUcbScalar, "scalar"};
+}
+
+const Dispatch& GetDispatch() {
+  static const Dispatch dispatch = SelectKernel();
+  return dispatch;
+}
+
+}  // namespace
+
+size_t ArgmaxUcb(const FeatureMatrix& matrix, const UcbWeights& weights,
+                 uint32_t seed) {
+  return GetDispatch().kernel(matrix, matrix.Penalty(), weights, seed);
+}
+
+size_t ArgmaxUcb(const FeatureMatrix& matrix, const float* penalty,
+                 const UcbWeights& weights, uint32_t seed) {
+  return GetDispatch().kernel(matrix, penalty, weights, seed);
+}
+
+const char* ScoringKernelName() { return GetDispatch().name; }
+
+}  // namespace rl
+}  // namespace load_balancer
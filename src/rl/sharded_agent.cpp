@@ -0,0 +1,245 @@
+#include "rl/sharded_agent.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sched.h>
+#include <spdlog/spdlog.h>
+
+namespace load_balancer {
+namespace rl {
+
+ShardedAgent::ShardedAgent(
+    std::function<std::unique_ptr<Agent>()> make_replica,
+    ShardedAgentConfig config)
+    : config_(config) {
+  shard_count_ = config_.shards > 0
+                     ? config_.shards
+                     : std::max(1u, std::thread::hardware_concurrency());
+  shards_ = std::make_unique<Shard[]>(shard_count_);
+  for (size_t i = 0; i < shard_count_; ++i)
+    shards_[i].agent = make_replica();
+  merged_at_ns_ = core::SteadyNowNs();
+
+  if (shard_count_ < 2) return;
+  // Every replica starts from the same parameters, which the first merge
+  // is taken against.
+  mergeable_ = shards_[0].agent->CheckpointKind() != nullptr;
+  if (mergeable_) {
+    base_ = shards_[0].agent->SaveParameters();
+    for (size_t i = 1; i < shard_count_ && mergeable_; ++i)
+      mergeable_ = shards_[i].agent->LoadParameters(base_);
+  }
+  if (!mergeable_) {
+    spdlog::warn("Routing policy replicas cannot be merged; each of the {} "
+                 "replicas learns on its own",
+                 shard_count_);
+    return;
+  }
+  running_ = true;
+  merger_thread_ = std::thread(&ShardedAgent::MergeLoop, this);
+}
+
+ShardedAgent::~ShardedAgent() {
+  {
+    std::lock_guard<std::mutex> lock(stop_mutex_);
+    running_ = false;
+  }
+  stop_cv_.notify_all();
+  if (merger_thread_.joinable()) merger_thread_.join();
+}
+
+int ShardedAgent::SelectAction(
+    const std::vector<std::shared_ptr<core::BackendServer>>& backends,
+    uint64_t set_version,
+    std::span<const std::shared_ptr<core::BackendServer>> excluded) {
+  return CurrentShard().agent->SelectAction(backends, set_version, excluded);
+}
+
+void ShardedAgent::Update(const core::BackendServer& backend,
+                          const FeatureVector& features, double reward) {
+  Shard& shard = shards_[next_shard_.fetch_add(1, std::memory_order_relaxed) %
+                         shard_count_];
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  shard.agent->Update(backend, features, reward);
+  shard.pending.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ShardedAgent::UpdateBatch(std::span<const Experience> batch) {
+  if (batch.empty()) return;
+  if (shard_count_ == 1) {
+    std::lock_guard<std::mutex> lock(shards_[0].mutex);
+    shards_[0].agent->UpdateBatch(batch);
+    shards_[0].pending.fetch_add(batch.size(), std::memory_order_relaxed);
+    return;
+  }
+
+  // Experiences without a recorded replica rotate among the replicas from
+  // one that changes with every batch.
+  size_t first = next_shard_.fetch_add(1, std::memory_order_relaxed);
+  auto shard_of = [this, first](const Experience& experience,
+                                size_t position) {
+    if (experience.replica >= 0 &&
+        static_cast<size_t>(experience.replica) < shard_count_) {
+      return static_cast<size_t>(experience.replica);
+    }
+    return (first + position) % shard_count_;
+  };
+
+  // Every replica learns its share as one batch, so it publishes once.
+  for (size_t i = 0; i < shard_count_; ++i) {
+    Shard& shard = shards_[i];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    for (size_t position = 0; position < batch.size(); ++position) {
+      if (shard_of(batch[position], position) == i)
+        shard.batch.push_back(batch[position]);
+    }
+    if (shard.batch.empty()) continue;
+    shard.agent->UpdateBatch(shard.batch);
+    shard.pending.fetch_add(shard.batch.size(), std::memory_order_relaxed);
+    // Keeps the capacity but not the backends.
+    shard.batch.clear();
+  }
+}
+
+int ShardedAgent::DecisionReplica() const {
+  return static_cast<int>(CurrentShardIndex());
+}
+
+uint64_t ShardedAgent::PolicyVersion() const {
+  uint64_t version = version_offset_.load(std::memory_order_relaxed);
+  for (size_t i = 0; i < shard_count_; ++i)
+    version += shards_[i].agent->PolicyVersion();
+  return version;
+}
+
+void ShardedAgent::RestorePolicyVersion(uint64_t version) {
+  auto locks = LockShards();
+  // Wraps around if 'version' is lower, which the sum undoes.
+  for (size_t i = 0; i < shard_count_; ++i)
+    version -= shards_[i].agent->PolicyVersion();
+  version_offset_.store(version, std::memory_order_relaxed);
+}
+
+const char* ShardedAgent::CheckpointKind() const {
+  return shards_[0].agent->CheckpointKind();
+}
+
+std::vector<double> ShardedAgent::SaveParameters() const {
+  auto locks = LockShards();
+  if (shard_count_ == 1) return shards_[0].agent->SaveParameters();
+  std::vector<std::vector<double>> replicas;
+  return MergedParametersLocked(&replicas);
+}
+
+bool ShardedAgent::LoadParameters(std::span<const double> parameters) {
+  auto locks = LockShards();
+  for (size_t i = 0; i < shard_count_; ++i) {
+    if (!shards_[i].agent->LoadParameters(parameters)) return false;
+    shards_[i].pending.store(0, std::memory_order_relaxed);
+  }
+  if (mergeable_) base_.assign(parameters.begin(), parameters.end());
+  return true;
+}
+
+void ShardedAgent::Merge() {
+  auto locks = LockShards();
+  MergeLocked();
+}
+
+ShardedAgentStats ShardedAgent::Stats() const {
+  ShardedAgentStats stats;
+  stats.shards = shard_count_;
+  stats.merges = merges_.load(std::memory_order_relaxed);
+  stats.since_merge = std::chrono::milliseconds(
+      (core::SteadyNowNs() - merged_at_ns_.load(std::memory_order_relaxed)) /
+      1000000);
+  for (size_t i = 0; i < shard_count_; ++i) {
+    uint64_t pending = shards_[i].pending.load(std::memory_order_relaxed);
+    stats.pending_updates += pending;
+    stats.max_pending_updates = std::max(stats.max_pending_updates, pending);
+  }
+  stats.divergence = divergence_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+size_t ShardedAgent::CurrentShardIndex() const {
+  // Served from the vDSO; a thread that migrates meanwhile only decides
+  // with a neighbor's replica once.
+  int cpu = sched_getcpu();
+  return cpu < 0 ? 0 : static_cast<size_t>(cpu) % shard_count_;
+}
+
+std::vector<std::unique_lock<std::mutex>> ShardedAgent::LockShards() const {
+  std::vector<std::unique_lock<std::mutex>> locks;
+  locks.reserve(shard_count_);
+  for (size_t i = 0; i < shard_count_; ++i)
+    locks.emplace_back(shards_[i].mutex);
+  return locks;
+}
+
+void ShardedAgent::MergeLocked() {
+  if (!mergeable_) return;
+  bool changed = false;
+  for (size_t i = 0; i < shard_count_; ++i)
+    changed |= shards_[i].pending.load(std::memory_order_relaxed) > 0;
+  if (!changed) {
+    // The replicas still agree.
+    merged_at_ns_.store(core::SteadyNowNs(), std::memory_order_relaxed);
+    return;
+  }
+
+  std::vector<std::vector<double>> replicas;
+  std::vector<double> merged = MergedParametersLocked(&replicas);
+  if (merged.empty()) return;
+
+  double divergence = 0.0;
+  for (const auto& parameters : replicas) {
+    double squares = 0.0;
+    for (size_t j = 0; j < base_.size(); ++j) {
+      double difference = parameters[j] - base_[j];
+      squares += difference * difference;
+    }
+    divergence = std::max(divergence, std::sqrt(squares / base_.size()));
+  }
+
+  // A merge the policy rejects changes nothing; replicas of one kind accept
+  // what the first one accepts.
+  if (!shards_[0].agent->LoadParameters(merged)) {
+    spdlog::error("Routing policy rejected the merged replica parameters");
+    return;
+  }
+  for (size_t i = 1; i < shard_count_; ++i)
+    shards_[i].agent->LoadParameters(merged);
+  for (size_t i = 0; i < shard_count_; ++i)
+    shards_[i].pending.store(0, std::memory_order_relaxed);
+  base_ = std::move(merged);
+  divergence_.store(divergence, std::memory_order_relaxed);
+  merged_at_ns_.store(core::SteadyNowNs(), std::memory_order_relaxed);
+  merges_.fetch_add(1, std::memory_order_relaxed);
+}
+
+std::vector<double> ShardedAgent::MergedParametersLocked(
+    std::vector<std::vector<double>>* replicas) const {
+  if (!mergeable_ || base_.empty()) return {};
+  replicas->resize(shard_count_);
+  for (size_t i = 0; i < shard_count_; ++i) {
+    (*replicas)[i] = shards_[i].agent->SaveParameters();
+    if ((*replicas)[i].size() != base_.size()) return {};
+  }
+  return shards_[0].agent->MergeParameters(base_, *replicas);
+}
+
+void ShardedAgent::MergeLoop() {
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(stop_mutex_);
+      stop_cv_.wait_for(lock, config_.sync_interval,
+                        [this]() { return !running_; });
+      if (!running_) return;
+    }
+    Merge();
+  }
+}
+
+}  // namespace rl
+}  // namespace load_balancer
@@ -0,0 +1,109 @@
+#include "rl/trainer.h"
+#include "rl/checkpoint.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace load_balancer {
+namespace rl {
+
+Trainer::Trainer(std::shared_ptr<Agent> agent, TrainerConfig config)
+    : agent_(std::move(agent)),
+      config_(config),
+      queue_(config.queue_capacity) {
+  config_.batch_size = std::max<size_t>(config_.batch_size, 1);
+  batch_.reserve(config_.batch_size);
+}
+
+Trainer::~Trainer() { Stop(); }
+
+void Trainer::Start() {
+  if (running_) return;
+  if (agent_ && !config_.checkpoint_path.empty()) {
+    LoadCheckpoint(config_.checkpoint_path, agent_.get());
+    checkpoint_version_ = agent_->PolicyVersion();
+    checkpointed_at_ = std::chrono::steady_clock::now();
+  }
+  running_ = true;
+  trainer_thread_ = std::thread(&Trainer::TrainLoop, this);
+}
+
+void Trainer::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(stop_mutex_);
+    running_ = false;
+  }
+  stop_cv_.notify_all();
+  if (trainer_thread_.joinable()) trainer_thread_.join();
+}
+
+bool Trainer::Submit(Experience experience) {
+  if (!queue_.TryPush(std::move(experience))) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  submitted_.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+TrainerStats Trainer::Stats() const {
+  TrainerStats stats;
+  stats.submitted = submitted_.load(std::memory_order_relaxed);
+  stats.dropped = dropped_.load(std::memory_order_relaxed);
+  stats.trained = trained_.load(std::memory_order_relaxed);
+  stats.batches = batches_.load(std::memory_order_relaxed);
+  stats.policy_version = agent_ ? agent_->PolicyVersion() : 0;
+  stats.checkpoints = checkpoints_.load(std::memory_order_relaxed);
+  stats.checkpoint_version =
+      checkpoint_version_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+void Trainer::TrainLoop() {
+  while (running_) {
+    size_t trained = TrainBatch();
+    MaybeCheckpoint(false);
+    if (trained > 0) continue;
+    // Sleep for the idle interval, or until stopped.
+    std::unique_lock<std::mutex> lock(stop_mutex_);
+    stop_cv_.wait_for(lock, config_.idle_interval,
+                      [this]() { return !running_; });
+  }
+  // Experiences queued before stopping are still learned from.
+  while (TrainBatch() > 0) {
+  }
+  MaybeCheckpoint(true);
+}
+
+size_t Trainer::TrainBatch() {
+  Experience experience;
+  while (batch_.size() < config_.batch_size && queue_.TryPop(&experience))
+    batch_.push_back(std::move(experience));
+  size_t count = batch_.size();
+  if (count == 0) return 0;
+
+  if (agent_) agent_->UpdateBatch(batch_);
+  if (config_.observer) config_.observer(batch_);
+  // Releases the backends the experiences held.
+  batch_.clear();
+  trained_.fetch_add(count, std::memory_order_relaxed);
+  batches_.fetch_add(1, std::memory_order_relaxed);
+  return count;
+}
+
+void Trainer::MaybeCheckpoint(bool force) {
+  if (!agent_ || config_.checkpoint_path.empty()) return;
+  uint64_t version = agent_->PolicyVersion();
+  if (version == checkpoint_version_.load(std::memory_order_relaxed)) return;
+  auto now = std::chrono::steady_clock::now();
+  if (!force && now - checkpointed_at_ < config_.checkpoint_interval) return;
+
+  // A failed write is retried after the next interval.
+  checkpointed_at_ = now;
+  if (!WriteCheckpoint(config_.checkpoint_path, *agent_)) return;
+  checkpoints_.fetch_add(1, std::memory_order_relaxed);
+  checkpoint_version_.store(version, std::memory_order_relaxed);
+}
+
+}  // namespace rl
+}  // namespace load_balancer
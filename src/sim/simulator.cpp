@@ -0,0 +1,437 @@
+#include "sim/simulator.h"
+#include "core/router.h"
+#include "rl/features.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <queue>
+#include <random>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+
+namespace load_balancer {
+namespace sim {
+
+namespace {
+
+// Offset of simulated time in request timings, whose zero means a phase was
+// not reached.
+constexpr int64_t TIMING_ORIGIN_NS = 1000000000;
+
+// Kinds of scheduled events.
+enum class EventType : uint8_t {
+  // The connect of a request reached its backend.
+  kConnected,
+  // A backend finished serving a request.
+  kServed,
+};
+
+struct Event {
+  int64_t at_ns;
+  // Orders events scheduled for the same time by when they were scheduled.
+  uint64_t sequence;
+  uint32_t request;
+  EventType type;
+
+  // Inverted for std::priority_queue, which pops the largest element.
+  bool operator<(const Event& other) const {
+    return at_ns != other.at_ns ? at_ns > other.at_ns
+                                : sequence > other.sequence;
+  }
+};
+
+// A request between its arrival and its outcome.
+struct Request {
+  int64_t arrival_ns = 0;
+  float work = 1.0f;
+  int attempts = 0;
+  // The backend picked last, its model, its features at the pick and the
+  // agent's replica that picked it.
+  std::shared_ptr<core::BackendServer> backend;
+  size_t model = 0;
+  rl::FeatureVector features{};
+  int replica = -1;
+  rl::RequestTiming timing;
+  // Counts the request in flight while it is at 'backend'.
+  core::ActiveConnection active;
+  // Backends that refused the request.
+  std::vector<std::shared_ptr<core::BackendServer>> tried;
+};
+
+// State of a modeled backend.
+struct BackendState {
+  const BackendModel* model = nullptr;
+  std::shared_ptr<core::BackendServer> server;
+  // Requests in service and those waiting for capacity.
+  int busy = 0;
+  std::deque<uint32_t> queue;
+  // Integral of 'busy' over simulated time, and when it last changed.
+  double busy_ns = 0.0;
+  int64_t changed_ns = 0;
+  uint64_t requests = 0;
+  uint64_t failures = 0;
+};
+
+// Runs one scenario; see Simulate.
+class Simulation {
+ public:
+  explicit Simulation(const Scenario& scenario)
+      : scenario_(scenario), generator_(scenario.seed) {
+    if (scenario_.make_agent) agent_ = scenario_.make_agent();
+    router_ = std::make_unique<core::Router>(agent_);
+    batch_.reserve(std::max<size_t>(scenario_.batch_size, 1));
+
+    backends_.resize(scenario_.backends.size());
+    for (size_t i = 0; i < backends_.size(); ++i) {
+      BackendState& backend = backends_[i];
+      backend.model = &scenario_.backends[i];
+      backend.server = std::make_shared<core::BackendServer>(
+          "10.0." + std::to_string(i / 256) + "." + std::to_string(i % 256),
+          8080, backend.model->weight);
+      router_->AddBackendServer(backend.server);
+      models_[backend.server->Id()] = i;
+    }
+  }
+
+  ScenarioResult Run() {
+    auto started = std::chrono::steady_clock::now();
+    const std::vector<Arrival>& arrivals = *scenario_.arrivals;
+    latencies_ms_.reserve(arrivals.size());
+
+    size_t next_arrival = 0;
+    while (next_arrival < arrivals.size() || !events_.empty()) {
+      // Arrivals are sorted, so they are merged in rather than queued.
+      if (next_arrival < arrivals.size() &&
+          (events_.empty() ||
+           arrivals[next_arrival].at_ns < events_.top().at_ns)) {
+        const Arrival& arrival = arrivals[next_arrival++];
+        now_ns_ = arrival.at_ns;
+        uint32_t index = AllocateRequest();
+        requests_[index].arrival_ns = arrival.at_ns;
+        requests_[index].work = arrival.work;
+        Pick(index);
+        continue;
+      }
+      Event event = events_.top();
+      events_.pop();
+      now_ns_ = event.at_ns;
+      if (event.type == EventType::kConnected) {
+        Connected(event.request);
+      } else {
+        Served(event.request);
+      }
+    }
+    Learn();
+
+    ScenarioResult result = Summarize();
+    result.wall_seconds = std::chrono::duration<double>(
+                              std::chrono::steady_clock::now() - started)
+                              .count();
+    return result;
+  }
+
+ private:
+  uint32_t AllocateRequest() {
+    if (free_.empty()) {
+      requests_.emplace_back();
+      return static_cast<uint32_t>(requests_.size() - 1);
+    }
+    uint32_t index = free_.back();
+    free_.pop_back();
+    return index;
+  }
+
+  void ReleaseRequest(uint32_t index) {
+    Request& request = requests_[index];
+    request.attempts = 0;
+    request.backend.reset();
+    request.active = core::ActiveConnection();
+    request.tried.clear();
+    free_.push_back(index);
+  }
+
+  void Schedule(int64_t at_ns, uint32_t request, EventType type) {
+    events_.push(Event{at_ns, sequence_++, request, type});
+  }
+
+  // Returns the fault of 'backend' active now, or nullptr.
+  const Fault* ActiveFault(const BackendState& backend) const {
+    for (const Fault& fault : backend.model->faults) {
+      if (now_ns_ >= fault.start_ns && now_ns_ < fault.end_ns) return &fault;
+    }
+    return nullptr;
+  }
+
+  double Slowdown(const BackendState& backend) const {
+    const Fault* fault = ActiveFault(backend);
+    return fault ? fault->slowdown : 1.0;
+  }
+
+  // Picks a backend for 'index', excluding those that refused it, and sends
+  // the connect.
+  void Pick(uint32_t index) {
+    Request& request = requests_[index];
+    if (request.attempts >= scenario_.max_attempts) {
+      Fail(index);
+      return;
+    }
+    request.backend = request.attempts == 0
+                          ? router_->PickBackendServer()
+                          : router_->PickBackendServer(request.tried);
+    if (!request.backend) {
+      Fail(index);
+      return;
+    }
+    if (request.attempts > 0) ++retries_;
+    ++request.attempts;
+    request.model = models_[request.backend->Id()];
+    request.features = rl::ExtractFeatures(*request.backend);
+    request.replica = router_->DecisionReplica();
+    request.timing = rl::RequestTiming();
+    request.timing.picked_ns = TIMING_ORIGIN_NS + now_ns_;
+
+    const BackendState& backend = backends_[request.model];
+    auto connect_ns = static_cast<int64_t>(backend.model->connect_ms * 1e6 *
+                                           Slowdown(backend));
+    Schedule(now_ns_ + connect_ns, index, EventType::kConnected);
+  }
+
+  void Connected(uint32_t index) {
+    Request& request = requests_[index];
+    BackendState& backend = backends_[request.model];
+    ++backend.requests;
+    auto latency = std::chrono::microseconds(
+        (TIMING_ORIGIN_NS + now_ns_ - request.timing.picked_ns) / 1000);
+
+    const Fault* fault = ActiveFault(backend);
+    bool full = backend.busy >= backend.model->capacity &&
+                static_cast<int>(backend.queue.size()) >=
+                    backend.model->queue_limit;
+    if ((fault && fault->down) || full) {
+      ++backend.failures;
+      request.backend->RecordOutcome(latency, false);
+      Report(request, false);
+      request.tried.push_back(std::move(request.backend));
+      Pick(index);
+      return;
+    }
+
+    request.backend->RecordOutcome(latency, true);
+    request.timing.connected_ns = TIMING_ORIGIN_NS + now_ns_;
+    request.active = core::ActiveConnection(request.backend);
+    if (backend.busy < backend.model->capacity) {
+      StartService(index);
+    } else {
+      backend.queue.push_back(index);
+    }
+  }
+
+  void StartService(uint32_t index) {
+    Request& request = requests_[index];
+    BackendState& backend = backends_[request.model];
+    SetBusy(backend, backend.busy + 1);
+    double service_ms =
+        DrawServiceMs(*backend.model) * request.work * Slowdown(backend);
+    Schedule(now_ns_ + static_cast<int64_t>(service_ms * 1e6), index,
+             EventType::kServed);
+  }
+
+  void Served(uint32_t index) {
+    Request& request = requests_[index];
+    BackendState& backend = backends_[request.model];
+    SetBusy(backend, backend.busy - 1);
+
+    double failure_probability = backend.model->failure_probability;
+    if (failure_probability > 0.0 && unit_(generator_) < failure_probability) {
+      // Like a RoutingDecision finished as failed after the connect.
+      ++backend.failures;
+      request.backend->RecordOutcome(
+          std::chrono::microseconds(
+              (TIMING_ORIGIN_NS + now_ns_ - request.timing.picked_ns) / 1000),
+          false);
+      Report(request, false);
+      Fail(index);
+    } else {
+      request.timing.first_byte_ns = request.timing.completed_ns =
+          TIMING_ORIGIN_NS + now_ns_;
+      Report(request, true);
+      latencies_ms_.push_back(
+          static_cast<float>((now_ns_ - request.arrival_ns) / 1e6));
+      ReleaseRequest(index);
+    }
+
+    // The freed capacity goes to the longest waiting request.
+    if (!backend.queue.empty()) {
+      uint32_t next = backend.queue.front();
+      backend.queue.pop_front();
+      StartService(next);
+    }
+  }
+
+  void Fail(uint32_t index) {
+    ++failed_;
+    ReleaseRequest(index);
+  }
+
+  void SetBusy(BackendState& backend, int busy) {
+    backend.busy_ns +=
+        static_cast<double>(backend.busy) * (now_ns_ - backend.changed_ns);
+    backend.changed_ns = now_ns_;
+    backend.busy = busy;
+  }
+
+  double DrawServiceMs(const BackendModel& model) {
+    double mean = model.mean_service_ms;
+    switch (model.distribution) {
+      case ServiceDistribution::kConstant:
+        return mean;
+      case ServiceDistribution::kExponential:
+        return -mean * std::log(1.0 - unit_(generator_));
+      case ServiceDistribution::kLogNormal: {
+        double sigma = model.shape;
+        double mu = std::log(mean) - sigma * sigma / 2.0;
+        return std::exp(mu + sigma * normal_(generator_));
+      }
+      case ServiceDistribution::kPareto: {
+        double alpha = std::max(model.shape, 1.0 + 1e-3);
+        double scale = mean * (alpha - 1.0) / alpha;
+        return scale / std::pow(1.0 - unit_(generator_), 1.0 / alpha);
+      }
+    }
+    return mean;
+  }
+
+  // Queues the outcome of the request's current attempt for the agent.
+  void Report(const Request& request, bool success) {
+    double reward =
+        rl::ComputeReward(request.timing, success, scenario_.reward);
+    reward_sum_ += reward;
+    ++rewards_;
+    if (!agent_) return;
+    batch_.push_back(rl::Experience{request.backend, request.features, reward,
+                                    request.timing, success,
+                                    request.replica});
+    if (batch_.size() >= batch_.capacity()) Learn();
+  }
+
+  void Learn() {
+    if (batch_.empty()) return;
+    agent_->UpdateBatch(batch_);
+    batch_.clear();
+    router_->RefreshPolicy();
+  }
+
+  ScenarioResult Summarize() {
+    ScenarioResult result;
+    result.name = scenario_.name;
+    result.policy = scenario_.policy;
+    result.completed = latencies_ms_.size();
+    result.failed = failed_;
+    result.retries = retries_;
+    result.simulated_seconds = now_ns_ / 1e9;
+    if (rewards_ > 0) result.mean_reward = reward_sum_ / rewards_;
+
+    if (!latencies_ms_.empty()) {
+      double sum = 0.0;
+      for (float latency : latencies_ms_) sum += latency;
+      result.mean_ms = sum / latencies_ms_.size();
+      // Percentiles in increasing order, each selection narrowing the next.
+      auto begin = latencies_ms_.begin();
+      for (auto [quantile, field] :
+           {std::pair{0.5, &result.p50_ms}, std::pair{0.9, &result.p90_ms},
+            std::pair{0.99, &result.p99_ms}, std::pair{0.999, &result.p999_ms},
+            std::pair{1.0, &result.max_ms}}) {
+        auto position = latencies_ms_.begin() +
+                        std::min(latencies_ms_.size() - 1,
+                                 static_cast<size_t>(quantile *
+                                                     latencies_ms_.size()));
+        std::nth_element(begin, position, latencies_ms_.end());
+        *field = *position;
+        begin = position;
+      }
+    }
+
+    for (BackendState& backend : backends_) {
+      SetBusy(backend, backend.busy);
+      BackendResult backend_result;
+      backend_result.requests = backend.requests;
+      backend_result.failures = backend.failures;
+      if (now_ns_ > 0 && backend.model->capacity > 0) {
+        backend_result.utilization =
+            backend.busy_ns / (static_cast<double>(now_ns_) *
+                               backend.model->capacity);
+      }
+      result.backends.push_back(backend_result);
+    }
+    return result;
+  }
+
+  const Scenario& scenario_;
+  std::shared_ptr<rl::Agent> agent_;
+  std::unique_ptr<core::Router> router_;
+  std::vector<BackendState> backends_;
+  // Maps FeatureStore IDs to positions in 'backends_'.
+  std::unordered_map<uint32_t, size_t> models_;
+
+  // Requests in flight and the free positions among them.
+  std::vector<Request> requests_;
+  std::vector<uint32_t> free_;
+  std::priority_queue<Event> events_;
+  uint64_t sequence_ = 0;
+  // Current simulated time.
+  int64_t now_ns_ = 0;
+
+  std::mt19937_64 generator_;
+  std::uniform_real_distribution<double> unit_{0.0, 1.0};
+  std::normal_distribution<double> normal_{0.0, 1.0};
+
+  // Experiences waiting for the next update of the agent.
+  std::vector<rl::Experience> batch_;
+
+  std::vector<float> latencies_ms_;
+  uint64_t failed_ = 0;
+  uint64_t retries_ = 0;
+  double reward_sum_ = 0.0;
+  uint64_t rewards_ = 0;
+};
+
+}  // namespace
+
+ScenarioResult Simulate(const Scenario& scenario) {
+  if (!scenario.arrivals || scenario.backends.empty()) {
+    ScenarioResult result;
+    result.name = scenario.name;
+    result.policy = scenario.policy;
+    return result;
+  }
+  return Simulation(scenario).Run();
+}
+
+std::vector<ScenarioResult> SimulateAll(std::span<const Scenario> scenarios,
+                                        int threads) {
+  std::vector<ScenarioResult> results(scenarios.size());
+  size_t count = threads > 0
+                     ? static_cast<size_t>(threads)
+                     : std::max(1u, std::thread::hardware_concurrency());
+  count = std::min(count, scenarios.size());
+
+  // Scenarios are handed out one at a time, so long ones do not hold up a
+  // whole share of the others.
+  std::atomic<size_t> next{0};
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < count; ++i) {
+    workers.emplace_back([&]() {
+      for (size_t index = next++; index < scenarios.size(); index = next++)
+        results[index] = Simulate(scenarios[index]);
+    });
+  }
+  for (std::thread& worker : workers) worker.join();
+  return results;
+}
+
+}  // namespace sim
+}  // namespace load_balancer
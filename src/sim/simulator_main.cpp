@@ -0,0 +1,261 @@
+// Replays arrival traces against modeled backends with every routing policy
+// and prints tail latency and utilization per scenario and policy.
+//
+// Usage: load_balancer_simulator [--requests N] [--load L] [--rate R]
+//            [--burst F] [--trace FILE] [--seeds K] [--threads T]
+//            [--policies weighted,linucb,linucb-softmax,sharded-linucb]
+//            [--environments a,b,...]
+
+#include "rl/lin_ucb_agent.h"
+#include "rl/sharded_agent.h"
+#include "sim/simulator.h"
+#include "sim/trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <spdlog/spdlog.h>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace load_balancer;
+
+namespace {
+
+// Options of a simulator run.
+struct Options {
+  uint64_t requests = 1000000;
+  // Offered load as a fraction of the environment's capacity, unless a rate
+  // is given.
+  double load = 0.7;
+  double rate = 0.0;
+  double burst = 1.0;
+  std::string trace;
+  int seeds = 1;
+  int threads = 0;
+  std::vector<std::string> policies{"weighted", "linucb"};
+  std::vector<std::string> environments{"uniform", "heterogeneous",
+                                        "heavy-tail", "faults"};
+};
+
+// A set of backends a policy is evaluated against.
+struct Environment {
+  std::string name;
+  std::vector<sim::BackendModel> backends;
+};
+
+std::vector<std::string> SplitList(const std::string& list) {
+  std::vector<std::string> items;
+  std::istringstream stream(list);
+  for (std::string item; std::getline(stream, item, ',');) {
+    if (!item.empty()) items.push_back(item);
+  }
+  return items;
+}
+
+bool ParseOptions(int argc, char** argv, Options* options) {
+  for (int i = 1; i < argc; ++i) {
+    std::string flag = argv[i];
+    if (i + 1 >= argc) {
+      spdlog::error("Missing value for {}", flag);
+      return false;
+    }
+    std::string value = argv[++i];
+    if (flag == "--requests") {
+      options->requests = std::strtoull(value.c_str(), nullptr, 10);
+    } else if (flag == "--load") {
+      options->load = std::atof(value.c_str());
+    } else if (flag == "--rate") {
+      options->rate = std::atof(value.c_str());
+    } else if (flag == "--burst") {
+      options->burst = std::atof(value.c_str());
+    } else if (flag == "--trace") {
+      options->trace = value;
+    } else if (flag == "--seeds") {
+      options->seeds = std::max(1, std::atoi(value.c_str()));
+    } else if (flag == "--threads") {
+      options->threads = std::atoi(value.c_str());
+    } else if (flag == "--policies") {
+      options->policies = SplitList(value);
+    } else if (flag == "--environments") {
+      options->environments = SplitList(value);
+    } else {
+      spdlog::error("Unknown option {}", flag);
+      return false;
+    }
+  }
+  return true;
+}
+
+// Returns the environment called 'name', or one without backends.
+// 'duration_ns' is the expected length of the trace, which places faults.
+Environment MakeEnvironment(const std::string& name, int64_t duration_ns) {
+  Environment environment{name, {}};
+  if (name == "uniform") {
+    environment.backends.resize(8);
+  } else if (name == "heterogeneous") {
+    // Equal weights hide a fourfold spread in speed.
+    for (double mean_ms : {5.0, 5.0, 10.0, 10.0, 20.0, 20.0, 20.0, 20.0}) {
+      sim::BackendModel backend;
+      backend.mean_service_ms = mean_ms;
+      environment.backends.push_back(backend);
+    }
+  } else if (name == "heavy-tail") {
+    for (int i = 0; i < 8; ++i) {
+      sim::BackendModel backend;
+      backend.distribution = sim::ServiceDistribution::kLogNormal;
+      backend.shape = i < 2 ? 2.0 : 1.0;
+      environment.backends.push_back(backend);
+    }
+  } else if (name == "faults") {
+    environment.backends.resize(8);
+    // One backend goes down, another slows down, a third fails requests.
+    environment.backends[0].faults.push_back(
+        {duration_ns / 5, duration_ns * 2 / 5, 1.0, true});
+    environment.backends[1].faults.push_back(
+        {duration_ns / 2, duration_ns * 7 / 10, 5.0, false});
+    environment.backends[2].failure_probability = 0.2;
+  }
+  return environment;
+}
+
+// Requests per second the backends of 'environment' serve at full capacity.
+double Capacity(const Environment& environment) {
+  double capacity = 0.0;
+  for (const sim::BackendModel& backend : environment.backends)
+    capacity += backend.capacity * 1000.0 / backend.mean_service_ms;
+  return capacity;
+}
+
+// Stores the factory of the agent of 'policy' in 'make_agent', an empty one
+// for weighted routing. Returns false if the policy is unknown.
+bool MakePolicy(const std::string& policy,
+                std::function<std::shared_ptr<rl::Agent>()>* make_agent) {
+  if (policy == "weighted") {
+    *make_agent = nullptr;
+    return true;
+  }
+  if (policy == "linucb" || policy == "linucb-softmax") {
+    *make_agent = [softmax = policy == "linucb-softmax"]() {
+      // Simulated time passes much faster than the wall clock, so every
+      // decision reads fresh features.
+      rl::LinUcbConfig config;
+      config.feature_refresh_interval = std::chrono::microseconds(0);
+      // Sampled from the distribution the router refreshes per batch.
+      if (softmax) config.softmax_temperature = 0.05;
+      return std::make_shared<rl::LinUcbAgent>(config);
+    };
+    return true;
+  }
+  if (policy == "sharded-linucb") {
+    *make_agent = []() {
+      rl::LinUcbConfig config;
+      config.feature_refresh_interval = std::chrono::microseconds(0);
+      // Replicas of the core the simulation thread runs on decide and
+      // learn; the merger combines them on the wall clock.
+      return std::make_shared<rl::ShardedAgent>(
+          [config]() { return std::make_unique<rl::LinUcbAgent>(config); });
+    };
+    return true;
+  }
+  return false;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options options;
+  if (!ParseOptions(argc, argv, &options)) return 1;
+  // Adding backends to every scenario's router is not worth reporting.
+  spdlog::set_level(spdlog::level::warn);
+
+  std::shared_ptr<std::vector<sim::Arrival>> recorded;
+  if (!options.trace.empty()) {
+    recorded = std::make_shared<std::vector<sim::Arrival>>();
+    if (!sim::LoadTrace(options.trace, recorded.get())) return 1;
+  }
+
+  std::vector<sim::Scenario> scenarios;
+  for (const std::string& name : options.environments) {
+    // Faults are placed in a trace of the expected length.
+    Environment probe = MakeEnvironment(name, 0);
+    if (probe.backends.empty()) {
+      spdlog::error("Unknown environment {}", name);
+      return 1;
+    }
+    double rate =
+        options.rate > 0.0 ? options.rate : options.load * Capacity(probe);
+    int64_t duration_ns =
+        recorded && !recorded->empty()
+            ? recorded->back().at_ns
+            : static_cast<int64_t>(options.requests / rate * 1e9);
+    Environment environment = MakeEnvironment(name, duration_ns);
+
+    for (int seed = 1; seed <= options.seeds; ++seed) {
+      std::shared_ptr<const std::vector<sim::Arrival>> arrivals = recorded;
+      if (!arrivals) {
+        sim::TraceConfig trace;
+        trace.requests = options.requests;
+        trace.rate = rate;
+        trace.burst_factor = options.burst;
+        trace.seed = seed;
+        arrivals = std::make_shared<std::vector<sim::Arrival>>(
+            sim::GenerateTrace(trace));
+      }
+      for (const std::string& policy : options.policies) {
+        sim::Scenario scenario;
+        if (!MakePolicy(policy, &scenario.make_agent)) {
+          spdlog::error("Unknown policy {}", policy);
+          return 1;
+        }
+        scenario.name = name;
+        scenario.policy = policy;
+        scenario.backends = environment.backends;
+        scenario.arrivals = arrivals;
+        scenario.seed = seed;
+        scenarios.push_back(std::move(scenario));
+      }
+    }
+  }
+
+  auto started = std::chrono::steady_clock::now();
+  std::vector<sim::ScenarioResult> results =
+      sim::SimulateAll(scenarios, options.threads);
+  double wall_seconds = std::chrono::duration<double>(
+                            std::chrono::steady_clock::now() - started)
+                            .count();
+
+  std::printf("%-14s %-14s %10s %8s %8s %8s %8s %9s %9s %6s %6s %7s %8s\n",
+              "environment", "policy", "completed", "failed", "p50 ms",
+              "p90 ms", "p99 ms", "p99.9 ms", "max ms", "util", "peak",
+              "reward", "Mreq/s");
+  uint64_t total = 0;
+  for (const sim::ScenarioResult& result : results) {
+    double utilization = 0.0;
+    double peak = 0.0;
+    for (const sim::BackendResult& backend : result.backends) {
+      utilization += backend.utilization / result.backends.size();
+      peak = std::max(peak, backend.utilization);
+    }
+    uint64_t requests = result.completed + result.failed;
+    total += requests;
+    std::printf(
+        "%-14s %-14s %10llu %8llu %8.2f %8.2f %8.2f %9.2f %9.2f %6.3f %6.3f "
+        "%7.3f %8.2f\n",
+        result.name.c_str(), result.policy.c_str(),
+        static_cast<unsigned long long>(result.completed),
+        static_cast<unsigned long long>(result.failed), result.p50_ms,
+        result.p90_ms, result.p99_ms, result.p999_ms, result.max_ms,
+        utilization, peak, result.mean_reward,
+        result.wall_seconds > 0.0 ? requests / result.wall_seconds / 1e6
+                                  : 0.0);
+  }
+  std::printf("%zu scenarios, %llu requests in %.2f s (%.2f Mreq/s)\n",
+              results.size(), static_cast<unsigned long long>(total),
+              wall_seconds, total / wall_seconds / 1e6);
+  return 0;
+}
@@ -0,0 +1,82 @@
+#include "sim/trace.h"
+
+#include <algorithm>
+#include <fstream>
+#include <random>
+#include <spdlog/spdlog.h>
+#include <sstream>
+
+namespace load_balancer {
+namespace sim {
+
+std::vector<Arrival> GenerateTrace(const TraceConfig& config) {
+  std::vector<Arrival> arrivals;
+  if (config.rate <= 0.0) return arrivals;
+  arrivals.reserve(config.requests);
+
+  std::mt19937_64 generator(config.seed);
+  std::exponential_distribution<double> unit(1.0);
+  double factor = std::max(config.burst_factor, 1.0);
+  double period_ns = config.burst_period_ms * 1e6;
+  // A burst takes 1 / (factor + 1) of the time, which keeps the mean rate.
+  double burst_ns = 2.0 * period_ns / (factor + 1.0);
+  double quiet_ns = 2.0 * period_ns - burst_ns;
+
+  bool burst = false;
+  double phase_end = factor > 1.0 ? quiet_ns * unit(generator) : 0.0;
+  double now = 0.0;
+  while (arrivals.size() < config.requests) {
+    double rate = config.rate * (factor > 1.0
+                                     ? (burst ? factor : 1.0 / factor)
+                                     : 1.0);
+    double next = now + unit(generator) * 1e9 / rate;
+    // Gaps are memoryless, so one crossing into the next phase is redrawn
+    // at that phase's rate.
+    if (factor > 1.0 && next > phase_end) {
+      now = phase_end;
+      burst = !burst;
+      phase_end = now + (burst ? burst_ns : quiet_ns) * unit(generator);
+      continue;
+    }
+    now = next;
+    arrivals.push_back(Arrival{static_cast<int64_t>(now), 1.0f});
+  }
+  return arrivals;
+}
+
+bool LoadTrace(const std::string& path, std::vector<Arrival>* arrivals) {
+  std::ifstream file(path);
+  if (!file) {
+    spdlog::error("Failed to open trace {}", path);
+    return false;
+  }
+
+  arrivals->clear();
+  std::string line;
+  for (int number = 1; std::getline(file, line); ++number) {
+    size_t start = line.find_first_not_of(" \t\r");
+    if (start == std::string::npos || line[start] == '#') continue;
+    std::istringstream fields(line);
+    double at_us = 0.0;
+    float work = 1.0f;
+    if (!(fields >> at_us) || (!(fields >> work) && !fields.eof()) ||
+        work < 0.0f) {
+      spdlog::error("Malformed line {} in trace {}", number, path);
+      return false;
+    }
+    arrivals->push_back(Arrival{static_cast<int64_t>(at_us * 1000.0), work});
+  }
+
+  std::stable_sort(arrivals->begin(), arrivals->end(),
+                   [](const Arrival& a, const Arrival& b) {
+                     return a.at_ns < b.at_ns;
+                   });
+  if (!arrivals->empty()) {
+    int64_t origin = arrivals->front().at_ns;
+    for (Arrival& arrival : *arrivals) arrival.at_ns -= origin;
+  }
+  return true;
+}
+
+}  // namespace sim
+}  // namespace load_balancer
@@ -0,0 +1,76 @@
+#include "utils/alias_table.h"
+#include "utils/random.h"
+
+#include <algorithm>
+
+namespace load_balancer {
+namespace utils {
+
+namespace {
+
+// Scale of the thresholds: a probability of 1 maps to 2^32.
+constexpr double kThresholdScale = 4294967296.0;
+
+uint32_t ToThreshold(double probability) {
+  return static_cast<uint32_t>(
+      std::clamp(probability * kThresholdScale, 0.0, kThresholdScale - 1.0));
+}
+
+}  // namespace
+
+AliasTable::AliasTable(std::span<const double> weights) {
+  double total = 0.0;
+  for (double weight : weights) total += std::max(weight, 0.0);
+  if (total <= 0.0) return;
+
+  // Scale so the average entry holds probability 1, then pair every entry
+  // below 1 with one above it, which donates the remainder.
+  size_t count = weights.size();
+  std::vector<double> scaled(count);
+  std::vector<uint32_t> small;
+  std::vector<uint32_t> large;
+  for (size_t i = 0; i < count; ++i) {
+    scaled[i] = std::max(weights[i], 0.0) * count / total;
+    (scaled[i] < 1.0 ? small : large).push_back(static_cast<uint32_t>(i));
+  }
+
+  entries_.resize(count);
+  while (!small.empty() && !large.empty()) {
+    uint32_t less = small.back();
+    small.pop_back();
+    uint32_t more = large.back();
+    entries_[less] = {ToThreshold(scaled[less]), more};
+    scaled[more] -= 1.0 - scaled[less];
+    if (scaled[more] < 1.0) {
+      large.pop_back();
+      small.push_back(more);
+    }
+  }
+  // What is left holds probability 1 up to rounding, except that an entry
+  // without weight must never keep its own index.
+  uint32_t positive = static_cast<uint32_t>(
+      std::find_if(weights.begin(), weights.end(),
+                   [](double weight) { return weight > 0.0; }) -
+      weights.begin());
+  for (auto* rest : {&large, &small}) {
+    for (uint32_t index : *rest) {
+      entries_[index] = weights[index] > 0.0
+                            ? Entry{ToThreshold(1.0), index}
+                            : Entry{0, positive};
+    }
+  }
+}
+
+size_t AliasTable::Sample(uint64_t random) const {
+  // The high half picks the entry without a division, the low half flips
+  // its biased coin.
+  uint64_t column = ((random >> 32) * entries_.size()) >> 32;
+  const Entry& entry = entries_[column];
+  return static_cast<uint32_t>(random) < entry.threshold ? column
+                                                         : entry.alias;
+}
+
+size_t AliasTable::Sample() const { return Sample(NextRandom()); }
+
+}  // namespace utils
+}  // namespace load_balancer
@@ -0,0 +1,147 @@
+#include "utils/buffer_pool.h"
+
+#include <algorithm>
+#include <bit>
+#include <new>
+#include <sched.h>
+#include <spdlog/spdlog.h>
+
+namespace load_balancer {
+namespace utils {
+
+// Alignment of every buffer, so neighbouring buffers never share a line.
+constexpr std::align_val_t BUFFER_ALIGNMENT{64};
+
+PooledBuffer::PooledBuffer(PooledBuffer&& other) noexcept
+    : pool_(other.pool_), data_(other.data_), size_(other.size_) {
+  other.pool_ = nullptr;
+  other.data_ = nullptr;
+  other.size_ = 0;
+}
+
+PooledBuffer& PooledBuffer::operator=(PooledBuffer&& other) noexcept {
+  if (this != &other) {
+    Reset();
+    pool_ = other.pool_;
+    data_ = other.data_;
+    size_ = other.size_;
+    other.pool_ = nullptr;
+    other.data_ = nullptr;
+    other.size_ = 0;
+  }
+  return *this;
+}
+
+void PooledBuffer::Reset() {
+  if (data_) pool_->Release(data_, size_);
+  pool_ = nullptr;
+  data_ = nullptr;
+  size_ = 0;
+}
+
+BufferPool::BufferPool(BufferPoolConfig config) : config_(config) {
+  // Class sizes are powers of two, so both bounds are rounded up to one.
+  config_.min_buffer_size = std::bit_ceil(std::max<size_t>(
+      config_.min_buffer_size, 64));
+  config_.max_buffer_size = std::bit_ceil(std::max(config_.max_buffer_size,
+                                                   config_.min_buffer_size));
+  classes_ = std::countr_zero(config_.max_buffer_size) -
+             std::countr_zero(config_.min_buffer_size) + 1;
+  if (classes_ > kMaxClasses) {
+    classes_ = kMaxClasses;
+    config_.max_buffer_size = config_.min_buffer_size << (kMaxClasses - 1);
+    spdlog::warn("Relay buffers are limited to {} bytes",
+                 config_.max_buffer_size);
+  }
+}
+
+BufferPool::~BufferPool() {
+  for (Shard& shard : shards_) {
+    for (auto& free_list : shard.free_lists) {
+      for (char* data : free_list) ::operator delete(data, BUFFER_ALIGNMENT);
+    }
+  }
+  if (buffers_in_use_ > 0) {
+    spdlog::warn("Buffer pool destroyed with {} buffers in use",
+                 buffers_in_use_.load());
+  }
+}
+
+PooledBuffer BufferPool::Acquire(size_t size) {
+  size = std::clamp(std::bit_ceil(std::max<size_t>(size, 1)),
+                    config_.min_buffer_size, config_.max_buffer_size);
+  size_t size_class = ClassOf(size);
+
+  char* data = nullptr;
+  {
+    Shard& shard = LocalShard();
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto& free_list = shard.free_lists[size_class];
+    if (!free_list.empty()) {
+      data = free_list.back();
+      free_list.pop_back();
+    }
+  }
+
+  if (data) {
+    bytes_cached_.fetch_sub(size, std::memory_order_relaxed);
+    reuses_.fetch_add(1, std::memory_order_relaxed);
+  } else {
+    data = static_cast<char*>(::operator new(size, BUFFER_ALIGNMENT));
+    allocations_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  buffers_in_use_.fetch_add(1, std::memory_order_relaxed);
+  size_t in_use =
+      bytes_in_use_.fetch_add(size, std::memory_order_relaxed) + size;
+  size_t peak = peak_bytes_in_use_.load(std::memory_order_relaxed);
+  while (in_use > peak &&
+         !peak_bytes_in_use_.compare_exchange_weak(
+             peak, in_use, std::memory_order_relaxed)) {
+  }
+  return PooledBuffer(this, data, size);
+}
+
+size_t BufferPool::NextSize(size_t size) const {
+  return std::min(size * 2, config_.max_buffer_size);
+}
+
+BufferPoolStats BufferPool::Stats() const {
+  BufferPoolStats stats;
+  stats.buffers_in_use = buffers_in_use_.load(std::memory_order_relaxed);
+  stats.bytes_in_use = bytes_in_use_.load(std::memory_order_relaxed);
+  stats.peak_bytes_in_use = peak_bytes_in_use_.load(std::memory_order_relaxed);
+  stats.bytes_cached = bytes_cached_.load(std::memory_order_relaxed);
+  stats.allocations = allocations_.load(std::memory_order_relaxed);
+  stats.reuses = reuses_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+void BufferPool::Release(char* data, size_t size) {
+  buffers_in_use_.fetch_sub(1, std::memory_order_relaxed);
+  bytes_in_use_.fetch_sub(size, std::memory_order_relaxed);
+
+  // Keep the buffer for reuse while the cache has room; the check is racy
+  // but only ever overshoots the cap by a few buffers.
+  if (bytes_cached_.load(std::memory_order_relaxed) + size <=
+      config_.max_cached_bytes) {
+    bytes_cached_.fetch_add(size, std::memory_order_relaxed);
+    Shard& shard = LocalShard();
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.free_lists[ClassOf(size)].push_back(data);
+    return;
+  }
+  ::operator delete(data, BUFFER_ALIGNMENT);
+}
+
+size_t BufferPool::ClassOf(size_t size) const {
+  return std::countr_zero(size) - std::countr_zero(config_.min_buffer_size);
+}
+
+BufferPool::Shard& BufferPool::LocalShard() {
+  int cpu = sched_getcpu();
+  return shards_[cpu >= 0 ? cpu % kShards : 0];
+}
+
+}  // namespace utils
+}  // namespace load_balancer
@@ -0,0 +1,143 @@
+#include "utils/epoch.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <vector>
+
+namespace load_balancer {
+namespace utils {
+
+namespace {
+
+// Announcement of one thread. Records live on their own cache line so
+// readers never share one, and are never freed.
+struct alignas(64) ThreadRecord {
+  // Epoch the thread entered its outermost guard in, or 0 outside guards.
+  std::atomic<uint64_t> epoch{0};
+  // True while a live thread owns the record.
+  std::atomic<bool> in_use{false};
+  // Guards the owning thread currently holds.
+  uint32_t depth = 0;
+  // Next record of the registry.
+  ThreadRecord* next = nullptr;
+};
+
+// An object waiting until no reader can hold it.
+struct RetiredObject {
+  const void* object;
+  void (*deleter)(const void*);
+  // Epoch that was current when the object was retired.
+  uint64_t epoch;
+};
+
+// The global epoch starts at 1 so 0 can mean "not reading".
+std::atomic<uint64_t> global_epoch{1};
+// Registry of every thread record ever created, pushed at the head.
+std::atomic<ThreadRecord*> records{nullptr};
+// Objects retired but not yet deleted.
+std::mutex retired_mutex;
+std::vector<RetiredObject> retired;
+
+ThreadRecord* AcquireRecord() {
+  // Reuse the record of a thread that exited.
+  for (ThreadRecord* record = records.load(std::memory_order_acquire); record;
+       record = record->next) {
+    bool expected = false;
+    if (!record->in_use.load(std::memory_order_relaxed) &&
+        record->in_use.compare_exchange_strong(expected, true,
+                                               std::memory_order_acquire)) {
+      return record;
+    }
+  }
+
+  auto* record = new ThreadRecord();
+  record->in_use.store(true, std::memory_order_relaxed);
+  ThreadRecord* head = records.load(std::memory_order_relaxed);
+  do {
+    record->next = head;
+  } while (!records.compare_exchange_weak(head, record,
+                                          std::memory_order_release,
+                                          std::memory_order_relaxed));
+  return record;
+}
+
+// Hands the calling thread's record back when the thread exits.
+struct ThreadSlot {
+  ThreadRecord* record = AcquireRecord();
+
+  ~ThreadSlot() {
+    record->depth = 0;
+    record->epoch.store(0, std::memory_order_release);
+    record->in_use.store(false, std::memory_order_release);
+  }
+};
+
+ThreadRecord& LocalRecord() {
+  thread_local ThreadSlot slot;
+  return *slot.record;
+}
+
+}  // namespace
+
+void Epoch::Enter() {
+  ThreadRecord& record = LocalRecord();
+  if (record.depth++ > 0) return;
+
+  // Acquire pairs with the release increment of Retire: a reader that sees
+  // the new epoch also sees the pointer swap that preceded it. The fence
+  // orders the announcement before the reads of shared objects, so a
+  // writer either sees the announcement or the reader sees the new object.
+  record.epoch.store(global_epoch.load(std::memory_order_acquire),
+                     std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+void Epoch::Leave() {
+  ThreadRecord& record = LocalRecord();
+  if (--record.depth == 0) record.epoch.store(0, std::memory_order_release);
+}
+
+void Epoch::Retire(const void* object, void (*deleter)(const void*)) {
+  {
+    std::lock_guard<std::mutex> lock(retired_mutex);
+    retired.push_back({object, deleter,
+                       global_epoch.fetch_add(1, std::memory_order_acq_rel)});
+  }
+  Reclaim();
+}
+
+size_t Epoch::Reclaim() {
+  std::vector<RetiredObject> reclaimable;
+  size_t waiting;
+  {
+    std::lock_guard<std::mutex> lock(retired_mutex);
+    if (retired.empty()) return 0;
+
+    // Pairs with the fence of Enter.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    uint64_t oldest = std::numeric_limits<uint64_t>::max();
+    for (ThreadRecord* record = records.load(std::memory_order_acquire);
+         record; record = record->next) {
+      uint64_t epoch = record->epoch.load(std::memory_order_acquire);
+      if (epoch != 0) oldest = std::min(oldest, epoch);
+    }
+
+    // Readers that entered after an object was retired cannot reach it.
+    auto still_held = std::partition(
+        retired.begin(), retired.end(),
+        [oldest](const RetiredObject& entry) { return entry.epoch >= oldest; });
+    reclaimable.assign(still_held, retired.end());
+    retired.erase(still_held, retired.end());
+    waiting = retired.size();
+  }
+
+  // Deleters run without the lock, as they may retire further objects.
+  for (const RetiredObject& entry : reclaimable) entry.deleter(entry.object);
+  return waiting;
+}
+
+}  // namespace utils
+}  // namespace load_balancer
@@ -0,0 +1,80 @@
+#include "utils/socket_utils.h"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace load_balancer {
+namespace utils {
+
+int SocketUtils::StartConnect(const std::string& ip, int port) {
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  if (inet_pton(AF_INET, ip.c_str(), &address.sin_addr) != 1) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) return -1;
+  if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) <
+          0 &&
+      errno != EINPROGRESS) {
+    int error = errno;
+    close(fd);
+    errno = error;
+    return -1;
+  }
+  return fd;
+}
+
+int SocketUtils::ConnectWithTimeout(const std::string& ip, int port,
+                                    std::chrono::milliseconds timeout) {
+  // Connect without blocking so the deadline can be enforced; a blackholed
+  // address would otherwise hold the caller for the kernel's SYN retries.
+  int fd = StartConnect(ip, port);
+  if (fd < 0) return -1;
+
+  auto deadline = std::chrono::steady_clock::now() + timeout;
+  pollfd pfd{fd, POLLOUT, 0};
+  while (true) {
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - std::chrono::steady_clock::now());
+    int ready = poll(&pfd, 1, std::max<int>(0, remaining.count()));
+    if (ready > 0) break;
+    if (ready == 0 || errno != EINTR) {
+      int error = ready == 0 ? ETIMEDOUT : errno;
+      close(fd);
+      errno = error;
+      return -1;
+    }
+  }
+
+  int connect_error = 0;
+  socklen_t length = sizeof(connect_error);
+  getsockopt(fd, SOL_SOCKET, SO_ERROR, &connect_error, &length);
+  if (connect_error != 0) {
+    close(fd);
+    errno = connect_error;
+    return -1;
+  }
+
+  // Callers expect an ordinary blocking socket.
+  int flags = fcntl(fd, F_GETFL, 0);
+  if (flags < 0 || fcntl(fd, F_SETFL, flags & ~O_NONBLOCK) < 0) {
+    int error = errno;
+    close(fd);
+    errno = error;
+    return -1;
+  }
+  return fd;
+}
+
+}  // namespace utils
+}  // namespace load_balancer
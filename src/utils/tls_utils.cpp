@@ -1,6 +1,11 @@
 #include "utils/tls_utils.h"
 
+#include <cstring>
+#include <mutex>
+#include <openssl/core_names.h>
 #include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
 #include <spdlog/spdlog.h>
 
 namespace load_balancer {
@@ -41,5 +46,285 @@ void TlsUtils::ConfigureContext(SSL_CTX* ctx, const std::string& cert_file,
   }
 }
 
+void TlsUtils::ConfigureAlpn(SSL_CTX* ctx,
+                             const std::vector<unsigned char>& protocols) {
+  // Pick the first of our protocols the client offers, so server preference
+  // wins.
+  auto select = [](SSL*, const unsigned char** out, unsigned char* out_len,
+                   const unsigned char* in, unsigned int in_len, void* arg) {
+    const auto* supported = static_cast<const std::vector<unsigned char>*>(arg);
+    unsigned char* selected = nullptr;
+    if (SSL_select_next_proto(&selected, out_len, supported->data(),
+                              static_cast<unsigned int>(supported->size()), in,
+                              in_len) != OPENSSL_NPN_NEGOTIATED) {
+      return SSL_TLSEXT_ERR_NOACK;
+    }
+    *out = selected;
+    return SSL_TLSEXT_ERR_OK;
+  };
+  SSL_CTX_set_alpn_select_cb(ctx, select,
+                             const_cast<std::vector<unsigned char>*>(
+                                 &protocols));
+}
+
+std::string_view TlsUtils::NegotiatedProtocol(const SSL* ssl) {
+  const unsigned char* protocol = nullptr;
+  unsigned int length = 0;
+  SSL_get0_alpn_selected(ssl, &protocol, &length);
+  if (!protocol) return {};
+  return std::string_view(reinterpret_cast<const char*>(protocol), length);
+}
+
+// Session ID context shared by every server connection; sessions are only
+// resumed within the same context.
+constexpr unsigned char SESSION_ID_CONTEXT[] = "load_balancer";
+
+namespace {
+
+// Releases the reference to a session cache entry a backend connection
+// holds, when the connection is freed.
+void FreeBackendSessionReference(void* /*parent*/, void* reference,
+                                 CRYPTO_EX_DATA* /*data*/, int /*index*/,
+                                 long /*argl*/, void* /*argp*/) {
+  delete static_cast<std::shared_ptr<void>*>(reference);
+}
+
+// Returns the SSL ex_data index linking a backend connection to its session
+// cache entry.
+int BackendSessionIndex() {
+  static const int index = SSL_get_ex_new_index(
+      0, nullptr, nullptr, nullptr, &FreeBackendSessionReference);
+  return index;
+}
+
+}  // namespace
+
+void TlsUtils::EnableKtls(SSL_CTX* ctx) {
+  SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+}
+
+bool TlsUtils::KtlsSendActive(SSL* ssl) {
+  return BIO_get_ktls_send(SSL_get_wbio(ssl));
+}
+
+bool TlsUtils::KtlsReceiveActive(SSL* ssl) {
+  return BIO_get_ktls_recv(SSL_get_rbio(ssl));
+}
+
+TlsContextManager::TlsContextManager(TlsConfig config)
+    : config_(std::move(config)), server_ctx_(nullptr), client_ctx_(nullptr) {
+  server_ctx_ = CreateServerContext();
+  client_ctx_ = CreateClientContext();
+
+  if (config_.ktls) {
+#ifdef OPENSSL_NO_KTLS
+    spdlog::warn("OpenSSL was built without kTLS; using userspace TLS");
+#else
+    TlsUtils::EnableKtls(server_ctx_);
+    TlsUtils::EnableKtls(client_ctx_);
+#endif
+  }
+}
+
+TlsContextManager::~TlsContextManager() {
+  SSL_CTX_free(server_ctx_);
+  SSL_CTX_free(client_ctx_);
+}
+
+TlsContextManager::BackendSession::~BackendSession() {
+  if (session) SSL_SESSION_free(session);
+}
+
+SSL_CTX* TlsContextManager::CreateServerContext() {
+  // Load the credentials once for every connection served by this manager.
+  SSL_CTX* ctx = TlsUtils::CreateContext(true);
+  TlsUtils::ConfigureContext(ctx, config_.cert_file, config_.key_file);
+
+  // Keep sessions in a cache shared by all connections and threads.
+  SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+  SSL_CTX_sess_set_cache_size(ctx, config_.session_cache_size);
+  SSL_CTX_set_timeout(ctx, static_cast<long>(config_.session_timeout.count()));
+  SSL_CTX_set_session_id_context(ctx, SESSION_ID_CONTEXT,
+                                 sizeof(SESSION_ID_CONTEXT) - 1);
+
+  // Issue tickets with keys managed (and rotated) by this class.
+  SSL_CTX_set_app_data(ctx, this);
+  {
+    std::unique_lock<std::shared_mutex> lock(keys_mutex_);
+    RotateTicketKeysLocked();
+  }
+  SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx,
+                                       &TlsContextManager::TicketKeyCallback);
+
+  // Offer the configured application protocols, e.g. "h2" and "http/1.1".
+  if (!config_.alpn_protocols.empty()) {
+    for (const std::string& protocol : config_.alpn_protocols) {
+      alpn_wire_.push_back(static_cast<unsigned char>(protocol.size()));
+      alpn_wire_.insert(alpn_wire_.end(), protocol.begin(), protocol.end());
+    }
+    TlsUtils::ConfigureAlpn(ctx, alpn_wire_);
+  }
+
+  spdlog::info("Loaded TLS credentials from {} and {}", config_.cert_file,
+               config_.key_file);
+  return ctx;
+}
+
+SSL_CTX* TlsContextManager::CreateClientContext() {
+  SSL_CTX* ctx = TlsUtils::CreateContext(false);
+
+  // Sessions are stored per backend by this class rather than in OpenSSL's
+  // internal cache, which clients never look up on their own.
+  SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT |
+                                      SSL_SESS_CACHE_NO_INTERNAL_STORE);
+  SSL_CTX_sess_set_new_cb(ctx, &TlsContextManager::NewBackendSessionCallback);
+  SSL_CTX_set_app_data(ctx, this);
+  return ctx;
+}
+
+void TlsContextManager::PrepareBackendConnection(SSL* ssl,
+                                                 const std::string& backend) {
+  std::lock_guard<std::mutex> lock(sessions_mutex_);
+  std::shared_ptr<BackendSession>& entry = backend_sessions_[backend];
+  if (!entry) entry = std::make_shared<BackendSession>();
+
+  // Remember the entry so sessions issued on this connection land in it. The
+  // connection holds a reference, so the entry outlives its eviction.
+  SSL_set_ex_data(ssl, BackendSessionIndex(),
+                  new std::shared_ptr<void>(entry));
+  if (entry->session && SSL_SESSION_is_resumable(entry->session))
+    SSL_set_session(ssl, entry->session);
+}
+
+void TlsContextManager::EvictBackendSession(const std::string& backend) {
+  std::lock_guard<std::mutex> lock(sessions_mutex_);
+  auto it = backend_sessions_.find(backend);
+  if (it == backend_sessions_.end()) return;
+
+  // Connections still referring to the entry keep it alive; sessions they
+  // receive are dropped with it.
+  bool cached = it->second->session != nullptr;
+  backend_sessions_.erase(it);
+  if (cached)
+    spdlog::debug("Evicted cached TLS session for backend {}", backend);
+}
+
+int TlsContextManager::NewBackendSessionCallback(SSL* ssl,
+                                                 SSL_SESSION* session) {
+  auto* manager = static_cast<TlsContextManager*>(
+      SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl)));
+  auto* reference = static_cast<std::shared_ptr<void>*>(
+      SSL_get_ex_data(ssl, BackendSessionIndex()));
+  if (!reference) return 0;
+  auto* entry = static_cast<BackendSession*>(reference->get());
+
+  // Keep only the most recent session; returning 1 takes over the reference.
+  std::lock_guard<std::mutex> lock(manager->sessions_mutex_);
+  if (entry->session) SSL_SESSION_free(entry->session);
+  entry->session = session;
+  return 1;
+}
+
+void TlsContextManager::RotateTicketKeys() {
+  std::unique_lock<std::shared_mutex> lock(keys_mutex_);
+  RotateTicketKeysLocked();
+}
+
+long TlsContextManager::ResumedSessions() const {
+  return SSL_CTX_sess_hits(server_ctx_);
+}
+
+void TlsContextManager::RotateTicketKeysLocked() {
+  TicketKey key{};
+  if (RAND_bytes(key.name.data(), key.name.size()) != 1 ||
+      RAND_bytes(key.aes_key.data(), key.aes_key.size()) != 1 ||
+      RAND_bytes(key.hmac_key.data(), key.hmac_key.size()) != 1) {
+    spdlog::error("Failed to generate session ticket key");
+    ERR_print_errors_fp(stderr);
+    return;
+  }
+  key.created = std::chrono::steady_clock::now();
+
+  ticket_keys_.insert(ticket_keys_.begin(), key);
+  if (ticket_keys_.size() > config_.retired_ticket_keys + 1)
+    ticket_keys_.resize(config_.retired_ticket_keys + 1);
+  spdlog::debug("Rotated session ticket keys ({} active)",
+                ticket_keys_.size());
+}
+
+int TlsContextManager::TicketKeyCallback(SSL* ssl, unsigned char* key_name,
+                                         unsigned char* iv,
+                                         EVP_CIPHER_CTX* cipher_ctx,
+                                         EVP_MAC_CTX* mac_ctx, int encrypt) {
+  auto* manager = static_cast<TlsContextManager*>(
+      SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl)));
+
+  // Rotate lazily once the current key is older than the rotation interval.
+  auto now = std::chrono::steady_clock::now();
+  if (encrypt) {
+    std::shared_lock<std::shared_mutex> lock(manager->keys_mutex_);
+    bool stale = manager->ticket_keys_.empty() ||
+                 now - manager->ticket_keys_.front().created >=
+                     manager->config_.ticket_key_rotation;
+    lock.unlock();
+    if (stale) {
+      std::unique_lock<std::shared_mutex> rotate_lock(manager->keys_mutex_);
+      // Another handshake may have rotated in the meantime.
+      if (manager->ticket_keys_.empty() ||
+          now - manager->ticket_keys_.front().created >=
+              manager->config_.ticket_key_rotation) {
+        manager->RotateTicketKeysLocked();
+      }
+    }
+  }
+
+  std::shared_lock<std::shared_mutex> lock(manager->keys_mutex_);
+  if (manager->ticket_keys_.empty()) return encrypt ? -1 : 0;
+
+  // Find the key to use: the newest one for new tickets, or the one named by
+  // the presented ticket.
+  const TicketKey* key = &manager->ticket_keys_.front();
+  if (!encrypt) {
+    key = nullptr;
+    for (const auto& candidate : manager->ticket_keys_) {
+      if (std::memcmp(candidate.name.data(), key_name,
+                      candidate.name.size()) == 0) {
+        key = &candidate;
+        break;
+      }
+    }
+    // Unknown or expired key: fall back to a full handshake.
+    if (!key) return 0;
+  }
+
+  OSSL_PARAM params[] = {
+      OSSL_PARAM_construct_octet_string(
+          OSSL_MAC_PARAM_KEY, const_cast<unsigned char*>(key->hmac_key.data()),
+          key->hmac_key.size()),
+      OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST,
+                                       const_cast<char*>("SHA256"), 0),
+      OSSL_PARAM_construct_end(),
+  };
+  if (EVP_MAC_CTX_set_params(mac_ctx, params) != 1) return -1;
+
+  if (encrypt) {
+    std::memcpy(key_name, key->name.data(), key->name.size());
+    if (RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) != 1)
+      return -1;
+    if (EVP_EncryptInit_ex(cipher_ctx, EVP_aes_256_cbc(), nullptr,
+                           key->aes_key.data(), iv) != 1) {
+      return -1;
+    }
+    return 1;
+  }
+
+  if (EVP_DecryptInit_ex(cipher_ctx, EVP_aes_256_cbc(), nullptr,
+                         key->aes_key.data(), iv) != 1) {
+    return -1;
+  }
+  // Ask OpenSSL to issue a fresh ticket when a retired key was used.
+  return key == &manager->ticket_keys_.front() ? 1 : 2;
+}
+
 }  // namespace utils
 }  // namespace load_balancer
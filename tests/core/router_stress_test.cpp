@@ -0,0 +1,102 @@
+#include "core/router.h"
+#include "rl/lin_ucb_agent.h"
+#include "rl/sharded_agent.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace load_balancer {
+namespace core {
+namespace {
+
+// Returns 'config' with every decision rebuilding the cached features.
+rl::LinUcbConfig Uncached(rl::LinUcbConfig config) {
+  config.feature_refresh_interval = std::chrono::microseconds(0);
+  return config;
+}
+
+// Picks, rewards, backend changes and training racing each other for
+// 'duration'. Meant to be run under ThreadSanitizer as well.
+void RunStress(std::shared_ptr<rl::Agent> agent,
+               std::chrono::milliseconds duration) {
+  Router router(std::move(agent), rl::TrainerConfig{.batch_size = 8});
+  for (int i = 0; i < 8; ++i) {
+    router.AddBackendServer(
+        std::make_shared<BackendServer>("10.0.0.1", 1000 + i));
+  }
+
+  std::atomic<bool> stop{false};
+  std::atomic<uint64_t> picks{0};
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&]() {
+      while (!stop.load(std::memory_order_relaxed)) {
+        auto backend = router.PickBackendServer();
+        ASSERT_NE(backend, nullptr);
+        picks.fetch_add(1, std::memory_order_relaxed);
+        rl::Experience experience;
+        experience.backend = backend;
+        experience.features = rl::ExtractFeatures(*backend);
+        experience.reward = (backend->Port() % 3) * 0.5;
+        experience.success = true;
+        experience.replica = router.DecisionReplica();
+        router.ReportReward(std::move(experience));
+      }
+    });
+  }
+  threads.emplace_back([&]() {
+    for (int n = 0; !stop.load(std::memory_order_relaxed); ++n) {
+      router.AddBackendServer(
+          std::make_shared<BackendServer>("10.0.0.2", 2000 + n % 16));
+      router.SetBackendWeight("10.0.0.1:1000", 1 + n % 4);
+      router.RemoveBackendServer("10.0.0.2:" +
+                                 std::to_string(2000 + (n + 8) % 16));
+      std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+  });
+
+  std::this_thread::sleep_for(duration);
+  stop = true;
+  for (auto& thread : threads) thread.join();
+
+  rl::TrainerStats stats = router.TrainingStats();
+  EXPECT_GT(picks.load(), 0u);
+  EXPECT_GT(stats.batches, 0u);
+}
+
+TEST(RouterStressTest, DecidesPerPickWhileTraining) {
+  RunStress(std::make_shared<rl::LinUcbAgent>(Uncached({})),
+            std::chrono::milliseconds(500));
+}
+
+TEST(RouterStressTest, SamplesThePolicyWhileTraining) {
+  rl::LinUcbConfig config;
+  config.softmax_temperature = 0.1;
+  RunStress(std::make_shared<rl::LinUcbAgent>(Uncached(config)),
+            std::chrono::milliseconds(500));
+}
+
+TEST(RouterStressTest, ShardsDecideWhileTrainingAndMerging) {
+  rl::LinUcbConfig config;
+  config.softmax_temperature = 0.1;
+  auto agent = std::make_shared<rl::ShardedAgent>(
+      [config]() {
+        return std::make_unique<rl::LinUcbAgent>(Uncached(config));
+      },
+      rl::ShardedAgentConfig{.shards = 4,
+                             .sync_interval = std::chrono::milliseconds(10)});
+  // Replicas with a softmax still decide every pick themselves.
+  EXPECT_TRUE(agent->ActionProbabilities({}).empty());
+  RunStress(agent, std::chrono::milliseconds(500));
+  EXPECT_GT(agent->Stats().merges, 0u);
+}
+
+}  // namespace
+}  // namespace core
+}  // namespace load_balancer
@@ -0,0 +1,217 @@
+#include "protocols/hpack.h"
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace load_balancer {
+namespace protocols {
+namespace {
+
+// Large enough for every example of RFC 7541 Appendix C.
+constexpr size_t kMaxListSize = 65536;
+
+using Fields = std::vector<std::pair<std::string, std::string>>;
+
+// Converts a hex dump as printed in RFC 7541, spaces allowed, into bytes.
+std::string FromHex(std::string_view hex) {
+  std::string bytes;
+  int high = -1;
+  for (char c : hex) {
+    if (c == ' ') continue;
+    int digit = c <= '9' ? c - '0' : c - 'a' + 10;
+    if (high < 0) {
+      high = digit;
+    } else {
+      bytes.push_back(static_cast<char>(high << 4 | digit));
+      high = -1;
+    }
+  }
+  return bytes;
+}
+
+// Decodes the header block in 'hex' and checks it yields 'expected'.
+void ExpectDecodes(HpackDecoder& decoder, std::string_view hex,
+                   const Fields& expected) {
+  std::vector<HpackHeader> headers;
+  ASSERT_TRUE(decoder.Decode(FromHex(hex), kMaxListSize, headers)) << hex;
+  ASSERT_EQ(headers.size(), expected.size()) << hex;
+  for (size_t i = 0; i < expected.size(); ++i) {
+    EXPECT_EQ(headers[i].name, expected[i].first) << hex;
+    EXPECT_EQ(headers[i].value, expected[i].second) << hex;
+  }
+}
+
+// RFC 7541 C.2: one field per block, each with a fresh decoder.
+TEST(HpackDecoderTest, DecodesFieldRepresentations) {
+  HpackDecoder with_indexing;
+  ExpectDecodes(with_indexing,
+                "400a 6375 7374 6f6d 2d6b 6579 0d63 7573 746f 6d2d 6865 6164 "
+                "6572",
+                {{"custom-key", "custom-header"}});
+  // The literal was added to the dynamic table as entry 62.
+  ExpectDecodes(with_indexing, "be", {{"custom-key", "custom-header"}});
+
+  HpackDecoder without_indexing;
+  ExpectDecodes(without_indexing, "040c 2f73 616d 706c 652f 7061 7468",
+                {{":path", "/sample/path"}});
+  std::vector<HpackHeader> headers;
+  EXPECT_FALSE(without_indexing.Decode(FromHex("be"), kMaxListSize, headers));
+
+  HpackDecoder never_indexed;
+  ExpectDecodes(never_indexed,
+                "1008 7061 7373 776f 7264 0673 6563 7265 74",
+                {{"password", "secret"}});
+  EXPECT_FALSE(never_indexed.Decode(FromHex("be"), kMaxListSize, headers));
+
+  HpackDecoder indexed;
+  ExpectDecodes(indexed, "82", {{":method", "GET"}});
+}
+
+// The requests of RFC 7541 C.3 and C.4, decoded in order on one connection.
+const Fields kRequest1 = {{":method", "GET"},
+                          {":scheme", "http"},
+                          {":path", "/"},
+                          {":authority", "www.example.com"}};
+const Fields kRequest2 = {{":method", "GET"},
+                          {":scheme", "http"},
+                          {":path", "/"},
+                          {":authority", "www.example.com"},
+                          {"cache-control", "no-cache"}};
+const Fields kRequest3 = {{":method", "GET"},
+                          {":scheme", "https"},
+                          {":path", "/index.html"},
+                          {":authority", "www.example.com"},
+                          {"custom-key", "custom-value"}};
+
+// RFC 7541 C.3.
+TEST(HpackDecoderTest, DecodesRequestsWithoutHuffmanCoding) {
+  HpackDecoder decoder;
+  ExpectDecodes(decoder, "8286 8441 0f77 7777 2e65 7861 6d70 6c65 2e63 6f6d",
+                kRequest1);
+  ExpectDecodes(decoder, "8286 84be 5808 6e6f 2d63 6163 6865", kRequest2);
+  ExpectDecodes(decoder,
+                "8287 85bf 400a 6375 7374 6f6d 2d6b 6579 0c63 7573 746f 6d2d "
+                "7661 6c75 65",
+                kRequest3);
+}
+
+// RFC 7541 C.4.
+TEST(HpackDecoderTest, DecodesRequestsWithHuffmanCoding) {
+  HpackDecoder decoder;
+  ExpectDecodes(decoder, "8286 8441 8cf1 e3c2 e5f2 3a6b a0ab 90f4 ff",
+                kRequest1);
+  ExpectDecodes(decoder, "8286 84be 5886 a8eb 1064 9cbf", kRequest2);
+  ExpectDecodes(decoder,
+                "8287 85bf 4088 25a8 49e9 5ba9 7d7f 8925 a849 e95b b8e8 b4bf",
+                kRequest3);
+}
+
+// The responses of RFC 7541 C.5 and C.6, which evict entries from a table
+// limited to 256 bytes.
+const Fields kResponse1 = {{":status", "302"},
+                           {"cache-control", "private"},
+                           {"date", "Mon, 21 Oct 2013 20:13:21 GMT"},
+                           {"location", "https://www.example.com"}};
+const Fields kResponse2 = {{":status", "307"},
+                           {"cache-control", "private"},
+                           {"date", "Mon, 21 Oct 2013 20:13:21 GMT"},
+                           {"location", "https://www.example.com"}};
+const Fields kResponse3 = {
+    {":status", "200"},
+    {"cache-control", "private"},
+    {"date", "Mon, 21 Oct 2013 20:13:22 GMT"},
+    {"location", "https://www.example.com"},
+    {"content-encoding", "gzip"},
+    {"set-cookie", "foo=ASDJKHQKBZXOQWEOPIUAXQWEOIU; max-age=3600; version=1"}};
+
+// Checks that only three entries are left after the third response: the
+// fourth one, entry 65, was evicted.
+void ExpectEvictedAfterThirdResponse(HpackDecoder& decoder) {
+  std::vector<HpackHeader> headers;
+  EXPECT_TRUE(decoder.Decode(FromHex("c0"), kMaxListSize, headers));
+  EXPECT_FALSE(decoder.Decode(FromHex("c1"), kMaxListSize, headers));
+}
+
+// RFC 7541 C.5.
+TEST(HpackDecoderTest, DecodesResponsesWithoutHuffmanCoding) {
+  HpackDecoder decoder(256);
+  ExpectDecodes(decoder,
+                "4803 3330 3258 0770 7269 7661 7465 611d 4d6f 6e2c 2032 3120 "
+                "4f63 7420 3230 3133 2032 303a 3133 3a32 3120 474d 546e 1768 "
+                "7474 7073 3a2f 2f77 7777 2e65 7861 6d70 6c65 2e63 6f6d",
+                kResponse1);
+  ExpectDecodes(decoder, "4803 3330 37c1 c0bf", kResponse2);
+  ExpectDecodes(decoder,
+                "88c1 611d 4d6f 6e2c 2032 3120 4f63 7420 3230 3133 2032 303a "
+                "3133 3a32 3220 474d 54c0 5a04 677a 6970 7738 666f 6f3d 4153 "
+                "444a 4b48 514b 425a 584f 5157 454f 5049 5541 5851 5745 4f49 "
+                "553b 206d 6178 2d61 6765 3d33 3630 303b 2076 6572 7369 6f6e "
+                "3d31",
+                kResponse3);
+  ExpectEvictedAfterThirdResponse(decoder);
+}
+
+// RFC 7541 C.6.
+TEST(HpackDecoderTest, DecodesResponsesWithHuffmanCoding) {
+  HpackDecoder decoder(256);
+  ExpectDecodes(decoder,
+                "4882 6402 5885 aec3 771a 4b61 96d0 7abe 9410 54d4 44a8 2005 "
+                "9504 0b81 66e0 82a6 2d1b ff6e 919d 29ad 1718 63c7 8f0b 97c8 "
+                "e9ae 82ae 43d3",
+                kResponse1);
+  ExpectDecodes(decoder, "4883 640e ffc1 c0bf", kResponse2);
+  ExpectDecodes(decoder,
+                "88c1 6196 d07a be94 1054 d444 a820 0595 040b 8166 e084 a62d "
+                "1bff c05a 839b d9ab 77ad 94e7 821d d7f2 e6c7 b335 dfdf cd5b "
+                "3960 d5af 2708 7f36 72c1 ab27 0fb5 291f 9587 3160 65c0 03ed "
+                "4ee5 b106 3d50 07",
+                kResponse3);
+  ExpectEvictedAfterThirdResponse(decoder);
+}
+
+TEST(HpackDecoderTest, AppliesDynamicTableSizeUpdates) {
+  HpackDecoder decoder;
+  ExpectDecodes(decoder, "4003 6b65 7905 7661 6c75 65", {{"key", "value"}});
+
+  // Shrinking the table to zero evicts every entry.
+  ExpectDecodes(decoder, "20 82", {{":method", "GET"}});
+  std::vector<HpackHeader> headers;
+  EXPECT_FALSE(decoder.Decode(FromHex("be"), kMaxListSize, headers));
+}
+
+TEST(HpackDecoderTest, RejectsInvalidBlocks) {
+  std::vector<HpackHeader> headers;
+
+  // Index 0 and indices past the tables name nothing.
+  EXPECT_FALSE(HpackDecoder().Decode(FromHex("80"), kMaxListSize, headers));
+  EXPECT_FALSE(HpackDecoder().Decode(FromHex("be"), kMaxListSize, headers));
+  // A size update above the advertised limit (4097), or after a field.
+  EXPECT_FALSE(
+      HpackDecoder().Decode(FromHex("3fe2 1f"), kMaxListSize, headers));
+  EXPECT_FALSE(HpackDecoder().Decode(FromHex("8220"), kMaxListSize, headers));
+  // A string literal longer than the block, and a truncated integer.
+  EXPECT_FALSE(
+      HpackDecoder().Decode(FromHex("0005 6162"), kMaxListSize, headers));
+  EXPECT_FALSE(HpackDecoder().Decode(FromHex("ff"), kMaxListSize, headers));
+  // Huffman padding longer than 7 bits, and padding that is not all ones.
+  EXPECT_FALSE(
+      HpackDecoder().Decode(FromHex("0081 ff81 ff"), kMaxListSize, headers));
+  EXPECT_FALSE(
+      HpackDecoder().Decode(FromHex("0082 0000 00"), kMaxListSize, headers));
+}
+
+TEST(HpackDecoderTest, EnforcesHeaderListSize) {
+  // ":method: GET" counts 7 + 3 + 32 bytes.
+  std::vector<HpackHeader> headers;
+  EXPECT_TRUE(HpackDecoder().Decode(FromHex("82"), 42, headers));
+  EXPECT_FALSE(HpackDecoder().Decode(FromHex("8282"), 83, headers));
+}
+
+}  // namespace
+}  // namespace protocols
+}  // namespace load_balancer
@@ -0,0 +1,283 @@
+#include "protocols/http_parser.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <string_view>
+
+namespace load_balancer {
+namespace protocols {
+namespace {
+
+using Status = HttpParser::Status;
+
+TEST(HttpParserTest, ParsesRequestHead) {
+  HttpParser parser(HttpParser::Type::kRequest);
+  std::string message =
+      "GET /index.html HTTP/1.1\r\nHost: example.com\r\n"
+      "Content-Length: 5\r\n\r\nhello";
+
+  ASSERT_EQ(parser.ParseHead(message), Status::kComplete);
+  const HttpHead& head = parser.Head();
+  EXPECT_EQ(head.method, "GET");
+  EXPECT_EQ(head.target, "/index.html");
+  EXPECT_EQ(head.minor_version, 1);
+  EXPECT_EQ(head.Header("host"), "example.com");
+  EXPECT_EQ(head.framing, BodyFraming::kContentLength);
+  EXPECT_EQ(head.content_length, 5u);
+  EXPECT_TRUE(head.keep_alive);
+  EXPECT_EQ(parser.HeadSize(), message.size() - 5);
+}
+
+TEST(HttpParserTest, ParsesHeadSplitAcrossReads) {
+  std::string message =
+      "POST /submit HTTP/1.1\r\nHost: example.com\r\n"
+      "Transfer-Encoding: chunked\r\n\r\n";
+
+  // Every prefix is a read that ended at that byte.
+  for (size_t split = 1; split < message.size(); ++split) {
+    HttpParser parser(HttpParser::Type::kRequest);
+    ASSERT_EQ(parser.ParseHead(std::string_view(message).substr(0, split)),
+              Status::kIncomplete)
+        << "split at " << split;
+    ASSERT_EQ(parser.ParseHead(message), Status::kComplete)
+        << "split at " << split;
+    EXPECT_EQ(parser.Head().method, "POST");
+    EXPECT_EQ(parser.Head().framing, BodyFraming::kChunked);
+    EXPECT_EQ(parser.HeadSize(), message.size());
+  }
+}
+
+TEST(HttpParserTest, RejectsContentLengthWithTransferEncoding) {
+  HttpParser parser(HttpParser::Type::kRequest);
+  EXPECT_EQ(parser.ParseHead("POST / HTTP/1.1\r\nContent-Length: 4\r\n"
+                             "Transfer-Encoding: chunked\r\n\r\n"),
+            Status::kError);
+  EXPECT_STREQ(parser.Error(),
+               "both Transfer-Encoding and Content-Length present");
+}
+
+TEST(HttpParserTest, RejectsTransferEncodingWithContentLengthInResponse) {
+  HttpParser parser(HttpParser::Type::kResponse);
+  EXPECT_EQ(parser.ParseHead("HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n"
+                             "Content-Length: 4\r\n\r\n"),
+            Status::kError);
+}
+
+TEST(HttpParserTest, RejectsObsoleteLineFolding) {
+  HttpParser parser(HttpParser::Type::kRequest);
+  EXPECT_EQ(parser.ParseHead("GET / HTTP/1.1\r\nX-Long: first\r\n"
+                             " continued\r\n\r\n"),
+            Status::kError);
+  EXPECT_STREQ(parser.Error(), "malformed header field");
+
+  // A folded line that happens to contain a colon is rejected as well.
+  HttpParser tab_folded(HttpParser::Type::kRequest);
+  EXPECT_EQ(tab_folded.ParseHead("GET / HTTP/1.1\r\nX-Long: first\r\n"
+                                 "\tsecond: part\r\n\r\n"),
+            Status::kError);
+}
+
+TEST(HttpParserTest, RejectsWhitespaceBeforeColon) {
+  HttpParser parser(HttpParser::Type::kRequest);
+  EXPECT_EQ(parser.ParseHead("GET / HTTP/1.1\r\nHost : example.com\r\n\r\n"),
+            Status::kError);
+  EXPECT_STREQ(parser.Error(), "malformed header field");
+
+  HttpParser tab(HttpParser::Type::kRequest);
+  EXPECT_EQ(tab.ParseHead("GET / HTTP/1.1\r\nContent-Length\t: 4\r\n\r\n"),
+            Status::kError);
+}
+
+TEST(HttpParserTest, RejectsEmptyHeaderName) {
+  HttpParser parser(HttpParser::Type::kRequest);
+  EXPECT_EQ(parser.ParseHead("GET / HTTP/1.1\r\n: value\r\n\r\n"),
+            Status::kError);
+}
+
+TEST(HttpParserTest, RejectsConflictingContentLengths) {
+  HttpParser parser(HttpParser::Type::kRequest);
+  EXPECT_EQ(parser.ParseHead("POST / HTTP/1.1\r\nContent-Length: 4\r\n"
+                             "Content-Length: 5\r\n\r\n"),
+            Status::kError);
+  EXPECT_STREQ(parser.Error(), "invalid Content-Length");
+
+  // Repeated fields that agree are accepted.
+  HttpParser agreeing(HttpParser::Type::kRequest);
+  ASSERT_EQ(agreeing.ParseHead("POST / HTTP/1.1\r\nContent-Length: 4\r\n"
+                               "Content-Length: 4\r\n\r\n"),
+            Status::kComplete);
+  EXPECT_EQ(agreeing.Head().content_length, 4u);
+}
+
+TEST(HttpParserTest, RejectsMalformedContentLength) {
+  for (std::string_view value : {"-1", "4 4", "0x10", "",
+                                 "99999999999999999999999"}) {
+    HttpParser parser(HttpParser::Type::kRequest);
+    std::string message = "POST / HTTP/1.1\r\nContent-Length: ";
+    message.append(value).append("\r\n\r\n");
+    EXPECT_EQ(parser.ParseHead(message), Status::kError) << value;
+  }
+}
+
+TEST(HttpParserTest, RejectsRequestsNotEndingInChunked) {
+  HttpParser parser(HttpParser::Type::kRequest);
+  EXPECT_EQ(parser.ParseHead("POST / HTTP/1.1\r\n"
+                             "Transfer-Encoding: chunked, gzip\r\n\r\n"),
+            Status::kError);
+  EXPECT_STREQ(parser.Error(), "unsupported Transfer-Encoding");
+}
+
+TEST(HttpParserTest, RejectsMalformedStartLines) {
+  for (std::string_view line : {"GET /\r\n\r\n", "GET  / HTTP/1.1\r\n\r\n",
+                                "GET / HTTP/2.0\r\n\r\n",
+                                "G@T / HTTP/1.1\r\n\r\n"}) {
+    HttpParser parser(HttpParser::Type::kRequest);
+    EXPECT_EQ(parser.ParseHead(line), Status::kError) << line;
+  }
+}
+
+TEST(HttpParserTest, EnforcesHeaderLimits) {
+  HttpParserLimits limits;
+  limits.max_headers = 2;
+  limits.max_head_size = 64;
+
+  HttpParser too_many(HttpParser::Type::kRequest, limits);
+  EXPECT_EQ(
+      too_many.ParseHead("GET / HTTP/1.1\r\nA: 1\r\nB: 2\r\nC: 3\r\n\r\n"),
+      Status::kError);
+  EXPECT_STREQ(too_many.Error(), "too many header fields");
+
+  // A head without a line feed cannot end within the limit anymore.
+  HttpParser too_large(HttpParser::Type::kRequest, limits);
+  EXPECT_EQ(too_large.ParseHead("GET /" + std::string(64, 'a')),
+            Status::kError);
+  EXPECT_STREQ(too_large.Error(), "message head too large");
+}
+
+TEST(HttpParserTest, DelimitsContentLengthBodyBeforePipelinedRequest) {
+  HttpParser parser(HttpParser::Type::kRequest);
+  std::string message =
+      "POST / HTTP/1.1\r\nContent-Length: 5\r\n\r\nhelloGET / HTTP/1.1\r\n";
+  ASSERT_EQ(parser.ParseHead(message), Status::kComplete);
+
+  size_t consumed = 0;
+  std::string_view body = std::string_view(message).substr(parser.HeadSize());
+  EXPECT_EQ(parser.ConsumeBody(body.substr(0, 3), consumed),
+            Status::kIncomplete);
+  EXPECT_EQ(consumed, 3u);
+  EXPECT_EQ(parser.ConsumeBody(body.substr(3), consumed), Status::kComplete);
+  EXPECT_EQ(consumed, 2u);
+}
+
+// A chunked body with an extension and a trailer, followed by the start of
+// the next request.
+constexpr std::string_view kChunkedBody =
+    "5\r\nhello\r\n"
+    "1;ext=value\r\n \r\n"
+    "0B\r\nhello world\r\n"
+    "0\r\nX-Trailer: yes\r\n\r\n";
+constexpr std::string_view kNextRequest = "GET / HTTP/1.1\r\n";
+
+// Returns a request parser positioned at the start of a chunked body.
+HttpParser ChunkedRequestParser() {
+  HttpParser parser(HttpParser::Type::kRequest);
+  parser.ParseHead("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n");
+  return parser;
+}
+
+TEST(HttpParserTest, DelimitsChunkedBodySplitAtEveryByte) {
+  std::string stream = std::string(kChunkedBody) + std::string(kNextRequest);
+
+  // Two reads, with the boundary at every position of the body.
+  for (size_t split = 0; split <= kChunkedBody.size(); ++split) {
+    HttpParser parser = ChunkedRequestParser();
+    std::string_view data(stream);
+    size_t consumed = 0;
+    Status status = parser.ConsumeBody(data.substr(0, split), consumed);
+    ASSERT_NE(status, Status::kError) << parser.Error();
+    ASSERT_EQ(consumed, split);
+    if (split < kChunkedBody.size()) {
+      ASSERT_EQ(status, Status::kIncomplete) << "split at " << split;
+    }
+
+    size_t total = consumed;
+    if (status != Status::kComplete) {
+      status = parser.ConsumeBody(data.substr(split), consumed);
+      total += consumed;
+    }
+    EXPECT_EQ(status, Status::kComplete) << "split at " << split;
+    EXPECT_EQ(total, kChunkedBody.size()) << "split at " << split;
+  }
+}
+
+TEST(HttpParserTest, DecodesChunkedBodyOneByteAtATime) {
+  HttpParser parser = ChunkedRequestParser();
+  std::string decoded;
+  Status status = Status::kIncomplete;
+  for (size_t i = 0; i < kChunkedBody.size(); ++i) {
+    ASSERT_EQ(status, Status::kIncomplete) << "completed early at " << i;
+    size_t consumed = 0;
+    std::string_view payload;
+    status = parser.DecodeBody(kChunkedBody.substr(i, 1), consumed, payload);
+    ASSERT_NE(status, Status::kError) << parser.Error();
+    ASSERT_EQ(consumed, 1u);
+    decoded.append(payload);
+  }
+  EXPECT_EQ(status, Status::kComplete);
+  EXPECT_EQ(decoded, "hello hello world");
+}
+
+TEST(HttpParserTest, DecodesChunkedBodyInOneRead) {
+  HttpParser parser = ChunkedRequestParser();
+  std::string stream = std::string(kChunkedBody) + std::string(kNextRequest);
+  std::string_view data(stream);
+  std::string decoded;
+  size_t total = 0;
+  Status status = Status::kIncomplete;
+  while (status == Status::kIncomplete) {
+    size_t consumed = 0;
+    std::string_view payload;
+    status = parser.DecodeBody(data.substr(total), consumed, payload);
+    decoded.append(payload);
+    total += consumed;
+  }
+  EXPECT_EQ(status, Status::kComplete);
+  EXPECT_EQ(decoded, "hello hello world");
+  EXPECT_EQ(total, kChunkedBody.size());
+}
+
+TEST(HttpParserTest, RejectsMalformedChunkFraming) {
+  for (std::string_view body : {"x\r\n", "\r\n", "5\r\nhelloX\r\n",
+                                "5;\r\nhello\r\r\n",
+                                "11111111111111111\r\n"}) {
+    HttpParser parser = ChunkedRequestParser();
+    size_t consumed = 0;
+    EXPECT_EQ(parser.ConsumeBody(body, consumed), Status::kError) << body;
+  }
+}
+
+TEST(HttpParserTest, FramesResponses) {
+  HttpParser no_length(HttpParser::Type::kResponse);
+  ASSERT_EQ(no_length.ParseHead("HTTP/1.1 200 OK\r\n\r\n"), Status::kComplete);
+  EXPECT_EQ(no_length.Head().framing, BodyFraming::kUntilClose);
+  EXPECT_FALSE(no_length.Head().keep_alive);
+
+  HttpParser not_modified(HttpParser::Type::kResponse);
+  ASSERT_EQ(not_modified.ParseHead("HTTP/1.1 304 Not Modified\r\n"
+                                   "Content-Length: 10\r\n\r\n"),
+            Status::kComplete);
+  EXPECT_EQ(not_modified.Head().framing, BodyFraming::kNone);
+
+  // Responses to HEAD carry no body whatever their headers say.
+  HttpParser head(HttpParser::Type::kResponse);
+  head.Reset(/*request_was_head=*/true);
+  ASSERT_EQ(head.ParseHead("HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\n"),
+            Status::kComplete);
+  EXPECT_EQ(head.Head().framing, BodyFraming::kNone);
+  EXPECT_TRUE(head.Head().keep_alive);
+}
+
+}  // namespace
+}  // namespace protocols
+}  // namespace load_balancer
@@ -0,0 +1,179 @@
+#include "core/backend_server.h"
+#include "core/router.h"
+#include "core/uring_loop.h"
+#include "protocols/handler_context.h"
+#include "protocols/uring_passthrough_session.h"
+#include "utils/buffer_pool.h"
+
+#include <gtest/gtest.h>
+
+#include <arpa/inet.h>
+#include <cstdint>
+#include <memory>
+#include <netinet/in.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace load_balancer {
+namespace protocols {
+namespace {
+
+// Returns a socket listening on an ephemeral loopback port, and stores the
+// port in 'port'.
+int Listen(int* port) {
+  int listen_socket = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t length = sizeof(address);
+  if (bind(listen_socket, reinterpret_cast<sockaddr*>(&address), length) < 0 ||
+      listen(listen_socket, 64) < 0 ||
+      getsockname(listen_socket, reinterpret_cast<sockaddr*>(&address),
+                  &length) < 0) {
+    close(listen_socket);
+    return -1;
+  }
+  *port = ntohs(address.sin_port);
+  return listen_socket;
+}
+
+// Returns a socket connected to 'port' on the loopback interface.
+int Connect(int port) {
+  int client = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (connect(client, reinterpret_cast<sockaddr*>(&address),
+              sizeof(address)) < 0) {
+    close(client);
+    return -1;
+  }
+  return client;
+}
+
+// A backend echoing every byte of 'connections' clients back until they
+// half-close.
+class EchoBackend {
+ public:
+  explicit EchoBackend(int connections) {
+    listen_socket_ = Listen(&port_);
+    thread_ = std::thread([this, connections]() {
+      std::vector<std::thread> echoes;
+      for (int i = 0; i < connections; ++i) {
+        int client = accept(listen_socket_, nullptr, nullptr);
+        if (client < 0) break;
+        echoes.emplace_back([client]() {
+          char buffer[8192];
+          ssize_t received;
+          while ((received = recv(client, buffer, sizeof(buffer), 0)) > 0) {
+            if (send(client, buffer, received, MSG_NOSIGNAL) != received)
+              break;
+          }
+          shutdown(client, SHUT_WR);
+          close(client);
+        });
+      }
+      for (auto& echo : echoes) echo.join();
+    });
+  }
+  ~EchoBackend() {
+    shutdown(listen_socket_, SHUT_RDWR);
+    thread_.join();
+    close(listen_socket_);
+  }
+
+  int Port() const { return port_; }
+
+ private:
+  int listen_socket_ = -1;
+  int port_ = 0;
+  std::thread thread_;
+};
+
+// Sends 'payload' through 'port' and returns what comes back before the end
+// of stream.
+std::string RoundTrip(int port, const std::string& payload) {
+  int client = Connect(port);
+  if (client < 0) return {};
+  std::thread writer([client, &payload]() {
+    size_t sent = 0;
+    while (sent < payload.size()) {
+      ssize_t result = send(client, payload.data() + sent,
+                            payload.size() - sent, MSG_NOSIGNAL);
+      if (result <= 0) break;
+      sent += result;
+    }
+    shutdown(client, SHUT_WR);
+  });
+  std::string echoed;
+  char buffer[8192];
+  ssize_t received;
+  while ((received = recv(client, buffer, sizeof(buffer), 0)) > 0)
+    echoed.append(buffer, received);
+  writer.join();
+  close(client);
+  return echoed;
+}
+
+TEST(UringPassthroughTest, RelaysSessionsBeyondTheRegisteredBuffers) {
+  if (!core::UringLoop::Supported()) GTEST_SKIP() << "io_uring unavailable";
+
+  constexpr int kSessions = 4;
+  EchoBackend backend(kSessions);
+  ASSERT_GT(backend.Port(), 0);
+
+  // Only the first session gets registered buffers. The others borrow from a
+  // pool whose buffers are much smaller than the loop's, so every read must
+  // be bounded by the buffer it lands in.
+  auto context = std::make_shared<HandlerContext>();
+  context->router = std::make_shared<core::Router>(nullptr);
+  context->router->AddBackendServer(
+      std::make_shared<core::BackendServer>("127.0.0.1", backend.Port()));
+  context->buffers = std::make_shared<utils::BufferPool>(
+      utils::BufferPoolConfig{.min_buffer_size = 4096,
+                              .max_buffer_size = 4096});
+  core::UringConfig config;
+  config.entries = 256;
+  config.max_connections = 64;
+  config.registered_buffers = 2;
+  config.buffer_size = 256 * 1024;
+
+  int port = 0;
+  int listen_socket = Listen(&port);
+  ASSERT_GE(listen_socket, 0);
+  core::UringLoop loop(config);
+  ASSERT_TRUE(loop.Start(listen_socket, [&loop, context](int client_file) {
+    auto session =
+        std::make_unique<UringPassthroughSession>(&loop, client_file, context);
+    auto* raw = session.get();
+    loop.Adopt(std::move(session));
+    raw->Start();
+  }));
+
+  std::string payload(1 << 20, '\0');
+  for (size_t i = 0; i < payload.size(); ++i)
+    payload[i] = static_cast<char>(i * 131 % 251);
+
+  std::vector<std::string> echoed(kSessions);
+  std::vector<std::thread> clients;
+  for (int i = 0; i < kSessions; ++i) {
+    clients.emplace_back(
+        [&, i]() { echoed[i] = RoundTrip(port, payload); });
+  }
+  for (auto& client : clients) client.join();
+  loop.Stop();
+  close(listen_socket);
+
+  for (int i = 0; i < kSessions; ++i) {
+    EXPECT_EQ(echoed[i].size(), payload.size()) << "session " << i;
+    EXPECT_TRUE(echoed[i] == payload) << "session " << i;
+  }
+}
+
+}  // namespace
+}  // namespace protocols
+}  // namespace load_balancer
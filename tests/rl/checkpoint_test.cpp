@@ -0,0 +1,90 @@
+#include "core/backend_server.h"
+#include "rl/checkpoint.h"
+#include "rl/lin_ucb_agent.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <span>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace load_balancer {
+namespace rl {
+namespace {
+
+// A checkpoint file of its own for every test, removed afterwards.
+class CheckpointTest : public testing::Test {
+ protected:
+  void TearDown() override { std::remove(path_.c_str()); }
+
+  std::string path_ = testing::TempDir() + "checkpoint_test." +
+                      std::to_string(getpid()) + "." +
+                      testing::UnitTest::GetInstance()
+                          ->current_test_info()
+                          ->name();
+};
+
+// Trains 'agent' on 'batches' batches of a single experience.
+void Train(LinUcbAgent& agent, int batches) {
+  core::BackendServer backend("10.0.0.1", 1000);
+  for (int i = 0; i < batches; ++i) {
+    Experience experience;
+    experience.features = ExtractFeatures(backend);
+    experience.reward = 0.5;
+    agent.UpdateBatch(std::span<const Experience>(&experience, 1));
+  }
+}
+
+TEST_F(CheckpointTest, RestoresParametersAndPolicyVersion) {
+  LinUcbAgent saved;
+  Train(saved, 5);
+  ASSERT_TRUE(WriteCheckpoint(path_, saved));
+
+  LinUcbAgent loaded;
+  Train(loaded, 2);
+  ASSERT_TRUE(LoadCheckpoint(path_, &loaded));
+  EXPECT_EQ(loaded.SaveParameters(), saved.SaveParameters());
+  EXPECT_EQ(loaded.PolicyVersion(), saved.PolicyVersion());
+
+  // Learning continues the saved count.
+  Train(loaded, 1);
+  EXPECT_EQ(loaded.PolicyVersion(), saved.PolicyVersion() + 1);
+}
+
+TEST_F(CheckpointTest, RestoresALowerPolicyVersion) {
+  LinUcbAgent saved;
+  Train(saved, 1);
+  ASSERT_TRUE(WriteCheckpoint(path_, saved));
+
+  LinUcbAgent loaded;
+  Train(loaded, 4);
+  ASSERT_TRUE(LoadCheckpoint(path_, &loaded));
+  EXPECT_EQ(loaded.PolicyVersion(), saved.PolicyVersion());
+}
+
+TEST_F(CheckpointTest, IgnoresMissingAndCorruptFiles) {
+  LinUcbAgent agent;
+  Train(agent, 3);
+  EXPECT_FALSE(LoadCheckpoint(path_, &agent));
+
+  ASSERT_TRUE(WriteCheckpoint(path_, agent));
+  std::FILE* file = std::fopen(path_.c_str(), "r+b");
+  ASSERT_NE(file, nullptr);
+  std::fseek(file, sizeof(CheckpointHeader), SEEK_SET);
+  std::fputc(0x7f, file);
+  std::fclose(file);
+
+  // A flipped parameter byte fails the checksum.
+  Train(agent, 1);
+  std::vector<double> parameters = agent.SaveParameters();
+  uint64_t version = agent.PolicyVersion();
+  EXPECT_FALSE(LoadCheckpoint(path_, &agent));
+  EXPECT_EQ(agent.SaveParameters(), parameters);
+  EXPECT_EQ(agent.PolicyVersion(), version);
+}
+
+}  // namespace
+}  // namespace rl
+}  // namespace load_balancer
@@ -0,0 +1,93 @@
+#include "rl/mlp.h"
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace load_balancer {
+namespace rl {
+namespace {
+
+// Evaluates 'network' one weight at a time, applying ReLU to every layer but
+// the last.
+template <size_t... kSizes>
+std::vector<float> ReferenceForward(Mlp<kSizes...>& network,
+                                    const std::vector<float>& input) {
+  constexpr std::array<size_t, sizeof...(kSizes)> kWidths{kSizes...};
+  std::vector<float> values = input;
+  for (size_t layer = 0; layer + 1 < kWidths.size(); ++layer) {
+    std::vector<float> next(kWidths[layer + 1]);
+    for (size_t output = 0; output < next.size(); ++output) {
+      float sum = network.Bias(layer, output);
+      for (size_t i = 0; i < values.size(); ++i)
+        sum += network.Weight(layer, i, output) * values[i];
+      bool hidden = layer + 2 < kWidths.size();
+      next[output] = hidden && sum < 0.0f ? 0.0f : sum;
+    }
+    values = std::move(next);
+  }
+  return values;
+}
+
+// Checks Forward against the reference for random weights, biases and
+// inputs drawn from 'seed'.
+template <size_t... kSizes>
+void ExpectMatchesReference(uint64_t seed) {
+  using Network = Mlp<kSizes...>;
+  constexpr std::array<size_t, sizeof...(kSizes)> kWidths{kSizes...};
+  Network network;
+  network.Initialize(seed);
+
+  // Initialize zeroes the biases; give them both signs so some units are
+  // cut off by the ReLU.
+  uint64_t state = seed + 1;
+  auto next = [&state]() {
+    state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return static_cast<float>(state >> 40) / (1u << 24) * 2.0f - 1.0f;
+  };
+  for (size_t layer = 0; layer + 1 < kWidths.size(); ++layer) {
+    for (size_t output = 0; output < kWidths[layer + 1]; ++output)
+      network.Bias(layer, output) = next();
+  }
+
+  for (int trial = 0; trial < 8; ++trial) {
+    std::array<float, Network::kInputs> input;
+    for (float& value : input) value = next() * 4.0f;
+    std::array<float, Network::kOutputs> output = network.Forward(input);
+    std::vector<float> expected = ReferenceForward(
+        network, std::vector<float>(input.begin(), input.end()));
+    for (size_t j = 0; j < Network::kOutputs; ++j)
+      EXPECT_NEAR(output[j], expected[j], 1e-4f) << "output " << j;
+  }
+}
+
+TEST(MlpTest, MatchesReferenceForPaddedWidths) {
+  ExpectMatchesReference<5, 32, 32, 1>(1);
+  ExpectMatchesReference<5, 16, 1>(2);
+}
+
+TEST(MlpTest, MatchesReferenceForUnpaddedWidths) {
+  ExpectMatchesReference<7, 20, 3>(3);
+  ExpectMatchesReference<3, 17, 33, 5>(4);
+  ExpectMatchesReference<1, 1, 1>(5);
+}
+
+TEST(MlpTest, MatchesReferenceForASingleLayer) {
+  ExpectMatchesReference<4, 3>(6);
+  ExpectMatchesReference<40, 18>(7);
+}
+
+TEST(MlpTest, ZeroNetworkOutputsZero) {
+  Mlp<6, 10, 2> network;
+  std::array<float, 2> output = network.Forward({1, 2, 3, 4, 5, 6});
+  EXPECT_EQ(output[0], 0.0f);
+  EXPECT_EQ(output[1], 0.0f);
+}
+
+}  // namespace
+}  // namespace rl
+}  // namespace load_balancer
@@ -0,0 +1,142 @@
+#include "utils/tls_utils.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <memory>
+#include <openssl/bio.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+#include <string>
+#include <unistd.h>
+
+namespace load_balancer {
+namespace utils {
+namespace {
+
+// Writes a fresh self-signed certificate and its key to 'cert_file' and
+// 'key_file'.
+void WriteCredentials(const std::string& cert_file,
+                      const std::string& key_file) {
+  EVP_PKEY* key = EVP_EC_gen("P-256");
+  ASSERT_NE(key, nullptr);
+  X509* cert = X509_new();
+  ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+  X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+  X509_gmtime_adj(X509_getm_notAfter(cert), 3600);
+  X509_set_pubkey(cert, key);
+  X509_NAME_add_entry_by_txt(X509_get_subject_name(cert), "CN", MBSTRING_ASC,
+                             reinterpret_cast<const unsigned char*>("backend"),
+                             -1, -1, 0);
+  X509_set_issuer_name(cert, X509_get_subject_name(cert));
+  X509_sign(cert, key, EVP_sha256());
+
+  std::FILE* file = std::fopen(cert_file.c_str(), "w");
+  PEM_write_X509(file, cert);
+  std::fclose(file);
+  file = std::fopen(key_file.c_str(), "w");
+  PEM_write_PrivateKey(file, key, nullptr, nullptr, 0, nullptr, nullptr);
+  std::fclose(file);
+  X509_free(cert);
+  EVP_PKEY_free(key);
+}
+
+// A TLS connection from the manager's client context to its server context,
+// over an in-memory BIO pair, standing in for a backend connection.
+struct Connection {
+  explicit Connection(TlsContextManager& tls)
+      : client(SSL_new(tls.ClientContext())),
+        server(SSL_new(tls.ServerContext())) {
+    BIO* client_bio = nullptr;
+    BIO* server_bio = nullptr;
+    BIO_new_bio_pair(&client_bio, 0, &server_bio, 0);
+    SSL_set_bio(client, client_bio, client_bio);
+    SSL_set_bio(server, server_bio, server_bio);
+    SSL_set_connect_state(client);
+    SSL_set_accept_state(server);
+  }
+  // Closes cleanly; OpenSSL marks the sessions of connections freed without
+  // a close_notify as not resumable.
+  ~Connection() {
+    SSL_shutdown(client);
+    SSL_free(client);
+    SSL_free(server);
+  }
+
+  // Runs the handshake, and lets the client read the session tickets the
+  // server sends after it. Returns false if the handshake failed.
+  bool Handshake() {
+    for (int round = 0; round < 16; ++round) {
+      int client_done = SSL_do_handshake(client);
+      int server_done = SSL_do_handshake(server);
+      if (client_done == 1 && server_done == 1) break;
+    }
+    if (!SSL_is_init_finished(client)) return false;
+    char byte;
+    SSL_read(client, &byte, 1);
+    return true;
+  }
+
+  SSL* client;
+  SSL* server;
+};
+
+class TlsSessionCacheTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    std::string prefix = testing::TempDir() + "tls_session_cache_test." +
+                         std::to_string(getpid());
+    config_.cert_file = prefix + ".cert.pem";
+    config_.key_file = prefix + ".key.pem";
+    WriteCredentials(config_.cert_file, config_.key_file);
+    tls_ = std::make_unique<TlsContextManager>(config_);
+  }
+
+  void TearDown() override {
+    tls_.reset();
+    std::remove(config_.cert_file.c_str());
+    std::remove(config_.key_file.c_str());
+  }
+
+  // Connects to 'backend' and returns whether the session was resumed.
+  bool ConnectResumed(const std::string& backend) {
+    Connection connection(*tls_);
+    tls_->PrepareBackendConnection(connection.client, backend);
+    EXPECT_TRUE(connection.Handshake());
+    return SSL_session_reused(connection.client) == 1;
+  }
+
+  TlsConfig config_;
+  std::unique_ptr<TlsContextManager> tls_;
+};
+
+TEST_F(TlsSessionCacheTest, ResumesUntilEvicted) {
+  EXPECT_FALSE(ConnectResumed("10.0.0.1:443"));
+  EXPECT_TRUE(ConnectResumed("10.0.0.1:443"));
+  // Sessions are cached per backend.
+  EXPECT_FALSE(ConnectResumed("10.0.0.2:443"));
+
+  tls_->EvictBackendSession("10.0.0.1:443");
+  EXPECT_FALSE(ConnectResumed("10.0.0.1:443"));
+  EXPECT_TRUE(ConnectResumed("10.0.0.1:443"));
+}
+
+TEST_F(TlsSessionCacheTest, ConnectionsOutliveTheEvictionOfTheirEntry) {
+  EXPECT_FALSE(ConnectResumed("10.0.0.1:443"));
+
+  // The entry is erased while a connection referring to it still receives
+  // its tickets; they are dropped with it.
+  {
+    Connection connection(*tls_);
+    tls_->PrepareBackendConnection(connection.client, "10.0.0.1:443");
+    tls_->EvictBackendSession("10.0.0.1:443");
+    EXPECT_TRUE(connection.Handshake());
+    EXPECT_TRUE(SSL_session_reused(connection.client));
+  }
+  EXPECT_FALSE(ConnectResumed("10.0.0.1:443"));
+}
+
+}  // namespace
+}  // namespace utils
+}  // namespace load_balancer